@@ -50,6 +50,24 @@
 #define MQTT_CLIENTID                          NULL // if NULL it defaults to <stationname>-<mac_addr_suffix>
 #define MQTT_USERNAME                          NULL
 #define MQTT_PASSWORD                          NULL
+#define MQTT_TLS                              false // connect to the broker over TLS (usually port 8883)
+#define MQTT_TLS_CA_FILE             "/mqtt_ca.pem" // CA certificate (PEM) on SPIFFS verifying the broker
+#define MQTT_TLS_SESSION_NVS                   true // keep the TLS session in NVS to resume it after a restart
+#define MQTT_SESSION_EXPIRY_SEC                   0 // keep the session (subscriptions) on the broker while disconnected, 0 for a clean session on each connect
+#define MQTT_VERSION                              3 // protocol version, 3 (3.1.1) or 5 for topic aliases, no-local subscriptions and message expiry
+#define MQTT_MESSAGE_EXPIRY_SEC                   0 // MQTT 5 only, the broker drops undelivered messages older than this (0 for never)
+#define MQTT_STATION_PROPERTY                  true // MQTT 5 only, add a "station" user property with the station name to each message (20 bytes)
+#define MQTT_QOS                                  0 // QoS of the published messages, 1 to have the broker acknowledge each one
+#define MQTT_INFLIGHT                             8 // QoS 1 messages sent without waiting for their acknowledgement (up to MQTT_INFLIGHT_MAX)
+#define MQTT_BATCH                             true // collect the packets of a burst and write them out together
+#define MQTT_NODELAY                           true // disable Nagle's algorithm on the broker connection
+#define MQTT_RATE_MSGS                           20 // messages per second the station sends, alerts are never held back (0 for no limit)
+#define MQTT_BURST_MSGS                          40 // messages sent at once after a quiet time
+#define MQTT_RATE_BYTES                        8192 // bytes per second the station sends (0 for no limit)
+#define MQTT_BURST_BYTES                      16384 // bytes sent at once after a quiet time
+
+#define NTP_SERVER                    "pool.ntp.org" // NTP server used for setting the wall clock
+#define NTP_TIMEZONE                         "UTC0" // POSIX TZ string of the station (i.e. "EET-2EEST,M3.5.0/3,M10.5.0/4")
 
 #define DISPLAY_REFRESH_SEC                       5 // interval to update the screen in seconds
 #define DISPLAY_CYCLE_PAGES_SEC                  20 // interval to automatically cycle between pages and screens
@@ -64,13 +82,35 @@
 // For XIAOMI MiFlora devices the final MQTT topic is 
 // <FLORA_BASE_TOPIC>/<device_address>/<characteristic_name> 
 // where characteristic_name can be either: moisture, temp, light and conductivity
+// Plant availability is published (retained) on <FLORA_BASE_TOPIC>/<device_address>/availability
+// Derived daily light integral and vapour pressure deficit are published on .../dli and .../vpd
+// Hours until moisture drops under min_moisture are published on <FLORA_BASE_TOPIC>/<device_address>/water_in
+// Hourly and daily min/max/avg/count are published on <FLORA_BASE_TOPIC>/<device_address>/hourly and .../daily
+// Zone values (see zone= in devices.cfg) are published on <FLORA_BASE_TOPIC>/zone/<zone_id>/<value>
+// With binary collaboration, only the station hearing a plant best publishes its values,
+// and its name is published (retained) on <FLORA_BASE_TOPIC>/<device_address>/owner
 //
 
 #define FLORA_BASE_TOPIC                         NULL // if NULL it defaults to STATION_ROOT_TOPIC (make sure this is common if you want station to collaborate)
 #define FLORA_PUBLISH_MIN_INTERVAL_SEC             10 // don't publish discovered attributes sooner than this
 #define FLORA_MQTT_COLLABORATE                   true // will use MQTT to collaborate for getting new values
+#define FLORA_MQTT_COLLABORATE_BINARY           false // collaborate with binary records on <FLORA_BASE_TOPIC>/collab, instead of the value topics (<FLORA_BASE_TOPIC>/+/+); enable on all stations at once, after they all run this firmware
 #define FLORA_MQTT_RETAIN                        true // for retaining the values published via MQTT
 #define FLORA_DISCOVER_DEVICES                   true // automatically add devices that are not configured via devices.cfg
+#define FLORA_STALE_SEC                          3600 // mark plant unavailable and reset its values if not updated for this long (0 to disable)
+#define FLORA_FORECAST_TAU_HOURS                   48 // how fast older samples fade in the watering forecast
+#define FLORA_WATERING_JUMP                         5 // rise in moisture (%) taken as a watering, restarting the forecast
+#define FLORA_PUBLISH_RAW                        true // publish every reading, disable to only send aggregates (also stops collaboration over the value topics)
+#define FLORA_PUBLISH_STATE                     false // publish the readings of a plant as one JSON object on <FLORA_BASE_TOPIC>/<device_address>/state
+
+#define AGGREGATE_HOURLY                         true // publish hourly aggregates of plant values
+#define AGGREGATE_DAILY                          true // publish daily aggregates of plant values
+
+#define SNAPSHOT_SAVE_SEC                        1800 // interval to save plant values to NVS, restored at boot (0 to disable)
+#define SNAPSHOT_PEER                            NULL // station asked for its snapshot on <STATION_ROOT_TOPIC>/station/<peer>/snapshot/get after boot, to warm-start without the retained values
+
+#define TSLOG_ENABLED                            true // keep 5 minute averages of plant attributes in the "tslog" flash partition
+#define TSLOG_FLUSH_SEC                           600 // interval to write pending samples to flash (samples are lost on reset)
 
 #define BLE_SCAN_DURATION_SEC                      20 // interval in seconds to scan for BLE advertisments
 #define BLE_SCAN_WAIT_SEC                          30 // interval in seconds to wait between scans
@@ -43,5 +43,76 @@
 #define UI_UPDATE_TIME_WARNING_MS   120000 // show items updated before this time in yellow (2 min)
 #define UI_UPDATE_TIME_STALL_MS    3600000 // show items updated before this time in red (1h)
 
+/*
+ * In-RAM history kept for each plant attribute, in three resolution tiers.
+ * The memory used by each plant is fixed (see HISTORY_DEVICE_FOOTPRINT) and is
+ * allocated when the plant gets its first value, for the first plants only and
+ * only while enough heap stays free for TLS, the MQTT queues and strings.
+ * The plant page shows the trend of the last hour from the averages tier.
+ */
+#define HISTORY_RAW_SEC               3600 // time covered by the raw tier (an hour)
+#define HISTORY_SCAN_SEC               (BLE_SCAN_DURATION_SEC + BLE_SCAN_WAIT_SEC) // a sample per BLE scan cycle
+#define HISTORY_RAW_SAMPLES            ((HISTORY_RAW_SEC + HISTORY_SCAN_SEC - 1) / HISTORY_SCAN_SEC) // raw samples (72 with the default scans)
+#define HISTORY_AVG_PERIOD_SEC         300 // averaging period of the second tier (5 min)
+#define HISTORY_AVG_SLOTS              288 // number of averages kept (a day)
+#define HISTORY_HOUR_SLOTS             168 // number of hourly min/max/avg kept (a week)
+#define HISTORY_MAX_DEVICES             16 // plants getting a history, the others only get the latest values
+#define HISTORY_MIN_FREE_HEAP        65536 // heap left free after allocating a history (bytes)
+#define HISTORY_TREND_SEC             3600 // time over which the trend of a value is shown
+#define HISTORY_TREND_PERCENT            3 // change, in percent of the attribute's range, shown as a trend
+
+#define FORECAST_MIN_SAMPLES            10 // samples needed after a watering before forecasting
+#define FORECAST_MIN_SPAN_SEC        10800 // time needed after a watering before forecasting (3h)
+#define FORECAST_MIN_RATE            0.01f // slowest drying rate, in %/hour, that gets a forecast
+
+#define DERIVED_LUX_TO_PPFD        0.0185f // umol/m2/s per lux, for sunlight
+#define DERIVED_MAX_GAP_SEC           1800 // light is not integrated over gaps longer than this (30 min)
+
+#define TSLOG_BATCH_RECORDS             32 // samples kept in RAM before writing them to the flash log
+#define TSLOG_BACKDATE_SEC           21600 // page base time is set back this much from its oldest sample, for late averages (6h)
+
+#define ALERT_DEFAULT_COOLDOWN_SEC    3600 // minimum time between two events of the same alert (1h)
+#define ALERT_AGE_CHECK_SEC             60 // how often rules using "age" are evaluated
+
+#define AGGREGATE_CHECK_SEC             30 // how often the aggregation windows are checked for closing
+
+#define FLORA_STATE_BUFFER_SIZE        512 // MQTT buffer needed for receiving the state of a plant
+#define SNAPSHOT_CHUNK_SIZE            960 // largest chunk of a fleet snapshot published over MQTT (bytes)
+#define SNAPSHOT_BUFFER_SIZE          1088 // MQTT buffer needed for receiving a chunk of a fleet snapshot
+#define SNAPSHOT_WARM_TIMEOUT_SEC       30 // connected time waited for the peer's snapshot before asking again, and for the retained values
+#define SNAPSHOT_WARM_REQUESTS           3 // snapshot requests sent to the peer before giving up
+#define SNAPSHOT_PUBLISH_MIN_SEC        60 // requests are answered with at most one snapshot in this interval
+#define FLORA_COLLAB_MAX_AGE_SEC        60 // collaboration records older than this are dropped, a frame counter older than this is reset
+
+/*
+ * Outbound MQTT messages are queued in RAM and sent by a task while connected.
+ * When the queue fills up while the broker is not reachable, the oldest messages
+ * are moved to a spool in SPIFFS and replayed, in order, after reconnecting.
+ * Each class of messages has its own queue, sent in order of priority.
+ */
+#define MQTT_QUEUE_ALERTS             1024 // RAM queue of alert states and events (bytes)
+#define MQTT_QUEUE_STATE              4096 // RAM queue of plant, zone and sensor values (bytes)
+#define MQTT_QUEUE_DIAGNOSTICS        1024 // RAM queue of signal levels (bytes)
+#define MQTT_QUEUE_DISCOVERY          2048 // RAM queue of home assistant discovery (bytes)
+#define MQTT_QUEUE_SIZE               (MQTT_QUEUE_ALERTS + MQTT_QUEUE_STATE + MQTT_QUEUE_DIAGNOSTICS + MQTT_QUEUE_DISCOVERY)
+#define MQTT_QUEUE_MAX_MESSAGE        1152 // larger messages are not queued, only sent when connected (discovery is up to 1KB)
+#define MQTT_QUEUE_DRAIN_MS             20 // interval of the task sending queued messages
+#define MQTT_QUEUE_BURST                 8 // messages sent on each run of the task
+#define MQTT_QUEUE_SPILL_PERCENT        75 // alerts and state over this share of their queue are spilled by the drain task
+#define MQTT_SPOOL_SIZE              32768 // SPIFFS space for messages spooled while offline (bytes)
+#define MQTT_RECONNECT_MIN_MS         1000 // first retry after a failed connect, doubled on each failure
+#define MQTT_RECONNECT_MAX_MS        60000 // longest time between connect retries
+#define MQTT5_ALIAS_IDLE_SEC          3600 // a topic alias not used for this long can be given to another topic
+#define MQTT_INFLIGHT_MAX               16 // size of the table of QoS 1 messages waiting for their acknowledgement
+#define TLS_HANDSHAKE_TIMEOUT_MS     15000 // give up a TLS handshake, or a blocked TLS write, after this long
+#define MQTT_BATCH_SIZE               1436 // batch of MQTT packets written at once, the TCP MSS of lwIP
+#define MQTT_BATCH_DEADLINE_MS          20 // longest a packet waits in the batch
+#define HASS_DISCOVERY_RESUME_MS      1000 // a discovery pass held back by its full queue resumes after this
+#define MQTT_RX_BURST                   32 // packets received on each run of the MQTT task, at most
+#define MQTT_RX_TABLE_SIZE            8192 // latest retained values received and not applied yet (bytes)
+#define MQTT_RX_APPLY_MS                10 // interval of the task applying the retained values
+#define MQTT_RX_APPLY_BURST              8 // retained values applied on each run of the task
+#define MQTT_TOPIC_LEVEL_MAX            16 // longest last topic level of a precomputed topic ("conductivity")
+
 
 #endif//_FIRMWARE_CONFIG_H_
\ No newline at end of file
@@ -0,0 +1,233 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <new>
+#include <time.h>
+
+#include "aggregate.h"
+#include "wallclock.h"
+#include "mqtt.h"
+
+#define LOG_TAG LOG_TAG_FLEET
+#include "log.h"
+
+Aggregator aggregator;
+
+/* attribute names in aggregate messages, same as their MQTT topics */
+static const char * s_attr_names[ATTR_ID_MAX] = {
+  "moisture",     // ATTR_ID_MOISTURE
+  "temp",         // ATTR_ID_TEMPERATURE
+  "conductivity", // ATTR_ID_CONDUCTIVITY
+  "light",        // ATTR_ID_ILLUMINANCE
+  "rssi",         // ATTR_ID_RSSI
+  "dli",          // ATTR_ID_DLI
+  "vpd",          // ATTR_ID_VPD
+};
+
+static const char * s_window_names[Aggregator::WINDOW_COUNT] = {
+  "hourly",
+  "daily"
+};
+
+Aggregator::Aggregator()
+  : _task_check(AGGREGATE_CHECK_SEC * TASK_SECOND, TASK_FOREVER, s_taskCheckCbk, &scheduler, false) {
+
+  for (int w = 0; w < WINDOW_COUNT; ++ w) {
+    _window_start[w] = 0;
+  }
+}
+
+bool Aggregator::begin() {
+
+  if (isEnabled(WINDOW_HOURLY) == false && isEnabled(WINDOW_DAILY) == false)
+    return true;
+
+  // windows also close when no values come in
+  _task_check.enable();
+
+  LOG_F("Aggregating plant values:%s%s, raw values %s",
+    isEnabled(WINDOW_HOURLY) ? " hourly" : "",
+    isEnabled(WINDOW_DAILY)  ? " daily"  : "",
+    config.flora_publish_raw ? "published" : "not published");
+  return true;
+}
+
+bool Aggregator::isEnabled(Window window) {
+  return window == WINDOW_HOURLY ? config.aggregate_hourly : config.aggregate_daily;
+}
+
+/* start of the local hour or day that contains time (epoch seconds) */
+uint32_t Aggregator::windowStart(Window window, uint32_t time) {
+
+  time_t    now = (time_t) time;
+  struct tm local;
+
+  localtime_r(&now, &local);
+
+  local.tm_sec = 0;
+  local.tm_min = 0;
+  if (window == WINDOW_DAILY) {
+    local.tm_hour  = 0;
+    local.tm_isdst = -1; // midnight may be on the other side of a DST change
+  }
+
+  return (uint32_t) mktime(&local);
+}
+
+/* windows of a plant, allocated the first time it gets a value */
+Aggregator::DeviceStats_t * Aggregator::find(MiFloraDevice * device) {
+
+  for (auto entry : _devices) {
+    if (entry->device == device)
+      return entry;
+  }
+
+  DeviceStats_t * entry = new (std::nothrow) DeviceStats_t();
+  if (entry == NULL) {
+    LOG_F("No memory for the aggregates of %s", device->getAddress().c_str());
+    return NULL;
+  }
+
+  entry->device = device;
+  _devices.push_back(entry);
+  return entry;
+}
+
+/* account a fresh attribute value in the open windows */
+void Aggregator::add(MiFloraDevice * device, DeviceAttribute * attr) {
+
+  AttributeID id = attr->getID();
+
+  // RSSI depends on the station, not on the plant
+  if (id >= ATTR_ID_MAX || id == ATTR_ID_RSSI || attr->hasValue() == false)
+    return;
+
+  if (_task_check.isEnabled() == false || wallclock.isSynced() == false)
+    return;
+
+  // close the windows that ended before this value
+  roll(wallclock.now());
+
+  DeviceStats_t * entry = find(device);
+  if (entry == NULL)
+    return;
+
+  float value = attr->get();
+
+  for (int w = 0; w < WINDOW_COUNT; ++ w) {
+
+    if (isEnabled((Window) w) == false)
+      continue;
+
+    Stats_t & stats = entry->stats[w][id];
+
+    if (stats.count == 0) {
+      stats.min  = value;
+      stats.max  = value;
+      stats.mean = value;
+    } else {
+      if (value < stats.min) stats.min = value;
+      if (value > stats.max) stats.max = value;
+    }
+
+    // running mean, no sum to overflow precision over a day of light readings
+    stats.count ++;
+    stats.mean += (value - stats.mean) / stats.count;
+
+    if (attr->getSource() == SOURCE_BLE) {
+      entry->heard[w] = true;
+    }
+  }
+}
+
+void Aggregator::roll(uint32_t now) {
+
+  for (int w = 0; w < WINDOW_COUNT; ++ w) {
+
+    if (isEnabled((Window) w) == false)
+      continue;
+
+    uint32_t start = windowStart((Window) w, now);
+
+    if (_window_start[w] != 0 && _window_start[w] != start) {
+      close((Window) w, _window_start[w], start);
+    }
+    _window_start[w] = start;
+  }
+}
+
+void Aggregator::close(Window window, uint32_t start, uint32_t end) {
+
+  for (auto entry : _devices) {
+
+    // every station aggregates, only the one publishing the plant in BLE range sends it
+    if (entry->heard[window] && entry->device->publishes()) {
+      publish(*entry, window, start, end);
+    }
+
+    entry->heard[window] = false;
+    for (unsigned int id = 0; id < ATTR_ID_MAX; ++ id) {
+      entry->stats[window][id].count = 0;
+    }
+  }
+}
+
+bool Aggregator::publish(DeviceStats_t & entry, Window window, uint32_t start, uint32_t end) {
+
+  char payload[384];
+  int  len;
+  std::string topic;
+
+  len = snprintf(payload, sizeof(payload), "{\"start\":%u,\"end\":%u",
+    (unsigned int) start, (unsigned int) end);
+
+  for (unsigned int id = 0; id < ATTR_ID_MAX; ++ id) {
+
+    Stats_t & stats = entry.stats[window][id];
+    if (stats.count == 0)
+      continue;
+
+    len += snprintf(payload + len, sizeof(payload) - len, ",\"%s\":[%.2f,%.2f,%.2f,%u]",
+      s_attr_names[id], stats.min, stats.max, stats.mean, (unsigned int) stats.count);
+
+    if (len >= (int) sizeof(payload) - 1)
+      return false;
+  }
+
+  len += snprintf(payload + len, sizeof(payload) - len, "}");
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, 
+    entry.device->getAddress().c_str(), s_window_names[window]);
+
+  // may not fit the MQTT buffer
+  return mqtt.publishLarge(topic.c_str(), payload, false);
+}
+
+void Aggregator::taskCheckCbk() {
+
+  if (wallclock.isSynced()) {
+    roll(wallclock.now());
+  }
+}
@@ -0,0 +1,101 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _AGGREGATE_H_
+#define _AGGREGATE_H_
+
+#include <Arduino.h>
+
+#include "scheduler.h"
+#include "device.h"
+
+/*
+ * Hourly and daily aggregates of the plant attributes.
+ *
+ * Each attribute keeps a running min, max, mean and count for every window,
+ * so the memory used by a plant is constant no matter how often it reports.
+ * Windows close on local wall clock boundaries (whole hours and midnight),
+ * when each plant heard by this station gets one message per window on
+ * <flora_base_topic>/<address>/hourly (or daily):
+ *
+ *   {"start":1700000000,"end":1700003600,"moisture":[min,max,avg,count],...}
+ *
+ * Nothing is aggregated until the wall clock is set.
+ */
+class Aggregator {
+
+  public:
+    enum Window {
+      WINDOW_HOURLY,
+      WINDOW_DAILY,
+      WINDOW_COUNT
+    };
+
+    /* running statistics of an attribute over a window */
+    typedef struct {
+      float    min;
+      float    max;
+      float    mean;
+      uint32_t count;
+    } Stats_t;
+
+  public:
+    Aggregator();
+
+    bool begin();
+    void add(MiFloraDevice * device, DeviceAttribute * attr);
+
+    static uint32_t windowStart(Window window, uint32_t time);
+
+  protected:
+    /* all windows of a plant */
+    typedef struct {
+      MiFloraDevice * device;
+      bool            heard[WINDOW_COUNT];  // got values over BLE during the window
+      Stats_t         stats[WINDOW_COUNT][ATTR_ID_MAX];
+    } DeviceStats_t;
+
+    std::vector<DeviceStats_t *> _devices;
+    uint32_t                     _window_start[WINDOW_COUNT];
+    Task                         _task_check;
+
+    bool            isEnabled(Window window);
+    DeviceStats_t * find(MiFloraDevice * device);
+    void            roll(uint32_t now);
+    void            close(Window window, uint32_t start, uint32_t end);
+    bool            publish(DeviceStats_t & entry, Window window, uint32_t start, uint32_t end);
+
+    void            taskCheckCbk();
+    static void     s_taskCheckCbk();
+};
+
+extern Aggregator aggregator;
+
+/* inlines for Aggregator */
+inline void Aggregator::s_taskCheckCbk() {
+  aggregator.taskCheckCbk();
+}
+
+#endif//_AGGREGATE_H_
@@ -0,0 +1,337 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <new>
+#include <math.h>
+
+#include "alerts.h"
+#include "mqtt.h"
+
+#define LOG_TAG LOG_TAG_ALERT
+#include "log.h"
+
+AlertRules alerts;
+
+/* names usable in rule expressions, same as the MQTT topics where possible */
+static const RuleSymbol_t s_symbols[] = {
+  { "moisture"     , ATTR_ID_MOISTURE     },
+  { "temp"         , ATTR_ID_TEMPERATURE  },
+  { "temperature"  , ATTR_ID_TEMPERATURE  },
+  { "conductivity" , ATTR_ID_CONDUCTIVITY },
+  { "light"        , ATTR_ID_ILLUMINANCE  },
+  { "illuminance"  , ATTR_ID_ILLUMINANCE  },
+  { "rssi"         , ATTR_ID_RSSI         },
+  { "dli"          , ATTR_ID_DLI          },
+  { "vpd"          , ATTR_ID_VPD          },
+};
+
+AlertRules::AlertRules()
+  : _task_tick(TASK_SECOND, TASK_FOREVER, s_taskTickCbk, &scheduler, false)
+  , _last_tick(0)
+  , _age_ticks(0) {
+}
+
+bool AlertRules::begin(const char * filename) {
+
+  ConfigFile file;
+
+  // rules are optional
+  if (file.load(filename) == false) {
+    LOG_F("No alert rules in '%s'", filename);
+    return true;
+  }
+
+  bool success = load(file);
+  LOG_F("Loaded %u rules from '%s' (%u bytes of code)",
+    count(), filename, (unsigned int) _code.size());
+
+  if (count() > 0) {
+    _last_tick = millis();
+    _task_tick.enable();
+  }
+
+  return success;
+}
+
+bool AlertRules::load(ConfigFile & file) {
+
+  bool success = true;
+
+  for (const std::string & section : file.sections()) {
+
+    Rule_t rule;
+    const char * when  = file.get((section + ":when").c_str());
+    const char * error = NULL;
+
+    if (when == NULL) {
+      LOG_F("Rule '%s' has no condition, ignored", section.c_str());
+      continue;
+    }
+
+    if (_rules.size() >= 0xFFFF ||
+        _code.compile(when, s_symbols, sizeof(s_symbols)/sizeof(RuleSymbol_t), rule.program, &error) == false) {
+      LOG_F("Rule '%s': %s in '%s'", section.c_str(), error ? error : "too many rules", when);
+      success = false;
+      continue;
+    }
+
+    // optional settings
+    const char * duration;
+
+    duration = file.get((section + ":for").c_str());
+    if (duration && RuleCode::parseDuration(duration, rule.program.for_sec) == false) {
+      LOG_F("Rule '%s': invalid duration '%s'", section.c_str(), duration);
+    }
+
+    rule.cooldown_sec = ALERT_DEFAULT_COOLDOWN_SEC;
+    duration = file.get((section + ":cooldown").c_str());
+    if (duration && RuleCode::parseDuration(duration, rule.cooldown_sec) == false) {
+      LOG_F("Rule '%s': invalid cooldown '%s'", section.c_str(), duration);
+    }
+
+    rule.name.assign(section);
+    rule.device.assign(file.get((section + ":device").c_str(), ""));
+    rule.hysteresis = file.getFloat((section + ":hysteresis").c_str(), 0);
+
+    LOG_F("Rule '%s': %s (for:%us hysteresis:%.2f cooldown:%us)",
+      section.c_str(), when, (unsigned int) rule.program.for_sec, 
+      rule.hysteresis, (unsigned int) rule.cooldown_sec);
+
+    // index by the values that trigger an evaluation
+    uint16_t index = _rules.size();
+    for (unsigned int id = 0; id < ATTR_ID_MAX; ++ id) {
+      if (rule.program.deps & (1u << id)) {
+        _by_attr[id].push_back(index);
+      }
+    }
+    if (rule.program.uses_age) {
+      _by_age.push_back(index);
+    }
+
+    _rules.push_back(rule);
+  }
+
+  return success;
+}
+
+bool AlertRules::appliesTo(unsigned int rule, MiFloraDevice * device) {
+
+  const std::string & filter = _rules[rule].device;
+
+  return filter.empty() ||
+    strcasecmp(filter.c_str(), device->getAddress().c_str()) == 0 ||
+    strcasecmp(filter.c_str(), device->getName().c_str()) == 0;
+}
+
+/* rule states of a plant, allocated the first time it is evaluated */
+AlertRules::Instance_t * AlertRules::instances(MiFloraDevice * device) {
+
+  int slot = device->getAlertSlot();
+  if (slot >= 0 && slot < (int) _devices.size() && _devices[slot].device == device)
+    return _devices[slot].instances;
+
+  Instance_t * instances = new (std::nothrow) Instance_t[_rules.size()];
+  if (instances == NULL) {
+    LOG_F("No memory for the rules of %s", device->getAddress().c_str());
+    return NULL;
+  }
+
+  for (unsigned int i = 0; i < _rules.size(); ++ i) {
+    Instance_t & instance = instances[i];
+    instance.timer.setCallback(s_onTimer, &instance);
+    instance.device     = device;
+    instance.rule       = i;
+    instance.applies    = appliesTo(i, device);
+    instance.pending    = false;
+    instance.active     = false;
+    instance.announced  = false;
+    instance.last_event = 0;
+  }
+
+  // the plant keeps its slot, no search on each update
+  device->setAlertSlot(_devices.size());
+  _devices.push_back({ device, instances });
+  return instances;
+}
+
+/* snapshot of the plant's values, missing values and limits are NaN */
+void AlertRules::buildContext(MiFloraDevice * device, RuleContext_t & ctx, float * values, float * mins, float * maxs) {
+
+  for (unsigned int id = 0; id < ATTR_ID_MAX; ++ id) {
+    DeviceAttribute * attr = device->attributeByID((AttributeID) id);
+    values[id] = attr->hasValue() ? attr->get()    : NAN;
+    mins[id]   = attr->hasMin()   ? attr->getMin() : NAN;
+    maxs[id]   = attr->hasMax()   ? attr->getMax() : NAN;
+  }
+
+  ctx.values = values;
+  ctx.mins   = mins;
+  ctx.maxs   = maxs;
+  ctx.age    = (millis() - device->lastUpdated()) / 1000;
+}
+
+/* evaluate the rules that depend on an attribute that just changed */
+void AlertRules::onAttributeUpdate(MiFloraDevice * device, AttributeID id) {
+
+  if (id >= ATTR_ID_MAX || _by_attr[id].empty())
+    return;
+
+  Instance_t * states = instances(device);
+  if (states == NULL)
+    return;
+
+  RuleContext_t ctx;
+  float values[ATTR_ID_MAX], mins[ATTR_ID_MAX], maxs[ATTR_ID_MAX];
+  buildContext(device, ctx, values, mins, maxs);
+
+  for (uint16_t rule : _by_attr[id]) {
+    if (states[rule].applies) {
+      evaluate(states[rule], ctx);
+    }
+  }
+}
+
+void AlertRules::evaluate(Instance_t & instance, const RuleContext_t & ctx) {
+
+  Rule_t & rule = _rules[instance.rule];
+  bool engaged  = instance.active || instance.pending;
+
+  // the hysteresis only applies once the condition was met
+  bool holds = _code.evaluate(rule.program, ctx, engaged ? rule.hysteresis : 0);
+
+  if (holds) {
+    if (engaged)
+      return;
+
+    if (rule.program.for_sec == 0) {
+      setActive(instance, true);
+      return;
+    }
+
+    // wait for the condition to hold long enough
+    instance.pending = true;
+    _wheel.schedule(&instance.timer, rule.program.for_sec);
+    return;
+  }
+
+  if (instance.pending) {
+    _wheel.cancel(&instance.timer);
+    instance.pending = false;
+  }
+
+  if (instance.active) {
+    setActive(instance, false);
+  }
+}
+
+/* the condition held for the whole duration, any change in between cancels the timer */
+void AlertRules::onTimer(Instance_t & instance) {
+
+  instance.pending = false;
+  setActive(instance, true);
+}
+
+void AlertRules::setActive(Instance_t & instance, bool active) {
+
+  Rule_t & rule           = _rules[instance.rule];
+  MiFloraDevice * device  = instance.device;
+  uint32_t now            = millis() / 1000;
+  std::string topic;
+  char payload[160];
+
+  instance.active = active;
+
+  LOG_F("Rule '%s' %s for %s (%s)", rule.name.c_str(), active ? "triggered" : "cleared",
+    device->getName().c_str(), device->getAddress().c_str());
+
+  //
+  // States and events are sent only by the station publishing the plant, so
+  // that collaborating stations don't all report the same alert. Nobody hears
+  // a plant that stopped reporting, so for rules on "age" every station does.
+  //
+  if (rule.program.uses_age == false && device->publishes() == false)
+    return;
+
+  // state of the binary sensor, the same on every station
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, device->getAddress().c_str(), 
+    ("alert/" + rule.name).c_str());
+  mqtt.publish(topic.c_str(), active ? "ON" : "OFF", true, MQTT::PRIORITY_ALERT);
+
+  // events only from the stations in BLE range
+  if (rule.program.uses_age == false && device->RSSI.hasValue() == false)
+    return;
+
+  if (active) {
+    if (instance.last_event != 0 && now - instance.last_event < rule.cooldown_sec)
+      return;
+    instance.last_event = now ? now : 1;
+    instance.announced  = true;
+  } else {
+    if (instance.announced == false)
+      return;
+    instance.announced = false;
+  }
+
+  snprintf(payload, sizeof(payload),
+    "{\"rule\":\"%s\",\"state\":\"%s\",\"address\":\"%s\",\"name\":\"%s\"}",
+    rule.name.c_str(), active ? "on" : "off", 
+    device->getAddress().c_str(), device->getName().c_str());
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_ALERT, rule.name.c_str());
+  mqtt.publish(topic.c_str(), payload, false, MQTT::PRIORITY_ALERT);
+}
+
+/* advance the timers and evaluate the rules that depend on time */
+void AlertRules::taskTickCbk() {
+
+  unsigned long ticks = (millis() - _last_tick) / 1000;
+  if (ticks == 0)
+    return;
+
+  _last_tick += ticks * 1000;
+  _wheel.advance(ticks);
+
+  _age_ticks += ticks;
+  if (_age_ticks < ALERT_AGE_CHECK_SEC || _by_age.empty())
+    return;
+  _age_ticks = 0;
+
+  RuleContext_t ctx;
+  float values[ATTR_ID_MAX], mins[ATTR_ID_MAX], maxs[ATTR_ID_MAX];
+
+  for (auto device : fleet.devices()) {
+
+    Instance_t * states = instances(device);
+    if (states == NULL)
+      continue;
+
+    buildContext(device, ctx, values, mins, maxs);
+    for (uint16_t rule : _by_age) {
+      if (states[rule].applies) {
+        evaluate(states[rule], ctx);
+      }
+    }
+  }
+}
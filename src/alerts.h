@@ -0,0 +1,138 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _ALERTS_H_
+#define _ALERTS_H_
+
+#include <Arduino.h>
+
+#include "scheduler.h"
+#include "device.h"
+#include "rule_vm.h"
+#include "timer_wheel.h"
+
+/*
+ * Alert rules, loaded from a config file with a section for each rule:
+ *
+ *   [dry]
+ *   when       = moisture < 20 for 30 min
+ *   hysteresis = 2
+ *   cooldown   = 6h
+ *   device     = Palmier
+ *
+ * The expressions are compiled at load time (see rule_vm.h) and a rule is
+ * evaluated for a plant only when one of the values it reads is updated.
+ * Rules that use "age" are evaluated periodically instead.
+ *
+ * A rule turns active once its condition held for the "for" duration and
+ * clears when the condition, biased by the hysteresis, no longer holds. The
+ * state of each rule for each plant is published as a binary sensor, and the
+ * transitions as events on the station's alert topic, rate limited by the
+ * cooldown.
+ */
+class AlertRules {
+
+  public:
+    AlertRules();
+
+    bool                begin(const char * filename);
+    void                onAttributeUpdate(MiFloraDevice * device, AttributeID id);
+
+    unsigned int        count();
+    const std::string & ruleName(unsigned int rule);
+    bool                appliesTo(unsigned int rule, MiFloraDevice * device);
+
+  protected:
+    /* compiled rule */
+    typedef struct {
+      std::string         name;
+      std::string         device;       // address or name, empty for all
+      RuleCode::Program_t program;
+      float               hysteresis;
+      uint32_t            cooldown_sec;
+    } Rule_t;
+
+    /* state of a rule for one plant */
+    typedef struct {
+      TimerWheel::Timer   timer;        // "for" duration
+      MiFloraDevice *     device;
+      uint16_t            rule;
+      bool                applies;
+      bool                pending;      // condition holds, waiting for the duration
+      bool                active;
+      bool                announced;    // the "on" event was sent
+      uint32_t            last_event;   // uptime seconds
+    } Instance_t;
+
+    /* all rule states of one plant */
+    typedef struct {
+      MiFloraDevice *     device;
+      Instance_t *        instances;
+    } DeviceRules_t;
+
+    RuleCode                    _code;
+    std::vector<Rule_t>         _rules;
+    std::vector<uint16_t>       _by_attr[ATTR_ID_MAX];
+    std::vector<uint16_t>       _by_age;
+    std::vector<DeviceRules_t>  _devices;
+
+    TimerWheel                  _wheel;
+    Task                        _task_tick;
+    unsigned long               _last_tick;
+    uint32_t                    _age_ticks;
+
+    bool                        load(ConfigFile & file);
+    Instance_t *                instances(MiFloraDevice * device);
+    void                        buildContext(MiFloraDevice * device, RuleContext_t & ctx, float * values, float * mins, float * maxs);
+    void                        evaluate(Instance_t & instance, const RuleContext_t & ctx);
+    void                        setActive(Instance_t & instance, bool active);
+    void                        onTimer(Instance_t & instance);
+
+    void                        taskTickCbk();
+    static void                 s_taskTickCbk();
+    static void                 s_onTimer(void * param);
+};
+
+extern AlertRules alerts;
+
+/* inlines for AlertRules */
+inline unsigned int AlertRules::count() {
+  return _rules.size();
+}
+
+inline const std::string & AlertRules::ruleName(unsigned int rule) {
+  return _rules[rule].name;
+}
+
+inline void AlertRules::s_taskTickCbk() {
+  alerts.taskTickCbk();
+}
+
+inline void AlertRules::s_onTimer(void * param) {
+  Instance_t * instance = (Instance_t *) param;
+  alerts.onTimer(*instance);
+}
+
+#endif//_ALERTS_H_
@@ -0,0 +1,47 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _ATTRIBUTE_ID_H_
+#define _ATTRIBUTE_ID_H_
+
+/*
+ * Identifiers of the attributes of a plant, kept apart from device.h so the
+ * history and the time series log can be built on the host.
+ *
+ * This file does not depend on Arduino, so it can be tested on the host.
+ */
+enum AttributeID {
+  ATTR_ID_MOISTURE,
+  ATTR_ID_TEMPERATURE,
+  ATTR_ID_CONDUCTIVITY,
+  ATTR_ID_ILLUMINANCE,
+  ATTR_ID_RSSI,
+  ATTR_ID_DLI,
+  ATTR_ID_VPD,
+  ATTR_ID_MAX,
+  ATTR_ID_NONE = ATTR_ID_MAX
+};
+
+#endif//_ATTRIBUTE_ID_H_
@@ -0,0 +1,139 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "batch_client.h"
+
+BatchClient::BatchClient(Client & client)
+  : _client(&client)
+  , _enabled(false)
+  , _failed(false)
+  , _deadline_ms(0)
+  , _since(0)
+  , _used(0)
+  , _writes(0)
+  , _segments(0) {
+}
+
+void BatchClient::setBatching(bool enabled, unsigned long deadline_ms) {
+  flush();
+  _enabled     = enabled;
+  _deadline_ms = deadline_ms;
+}
+
+/* write out the buffer once its oldest byte waited for the deadline */
+void BatchClient::poll() {
+  if (_used > 0 && millis() - _since >= _deadline_ms)
+    flush();
+}
+
+bool BatchClient::writeOut(const uint8_t * buffer, size_t size) {
+  _segments ++;
+  return _client->write(buffer, size) == size;
+}
+
+int BatchClient::connect(IPAddress ip, uint16_t port) {
+  _used   = 0;
+  _failed = false;
+  return _client->connect(ip, port);
+}
+
+int BatchClient::connect(const char * host, uint16_t port) {
+  _used   = 0;
+  _failed = false;
+  return _client->connect(host, port);
+}
+
+size_t BatchClient::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t BatchClient::write(const uint8_t * buffer, size_t size) {
+
+  _writes ++;
+
+  if (_enabled == false)
+    return writeOut(buffer, size) ? size : 0;
+
+  // make room, larger writes go out on their own
+  if (_used + size > sizeof(_buffer))
+    flush();
+  if (_failed)
+    return 0;
+  if (size > sizeof(_buffer))
+    return writeOut(buffer, size) ? size : 0;
+
+  if (_used == 0)
+    _since = millis();
+
+  memcpy(_buffer + _used, buffer, size);
+  _used += size;
+  return size;
+}
+
+int BatchClient::available() {
+  flush();
+  return _client->available();
+}
+
+int BatchClient::read() {
+  flush();
+  return _client->read();
+}
+
+int BatchClient::read(uint8_t * buffer, size_t size) {
+  flush();
+  return _client->read(buffer, size);
+}
+
+int BatchClient::peek() {
+  flush();
+  return _client->peek();
+}
+
+void BatchClient::flush() {
+
+  if (_used == 0)
+    return;
+
+  // the buffered writes were reported done, a short write drops the connection
+  if (writeOut(_buffer, _used) == false) {
+    _failed = true;
+    _client->stop();
+  }
+  _used = 0;
+}
+
+void BatchClient::stop() {
+  flush();
+  _client->stop();
+}
+
+uint8_t BatchClient::connected() {
+  return _failed == false && _client->connected();
+}
+
+BatchClient::operator bool() {
+  return _failed == false && (bool) *_client;
+}
@@ -0,0 +1,94 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _BATCH_CLIENT_H_
+#define _BATCH_CLIENT_H_
+
+#include <Arduino.h>
+#include <Client.h>
+#include <firmware_config.h>
+
+/*
+ * Client collecting the writes to another client in a buffer, sized for
+ * one TCP segment, so the PUBLISH packets of a burst leave together.
+ *
+ * The buffer is written out when the next write doesn't fit, on flush(),
+ * before reading (the peer is being waited on) and from poll(), once the
+ * oldest buffered byte is older than the deadline. With batching off the
+ * writes go straight through.
+ */
+class BatchClient : public Client {
+
+  public:
+    BatchClient(Client & client);
+
+    void          setClient(Client & client);
+    void          setBatching(bool enabled, unsigned long deadline_ms);
+    void          poll();
+
+    int           connect(IPAddress ip, uint16_t port) override;
+    int           connect(const char * host, uint16_t port) override;
+    size_t        write(uint8_t data) override;
+    size_t        write(const uint8_t * buffer, size_t size) override;
+    int           available() override;
+    int           read() override;
+    int           read(uint8_t * buffer, size_t size) override;
+    int           peek() override;
+    void          flush() override;
+    void          stop() override;
+    uint8_t       connected() override;
+    operator bool() override;
+
+    unsigned long writes();
+    unsigned long segments();
+
+  protected:
+    Client *      _client;
+    bool          _enabled;
+    bool          _failed;      // a flush fell short, the connection is broken
+    unsigned long _deadline_ms;
+    unsigned long _since;       // millis() of the oldest buffered byte
+    size_t        _used;
+    unsigned long _writes;      // writes received
+    unsigned long _segments;    // writes handed to the client
+    uint8_t       _buffer[MQTT_BATCH_SIZE];
+
+    bool          writeOut(const uint8_t * buffer, size_t size);
+};
+
+/* inlines for BatchClient */
+inline void BatchClient::setClient(Client & client) {
+  _client = &client;
+}
+
+inline unsigned long BatchClient::writes() {
+  return _writes;
+}
+
+inline unsigned long BatchClient::segments() {
+  return _segments;
+}
+
+#endif//_BATCH_CLIENT_H_
@@ -0,0 +1,329 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "collab.h"
+#include "config.h"
+#include "mqtt.h"
+#include "wallclock.h"
+
+#define LOG_TAG LOG_TAG_FLEET
+#include "log.h"
+
+Collaboration collab;
+
+/* FNV-1a of the station name, identifies the records of a station */
+static uint32_t stationHash(const char * name) {
+  uint32_t hash = 2166136261u;
+  while (*name != '\0') {
+    hash ^= (uint8_t) *name++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+Collaboration::Collaboration()
+  : _station(0)
+  , _binary(false)
+  , _sent(0)
+  , _received(0)
+  , _dropped(0)
+  , _task_advert(COLLAB_ADVERT_SEC * TASK_SECOND, TASK_FOREVER, s_taskAdvertCbk, &scheduler, false) {
+}
+
+bool Collaboration::begin() {
+
+  if (config.flora_mqtt_collaborate == false) {
+    LOG_LN("Collaboration disabled");
+    return false;
+  }
+
+  // plant ownership is advertised in both modes, readings only in binary
+  _binary  = config.flora_mqtt_collaborate_binary;
+  _station = stationHash(config.station_name);
+  config.formatTopic(_topic, ConfigMain::MQTT_TOPIC_COLLAB);
+  LOG_F("Collaboration on %s, readings %s", _topic.c_str(), _binary ? "binary" : "on the value topics");
+
+  _task_advert.enableDelayed();
+  return mqtt.subscribeTo(_topic.c_str(), s_onMessage);
+}
+
+/* the address of a plant in records, the bytes of MiFloraDevice::getMAC(), first byte first */
+static void macToBytes(uint64_t mac, uint8_t * bytes) {
+  for (int i = 5; i >= 0; -- i, mac >>= 8)
+    bytes[i] = (uint8_t) mac;
+}
+
+static uint64_t macFromBytes(const uint8_t * bytes) {
+  uint64_t mac = 0;
+  for (int i = 0; i < 6; ++ i)
+    mac = (mac << 8) | bytes[i];
+  return mac;
+}
+
+void Collaboration::updateOwnership(MiFloraDevice * device, unsigned long now) {
+
+  PlantOwnership & ownership = device->ownership();
+
+  if (ownership.update(_station, now) == false)
+    return;
+
+  if (ownership.isOwner()) {
+    LOG_F("Owner of %s (%s), rssi %d", 
+      device->getName().c_str(), device->getAddress().c_str(), ownership.rssi());
+  } else {
+    LOG_F("Not owner of %s (%s), rssi %d, owner %08x", 
+      device->getName().c_str(), device->getAddress().c_str(), ownership.rssi(), 
+      (unsigned int) ownership.remoteOwner());
+  }
+}
+
+/* a plant was heard over BLE, may change who publishes it */
+void Collaboration::onHeard(MiFloraDevice * device, int rssi) {
+
+  if (isEnabled() == false)
+    return;
+
+  unsigned long now = millis();
+
+  if (rssi != BLE_NO_RSSI)
+    device->ownership().heard(rssi, now);
+
+  updateOwnership(device, now);
+}
+
+/* share a BLE frame of a plant, called before the frame updates the device */
+void Collaboration::publish(MiFloraDevice * device, XiaomiParseResult & result, int rssi) {
+
+  if (isEnabled() == false || _binary == false || mqtt.connected() == false || device->ownership().isOwner() == false)
+    return;
+
+  uint8_t          record[COLLAB_MAX_RECORD];
+  CollabHeader_t * header = (CollabHeader_t *) record;
+  uint8_t *        value  = record + sizeof(CollabHeader_t);
+  unsigned int     interval = config.flora_publish_min_interval_sec;
+
+  header->mask = 0;
+
+  // values go at the same pace as on the value topics
+  if (result.has_moisture && device->moisture.isOlder(interval)) {
+    header->mask |= COLLAB_MOISTURE;
+    *value++ = (uint8_t) result.moisture;
+  }
+  if (result.has_temperature && device->temperature.isOlder(interval)) {
+    int16_t temperature = (int16_t) lroundf(result.temperature * 10);
+    header->mask |= COLLAB_TEMPERATURE;
+    *value++ = temperature & 0xFF;
+    *value++ = (temperature >> 8) & 0xFF;
+  }
+  if (result.has_conductivity && device->conductivity.isOlder(interval)) {
+    uint16_t conductivity = (uint16_t) result.conductivity;
+    header->mask |= COLLAB_CONDUCTIVITY;
+    *value++ = conductivity & 0xFF;
+    *value++ = conductivity >> 8;
+  }
+  if (result.has_illuminance && device->illuminance.isOlder(interval)) {
+    uint32_t illuminance = (uint32_t) result.illuminance;
+    header->mask |= COLLAB_ILLUMINANCE;
+    *value++ = illuminance & 0xFF;
+    *value++ = (illuminance >> 8) & 0xFF;
+    *value++ = (illuminance >> 16) & 0xFF;
+  }
+
+  if (header->mask == 0 || device->getMAC() == 0)
+    return;
+  macToBytes(device->getMAC(), header->mac);
+
+  header->type    = COLLAB_TYPE_READING;
+  header->frame   = result.frame_count;
+  header->rssi    = (int8_t) (rssi < -128 ? -128 : rssi);
+  header->station = _station;
+  header->time    = wallclock.isSynced() ? wallclock.now() : 0;
+
+  if (mqtt.publish(_topic.c_str(), record, value - record))
+    _sent ++;
+}
+
+/* a record of another station */
+void Collaboration::onMessage(uint8_t * payload, unsigned int len) {
+
+  if (len < 1) {
+    _dropped ++;
+    return;
+  }
+
+  switch (payload[0]) {
+    case COLLAB_TYPE_READING: onReading(payload, len); break;
+    case COLLAB_TYPE_ADVERT : onAdvert (payload, len); break;
+    default:
+      _dropped ++;
+  }
+}
+
+void Collaboration::onReading(uint8_t * payload, unsigned int len) {
+
+  CollabHeader_t header;
+
+  // readings come over the value topics
+  if (_binary == false || len < sizeof(header)) {
+    _dropped ++;
+    return;
+  }
+  memcpy(&header, payload, sizeof(header));
+
+  // our own record, echoed by the broker
+  if (header.station == _station)
+    return;
+
+  // a record delayed too much is no longer current
+  if (header.time != 0 && wallclock.isSynced() && 
+      (int32_t) (wallclock.now() - header.time) > FLORA_COLLAB_MAX_AGE_SEC) {
+    _dropped ++;
+    return;
+  }
+
+  // plants we don't know of
+  MiFloraDevice * device = fleet.findByMAC(macFromBytes(header.mac));
+  if (device == NULL) {
+    _dropped ++;
+    return;
+  }
+
+  // the owner is still publishing
+  device->ownership().remoteReading(header.station, millis());
+
+  // frames we already have
+  if (device->acceptFrame(header.frame) == false) {
+    _dropped ++;
+    return;
+  }
+
+  const uint8_t * value = payload + sizeof(header);
+  const uint8_t * end   = payload + len;
+
+  LOG_F("From station %08x %s frame %u", (unsigned int) header.station, device->getName().c_str(), header.frame);
+
+  if ((header.mask & COLLAB_MOISTURE) && value + 1 <= end) {
+    device->moisture.set(value[0], SOURCE_MQTT);
+    value += 1;
+  }
+  if ((header.mask & COLLAB_TEMPERATURE) && value + 2 <= end) {
+    device->temperature.set((int16_t) (value[0] | (value[1] << 8)) / 10.0f, SOURCE_MQTT);
+    value += 2;
+  }
+  if ((header.mask & COLLAB_CONDUCTIVITY) && value + 2 <= end) {
+    device->conductivity.set(value[0] | (value[1] << 8), SOURCE_MQTT);
+    value += 2;
+  }
+  if ((header.mask & COLLAB_ILLUMINANCE) && value + 3 <= end) {
+    device->illuminance.set(value[0] | (value[1] << 8) | ((uint32_t) value[2] << 16), SOURCE_MQTT);
+    value += 3;
+  }
+
+  _received ++;
+}
+
+/* the plants another station hears, and the ones it owns */
+void Collaboration::onAdvert(uint8_t * payload, unsigned int len) {
+
+  CollabAdvertHeader_t header;
+
+  if (len < sizeof(header)) {
+    _dropped ++;
+    return;
+  }
+  memcpy(&header, payload, sizeof(header));
+
+  if (header.station == _station)
+    return;
+
+  if (len < sizeof(header) + header.count * sizeof(CollabAdvertEntry_t)) {
+    _dropped ++;
+    return;
+  }
+
+  unsigned long now = millis();
+
+  for (unsigned int i = 0; i < header.count; ++ i) {
+    CollabAdvertEntry_t entry;
+    memcpy(&entry, payload + sizeof(header) + i * sizeof(entry), sizeof(entry));
+
+    if ((entry.flags & COLLAB_ADVERT_OWNER) == 0)
+      continue;
+
+    MiFloraDevice * device = fleet.findByMAC(macFromBytes(entry.mac));
+    if (device == NULL)
+      continue;
+
+    device->ownership().remoteClaim(header.station, entry.rssi, now);
+    updateOwnership(device, now);
+  }
+}
+
+/* advertise the plants we hear, also expires the claims of others */
+void Collaboration::taskAdvertCbk() {
+
+  uint8_t                message[sizeof(CollabAdvertHeader_t) + COLLAB_ADVERT_ENTRIES * sizeof(CollabAdvertEntry_t)];
+  CollabAdvertHeader_t * header  = (CollabAdvertHeader_t *) message;
+  CollabAdvertEntry_t *  entries = (CollabAdvertEntry_t *) (message + sizeof(CollabAdvertHeader_t));
+  unsigned long          now     = millis();
+  bool                   connected = mqtt.connected();
+  std::string            topic;
+
+  header->type    = COLLAB_TYPE_ADVERT;
+  header->count   = 0;
+  header->station = _station;
+
+  for (auto device : fleet.devices()) {
+    PlantOwnership & ownership = device->ownership();
+
+    updateOwnership(device, now);
+
+    if (connected == false || ownership.isHeard(now) == false)
+      continue;
+
+    // diagnostic, which station publishes the plant
+    if (ownership.needsAnnounce()) {
+      config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, device->getAddress().c_str(), "owner");
+      if (mqtt.publish(topic.c_str(), config.station_name, true, MQTT::PRIORITY_DIAGNOSTIC))
+        ownership.announced();
+    }
+
+    CollabAdvertEntry_t & entry = entries[header->count];
+    if (device->getMAC() == 0)
+      continue;
+    macToBytes(device->getMAC(), entry.mac);
+    entry.rssi  = (int8_t) ownership.rssi();
+    entry.flags = ownership.isOwner() ? COLLAB_ADVERT_OWNER : 0;
+
+    if (++ header->count == COLLAB_ADVERT_ENTRIES) {
+      mqtt.publish(_topic.c_str(), message, sizeof(message));
+      header->count = 0;
+    }
+  }
+
+  if (header->count > 0)
+    mqtt.publish(_topic.c_str(), message, 
+      sizeof(CollabAdvertHeader_t) + header->count * sizeof(CollabAdvertEntry_t));
+}
@@ -0,0 +1,159 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _COLLAB_H_
+#define _COLLAB_H_
+
+#include <Arduino.h>
+
+#include "scheduler.h"
+#include "device.h"
+#include "xiaomi.h"
+
+/*
+ * Binary collaboration between stations.
+ *
+ * Each BLE frame of a plant heard by a station is shared as one record on
+ * <flora_base_topic>/collab (little endian):
+ *
+ *   header   CollabHeader_t
+ *   values   in the order of the mask bits, only the ones present
+ *              moisture      uint8   %
+ *              temperature   int16   0.1 C
+ *              conductivity  uint16  uS/cm
+ *              illuminance   uint24  lux
+ *
+ * Receivers drop their own records and the frames they already have, by
+ * the frame counter of the plant, whoever got them first.
+ *
+ * Every COLLAB_ADVERT_SEC a station also advertises the plants it hears, on
+ * the same topic:
+ *
+ *   header   CollabAdvertHeader_t
+ *   entries  CollabAdvertEntry_t[count], smoothed RSSI and ownership
+ *
+ * Only the owner of a plant (see ownership.h) shares its readings and
+ * publishes its values. Stations collaborating over the value topics
+ * (flora:mqtt_collaborate_binary off) exchange only the advertisements
+ * here, ownership doesn't depend on how the readings are shared.
+ */
+
+#define COLLAB_TYPE_READING   1
+#define COLLAB_TYPE_ADVERT    2
+
+#define COLLAB_MOISTURE       0x01
+#define COLLAB_TEMPERATURE    0x02
+#define COLLAB_CONDUCTIVITY   0x04
+#define COLLAB_ILLUMINANCE    0x08
+
+#define COLLAB_MAX_RECORD     (sizeof(CollabHeader_t) + 1 + 2 + 2 + 3)
+
+#define COLLAB_ADVERT_SEC     30
+#define COLLAB_ADVERT_ENTRIES 24 // per message, so they fit the default MQTT buffer
+#define COLLAB_ADVERT_OWNER   0x01
+
+typedef struct __attribute__((packed)) {
+  uint8_t  type;
+  uint8_t  mac[6];
+  uint8_t  frame;     // frame counter of the plant
+  uint8_t  mask;      // COLLAB_xxx values in the record
+  int8_t   rssi;      // as heard by the station, 0 if unknown
+  uint32_t station;   // hash of the station name
+  uint32_t time;      // wall clock of the reading, 0 if not synced
+} CollabHeader_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t  type;
+  uint8_t  count;
+  uint32_t station;
+} CollabAdvertHeader_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t  mac[6];
+  int8_t   rssi;
+  uint8_t  flags;     // COLLAB_ADVERT_OWNER
+} CollabAdvertEntry_t;
+
+class Collaboration {
+
+  public:
+    Collaboration();
+
+    bool begin();
+    bool isEnabled();
+    void onHeard(MiFloraDevice * device, int rssi);
+    void publish(MiFloraDevice * device, XiaomiParseResult & result, int rssi);
+
+    unsigned long countSent();
+    unsigned long countReceived();
+    unsigned long countDropped();
+
+  protected:
+    uint32_t      _station;
+    std::string   _topic;
+    bool          _binary;
+    unsigned long _sent;
+    unsigned long _received;
+    unsigned long _dropped;
+    Task          _task_advert;
+
+    void onMessage(uint8_t * payload, unsigned int len);
+    void onReading(uint8_t * payload, unsigned int len);
+    void onAdvert(uint8_t * payload, unsigned int len);
+    void updateOwnership(MiFloraDevice * device, unsigned long now);
+    void taskAdvertCbk();
+
+    static void s_onMessage(const char * topic, uint8_t * payload, unsigned int len, void * param);
+    static void s_taskAdvertCbk();
+};
+
+extern Collaboration collab;
+
+/* inlines for Collaboration */
+inline bool Collaboration::isEnabled() {
+  return _topic.empty() == false;
+}
+
+inline unsigned long Collaboration::countSent() {
+  return _sent;
+}
+
+inline unsigned long Collaboration::countReceived() {
+  return _received;
+}
+
+inline unsigned long Collaboration::countDropped() {
+  return _dropped;
+}
+
+inline void Collaboration::s_onMessage(const char * topic, uint8_t * payload, unsigned int len, void * param) {
+  collab.onMessage(payload, len);
+}
+
+inline void Collaboration::s_taskAdvertCbk() {
+  collab.taskAdvertCbk();
+}
+
+#endif//_COLLAB_H_
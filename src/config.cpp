@@ -383,6 +383,46 @@ void ConfigMain::formatTopic(std::string & ret, MqttTopics topic, const char * s
         ret.append("/light/");
         ret.append(subTopic1);
     } break;
+
+    // replies to export commands
+    case MQTT_TOPIC_EXPORT: {
+        ret.assign(station_root_topic);
+        ret.append("/station/");
+        ret.append(station_name);
+        ret.append("/export/");
+        ret.append(subTopic1);
+    } break;
+
+    // alert events
+    case MQTT_TOPIC_ALERT: {
+        ret.assign(station_root_topic);
+        ret.append("/station/");
+        ret.append(station_name);
+        ret.append("/alert/");
+        ret.append(subTopic1);
+    } break;
+
+    // binary collaboration records
+    case MQTT_TOPIC_COLLAB: {
+      if (flora_base_topic == NULL) {
+        ret.assign(station_root_topic);
+      } else {
+        ret.assign(flora_base_topic);
+      }
+        ret.append("/collab");
+    } break;
+
+    // fleet snapshots of a station, and the requests for them
+    case MQTT_TOPIC_SNAPSHOT: {
+        ret.assign(station_root_topic);
+        ret.append("/station/");
+        ret.append(subTopic1);
+        ret.append("/snapshot");
+        if (subTopic2 != NULL && *subTopic2) {
+          ret.append("/");
+          ret.append(subTopic2);
+        }
+    } break;
   }
 
   return ;
@@ -420,11 +460,34 @@ bool ConfigMain::load() {
   mqtt_clientid                  = get("mqtt:clientid", MQTT_CLIENTID);
   mqtt_username                  = get("mqtt:username", MQTT_USERNAME);
   mqtt_password                  = get("mqtt:password", MQTT_PASSWORD);
+  mqtt_tls                       = getBool("mqtt:tls", MQTT_TLS);
+  mqtt_tls_ca_file               = get("mqtt:tls_ca_file", MQTT_TLS_CA_FILE);
+  mqtt_tls_session_nvs           = getBool("mqtt:tls_session_nvs", MQTT_TLS_SESSION_NVS);
+  mqtt_session_expiry_sec        = getUInt("mqtt:session_expiry_sec", MQTT_SESSION_EXPIRY_SEC);
+  mqtt_version                   = getUInt("mqtt:version", MQTT_VERSION) == 5 ? 5 : 3;
+  mqtt_message_expiry_sec        = getUInt("mqtt:message_expiry_sec", MQTT_MESSAGE_EXPIRY_SEC);
+  mqtt_station_property          = getBool("mqtt:station_property", MQTT_STATION_PROPERTY);
+  mqtt_qos                       = getUInt("mqtt:qos", MQTT_QOS) ? 1 : 0;
+  mqtt_inflight                  = getUInt("mqtt:inflight", MQTT_INFLIGHT);
+  mqtt_batch                     = getBool("mqtt:batch", MQTT_BATCH);
+  mqtt_nodelay                   = getBool("mqtt:nodelay", MQTT_NODELAY);
+  mqtt_rate_msgs                 = getUInt("mqtt:rate_msgs", MQTT_RATE_MSGS);
+  mqtt_burst_msgs                = getUInt("mqtt:burst_msgs", MQTT_BURST_MSGS);
+  mqtt_rate_bytes                = getUInt("mqtt:rate_bytes", MQTT_RATE_BYTES);
+  mqtt_burst_bytes               = getUInt("mqtt:burst_bytes", MQTT_BURST_BYTES);
+
+  // the in-flight window is a fixed table
+  if (mqtt_inflight < 1) mqtt_inflight = 1;
+  if (mqtt_inflight > MQTT_INFLIGHT_MAX) mqtt_inflight = MQTT_INFLIGHT_MAX;
 
   // convert empty credentials to NULL
   if (mqtt_username != NULL && *mqtt_username == '\0') mqtt_username = NULL;
   if (mqtt_password != NULL && *mqtt_password == '\0') mqtt_password = NULL;
 
+  // NTP
+  ntp_server                     = get("ntp:server", NTP_SERVER);
+  ntp_timezone                   = get("ntp:timezone", NTP_TIMEZONE);
+
   // WIFI
   wifi_ssid                      = get("wifi:ssid", WIFI_SSID);
   wifi_password                  = get("wifi:password", WIFI_PASSWORD);
@@ -446,8 +509,26 @@ bool ConfigMain::load() {
   flora_base_topic               = get("flora:base_topic", FLORA_BASE_TOPIC);
   flora_publish_min_interval_sec = getUInt("flora:publish_min_interval_sec", FLORA_PUBLISH_MIN_INTERVAL_SEC);
   flora_mqtt_collaborate         = getBool("flora:mqtt_collaborate", FLORA_MQTT_COLLABORATE);
+  flora_mqtt_collaborate_binary  = getBool("flora:mqtt_collaborate_binary", FLORA_MQTT_COLLABORATE_BINARY);
   flora_mqtt_retain              = getBool("flora:mqtt_retain", FLORA_MQTT_RETAIN);
   flora_discover_devices         = getBool("flora:discover_devices", FLORA_DISCOVER_DEVICES);
+  flora_stale_sec                = getULong("flora:stale_sec", FLORA_STALE_SEC);
+  flora_forecast_tau_hours       = getFloat("flora:forecast_tau_hours", FLORA_FORECAST_TAU_HOURS);
+  flora_watering_jump            = getFloat("flora:watering_jump", FLORA_WATERING_JUMP);
+  flora_publish_raw              = getBool("flora:publish_raw", FLORA_PUBLISH_RAW);
+  flora_publish_state            = getBool("flora:publish_state", FLORA_PUBLISH_STATE);
+
+  // AGGREGATE
+  aggregate_hourly               = getBool("aggregate:hourly", AGGREGATE_HOURLY);
+  aggregate_daily                = getBool("aggregate:daily", AGGREGATE_DAILY);
+
+  // SNAPSHOT
+  snapshot_save_sec              = getULong("snapshot:save_sec", SNAPSHOT_SAVE_SEC);
+  snapshot_peer                  = get("snapshot:peer", SNAPSHOT_PEER);
+
+  // Flash log
+  tslog_enabled                  = getBool("tslog:enabled", TSLOG_ENABLED);
+  tslog_flush_sec                = getULong("tslog:flush_sec", TSLOG_FLUSH_SEC);
 
   // Home assistant
   hass_discovery_topic_prefix    = get("homeassistant:discovery_topic_prefix", HASS_DISCOVERY_TOPIC_PREFIX);
@@ -100,7 +100,11 @@ class ConfigMain : public ConfigFile {
       MQTT_TOPIC_DHT_SENSOR,
       MQTT_TOPIC_WIFI,
       MQTT_TOPIC_FLORA,
-      MQTT_TOPIC_LIGHT
+      MQTT_TOPIC_LIGHT,
+      MQTT_TOPIC_EXPORT,
+      MQTT_TOPIC_ALERT,
+      MQTT_TOPIC_COLLAB,
+      MQTT_TOPIC_SNAPSHOT
     };
 
   public:
@@ -134,6 +138,25 @@ class ConfigMain : public ConfigFile {
     const char * mqtt_clientid;
     const char * mqtt_username;
     const char * mqtt_password;
+    bool         mqtt_tls;
+    const char * mqtt_tls_ca_file;
+    bool         mqtt_tls_session_nvs;
+    uint32_t     mqtt_session_expiry_sec;
+    uint8_t      mqtt_version;
+    uint32_t     mqtt_message_expiry_sec;
+    bool         mqtt_station_property;
+    uint8_t      mqtt_qos;
+    uint8_t      mqtt_inflight;
+    bool         mqtt_batch;
+    bool         mqtt_nodelay;
+    uint32_t     mqtt_rate_msgs;
+    uint32_t     mqtt_burst_msgs;
+    uint32_t     mqtt_rate_bytes;
+    uint32_t     mqtt_burst_bytes;
+
+    /* NTP settings */
+    const char * ntp_server;
+    const char * ntp_timezone;
 
     /* Display settings */
     uint16_t     display_refresh_sec;
@@ -150,8 +173,26 @@ class ConfigMain : public ConfigFile {
     const char * flora_base_topic;
     uint16_t     flora_publish_min_interval_sec;
     bool         flora_mqtt_collaborate;
+    bool         flora_mqtt_collaborate_binary;
     bool         flora_mqtt_retain;
     bool         flora_discover_devices;
+    uint32_t     flora_stale_sec;
+    float        flora_forecast_tau_hours;
+    float        flora_watering_jump;
+    bool         flora_publish_raw;
+    bool         flora_publish_state;
+
+    // AGGREGATE
+    bool         aggregate_hourly;
+    bool         aggregate_daily;
+
+    // SNAPSHOT
+    uint32_t     snapshot_save_sec;
+    const char * snapshot_peer;
+
+    /* Flash log settings */
+    bool         tslog_enabled;
+    uint32_t     tslog_flush_sec;
 
     /* Home assistant */
     const char * hass_discovery_topic_prefix;
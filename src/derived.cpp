@@ -0,0 +1,87 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <math.h>
+#include <time.h>
+
+#include "derived.h"
+#include "wallclock.h"
+
+DerivedMetrics::DerivedMetrics()
+  : last_time(0)
+  , last_lux(0)
+  , has_last(false)
+  , integral(0)
+  , day(-1) {
+}
+
+/* integrate an illuminance sample taken at uptime seconds, returns true if DLI changed */
+bool DerivedMetrics::addIlluminance(uint32_t time, float lux) {
+
+  bool changed = false;
+
+  // local midnight resets the integral (only once the clock is set)
+  if (wallclock.isSynced()) {
+    time_t    now = (time_t) wallclock.now();
+    struct tm local;
+
+    localtime_r(&now, &local);
+
+    int32_t today = local.tm_year * 366 + local.tm_yday;
+    if (day != today) {
+      changed  = (day != -1 && integral != 0);
+      integral = day != -1 ? 0 : integral;
+      day      = today;
+    }
+  }
+
+  if (has_last) {
+    uint32_t dt = time - last_time;
+
+    if (dt > 0 && dt <= DERIVED_MAX_GAP_SEC) {
+      // trapezoid, umol/m2/s * s => mol/m2
+      integral += (last_lux + lux) * 0.5f * DERIVED_LUX_TO_PPFD * dt / 1e6f;
+      changed   = true;
+    }
+  }
+
+  last_time = time;
+  last_lux  = lux;
+  has_last  = true;
+  return changed;
+}
+
+/* Tetens equation, kPa */
+float DerivedMetrics::saturationPressure(float temp) {
+  return 0.6108f * expf(17.27f * temp / (temp + 237.3f));
+}
+
+float DerivedMetrics::vpd(float plant_temp, float air_temp, float air_humidity) {
+
+  float actual = saturationPressure(air_temp) * air_humidity / 100.0f;
+  float deficit = saturationPressure(plant_temp) - actual;
+
+  return deficit > 0 ? deficit : 0;
+}
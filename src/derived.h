@@ -0,0 +1,68 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _DERIVED_H_
+#define _DERIVED_H_
+
+#include <stdint.h>
+#include <firmware_config.h>
+
+/*
+ * Metrics derived from the raw plant readings, computed as samples come in,
+ * in constant memory and without keeping any history:
+ *
+ *  - DLI, daily light integral (mol/m2/day): illuminance converted to PPFD
+ *    and integrated over time with the trapezoidal rule, reset at local
+ *    midnight. Gaps longer than DERIVED_MAX_GAP_SEC are not integrated, as
+ *    there is no telling what the light was meanwhile.
+ *
+ *  - VPD, vapour pressure deficit (kPa): between the saturated air at the
+ *    plant's temperature and the air measured by the station's DHT sensor.
+ */
+class DerivedMetrics {
+
+  public:
+    DerivedMetrics();
+
+    bool  addIlluminance(uint32_t time, float lux);
+    float dli();
+
+    static float vpd(float plant_temp, float air_temp, float air_humidity);
+    static float saturationPressure(float temp);
+
+  protected:
+    uint32_t last_time;
+    float    last_lux;
+    bool     has_last;
+    float    integral;
+    int32_t  day;
+};
+
+/* inlines for DerivedMetrics */
+inline float DerivedMetrics::dli() {
+  return integral;
+}
+
+#endif//_DERIVED_H_
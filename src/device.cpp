@@ -22,118 +22,360 @@
  *  Copyright (c) 2021 Alex Mircescu
  */
 
+#include <new>
+
 #include "device.h"
+#include "history.h"
+#include "tslog.h"
+#include "wallclock.h"
+#include "alerts.h"
+#include "aggregate.h"
+#include "zone.h"
+#include "species.h"
+#include "collab.h"
+#include "dht_sensor.h"
 #include "mqtt.h"
+#include "snapshot.h"
+#include "number_format.h"
 
 #define LOG_TAG LOG_TAG_FLORA
 #include "log.h"
 
 MiFloraFleet fleet;
 
+/* plants with a history, up to HISTORY_MAX_DEVICES */
+static unsigned int s_history_count = 0;
+
+/* attribute names in state messages, same as their MQTT topics */
+static const char * s_state_names[ATTR_ID_MAX] = {
+  "moisture",     // ATTR_ID_MOISTURE
+  "temp",         // ATTR_ID_TEMPERATURE
+  "conductivity", // ATTR_ID_CONDUCTIVITY
+  "light",        // ATTR_ID_ILLUMINANCE
+  "rssi",         // ATTR_ID_RSSI
+  "dli",          // ATTR_ID_DLI
+  "vpd",          // ATTR_ID_VPD
+};
+
+/* append text to a NUL terminated buffer, false when it doesn't fit */
+static bool s_append(char * buffer, size_t size, size_t & len, const char * text, size_t text_len) {
+
+  if (len + text_len >= size)
+    return false;
+
+  memcpy(buffer + len, text, text_len);
+  len += text_len;
+  buffer[len] = '\0';
+  return true;
+}
+
+static bool s_append(char * buffer, size_t size, size_t & len, const char * text) {
+  return s_append(buffer, size, len, text, strlen(text));
+}
+
 /*
  * Device implementation for MiFlora
  */ 
 MiFloraDevice::MiFloraDevice(const std::string & addr): 
-    conductivity (this, ATTR_ID_MOISTURE    , "Cond"), 
+    conductivity (this, ATTR_ID_CONDUCTIVITY, "Cond"), 
     temperature  (this, ATTR_ID_TEMPERATURE , "Temp"),
     moisture     (this, ATTR_ID_MOISTURE    , "Moist"), 
     illuminance  (this, ATTR_ID_ILLUMINANCE , "Light"),
     RSSI         (this, ATTR_ID_RSSI        , "RSSI"),
+    dli          (this, ATTR_ID_DLI         , "DLI"),
+    vpd          (this, ATTR_ID_VPD         , "VPD"),
     _last_updated(millis()),
-    _id(0),
-    _address     (addr), _name("") {
+    _id(0), _mac(0),
+    _address     (addr), _name(""),
+    _available   (false), _availability_dirty(false),
+    _stale_timer (s_onStale, this),
+    _history     (NULL),
+    _history_refused(false),
+    _forecast_published_hours(-1),
+    _zone        (NULL),
+    _zone_slot   (-1),
+    _alert_slot  (-1),
+    _species     (NULL),
+    _state_published(0),
+    _frame_time  (0),
+    _frame       (0),
+    _has_frame   (false),
+    _topic       (TopicArena::INVALID) {
+
+  // all six bytes of "xx:xx:xx:xx:xx:xx", most significant first
+  unsigned int bytes[6];
+  if (sscanf(_address.c_str(), "%x:%x:%x:%x:%x:%x", 
+        &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) == 6) {
+    for (int i = 0; i < 6; ++ i)
+      _mac = (_mac << 8) | (uint8_t) bytes[i];
+  }
 
+  // plant topics are "<base>/<address>/<level>", the prefix is kept once
+  {
+    std::string prefix;
+    config.formatTopic(prefix, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "");
+    _topic = mqtt.topics().add(prefix.c_str(), MQTT_TOPIC_LEVEL_MAX);
+  }
 
-  // MQTT collaboration
-  if (config.flora_mqtt_collaborate) {
+  // MQTT collaboration over the value topics
+  if (config.flora_mqtt_collaborate && config.flora_mqtt_collaborate_binary == false) {
     std::string topic;
     
-    // subscribe for getting attribute update from other stations
+    // get attribute updates from other stations, these are received
+    // through the fleet's wildcard subscription
     config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "temp");
-    mqtt.subscribeTo(topic.c_str(), s_onMQTTMessage, this);
+    mqtt.route(topic.c_str(), s_onMQTTMessage, &temperature);
 
     config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "conductivity");
-    mqtt.subscribeTo(topic.c_str(), s_onMQTTMessage, this);
+    mqtt.route(topic.c_str(), s_onMQTTMessage, &conductivity);
 
     config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "light");
-    mqtt.subscribeTo(topic.c_str(), s_onMQTTMessage, this);
+    mqtt.route(topic.c_str(), s_onMQTTMessage, &illuminance);
 
     config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "moisture");
-    mqtt.subscribeTo(topic.c_str(), s_onMQTTMessage, this);
+    mqtt.route(topic.c_str(), s_onMQTTMessage, &moisture);
+
+    config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "state");
+    mqtt.route(topic.c_str(), s_onMQTTState, this);
+  }
+
+  // a device that is never heard of will go unavailable as well
+  fleet.scheduleStale(&_stale_timer);
+}
+
+/* any fresh attribute value keeps the device available */
+void MiFloraDevice::onAttributeUpdate(DeviceAttribute * attr) {
+
+  // alert rules and zones also see values going away
+  alerts.onAttributeUpdate(this, attr->getID());
+  if (_zone) {
+    _zone->onMemberUpdate(_zone_slot);
+  }
+
+  // resetting an attribute is not a fresh reading
+  if (attr->hasValue() == false)
+    return;
+
+  // a value relayed with its age doesn't make the plant fresher than it is
+  if ((long) (attr->lastUpdated() - _last_updated) > 0)
+    _last_updated = attr->lastUpdated();
+
+  // hourly and daily aggregates
+  aggregator.add(this, attr);
+
+  // record in history, allocated only for plants that do get values, as
+  // long as the cap and the heap left for TLS and the queues allow it
+  if (_history == NULL && _history_refused == false) {
+    if (s_history_count < HISTORY_MAX_DEVICES && 
+        ESP.getFreeHeap() >= HISTORY_MIN_FREE_HEAP + HISTORY_DEVICE_FOOTPRINT)
+      _history = new (std::nothrow) DeviceHistory();
+
+    if (_history != NULL) {
+      s_history_count ++;
+    } else {
+      _history_refused = true;
+      LOG_F("No history for %s (%u of %u plants have one, %u bytes of heap free, %u needed)", 
+        _address.c_str(), s_history_count, HISTORY_MAX_DEVICES, (unsigned int) ESP.getFreeHeap(), 
+        (unsigned int) (HISTORY_MIN_FREE_HEAP + HISTORY_DEVICE_FOOTPRINT));
+    }
+  }
+  if (_history && _history->add(attr->getID(), attr->get(), wallclock.uptime())) {
+
+    // a 5 minute average was closed, keep it in flash (needs wall clock time)
+    HistorySample_t average;
+    if (wallclock.isSynced() && _history->lastAverage(attr->getID(), average)) {
+      tslog.append(_mac, attr->getID(), wallclock.fromUptime(average.time), average.avg);
+    }
+  }
+
+  // drying forecast follows moisture
+  if (attr == &moisture) {
+    updateForecast();
+  }
+
+  // light integral and vapour pressure deficit
+  if (attr == &illuminance || attr == &temperature) {
+    updateDerived(attr);
+  }
+
+  // push back expiration
+  fleet.scheduleStale(&_stale_timer);
+
+  // also retry if the last state did not make it to the broker
+  if (_available == false || _availability_dirty) {
+    setAvailable(true);
+  }
+}
+
+/* attributes were restored from a snapshot, catch up without publishing anything */
+void MiFloraDevice::onRestored() {
+
+  unsigned long now = millis();
+  bool first = true;
+
+  // last seen is the most recent of the restored values
+  for (unsigned int i = 0 ; i < attributeCount(); ++ i) {
+    DeviceAttribute * attr = attributeAt(i);
+    if (attr->isRestored() == false)
+      continue;
+
+    if (first || now - attr->lastUpdated() < now - _last_updated) {
+      _last_updated = attr->lastUpdated();
+      first = false;
+    }
+  }
+
+  if (_zone) {
+    _zone->onMemberUpdate(_zone_slot);
+  }
+}
+
+/* publish the availability of this plant (retained) */
+void MiFloraDevice::setAvailable(bool available) {
+
+  const char * payload = available ? config.station_payload_online : config.station_payload_offline;
+  const char * topic;
+
+  _available = available;
+  if (_zone) {
+    _zone->onMemberUpdate(_zone_slot);
+  }
+
+  LOG_F("Device %s (%s) is now %s", 
+    _name.c_str(), _address.c_str(), available ? "available" : "unavailable");
+
+  //
+  // Every collaborating station refreshes its timer from the values published
+  // by the others, so a plant goes offline only when none of them heard it.
+  //
+  topic = mqtt.topics().topic(_topic, "availability");
+  _availability_dirty = topic == NULL || !mqtt.publish(topic, payload, true);
+}
+
+/* refit the watering forecast and publish it when it changes */
+void MiFloraDevice::updateForecast() {
+
+  char value[NUMBER_FORMAT_SIZE];
+  size_t len;
+  int32_t hours = -1;
+  uint32_t now = wallclock.uptime();
+
+  // nothing to forecast without a limit
+  if (moisture.hasMin() == false)
+    return;
+
+  if (_forecast.add(now, moisture.get(), moisture.getMin())) {
+    hours = (int32_t) ((_forecast.secondsLeft(now) + 1800) / 3600);
+  }
+
+  // every station keeps its own fit, only the one publishing the plant sends it
+  if (hours == _forecast_published_hours || moisture.getSource() != SOURCE_BLE || publishes() == false)
+    return;
+
+  // "None" makes HASS show the sensor as unknown
+  if (hours >= 0) {
+    len = NumberFormat::formatInt(value, hours);
+  } else {
+    strcpy(value, "None");
+    len = 4;
+  }
+
+  if (publishValue("water_in", value, len)) {
+    _forecast_published_hours = hours;
+  }
+}
+
+/* update the metrics derived from light and temperature */
+void MiFloraDevice::updateDerived(DeviceAttribute * attr) {
+
+  if (attr == &illuminance) {
+    if (_derived.addIlluminance(wallclock.uptime(), illuminance.get())) {
+      setDerived(dli, _derived.dli(), illuminance.getSource(), "dli");
+    }
+  } else
+  if (attr == &temperature && dht.hasValues()) {
+    setDerived(vpd, DerivedMetrics::vpd(temperature.get(), dht.temperature(), dht.humidity()), 
+      temperature.getSource(), "vpd");
+  }
+}
+
+/* set a derived attribute, publishing it the same way as the readings it comes from */
+void MiFloraDevice::setDerived(DeviceAttribute & attr, float value, UpdateSource source, const char * level) {
+
+  if (source == SOURCE_BLE && config.flora_publish_raw && publishes() && attr.isOlder(config.flora_publish_min_interval_sec)) {
+    char val[NUMBER_FORMAT_SIZE];
+    size_t len = NumberFormat::formatFixed(val, value, 2);
+    publishValue(level, val, len);
+  }
+
+  attr.set(value, source);
+}
+
+/* called by the fleet's timer wheel when no fresh value came in time */
+void MiFloraDevice::onStale() {
+
+  LOG_F("Device %s (%s) not updated for %us, resetting values", 
+    _name.c_str(), _address.c_str(), (unsigned int) config.flora_stale_sec);
+
+  // forget values that are no longer valid
+  for (unsigned int i = 0 ; i < attributeCount(); ++ i) {
+    attributeAt(i)->reset();
   }
+
+  setAvailable(false);
 }
 
 /* update device attributes from BLE scan result */
 void MiFloraDevice::updateFromBLEScan(XiaomiParseResult & result) {
 
   unsigned long now = millis();
-  char value[16];
-  std::string topic;
+  char value[NUMBER_FORMAT_SIZE];
+  size_t len;
 
   // TEMPERATURE
   if (result.has_temperature) {
+    len = NumberFormat::formatFixed(value, result.temperature, 2);
 
     // publish to mqtt
-    if (temperature.isOlder(config.flora_publish_min_interval_sec, now)) {
-      sprintf(value, "%.2f", result.temperature);
-
-      config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "temp");
-      mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
-    }
-
-    LOG_F("From BLE %s %s->%.2f", 
-      _name.c_str(), temperature.getLabel(), result.temperature );
+    if (config.flora_publish_raw && publishes() && temperature.isOlder(config.flora_publish_min_interval_sec, now))
+      publishValue("temp", value, len);
 
+    logValue("From BLE", temperature, value);
     temperature.set(result.temperature, SOURCE_BLE);
   }
 
   // CONDUCTIVITY
   if (result.has_conductivity) {
+    len = NumberFormat::formatUInt(value, result.conductivity);
 
     // publish to mqtt
-    if (conductivity.isOlder(config.flora_publish_min_interval_sec, now)) {
-      sprintf(value, "%u", (unsigned int) result.conductivity);
-
-      config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "conductivity");
-      mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
-    }
-    
-    LOG_F("From BLE %s %s->%d", 
-      _name.c_str(), conductivity.getLabel(), (int) result.conductivity);
+    if (config.flora_publish_raw && publishes() && conductivity.isOlder(config.flora_publish_min_interval_sec, now))
+      publishValue("conductivity", value, len);
 
+    logValue("From BLE", conductivity, value);
     conductivity.set(result.conductivity, SOURCE_BLE);
   }
 
   // LIGHT
   if (result.has_illuminance) {
+    len = NumberFormat::formatUInt(value, result.illuminance);
 
     // publish to mqtt
-    if (illuminance.isOlder(config.flora_publish_min_interval_sec, now)) {
-      sprintf(value, "%u", (unsigned int) result.illuminance);
-
-      config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "light");
-      mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
-    }
-
-    LOG_F("From BLE %s %s->%d", 
-      _name.c_str(), illuminance.getLabel(), (int) result.illuminance);
+    if (config.flora_publish_raw && publishes() && illuminance.isOlder(config.flora_publish_min_interval_sec, now))
+      publishValue("light", value, len);
 
+    logValue("From BLE", illuminance, value);
     illuminance.set((int)result.illuminance, SOURCE_BLE);
   }
   // MOISTURE
   if (result.has_moisture) {
+    len = NumberFormat::formatUInt(value, result.moisture);
 
     // publish to mqtt
-    if (moisture.isOlder(config.flora_publish_min_interval_sec, now)) {
-      sprintf(value, "%u", (unsigned int) result.moisture);
+    if (config.flora_publish_raw && publishes() && moisture.isOlder(config.flora_publish_min_interval_sec, now))
+      publishValue("moisture", value, len);
 
-      config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "moisture");
-      mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
-    }
-
-    LOG_F("From BLE %s %s->%d", 
-      _name.c_str(), moisture.getLabel(), (int) result.moisture);
-      
+    logValue("From BLE", moisture, value);
     moisture.set((int)result.moisture, SOURCE_BLE);
   }
 }
@@ -141,61 +383,261 @@ void MiFloraDevice::updateFromBLEScan(XiaomiParseResult & result) {
 inline void MiFloraDevice::updateRSSI(int rssi) {
 
   unsigned long now = millis();
-  std::string topic;
-  char value[16];
+  char value[NUMBER_FORMAT_SIZE];
 
   // publish RSSI on MQTT
-  if (RSSI.isOlder(config.flora_publish_min_interval_sec, now)) {
-    
-    sprintf(value, "%d", rssi);
-    config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, _address.c_str(), "rssi");
-    mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
+  if (config.flora_publish_raw && publishes() && RSSI.isOlder(config.flora_publish_min_interval_sec, now)) {
+    size_t len = NumberFormat::formatInt(value, rssi);
+    publishValue("rssi", value, len, true);
   }
 
   // update attribute
   RSSI.set(rssi, SOURCE_BLE);
 }
 
-/* update device attributes via MQTT message */
-void MiFloraDevice::updateFromMQTT(const char * topic, uint8_t * _payload, unsigned int len) {
+/* publish a raw value, the topic comes from the arena and nothing is allocated */
+bool MiFloraDevice::publishValue(const char * level, const char * value, size_t len, bool diagnostic) {
+
+  const char * topic = mqtt.topics().topic(_topic, level);
+  if (topic == NULL)
+    return false;
+
+  return mqtt.publish(topic, (const uint8_t *) value, len, config.flora_mqtt_retain,
+    diagnostic ? MQTT::PRIORITY_DIAGNOSTIC : MQTT::PRIORITY_STATE);
+}
+
+/* log a value in pieces, printf allocates for lines over its buffer */
+void MiFloraDevice::logValue(const char * source, DeviceAttribute & attr, const char * value) {
+  LOG_PART_START(source);
+  LOG_PART(' ');
+  LOG_PART(_name.c_str());
+  LOG_PART(' ');
+  LOG_PART(attr.getLabel());
+  LOG_PART("->");
+  LOG_PART_END(value);
+}
+
+/* update a device attribute via MQTT message */
+void MiFloraDevice::updateFromMQTT(DeviceAttribute * attr, uint8_t * _payload, unsigned int len) {
 
-  const char * attribute;
   char payload [16];
 
   // payload too large
-  if (len - 1 > sizeof(payload)) 
+  if (len >= sizeof(payload)) 
     return;
 
   // copy payload with null terminator
-  strncpy(payload, (const char *)_payload, len);
+  memcpy(payload, _payload, len);
   payload[len] = '\0';
-  
-  // should not happen
-  attribute = strrchr(topic, '/');
-  if (attribute == NULL)
+
+  float value = attr == &temperature ? strtof(payload, NULL) : strtol(payload, NULL, 10);
+
+  //
+  // A retained value is from the past, of unknown age. It only fills in an
+  // attribute without a value since boot, as history, so it doesn't count
+  // as a reading and never hides a fresher BLE one. Values restored from
+  // the snapshot of a peer have known ages and are kept too.
+  //
+  if (mqtt.isRetained()) {
+    if (attr->hasValue() && (attr->isRestored() == false || snapshot.warmStarted()))
+      return;
+
+    attr->restore(value, SOURCE_MQTT, attr->hasValue() ? 
+      millis() - attr->lastUpdated() : config.flora_publish_min_interval_sec * 1000UL);
+    onRestored();
     return;
+  }
 
-  auto now = millis();
-
-  LOG_F("From MQTT %s %s->%s", _name.c_str(), attribute, payload);
-
-  if (strcmp(attribute, "/temp") == 0) {
-    if ((now - temperature.lastUpdated()) < 10000 && temperature.getSource() == SOURCE_BLE) return;
-    temperature.set(strtof(payload, NULL), SOURCE_MQTT);
-  } else 
-  if (strcmp(attribute, "/moisture") == 0) {
-    if ((now - moisture.lastUpdated()) < 10000 && moisture.getSource() == SOURCE_BLE) return;
-    moisture.set(strtol(payload, NULL, 10), SOURCE_MQTT);
-  } else 
-  if (strcmp(attribute, "/conductivity") == 0) {
-    if ((now - conductivity.lastUpdated()) < 10000 && conductivity.getSource() == SOURCE_BLE) return;
-    conductivity.set(strtol(payload, NULL, 10), SOURCE_MQTT);
-  } else
-  if (strcmp(attribute, "/light") == 0) {
-    if ((now - illuminance.lastUpdated()) < 10000 && illuminance.getSource() == SOURCE_BLE) return;
-    illuminance.set(strtol(payload, NULL, 10), SOURCE_MQTT);
-  } else {
-    // should not happen
+  LOG_F("From MQTT %s %s->%s", _name.c_str(), attr->getLabel(), payload);
+
+  // only the owner publishes the plant, its values keep its claim alive
+  _ownership.remoteReading(_ownership.remoteOwner(), millis());
+
+  // values just read over BLE are better than the ones of other stations
+  if ((millis() - attr->lastUpdated()) < 10000 && attr->getSource() == SOURCE_BLE)
+    return;
+
+  attr->set(value, SOURCE_MQTT);
+}
+
+/*
+ * Publish the values this station read over BLE as one JSON object:
+ *   {"moisture":41,"temp":21.50,...,"age":{"moisture":3,"temp":12,...},"station":"name"}
+ * Ages are in seconds. Values got from other stations are left out, they
+ * are in the state of the station that read them.
+ */
+void MiFloraDevice::publishState() {
+
+  unsigned long now = millis();
+
+  if (config.flora_publish_state == false || publishes() == false ||
+      (now - _state_published) < config.flora_publish_min_interval_sec * 1000UL)
+    return;
+
+  char values[192];
+  char ages[192];
+  char payload[FLORA_STATE_BUFFER_SIZE];
+  char number[NUMBER_FORMAT_SIZE];
+  size_t values_len = 0;
+  size_t ages_len = 0;
+  size_t payload_len = 0;
+  size_t len;
+  const char * topic;
+
+  for (unsigned int i = 0; i < attributeCount(); ++ i) {
+    DeviceAttribute * attr = attributeAt(i);
+
+    if (attr->hasValue() == false || attr->isRestored() || attr->getSource() != SOURCE_BLE)
+      continue;
+
+    const char * name = s_state_names[attr->getID()];
+    const char * sep  = values_len ? ",\"" : "\"";
+
+    if (attr == &temperature || attr == &dli || attr == &vpd) {
+      len = NumberFormat::formatFixed(number, attr->get(), 2);
+    } else {
+      len = NumberFormat::formatInt(number, attr->getInt());
+    }
+    if (s_append(values, sizeof(values), values_len, sep) == false ||
+        s_append(values, sizeof(values), values_len, name) == false ||
+        s_append(values, sizeof(values), values_len, "\":") == false ||
+        s_append(values, sizeof(values), values_len, number, len) == false)
+      return;
+
+    len = NumberFormat::formatUInt(number, (now - attr->lastUpdated()) / 1000);
+    if (s_append(ages, sizeof(ages), ages_len, sep) == false ||
+        s_append(ages, sizeof(ages), ages_len, name) == false ||
+        s_append(ages, sizeof(ages), ages_len, "\":") == false ||
+        s_append(ages, sizeof(ages), ages_len, number, len) == false)
+      return;
+  }
+
+  if (values_len == 0)
+    return;
+
+  if (s_append(payload, sizeof(payload), payload_len, "{") == false ||
+      s_append(payload, sizeof(payload), payload_len, values, values_len) == false ||
+      s_append(payload, sizeof(payload), payload_len, ",\"age\":{") == false ||
+      s_append(payload, sizeof(payload), payload_len, ages, ages_len) == false ||
+      s_append(payload, sizeof(payload), payload_len, "},\"station\":\"") == false ||
+      s_append(payload, sizeof(payload), payload_len, config.station_name) == false ||
+      s_append(payload, sizeof(payload), payload_len, "\"}") == false)
+    return;
+
+  topic = mqtt.topics().topic(_topic, "state");
+  if (topic == NULL)
+    return;
+  mqtt.publishLarge(topic, payload, config.flora_mqtt_retain);
+
+  _state_published = now;
+}
+
+/* update device attributes from the state published by another station */
+void MiFloraDevice::updateFromMQTTState(uint8_t * _payload, unsigned int len) {
+
+  char payload[FLORA_STATE_BUFFER_SIZE];
+  unsigned long now = millis();
+
+  if (len >= sizeof(payload))
+    return;
+
+  memcpy(payload, _payload, len);
+  payload[len] = '\0';
+
+  // our own state, echoed by the broker
+  char * station = strstr(payload, "\"station\":\"");
+  if (station == NULL)
+    return;
+  station += 11;
+  size_t station_len = strlen(config.station_name);
+  if (strncmp(station, config.station_name, station_len) == 0 && station[station_len] == '"')
+    return;
+
+  // only the owner publishes the plant, its state keeps its claim alive
+  if (mqtt.isRetained() == false)
+    _ownership.remoteReading(_ownership.remoteOwner(), now);
+
+  // split values from their ages, both use the same names
+  char * ages = strstr(payload, "\"age\":{");
+  if (ages == NULL)
+    return;
+  * ages = '\0';
+  ages += 7;
+
+  // only the values other stations collaborate on
+  DeviceAttribute * attributes[] = { &moisture, &temperature, &conductivity, &illuminance };
+  bool              restored     = false;
+
+  for (auto attr : attributes) {
+    char key[24];
+    snprintf(key, sizeof(key), "\"%s\":", s_state_names[attr->getID()]);
+
+    char * value = strstr(payload, key);
+    char * age   = strstr(ages, key);
+    if (value == NULL || age == NULL)
+      continue;
+
+    // keep the value we have, if it's newer
+    unsigned long age_ms = strtoul(age + strlen(key), NULL, 10) * 1000UL;
+    if (attr->hasValue() && (now - attr->lastUpdated()) <= age_ms)
+      continue;
+
+    // a retained state is history, older still than its ages say
+    if (mqtt.isRetained()) {
+      if (attr->hasValue() == false || attr->isRestored()) {
+        attr->restore(strtof(value + strlen(key), NULL), SOURCE_MQTT, age_ms);
+        restored = true;
+      }
+      continue;
+    }
+
+    LOG_F("From MQTT state %s %s->%s (%lu s old)", _name.c_str(), attr->getLabel(), value + strlen(key), age_ms / 1000);
+
+    // the reading keeps its age, it's not fresher for having been relayed
+    attr->set(strtof(value + strlen(key), NULL), SOURCE_MQTT, age_ms);
+  }
+
+  if (restored)
+    onRestored();
+}
+
+/* 
+ * Check the frame counter of a reading, heard over BLE or from another station,
+ * returns false if the frame or a newer one was already seen.
+ */
+bool MiFloraDevice::acceptFrame(uint8_t frame) {
+
+  unsigned long now = millis();
+
+  // the counter wraps, newer frames are up to half of it ahead; an old
+  // counter is not trusted, the device may have been restarted since
+  if (_has_frame && (int8_t)(frame - _frame) <= 0 && 
+      (now - _frame_time) < FLORA_COLLAB_MAX_AGE_SEC * 1000UL)
+    return false;
+
+  _frame      = frame;
+  _frame_time = now;
+  _has_frame  = true;
+  return true;
+}
+
+/* use the limits of a species profile, config keys may override them later */
+void MiFloraDevice::setSpecies(const SpeciesProfile_t * profile) {
+
+  static const SpeciesValue values[] = {
+    SPECIES_MOISTURE, SPECIES_TEMPERATURE, SPECIES_CONDUCTIVITY, SPECIES_ILLUMINANCE
+  };
+  DeviceAttribute * attributes[] = {
+    &moisture, &temperature, &conductivity, &illuminance
+  };
+
+  _species = profile;
+  if (profile == NULL)
+    return;
+
+  for (int i = 0; i < SPECIES_VALUES; i++) {
+    if (speciesHasMin(profile, values[i])) attributes[i]->setMin(profile->min[values[i]]);
+    if (speciesHasMax(profile, values[i])) attributes[i]->setMax(profile->max[values[i]]);
   }
 }
 
@@ -205,9 +647,35 @@ void MiFloraDevice::updateFromMQTT(const char * topic, uint8_t * _payload, unsig
 #undef LOG_TAG
 #define LOG_TAG LOG_TAG_FLEET
 
+MiFloraFleet::MiFloraFleet()
+  : _task_stale(TASK_SECOND, TASK_FOREVER, s_taskStaleCbk, &scheduler, false)
+  , _task_zones(TASK_SECOND, TASK_FOREVER, s_taskZonesCbk, &scheduler, false)
+  , _stale_last_tick(0) {
+}
+
 bool MiFloraFleet::begin(const char * filename) {
 
   ConfigFile config;
+
+  // start tracking stale devices
+  _stale_last_tick = millis();
+  _task_stale.enable();
+
+  // a single subscription for the values of all plants, each device
+  // routes the topics of its own attributes
+  if (::config.flora_mqtt_collaborate && ::config.flora_mqtt_collaborate_binary == false) {
+    std::string topic;
+    ::config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, "+", "+");
+
+    // warm started from the snapshot of a peer, the retained values are not needed
+    bool retained = ::config.snapshot_peer == NULL || *::config.snapshot_peer == '\0';
+    mqtt.subscribeTo(topic.c_str(), NULL, NULL, retained);
+
+    // states of other stations don't fit the default buffer
+    if (::config.flora_publish_state && mqtt.getBufferSize() < FLORA_STATE_BUFFER_SIZE)
+      mqtt.setBufferSize(FLORA_STATE_BUFFER_SIZE);
+  }
+
   LOG_F("Loading devices from: %s", filename);
 
   // load filename
@@ -220,11 +688,30 @@ bool MiFloraFleet::begin(const char * filename) {
   loadFromConfig(config);
   LOG_F("Loaded %d devices from '%s'", count(), filename);
 
+  // zone values are published at most as often as plant values
+  if (_zones.empty() == false) {
+    _task_zones.setInterval(::config.flora_publish_min_interval_sec * TASK_SECOND);
+    _task_zones.enable();
+  }
+
   // register to BLE to get new updates
   ble.setMifloraHandler(s_BLE_MiFloraHandler);
   return true;
 }
 
+/* no warm start from the peer, the retained values of the plants are asked from the broker after all */
+void MiFloraFleet::fetchRetained() {
+
+  if (::config.flora_mqtt_collaborate == false || ::config.flora_mqtt_collaborate_binary)
+    return;
+
+  std::string topic;
+  ::config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, "+", "+");
+
+  LOG_F("Subscribing again for the retained values: %s", topic.c_str());
+  mqtt.resubscribe(topic.c_str(), true);
+}
+
 void MiFloraFleet::loadFromConfig(ConfigFile & configDevices) {
 
    // load devices
@@ -243,6 +730,15 @@ void MiFloraFleet::loadFromConfig(ConfigFile & configDevices) {
     flora_device->setID(id);
     flora_device->setName(name);
 
+    // species profile first, the limits below override it
+    const char * species_key = configDevices.get((address + ":species").c_str());
+    if (species_key) {
+      const SpeciesProfile_t * profile = species.find(species_key);
+      flora_device->setSpecies(profile);
+
+      LOG_F(" - species %s%s", species_key, profile ? "" : " (not found)");
+    }
+
     // install limits
     const char * min_val;
     const char * max_val;
@@ -289,12 +785,66 @@ void MiFloraFleet::loadFromConfig(ConfigFile & configDevices) {
 
     LOG_F(" - RSSI limit %s", 
       min_val ? min_val : "n/a");
+
+    // zone
+    const char * zone_name = configDevices.get((address + ":zone").c_str());
+    if (zone_name) {
+      Zone * zone = findZone(zone_name);
+      if (zone == NULL) {
+        zone = new Zone(zone_name);
+        _zones.push_back(zone);
+      }
+      flora_device->setZone(zone, zone->addMember(flora_device));
+
+      LOG_F(" - zone %s", zone_name);
+    }
     
     // add to devices
     addDevice(flora_device);
   }
 }
 
+Zone * MiFloraFleet::findZone(const char * name) {
+  for (auto zone : _zones)
+    if (zone->getName().compare(name) == 0)
+      return zone;
+  return NULL;
+}
+
+/* (re)arm the expiration timer of a device */
+void MiFloraFleet::scheduleStale(TimerWheel::Timer * timer) {
+
+  if (config.flora_stale_sec == 0)
+    return;
+
+  _stale_wheel.schedule(timer, config.flora_stale_sec);
+}
+
+/* advance the wheel with the seconds passed since the last tick */
+void MiFloraFleet::taskStaleCbk() {
+
+  // keeps the uptime counter going past the wrap of millis()
+  wallclock.uptime();
+
+  unsigned long ticks = (millis() - _stale_last_tick) / 1000;
+  if (ticks == 0)
+    return;
+
+  _stale_last_tick += ticks * 1000;
+  _stale_wheel.advance(ticks);
+}
+
+/* publish the zones that changed */
+void MiFloraFleet::taskZonesCbk() {
+
+  if (mqtt.connected() == false)
+    return;
+
+  for (auto zone : _zones) {
+    zone->publish();
+  }
+}
+
 /* notification from BLE to interpret new data scans */
 void MiFloraFleet::s_BLE_MiFloraHandler(const BLE::MiFloraScanData_t & scanData) {
 
@@ -324,11 +874,20 @@ void MiFloraFleet::s_BLE_MiFloraHandler(const BLE::MiFloraScanData_t & scanData)
     LOG_F("New flora device: %s",flora_device->getAddress().c_str());
   }
 
+  // stations hearing the same plant agree on which one publishes it
+  collab.onHeard(flora_device, scanData.deviceRSSI);
+
+  // share new frames with other stations, before they update the values
+  if (flora_device->acceptFrame(result.frame_count)) {
+    collab.publish(flora_device, result, scanData.deviceRSSI);
+  }
+
   // update device attributes from BLE data
   flora_device->updateFromBLEScan(result);
   if (scanData.deviceRSSI != BLE_NO_RSSI) {
     flora_device->updateRSSI(scanData.deviceRSSI);
   }
+  flora_device->publishState();
   
   LOG_F("BLE updated device #%d %s (%s): ", 
     flora_device->getID(),
@@ -29,6 +29,13 @@
 #include "xiaomi.h"
 #include "config.h"
 #include "ble_tracker.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "forecast.h"
+#include "derived.h"
+#include "species_db.h"
+#include "ownership.h"
+#include "attribute_id.h"
 
 enum UpdateSource {
   SOURCE_NONE,
@@ -36,17 +43,9 @@ enum UpdateSource {
   SOURCE_MQTT
 };
 
-enum AttributeID {
-  ATTR_ID_MOISTURE,
-  ATTR_ID_TEMPERATURE,
-  ATTR_ID_CONDUCTIVITY,
-  ATTR_ID_ILLUMINANCE,
-  ATTR_ID_RSSI,
-  ATTR_ID_MAX,
-  ATTR_ID_NONE = ATTR_ID_MAX
-};
-
 class DeviceAttribute;
+class DeviceHistory;
+class Zone;
 
 class Device {
   public:
@@ -64,27 +63,40 @@ class DeviceAttribute {
       _source(SOURCE_NONE),
       _ID(id),
       _last_updated(0),
-      _has_value(false),_has_min(false),_has_max(false),
+      _has_value(false),_has_min(false),_has_max(false),_restored(false),
       _value(0)        , _value_min(0) , _value_max(0),
       _label(label) {
     }
 
-    void updated() {
-      _last_updated = millis();
+    /* a reading, taken age_ms ago when relayed by another station */
+    void updated(unsigned long age_ms = 0) {
+      _last_updated = millis() - age_ms;
       if (_device) {
         _device->onAttributeUpdate(this);
       }
     }
     
+    /* not a reading, so the time of the last one is kept for the publish throttle */
     void reset() { 
       _has_value = false;
+      _restored = false;
       _source = SOURCE_NONE;
-      updated();
+      if (_device) {
+        _device->onAttributeUpdate(this);
+      }
     }
 
     UpdateSource getSource() {
       return _source;
     }
+
+    AttributeID getID() {
+      return _ID;
+    }
+
+    Device * getDevice() {
+      return _device;
+    }
     
     bool hasValue() { 
         return _has_value; 
@@ -102,13 +114,27 @@ class DeviceAttribute {
       return (_now - _last_updated) > ms;
     }
     
-    bool set(const float v, UpdateSource source){ 
+    bool set(const float v, UpdateSource source, unsigned long age_ms = 0){ 
         _value = v; 
         _has_value = true;
         _source = source;
-        updated();
+        _restored = false;
+        updated(age_ms);
         return true;
     }
+
+    /* value from before a restart, with its age, not notified to the device */
+    void restore(const float v, UpdateSource source, unsigned long age_ms) {
+        _value = v;
+        _has_value = true;
+        _source = source;
+        _restored = true;
+        _last_updated = millis() - age_ms;
+    }
+
+    bool isRestored() {
+      return _restored;
+    }
     
     float get(float default_value) { 
         if (_has_value == false) {
@@ -147,6 +173,22 @@ class DeviceAttribute {
       _has_max = true;
     }
 
+    bool hasMin() {
+      return _has_min;
+    }
+
+    bool hasMax() {
+      return _has_max;
+    }
+
+    float getMin() {
+      return _value_min;
+    }
+
+    float getMax() {
+      return _value_max;
+    }
+
     void resetMin() {
       _has_min = false;
       _value_min = 0.0;
@@ -183,7 +225,7 @@ class DeviceAttribute {
     UpdateSource _source;
     AttributeID _ID;
     unsigned long _last_updated;
-    bool _has_value, _has_min, _has_max;
+    bool _has_value, _has_min, _has_max, _restored;
     float _value, _value_min, _value_max;
     const char * _label;
 };
@@ -194,16 +236,30 @@ class DeviceAttribute {
 class MiFloraDevice : public Device {
 
   public:
-    static const int ATTRIBUTES_COUNT = 5;
+    static const int ATTRIBUTES_COUNT = 7;
 
   public:
     MiFloraDevice(const std::string & addr);
   
     void                updateFromBLEScan(XiaomiParseResult & result);
     void                updateRSSI(int rssi);
+    void                publishState();
+    bool                acceptFrame(uint8_t frame);
+    PlantOwnership &    ownership();
+    bool                publishes();
+    bool                isAvailable();
+    DeviceHistory *     history();
+    WateringForecast &  forecast();
+    Zone *              getZone();
+    void                setZone(Zone * zone, int slot);
+    int                 getAlertSlot();
+    void                setAlertSlot(int slot);
+    const SpeciesProfile_t * getSpecies();
+    void                setSpecies(const SpeciesProfile_t * profile);
 
     const std::string & getAddress();
     std::string         getAddressCompressed();
+    uint64_t            getMAC();
     int                 getID();
     void                setID(int id);
     const std::string & getName();
@@ -216,6 +272,7 @@ class MiFloraDevice : public Device {
     int                 attributeIndex(DeviceAttribute * attr);
     DeviceAttribute *   attributeByID(AttributeID ID);
     void                onAttributeUpdate(DeviceAttribute * attr);
+    void                onRestored();
 
   public:
     DeviceAttribute conductivity;
@@ -223,15 +280,46 @@ class MiFloraDevice : public Device {
     DeviceAttribute moisture;
     DeviceAttribute illuminance;
     DeviceAttribute RSSI;
+    DeviceAttribute dli;
+    DeviceAttribute vpd;
 
   private:
     unsigned long _last_updated;
     int _id;
+    uint64_t _mac;
     std::string _address;
     std::string _name;
+    bool _available, _availability_dirty;
+    TimerWheel::Timer _stale_timer;
+    DeviceHistory * _history;
+    bool _history_refused;
+    WateringForecast _forecast;
+    int32_t _forecast_published_hours;
+    DerivedMetrics _derived;
+    Zone * _zone;
+    int _zone_slot;
+    int _alert_slot;
+    const SpeciesProfile_t * _species;
+    unsigned long _state_published;
+    unsigned long _frame_time;
+    uint8_t _frame;
+    bool _has_frame;
+    uint16_t _topic;
+    PlantOwnership _ownership;
+
+    bool publishValue(const char * level, const char * value, size_t len, bool diagnostic = false);
+    void logValue(const char * source, DeviceAttribute & attr, const char * value);
+    void updateFromMQTT(DeviceAttribute * attr, uint8_t * payload, unsigned int len);
+    void updateFromMQTTState(uint8_t * payload, unsigned int len);
+    void setAvailable(bool available);
+    void updateForecast();
+    void updateDerived(DeviceAttribute * attr);
+    void setDerived(DeviceAttribute & attr, float value, UpdateSource source, const char * level);
+    void onStale();
 
-    void updateFromMQTT(const char * topic, uint8_t * payload, unsigned int len);
     static void s_onMQTTMessage(const char * topic, uint8_t * payload, unsigned int len, void * param);
+    static void s_onMQTTState(const char * topic, uint8_t * payload, unsigned int len, void * param);
+    static void s_onStale(void * param);
 };
 
 /* inlines for MiFloraDevice */
@@ -253,6 +341,54 @@ inline unsigned long MiFloraDevice::lastUpdated() {
   return _last_updated;
 }
 
+inline bool MiFloraDevice::isAvailable() {
+  return _available;
+}
+
+inline DeviceHistory * MiFloraDevice::history() {
+  return _history;
+}
+
+inline WateringForecast & MiFloraDevice::forecast() {
+  return _forecast;
+}
+
+inline Zone * MiFloraDevice::getZone() {
+  return _zone;
+}
+
+inline void MiFloraDevice::setZone(Zone * zone, int slot) {
+  _zone      = zone;
+  _zone_slot = slot;
+}
+
+/* index of the plant's rule states in the alert rules, -1 until evaluated */
+inline int MiFloraDevice::getAlertSlot() {
+  return _alert_slot;
+}
+
+inline void MiFloraDevice::setAlertSlot(int slot) {
+  _alert_slot = slot;
+}
+
+inline PlantOwnership & MiFloraDevice::ownership() {
+  return _ownership;
+}
+
+/* readings of a plant heard by more collaborating stations are published by its owner */
+inline bool MiFloraDevice::publishes() {
+  return config.flora_mqtt_collaborate == false || _ownership.isOwner();
+}
+
+inline const SpeciesProfile_t * MiFloraDevice::getSpecies() {
+  return _species;
+}
+
+/* the 48 bits of the address as a number, key of the device in compact records */
+inline uint64_t MiFloraDevice::getMAC() {
+  return _mac;
+}
+
 inline int MiFloraDevice::getID() {
   return _id;
 }
@@ -270,7 +406,7 @@ inline void MiFloraDevice::setName(const char * name) {
 }
 
 inline unsigned int MiFloraDevice::attributeCount() {
-  return 5;
+  return ATTRIBUTES_COUNT;
 }
 
 inline DeviceAttribute * MiFloraDevice::attributeAt(unsigned int index) {
@@ -281,6 +417,8 @@ inline DeviceAttribute * MiFloraDevice::attributeAt(unsigned int index) {
     case 2: return &conductivity;
     case 3: return &illuminance;
     case 4: return &RSSI;
+    case 5: return &dli;
+    case 6: return &vpd;
   }
   return NULL;
 }
@@ -292,6 +430,8 @@ inline int MiFloraDevice::attributeIndex(DeviceAttribute * attr) {
   if (attr == &conductivity) return 2;
   if (attr == &illuminance ) return 3;
   if (attr == &RSSI        ) return 4;
+  if (attr == &dli         ) return 5;
+  if (attr == &vpd         ) return 6;
   return -1;
 }
 
@@ -301,15 +441,22 @@ inline DeviceAttribute * MiFloraDevice::attributeByID(AttributeID id) {
   if (id == ATTR_ID_CONDUCTIVITY) return &conductivity;
   if (id == ATTR_ID_ILLUMINANCE ) return &illuminance;
   if (id == ATTR_ID_RSSI        ) return &RSSI;
+  if (id == ATTR_ID_DLI         ) return &dli;
+  if (id == ATTR_ID_VPD         ) return &vpd;
   return NULL;
 }
 
-inline void MiFloraDevice::onAttributeUpdate(DeviceAttribute * attr) {
-  _last_updated = millis();
+inline void MiFloraDevice::s_onMQTTMessage(const char * topic, uint8_t * payload, unsigned int len, void * param) {
+  DeviceAttribute * attr = (DeviceAttribute *) param;
+  ((MiFloraDevice*) attr->getDevice())->updateFromMQTT(attr, payload, len);
 }
 
-inline void MiFloraDevice::s_onMQTTMessage(const char * topic, uint8_t * payload, unsigned int len, void * param) {
-  ((MiFloraDevice*)param)->updateFromMQTT(topic, payload, len);
+inline void MiFloraDevice::s_onMQTTState(const char * topic, uint8_t * payload, unsigned int len, void * param) {
+  ((MiFloraDevice*)param)->updateFromMQTTState(payload, len);
+}
+
+inline void MiFloraDevice::s_onStale(void * param) {
+  ((MiFloraDevice*)param)->onStale();
 }
 
 /*
@@ -317,6 +464,7 @@ inline void MiFloraDevice::s_onMQTTMessage(const char * topic, uint8_t * payload
  */
 class MiFloraFleet {
   public:
+    MiFloraFleet();
 
     bool begin(const char * filename);
 
@@ -326,13 +474,31 @@ class MiFloraFleet {
     MiFloraDevice * findByAddress(const char * address);
     MiFloraDevice * findByName(const char * name);
     MiFloraDevice * findByID(int id);
+    MiFloraDevice * findByMAC(uint64_t mac);
     MiFloraDevice * atIndex(int idx);
 
     const std::vector<MiFloraDevice *> & devices();
     const unsigned int count();
 
+    Zone * findZone(const char * name);
+    const std::vector<Zone *> & zones();
+
+    void scheduleStale(TimerWheel::Timer * timer);
+    void fetchRetained();
+
   private:
     std::vector<MiFloraDevice *> _devices;
+    std::vector<Zone *> _zones;
+    TimerWheel _stale_wheel;
+    Task _task_stale;
+    Task _task_zones;
+    unsigned long _stale_last_tick;
+
+    void taskStaleCbk();
+    void taskZonesCbk();
+
+    static void s_taskStaleCbk();
+    static void s_taskZonesCbk();
     static void s_BLE_MiFloraHandler(const BLE::MiFloraScanData_t & scanData);
 };
 
@@ -361,6 +527,13 @@ inline MiFloraDevice* MiFloraFleet::atIndex(int idx) {
   return _devices.at(idx);
 }
 
+inline MiFloraDevice * MiFloraFleet::findByMAC(uint64_t mac) {
+  for (auto device : _devices)
+    if (device->getMAC() == mac)
+      return device;
+  return NULL;
+}
+
 inline MiFloraDevice * MiFloraFleet::findByID(int id) {
   for (auto device : _devices)
     if (device->getID() == id)
@@ -376,6 +549,18 @@ inline const unsigned int MiFloraFleet::count() {
   return (unsigned int) _devices.size();
 }
 
+inline const std::vector<Zone *> & MiFloraFleet::zones() {
+  return _zones;
+}
+
 extern MiFloraFleet fleet;
 
+inline void MiFloraFleet::s_taskStaleCbk() {
+  fleet.taskStaleCbk();
+}
+
+inline void MiFloraFleet::s_taskZonesCbk() {
+  fleet.taskZonesCbk();
+}
+
 #endif//_DEVICE_H_
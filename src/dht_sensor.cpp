@@ -25,6 +25,7 @@
 #include "dht_sensor.h"
 #include "config.h"
 #include "mqtt.h"
+#include "number_format.h"
 
 #define LOG_TAG LOG_TAG_DHT
 #include "log.h"
@@ -36,7 +37,9 @@ DHTSensor::DHTSensor()
     , taskUpdate(5000, TASK_FOREVER, s_taskUpdateCbk, &scheduler, false)
     , lastTemp(.0f)
     , lastHum(0)
-    , lastPublish(0) {
+    , lastValid(false)
+    , lastPublish(0)
+    , topic(TopicArena::INVALID) {
 }
 
 bool DHTSensor::begin() {
@@ -56,8 +59,16 @@ bool DHTSensor::begin() {
     // this will be read from cache anyway
     lastTemp = readTemperature(false, false);
     lastHum  = readHumidity(false);
+    lastValid = true;
     lastPublish = millis()/1000;
 
+    // topics are "<base>/temperature" and "<base>/humidity"
+    if (topic == TopicArena::INVALID) {
+        std::string prefix;
+        config.formatTopic(prefix, ConfigMain::MQTT_TOPIC_DHT_SENSOR, "");
+        topic = mqtt.topics().add(prefix.c_str(), MQTT_TOPIC_LEVEL_MAX);
+    }
+
     // start periodic updates
     taskUpdate.restartDelayed();
 
@@ -66,7 +77,8 @@ bool DHTSensor::begin() {
 
 void DHTSensor::taskUpdateCbk() {
 
-    char val[12];
+    char temp_val[NUMBER_FORMAT_SIZE];
+    char hum_val[NUMBER_FORMAT_SIZE];
     auto now = millis()/1000;
 
     // attempt to read by force
@@ -79,22 +91,30 @@ void DHTSensor::taskUpdateCbk() {
     auto temp = (float  ) readTemperature(false, false);
     auto  hum = (uint8_t) readHumidity(false);
 
-    // publish to MQTT
-    LOG_F("Temp: %.2fC Hum: %u%% Last publish: %lus Retain: %s",
-         temp, hum, (now - lastPublish), config.dht_mqtt_retain ? "yes" : "no");
+    size_t temp_len = NumberFormat::formatFixed(temp_val, temp, 2);
+    size_t hum_len  = NumberFormat::formatUInt(hum_val, hum);
 
+    // logged in pieces, without printf and its buffers
+    LOG_PART_START("Temp: ");
+    LOG_PART(temp_val);
+    LOG_PART("C Hum: ");
+    LOG_PART(hum_val);
+    LOG_PART("% Last publish: ");
+    LOG_PART(now - lastPublish);
+    LOG_PART("s Retain: ");
+    LOG_PART_END(config.dht_mqtt_retain ? "yes" : "no");
+
+    // publish to MQTT
     if ( (now - lastPublish)  > config.dht_publish_min_interval_sec) {
-        std::string topic;
+        const char * path;
 
         // temperature
-        sprintf(val, "%.2f", temp);
-        config.formatTopic(topic, ConfigMain::MQTT_TOPIC_DHT_SENSOR, "temperature");
-        mqtt.publish(topic.c_str(), val, config.dht_mqtt_retain);
+        if ((path = mqtt.topics().topic(topic, "temperature")) != NULL)
+            mqtt.publish(path, (const uint8_t *) temp_val, temp_len, config.dht_mqtt_retain);
 
         // humidity
-        sprintf(val, "%u", hum);
-        config.formatTopic(topic, ConfigMain::MQTT_TOPIC_DHT_SENSOR, "humidity");
-        mqtt.publish(topic.c_str(), val, config.dht_mqtt_retain);
+        if ((path = mqtt.topics().topic(topic, "humidity")) != NULL)
+            mqtt.publish(path, (const uint8_t *) hum_val, hum_len, config.dht_mqtt_retain);
 
         lastPublish = now;
     }
@@ -102,4 +122,5 @@ void DHTSensor::taskUpdateCbk() {
     // update
     lastTemp = temp;
     lastHum  = hum;
+    lastValid = true;
 }
@@ -38,6 +38,7 @@ class DHTSensor : protected DHT {
 
         bool begin();
 
+        bool          hasValues();
         float         temperature();
         uint8_t       humidity();
 
@@ -45,7 +46,9 @@ class DHTSensor : protected DHT {
         Task    taskUpdate;
         float   lastTemp;
         uint8_t lastHum;
+        bool    lastValid;
         unsigned long lastPublish;
+        uint16_t      topic;
 
         void taskUpdateCbk();
         static void s_taskUpdateCbk();
@@ -54,6 +57,9 @@ class DHTSensor : protected DHT {
 extern DHTSensor dht;
 
 /* inlines for DHTSensor */
+inline bool DHTSensor::hasValues() {
+    return lastValid;
+}
 inline float DHTSensor::temperature() {
     return lastTemp;
 }
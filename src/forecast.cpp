@@ -0,0 +1,105 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <math.h>
+
+#include "forecast.h"
+#include "config.h"
+
+WateringForecast::WateringForecast() {
+  reset();
+}
+
+void WateringForecast::reset() {
+  s0 = st = sm = stt = stm = 0;
+  start_time = last_time = 0;
+  last_value = 0;
+  count      = 0;
+  valid      = false;
+  rate       = 0;
+  dry_time   = 0;
+}
+
+/* add a moisture sample and recompute the prediction, returns isValid() */
+bool WateringForecast::add(uint32_t time, float moisture, float limit) {
+
+  float dt, den, intercept, t_cross;
+
+  // watered, drying starts over
+  if (count && moisture - last_value >= config.flora_watering_jump) {
+    reset();
+  }
+
+  if (count == 0) {
+    start_time = time;
+  } else {
+    // move the origin to this sample, t becomes t - dt for the old samples,
+    // so the sums keep small magnitudes no matter how long the fit runs
+    dt   = (float) (time - last_time) / 3600.0f;
+    stt += dt * (dt * s0 - 2 * st);
+    stm -= dt * sm;
+    st  -= dt * s0;
+
+    // fade the old samples according to the time passed
+    float decay = expf(-dt / config.flora_forecast_tau_hours);
+    s0  *= decay;
+    st  *= decay;
+    sm  *= decay;
+    stt *= decay;
+    stm *= decay;
+  }
+
+  // the new sample is at t = 0
+  s0  += 1;
+  sm  += moisture;
+
+  last_time  = time;
+  last_value = moisture;
+  if (count < 0xFFFF) ++ count;
+
+  valid = false;
+
+  // not enough data for a meaningful fit
+  if (count < FORECAST_MIN_SAMPLES || time - start_time < FORECAST_MIN_SPAN_SEC)
+    return false;
+
+  den = s0 * stt - st * st;
+  if (den <= 0)
+    return false;
+
+  rate      = (s0 * stm - st * sm) / den;
+  intercept = (sm - rate * st) / s0;
+
+  // not drying, nothing to predict
+  if (rate > -FORECAST_MIN_RATE)
+    return false;
+
+  // hours from now when the limit is crossed
+  t_cross = (limit - intercept) / rate;
+
+  dry_time = (t_cross > 0) ? time + (uint32_t) (t_cross * 3600.0f) : time;
+  valid    = true;
+  return true;
+}
@@ -0,0 +1,88 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _FORECAST_H_
+#define _FORECAST_H_
+
+#include <stdint.h>
+#include <firmware_config.h>
+
+/*
+ * Forecast of when a plant needs watering.
+ *
+ * Keeps an exponentially weighted least squares fit of moisture over time,
+ * in O(1) state: older samples fade away with a time constant, so the fit
+ * follows the current drying rate. A sharp rise in moisture is taken as a
+ * watering and the fit starts over.
+ *
+ * Times are uptime seconds.
+ */
+class WateringForecast {
+
+  public:
+    WateringForecast();
+
+    void     reset();
+    bool     add(uint32_t time, float moisture, float limit);
+
+    bool     isValid();
+    float    slope();
+    uint32_t dryTime();
+    uint32_t secondsLeft(uint32_t now);
+
+  protected:
+    /* weighted sums, times are in hours relative to the last sample */
+    float    s0, st, sm, stt, stm;
+    uint32_t start_time;
+    uint32_t last_time;
+    float    last_value;
+    uint16_t count;
+
+    /* last prediction */
+    bool     valid;
+    float    rate;
+    uint32_t dry_time;
+};
+
+/* inlines for WateringForecast */
+inline bool WateringForecast::isValid() {
+  return valid;
+}
+
+/* moisture change in % per hour */
+inline float WateringForecast::slope() {
+  return rate;
+}
+
+/* uptime second when moisture crosses the limit */
+inline uint32_t WateringForecast::dryTime() {
+  return dry_time;
+}
+
+inline uint32_t WateringForecast::secondsLeft(uint32_t now) {
+  return (int32_t) (dry_time - now) > 0 ? dry_time - now : 0;
+}
+
+#endif//_FORECAST_H_
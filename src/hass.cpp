@@ -30,6 +30,8 @@
 #include "version.h"
 #include "config.h"
 #include "led_strip.h"
+#include "alerts.h"
+#include "collab.h"
 
 #define LOG_TAG LOG_TAG_HASS
 #include "log.h"
@@ -41,7 +43,9 @@ HomeAssistant hass;
 HomeAssistant::HomeAssistant() 
     : taskDiscover(120 * TASK_SECOND, TASK_ONCE, s_taskDiscoverCbk, &scheduler, false)
     , bufferFormat(NULL)
-    , mqttBufferSize(0) {
+    , mqttBufferSize(0)
+    , discoveryIndex(0)
+    , discoveryResume(0) {
 
 }
 
@@ -54,7 +58,8 @@ bool HomeAssistant::begin() {
 
 void HomeAssistant::restart() {
 
-    // restart discover task
+    // restart discover task, from the start
+    discoveryResume = 0;
     taskDiscover.restart();
 }
 
@@ -104,7 +109,7 @@ void HomeAssistant::freeBuffer() {
     }
 }
 
-std::string HomeAssistant::getDeviceID(DeviceIDType type) {
+std::string HomeAssistant::getDeviceID(DeviceIDType type, Zone * zone) {
 
     std::string device_id;
 
@@ -129,6 +134,12 @@ std::string HomeAssistant::getDeviceID(DeviceIDType type) {
             device_id.assign("miflora_rbs_");
             device_id.append(config.station_name);
         }
+    } else
+    // each zone is a device of its own, next to the central one
+    if (type == DEVICE_ID_ZONE && zone != NULL) {
+        device_id = getDeviceID(DEVICE_ID_CENTRAL);
+        device_id.append("_zone_");
+        device_id.append(zone->getID());
     } else {
         // should not happen
         LOG_F("unknown device type (%d)!!!", (int) type);
@@ -137,14 +148,14 @@ std::string HomeAssistant::getDeviceID(DeviceIDType type) {
     return device_id;
 }
 
-std::string HomeAssistant::jsonGetDevice(DeviceIDType device) {
+std::string HomeAssistant::jsonGetDevice(DeviceIDType device, Zone * zone) {
 
     std::string json;
     std::string device_id;
     std::string suggested_area;
 
     // setup device id
-    device_id   = getDeviceID(device);
+    device_id   = getDeviceID(device, zone);
 
     if (device == DEVICE_ID_STATION) {
         if (config.hass_station_suggested_area) {
@@ -154,6 +165,13 @@ std::string HomeAssistant::jsonGetDevice(DeviceIDType device) {
         }
     }
 
+    // zones are usually rooms
+    if (device == DEVICE_ID_ZONE && zone != NULL) {
+        suggested_area.assign(" \"suggested_area\": \"");
+        suggested_area.append(zone->getName());
+        suggested_area.append("\"," ENDL);
+    }
+
     snprintf(
         bufferFormat, bufferSize, 
         "\"device\": {" ENDL
@@ -194,7 +212,7 @@ std::string HomeAssistant::baseMiFloraEntityName(MiFloraDevice * device) {
     return entity_name;
 }
 
-std::string HomeAssistant::getDiscoveryTopic(DeviceIDType device, const char * componentType, const char * _entityName) {
+std::string HomeAssistant::getDiscoveryTopic(DeviceIDType device, const char * componentType, const char * _entityName, Zone * zone) {
 
     std::string topic;
     std::string entityName(_entityName);
@@ -208,7 +226,7 @@ std::string HomeAssistant::getDiscoveryTopic(DeviceIDType device, const char * c
     topic.append("/");
 
     // node id
-    topic.append(getDeviceID(device));
+    topic.append(getDeviceID(device, zone));
     topic.append("/");
 
     // device name (object_id)
@@ -252,15 +270,6 @@ std::string HomeAssistant::jsonDHTSensor(bool temperature, std::string & entity_
     unique_id   = entity_name;
     std::replace(unique_id.begin(), unique_id.end(), ' ', '_');
 
-    //
-    // Note; 
-    //       Flora attributes don't (yet) have an availability topic.
-    //       We can't use station's availability topic, because multiple 
-    //       stations could collaborate for publishing the same plant.
-    //       If one goes offline, the plant could still be monitored by 
-    //       other station.
-    //
-
     // format discovery string
     snprintf(
         bufferFormat, bufferSize,
@@ -290,9 +299,11 @@ std::string HomeAssistant::jsonMiFloraAttribute(MiFloraDevice * flora_device, At
     std::string availability_topic;
     std::string state_topic;
     std::string unique_id;
+    std::string value_template;
     
     const char * unit = NULL;
     const char * icon = NULL;
+    const char * topic_name = NULL;
     const char * flora_address = flora_device->getAddress().c_str();
 
     // prepare the base for this entity name
@@ -303,8 +314,14 @@ std::string HomeAssistant::jsonMiFloraAttribute(MiFloraDevice * flora_device, At
     unique_id.append(flora_device->getAddressCompressed().c_str());
     unique_id.append("_");
 
-    // prepare availability topic
-    config.formatTopic(availability_topic, ConfigMain::MQTT_TOPIC_AVAILABILITY);
+    //
+    // Note; 
+    //       We can't use station's availability topic, because multiple 
+    //       stations could collaborate for publishing the same plant.
+    //       If one goes offline, the plant could still be monitored by 
+    //       other station. Each plant has its own availability topic instead.
+    //
+    config.formatTopic(availability_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "availability");
 
     // prepare attributes
     switch (attr_id) {
@@ -313,56 +330,269 @@ std::string HomeAssistant::jsonMiFloraAttribute(MiFloraDevice * flora_device, At
             unit = "%";
             entity_name.append(" moisture");
             unique_id.append("moisture");
-            config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "moisture");
+            topic_name = "moisture";
         } break;
         case ATTR_ID_TEMPERATURE: {
             icon = "mdi:thermometer";
             unit = "ºC";
             entity_name.append(" temperature");
             unique_id.append("temperature");
-            config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "temp");
+            topic_name = "temp";
         } break;
         case ATTR_ID_CONDUCTIVITY: {
             icon = "mdi:sprout";
             unit = "uS/cm";
             entity_name.append(" conductivity");
             unique_id.append("conductivity");
-            config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "conductivity");
+            topic_name = "conductivity";
         } break;
         case ATTR_ID_ILLUMINANCE: {
             icon = "mdi:sun-wireless";
             unit = "lux";
             entity_name.append(" light");
             unique_id.append("light");
-            config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "light");
+            topic_name = "light";
         } break;
         case ATTR_ID_RSSI: {
             icon = "mdi:signal";
             unit = "dB";
             entity_name.append(" rssi");
             unique_id.append("rssi");
-            config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "rssi");
+            topic_name = "rssi";
+        } break;
+        case ATTR_ID_DLI: {
+            icon = "mdi:white-balance-sunny";
+            unit = "mol/m²/d";
+            entity_name.append(" dli");
+            unique_id.append("dli");
+            topic_name = "dli";
+        } break;
+        case ATTR_ID_VPD: {
+            icon = "mdi:water-thermometer";
+            unit = "kPa";
+            entity_name.append(" vpd");
+            unique_id.append("vpd");
+            topic_name = "vpd";
         } break;
         default: 
             // should not happen
             return json;
     }
 
+    // in state mode, values are taken out of the JSON state of the plant
+    if (config.flora_publish_state) {
+        config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "state");
+        value_template.assign("\"value_template\": \"{{ value_json.");
+        value_template.append(topic_name);
+        value_template.append(" if '");
+        value_template.append(topic_name);
+        value_template.append("' in value_json else this.state }}\"," ENDL);
+    } else {
+        config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, topic_name);
+    }
+
     // format discovery string
     snprintf(
         bufferFormat, bufferSize,
+        "%s"
         "\"unit_of_measurement\": \"%s\"," ENDL
         "\"icon\": \"%s\"," ENDL
         "\"name\": \"%s\"," ENDL
         "\"state_topic\": \"%s\"," ENDL
         "\"availability_topic\": \"%s\"," ENDL
+        "\"payload_available\": \"%s\"," ENDL
+        "\"payload_not_available\": \"%s\"," ENDL
         "\"unique_id\": \"%s\"" ENDL
         ,
+        value_template.c_str(),
         unit, 
         icon,
         entity_name.c_str(),
         state_topic.c_str(),
         availability_topic.c_str(),
+        config.station_payload_online,
+        config.station_payload_offline,
+        unique_id.c_str()
+    );
+
+    json.assign(bufferFormat);
+    return json;
+}
+
+std::string HomeAssistant::jsonMiFloraForecast(MiFloraDevice * flora_device, std::string & entity_name) {
+
+    std::string json;
+    std::string availability_topic;
+    std::string state_topic;
+    std::string unique_id;
+
+    const char * flora_address = flora_device->getAddress().c_str();
+
+    entity_name = baseMiFloraEntityName(flora_device);
+    entity_name.append(" water in");
+
+    unique_id.assign("miflorarbs_");
+    unique_id.append(flora_device->getAddressCompressed().c_str());
+    unique_id.append("_water_in");
+
+    config.formatTopic(availability_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "availability");
+    config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "water_in");
+
+    // format discovery string
+    snprintf(
+        bufferFormat, bufferSize,
+        "\"device_class\": \"duration\"," ENDL
+        "\"unit_of_measurement\": \"h\"," ENDL
+        "\"icon\": \"mdi:watering-can\"," ENDL
+        "\"name\": \"%s\"," ENDL
+        "\"state_topic\": \"%s\"," ENDL
+        "\"availability_topic\": \"%s\"," ENDL
+        "\"payload_available\": \"%s\"," ENDL
+        "\"payload_not_available\": \"%s\"," ENDL
+        "\"unique_id\": \"%s\"" ENDL
+        ,
+        entity_name.c_str(),
+        state_topic.c_str(),
+        availability_topic.c_str(),
+        config.station_payload_online,
+        config.station_payload_offline,
+        unique_id.c_str()
+    );
+
+    json.assign(bufferFormat);
+    return json;
+}
+
+std::string HomeAssistant::jsonMiFloraOwner(MiFloraDevice * flora_device, std::string & entity_name) {
+
+    std::string json;
+    std::string state_topic;
+    std::string unique_id;
+
+    entity_name = baseMiFloraEntityName(flora_device);
+    entity_name.append(" owner");
+
+    unique_id.assign("miflorarbs_");
+    unique_id.append(flora_device->getAddressCompressed().c_str());
+    unique_id.append("_owner");
+
+    // published by the station owning the plant, it has no availability
+    config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_device->getAddress().c_str(), "owner");
+
+    // format discovery string
+    snprintf(
+        bufferFormat, bufferSize,
+        "\"entity_category\": \"diagnostic\"," ENDL
+        "\"icon\": \"mdi:access-point\"," ENDL
+        "\"name\": \"%s\"," ENDL
+        "\"state_topic\": \"%s\"," ENDL
+        "\"unique_id\": \"%s\"" ENDL
+        ,
+        entity_name.c_str(),
+        state_topic.c_str(),
+        unique_id.c_str()
+    );
+
+    json.assign(bufferFormat);
+    return json;
+}
+
+std::string HomeAssistant::jsonMiFloraAlert(MiFloraDevice * flora_device, unsigned int rule, std::string & entity_name) {
+
+    std::string json;
+    std::string availability_topic;
+    std::string state_topic;
+    std::string unique_id;
+
+    const char * flora_address = flora_device->getAddress().c_str();
+    const std::string & rule_name = alerts.ruleName(rule);
+
+    entity_name = baseMiFloraEntityName(flora_device);
+    entity_name.append(" ");
+    entity_name.append(rule_name);
+
+    unique_id.assign("miflorarbs_");
+    unique_id.append(flora_device->getAddressCompressed().c_str());
+    unique_id.append("_alert_");
+    unique_id.append(rule_name);
+
+    config.formatTopic(availability_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, "availability");
+    config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, flora_address, ("alert/" + rule_name).c_str());
+
+    // format discovery string
+    snprintf(
+        bufferFormat, bufferSize,
+        "\"device_class\": \"problem\"," ENDL
+        "\"name\": \"%s\"," ENDL
+        "\"state_topic\": \"%s\"," ENDL
+        "\"availability_topic\": \"%s\"," ENDL
+        "\"payload_available\": \"%s\"," ENDL
+        "\"payload_not_available\": \"%s\"," ENDL
+        "\"unique_id\": \"%s\"" ENDL
+        ,
+        entity_name.c_str(),
+        state_topic.c_str(),
+        availability_topic.c_str(),
+        config.station_payload_online,
+        config.station_payload_offline,
+        unique_id.c_str()
+    );
+
+    json.assign(bufferFormat);
+    return json;
+}
+
+std::string HomeAssistant::jsonZoneValue(Zone * zone, const char * value, std::string & entity_name) {
+
+    std::string json;
+    std::string state_topic;
+    std::string unique_id;
+    std::string subtopic("zone/");
+
+    const char * unit = NULL;
+    const char * icon = NULL;
+
+    subtopic.append(zone->getID());
+
+    entity_name = getDeviceID(DEVICE_ID_ZONE, zone);
+    entity_name.append(" ");
+    entity_name.append(value);
+
+    unique_id.assign("miflorarbs_zone_");
+    unique_id.append(zone->getID());
+    unique_id.append("_");
+    unique_id.append(value);
+
+    config.formatTopic(state_topic, ConfigMain::MQTT_TOPIC_FLORA, subtopic.c_str(), value);
+
+    if (strncmp(value, "moisture", 8) == 0) {
+        icon = "mdi:water";
+        unit = "%";
+    } else
+    if (strcmp(value, "out_of_limits") == 0) {
+        icon = "mdi:alert";
+        unit = "plants";
+    } else {
+        icon = "mdi:sleep";
+        unit = "plants";
+    }
+
+    //
+    // Zones have no availability topic: each value is computed by every
+    // station from the plants it knows of.
+    //
+    snprintf(
+        bufferFormat, bufferSize,
+        "\"unit_of_measurement\": \"%s\"," ENDL
+        "\"icon\": \"%s\"," ENDL
+        "\"name\": \"%s\"," ENDL
+        "\"state_topic\": \"%s\"," ENDL
+        "\"unique_id\": \"%s\"" ENDL
+        ,
+        unit,
+        icon,
+        entity_name.c_str(),
+        state_topic.c_str(),
         unique_id.c_str()
     );
 
@@ -512,10 +742,10 @@ std::string HomeAssistant::jsonNeopixel(std::string & entity_name) {
     return json;
 }
 
-bool HomeAssistant::publishMQTTComponent(DeviceIDType device, const char * componentType, const char * entityName, const char * entityJSON) {
+bool HomeAssistant::publishMQTTComponent(DeviceIDType device, const char * componentType, const char * entityName, const char * entityJSON, Zone * zone) {
     
-    std::string deviceJSON     = jsonGetDevice(device);
-    std::string discoveryTopic = getDiscoveryTopic(device, componentType, entityName);
+    std::string deviceJSON     = jsonGetDevice(device, zone);
+    std::string discoveryTopic = getDiscoveryTopic(device, componentType, entityName, zone);
 
     // prepare payload
     snprintf(
@@ -539,12 +769,20 @@ bool HomeAssistant::publishJSONPayload(const char * discoveryTopic) {
     
     bool publish_ok;
 
-    // do publish
+    // queued by the pass that was interrupted
+    if (discoveryIndex ++ < discoveryResume)
+        return true;
+
+    // queue with the lowest priority, refused while the discovery queue is full
     publish_ok = mqtt.publish(
         discoveryTopic, 
         (uint8_t *) bufferFormat, 
         (unsigned int) strlen(bufferFormat), 
-        config.hass_mqtt_retain);
+        config.hass_mqtt_retain,
+        MQTT::PRIORITY_DISCOVERY);
+
+    if (publish_ok == false)
+        discoveryResume = discoveryIndex - 1;
 
     // debug
     LOG_F("%s%s %s",
@@ -565,7 +803,9 @@ bool HomeAssistant::mqttPublishDiscovery_MiFlora(MiFloraDevice * device) {
         ATTR_ID_TEMPERATURE,
         ATTR_ID_CONDUCTIVITY,
         ATTR_ID_ILLUMINANCE,
-        ATTR_ID_RSSI
+        ATTR_ID_RSSI,
+        ATTR_ID_DLI,
+        ATTR_ID_VPD
     };
 
     LOG_F("Publishing Flora #%d %s (%s)", 
@@ -580,14 +820,68 @@ bool HomeAssistant::mqttPublishDiscovery_MiFlora(MiFloraDevice * device) {
         publish_ok = publishMQTTComponent(DEVICE_ID_CENTRAL, "sensor", entityName.c_str(), entityJson.c_str());
         if (publish_ok == false)
             break;
-        
-        // give it some time
-        delay(100);
+    }
+
+    // watering forecast, only for plants with a moisture limit
+    if (publish_ok && device->moisture.hasMin()) {
+
+        std::string entityName;
+        std::string entityJson = jsonMiFloraForecast(device, entityName);
+
+        publish_ok = publishMQTTComponent(DEVICE_ID_CENTRAL, "sensor", entityName.c_str(), entityJson.c_str());
+    }
+
+    // alert rules that watch this plant
+    for (unsigned int rule = 0; publish_ok && rule < alerts.count(); ++ rule) {
+
+        if (alerts.appliesTo(rule, device) == false)
+            continue;
+
+        std::string entityName;
+        std::string entityJson = jsonMiFloraAlert(device, rule, entityName);
+
+        publish_ok = publishMQTTComponent(DEVICE_ID_CENTRAL, "binary_sensor", entityName.c_str(), entityJson.c_str());
+    }
+
+    // station publishing the plant, when stations arbitrate
+    if (publish_ok && collab.isEnabled()) {
+
+        std::string entityName;
+        std::string entityJson = jsonMiFloraOwner(device, entityName);
+
+        publish_ok = publishMQTTComponent(DEVICE_ID_CENTRAL, "sensor", entityName.c_str(), entityJson.c_str());
     }
     
     return publish_ok;
 }
 
+bool HomeAssistant::mqttPublishDiscovery_Zone(Zone * zone) {
+
+    bool publish_ok = true;
+
+    const char * values [] = {
+        "moisture_mean",
+        "moisture_min",
+        "out_of_limits",
+        "stale"
+    };
+
+    LOG_F("Publishing zone %s (%u plants)", 
+        zone->getName().c_str(), zone->memberCount());
+
+    for (int idx = 0 ; idx < sizeof(values)/sizeof(values[0]); ++ idx) {
+
+        std::string entityName;
+        std::string entityJson = jsonZoneValue(zone, values[idx], entityName);
+
+        publish_ok = publishMQTTComponent(DEVICE_ID_ZONE, "sensor", entityName.c_str(), entityJson.c_str(), zone);
+        if (publish_ok == false)
+            break;
+    }
+
+    return publish_ok;
+}
+
 bool HomeAssistant::mqttPublishDiscovery_DHT() {
 
     bool publish_ok = true;
@@ -605,7 +899,6 @@ bool HomeAssistant::mqttPublishDiscovery_DHT() {
             break;
     }
 
-    if(publish_ok) delay(100);
     return publish_ok;
 }
 
@@ -618,7 +911,6 @@ bool HomeAssistant::mqttPublishDiscovery_Status() {
     std::string entityJson = jsonStatus(entityName);
 
     publish_ok = publishMQTTComponent(DEVICE_ID_STATION, "binary_sensor", entityName.c_str(), entityJson.c_str());
-    if(publish_ok) delay(100);
     return publish_ok;
 }
 
@@ -631,7 +923,6 @@ bool HomeAssistant::mqttPublishDiscovery_WiFiSignal() {
     std::string entityJson = jsonWiFiSignal(entityName);
 
     publish_ok = publishMQTTComponent(DEVICE_ID_STATION, "sensor", entityName.c_str(), entityJson.c_str());
-    if(publish_ok) delay(100);
     return publish_ok;
 }
 
@@ -643,7 +934,6 @@ bool HomeAssistant::mqttPublishDiscovery_Neopixel() {
     std::string entityJson = jsonNeopixel(entityName);
 
     publish_ok = publishMQTTComponent(DEVICE_ID_STATION, "light", entityName.c_str(), entityJson.c_str());
-    if(publish_ok) delay(100);
     return publish_ok;
 }
 
@@ -658,6 +948,8 @@ void HomeAssistant::taskDiscoverCbk() {
 
     LOG_F("Starting discovery..");
 
+    discoveryIndex = 0;
+
     do {
 
         // prepare internal buffer
@@ -680,6 +972,18 @@ void HomeAssistant::taskDiscoverCbk() {
                 }
             }
 
+            if (discovery_done == false)
+                break;
+
+            // zones of plants
+            for (auto zone : fleet.zones()) {
+
+                if (mqttPublishDiscovery_Zone(zone) == false) {
+                    discovery_done = false;
+                    break;
+                }
+            }
+
             if (discovery_done == false)
                 break;
         }
@@ -713,11 +1017,18 @@ void HomeAssistant::taskDiscoverCbk() {
 
     // check if everything went ok
     if (discovery_done == false) {
+        // the queue is full, the rest is published once it drains
+        if (discoveryResume > 0) {
+            LOG_F("Discovery paused after %u messages, resuming soon", discoveryResume);
+            taskDiscover.restartDelayed(HASS_DISCOVERY_RESUME_MS);
+            return;
+        }
         LOG_LN("Discovery failed, trying again soon!");
         taskDiscover.restartDelayed(10 * TASK_SECOND);
         return;
     }
 
+    discoveryResume = 0;
     LOG_LN("Discovery successful, stopping task!");
     taskDiscover.disable();
 }
\ No newline at end of file
@@ -27,6 +27,7 @@
 
 #include "scheduler.h"
 #include "device.h"
+#include "zone.h"
 #include <string>
 
 /*
@@ -36,7 +37,8 @@ class HomeAssistant {
     public:
         enum DeviceIDType {
             DEVICE_ID_CENTRAL,
-            DEVICE_ID_STATION
+            DEVICE_ID_STATION,
+            DEVICE_ID_ZONE
         };
     public:
         HomeAssistant();
@@ -49,30 +51,37 @@ class HomeAssistant {
         char *   bufferFormat;
         size_t   bufferSize;
         uint16_t mqttBufferSize;
+        unsigned int discoveryIndex;    // of the message in the discovery pass
+        unsigned int discoveryResume;   // messages queued by the interrupted pass
 
         bool        prepareBuffer();
         void        freeBuffer();
 
-        std::string getDeviceID(DeviceIDType type);
-        std::string getDiscoveryTopic(DeviceIDType device, const char * componentType, const char * entityName);
+        std::string getDeviceID(DeviceIDType type, Zone * zone = NULL);
+        std::string getDiscoveryTopic(DeviceIDType device, const char * componentType, const char * entityName, Zone * zone = NULL);
 
-        std::string jsonGetDevice(DeviceIDType device);
+        std::string jsonGetDevice(DeviceIDType device, Zone * zone = NULL);
         std::string baseStationEntityName();
         std::string baseMiFloraEntityName(MiFloraDevice * device);
 
         std::string jsonMiFloraAttribute(MiFloraDevice * device, AttributeID attribute, std::string & entityName);
+        std::string jsonMiFloraForecast(MiFloraDevice * device, std::string & entityName);
+        std::string jsonMiFloraAlert(MiFloraDevice * device, unsigned int rule, std::string & entityName);
+        std::string jsonMiFloraOwner(MiFloraDevice * device, std::string & entityName);
+        std::string jsonZoneValue(Zone * zone, const char * value, std::string & entityName);
         std::string jsonDHTSensor(bool temperature_or_humidity, std::string& entityName);
         std::string jsonStatus(std::string & entityName);
         std::string jsonWiFiSignal(std::string & entity_name);
         std::string jsonNeopixel(std::string &entity_name);
 
         bool        mqttPublishDiscovery_MiFlora(MiFloraDevice * device);
+        bool        mqttPublishDiscovery_Zone(Zone * zone);
         bool        mqttPublishDiscovery_DHT();
         bool        mqttPublishDiscovery_Status();
         bool        mqttPublishDiscovery_WiFiSignal();
         bool        mqttPublishDiscovery_Neopixel();
 
-        bool        publishMQTTComponent(DeviceIDType device, const char * componentType, const char * entityName, const char * entityJSON);
+        bool        publishMQTTComponent(DeviceIDType device, const char * componentType, const char * entityName, const char * entityJSON, Zone * zone = NULL);
         bool        publishJSONPayload(const char * deviceTopic);
 
         void        taskDiscoverCbk();
@@ -0,0 +1,121 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+#include "history.h"
+
+/*
+ * Quantization ranges, chosen so the resolution stays below the sensor noise:
+ *  - moisture      0.4 %
+ *  - temperature   0.25 C
+ *  - conductivity  10 uS/cm
+ *  - illuminance   ~1.8 lux (16 bit)
+ */
+const HistoryRange_t DeviceHistory::RANGE_MOISTURE     = {   0.0f,    101.6f };
+const HistoryRange_t DeviceHistory::RANGE_TEMPERATURE  = { -10.0f,     53.5f };
+const HistoryRange_t DeviceHistory::RANGE_CONDUCTIVITY = {   0.0f,   2540.0f };
+const HistoryRange_t DeviceHistory::RANGE_ILLUMINANCE  = {   0.0f, 120000.0f };
+
+/*
+ * History of all the attributes of a plant
+ */
+DeviceHistory::DeviceHistory()
+  : moisture     (RANGE_MOISTURE)
+  , temperature  (RANGE_TEMPERATURE)
+  , conductivity (RANGE_CONDUCTIVITY)
+  , illuminance  (RANGE_ILLUMINANCE) {
+}
+
+bool DeviceHistory::add(AttributeID id, float value, uint32_t time) {
+
+  switch (id) {
+    case ATTR_ID_MOISTURE:     return moisture.add(value, time);
+    case ATTR_ID_TEMPERATURE:  return temperature.add(value, time);
+    case ATTR_ID_CONDUCTIVITY: return conductivity.add(value, time);
+    case ATTR_ID_ILLUMINANCE:  return illuminance.add(value, time);
+    default: 
+      // not tracked
+      return false;
+  }
+}
+
+bool DeviceHistory::lastAverage(AttributeID id, HistorySample_t & out) {
+
+  switch (id) {
+    case ATTR_ID_MOISTURE:     return moisture.lastAverage(out);
+    case ATTR_ID_TEMPERATURE:  return temperature.lastAverage(out);
+    case ATTR_ID_CONDUCTIVITY: return conductivity.lastAverage(out);
+    case ATTR_ID_ILLUMINANCE:  return illuminance.lastAverage(out);
+    default:
+      return false;
+  }
+}
+
+const HistoryRange_t * DeviceHistory::rangeOf(AttributeID id) {
+
+  switch (id) {
+    case ATTR_ID_MOISTURE:     return &RANGE_MOISTURE;
+    case ATTR_ID_TEMPERATURE:  return &RANGE_TEMPERATURE;
+    case ATTR_ID_CONDUCTIVITY: return &RANGE_CONDUCTIVITY;
+    case ATTR_ID_ILLUMINANCE:  return &RANGE_ILLUMINANCE;
+    default:
+      return NULL;
+  }
+}
+
+size_t DeviceHistory::query(AttributeID id, HistoryTier tier, uint32_t from, uint32_t to, HistorySample_t * out, size_t max_count) {
+
+  switch (id) {
+    case ATTR_ID_MOISTURE:     return moisture.query(tier, from, to, out, max_count);
+    case ATTR_ID_TEMPERATURE:  return temperature.query(tier, from, to, out, max_count);
+    case ATTR_ID_CONDUCTIVITY: return conductivity.query(tier, from, to, out, max_count);
+    case ATTR_ID_ILLUMINANCE:  return illuminance.query(tier, from, to, out, max_count);
+    default:
+      // not tracked
+      return 0;
+  }
+}
+
+/* 
+ * Direction of the change over the last HISTORY_TREND_SEC from the averages
+ * tier, 1 rising, -1 falling, 0 steady or not known. Changes smaller than
+ * HISTORY_TREND_PERCENT of the attribute's range are taken as steady.
+ */
+int DeviceHistory::trend(AttributeID id, uint32_t now) {
+
+  const HistoryRange_t * range = rangeOf(id);
+  HistorySample_t        samples[HISTORY_TREND_SEC / HISTORY_AVG_PERIOD_SEC + 1];
+  uint32_t               from    = now > HISTORY_TREND_SEC ? now - HISTORY_TREND_SEC : 0;
+
+  if (range == NULL)
+    return 0;
+
+  size_t count = query(id, HISTORY_TIER_AVERAGE, from, now, samples, sizeof(samples) / sizeof(samples[0]));
+  if (count < 2)
+    return 0;
+
+  float change = samples[count - 1].avg - samples[0].avg;
+  float steady = (range->hi - range->lo) * HISTORY_TREND_PERCENT / 100;
+
+  return change > steady ? 1 : change < - steady ? -1 : 0;
+}
@@ -0,0 +1,347 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <default_config.h>
+#include <firmware_config.h>
+
+#include "attribute_id.h"
+
+/* resolution tiers kept for each attribute */
+enum HistoryTier {
+  HISTORY_TIER_RAW,     // every sample, last hour
+  HISTORY_TIER_AVERAGE, // averages over HISTORY_AVG_PERIOD_SEC, last day
+  HISTORY_TIER_HOURLY   // hourly min/max/avg, last week
+};
+
+/* a point returned by history queries (time is in uptime seconds, see WallClock::uptime()) */
+typedef struct {
+  uint32_t time;
+  float    min;
+  float    max;
+  float    avg;
+} HistorySample_t;
+
+/* value range used for quantizing samples of an attribute */
+typedef struct {
+  float lo;
+  float hi;
+} HistoryRange_t;
+
+/*
+ * Fixed size, tiered time series of a single attribute.
+ *
+ * Samples are quantized to T (uint8_t or uint16_t) over the attribute's range,
+ * the highest value of T is reserved for marking gaps. Averages and hourly
+ * aggregates are computed incrementally on insert, no pass over the raw data.
+ */
+template <typename T>
+class AttributeHistory {
+
+  public:
+    static const T NO_DATA = (T) ~((T) 0);
+
+  public:
+    AttributeHistory(const HistoryRange_t & range);
+
+    bool   add(float value, uint32_t time);
+    size_t query(HistoryTier tier, uint32_t from, uint32_t to, HistorySample_t * out, size_t max_count);
+    bool   lastAverage(HistorySample_t & out);
+
+    T      quantize(float value);
+    float  dequantize(T value);
+
+  protected:
+    const HistoryRange_t & range;
+
+    /* raw tier, times are kept as 16 bit seconds relative to the newest sample,
+       samples further than that from the newest one are dropped */
+    uint16_t raw_time [HISTORY_RAW_SAMPLES];
+    T        raw_value[HISTORY_RAW_SAMPLES];
+    uint16_t raw_head, raw_count;
+    uint32_t raw_last_time;
+
+    /* averages tier */
+    T        avg[HISTORY_AVG_SLOTS];
+    bool     avg_closed;
+    uint32_t avg_last_slot;
+    uint32_t avg_acc_slot, avg_acc_sum;
+    uint16_t avg_acc_count;
+
+    /* hourly tier */
+    T        hour_min[HISTORY_HOUR_SLOTS];
+    T        hour_max[HISTORY_HOUR_SLOTS];
+    T        hour_avg[HISTORY_HOUR_SLOTS];
+    bool     hour_closed;
+    uint32_t hour_last_slot;
+    uint32_t hour_acc_slot, hour_acc_sum;
+    uint16_t hour_acc_count;
+    T        hour_acc_min, hour_acc_max;
+
+    void     closeAverage();
+    void     closeHour();
+    size_t   queryRaw(uint32_t from, uint32_t to, HistorySample_t * out, size_t max_count);
+};
+
+/*
+ * History of all the attributes of a plant that are worth tracking
+ */
+class DeviceHistory {
+
+  public:
+    DeviceHistory();
+
+    bool   add(AttributeID id, float value, uint32_t time);
+    size_t query(AttributeID id, HistoryTier tier, uint32_t from, uint32_t to, HistorySample_t * out, size_t max_count);
+    bool   lastAverage(AttributeID id, HistorySample_t & out);
+    int    trend(AttributeID id, uint32_t now);
+
+    static const HistoryRange_t * rangeOf(AttributeID id);
+
+  public:
+    AttributeHistory<uint8_t>  moisture;
+    AttributeHistory<uint8_t>  temperature;
+    AttributeHistory<uint8_t>  conductivity;
+    AttributeHistory<uint16_t> illuminance;
+
+    static const HistoryRange_t RANGE_MOISTURE;
+    static const HistoryRange_t RANGE_TEMPERATURE;
+    static const HistoryRange_t RANGE_CONDUCTIVITY;
+    static const HistoryRange_t RANGE_ILLUMINANCE;
+};
+
+/* compile-time memory footprint of a plant's history */
+static const size_t HISTORY_DEVICE_FOOTPRINT = sizeof(DeviceHistory);
+
+/* template implementation for AttributeHistory */
+template <typename T>
+AttributeHistory<T>::AttributeHistory(const HistoryRange_t & _range)
+  : range(_range)
+  , raw_head(0), raw_count(0), raw_last_time(0)
+  , avg_closed(false), avg_last_slot(0), avg_acc_slot(0), avg_acc_sum(0), avg_acc_count(0)
+  , hour_closed(false), hour_last_slot(0), hour_acc_slot(0), hour_acc_sum(0), hour_acc_count(0)
+  , hour_acc_min(NO_DATA), hour_acc_max(0) {
+
+  for (size_t i = 0; i < HISTORY_AVG_SLOTS; ++ i) {
+    avg[i] = NO_DATA;
+  }
+  for (size_t i = 0; i < HISTORY_HOUR_SLOTS; ++ i) {
+    hour_min[i] = hour_max[i] = hour_avg[i] = NO_DATA;
+  }
+}
+
+template <typename T>
+T AttributeHistory<T>::quantize(float value) {
+
+  if (value <= range.lo) return 0;
+  if (value >= range.hi) return NO_DATA - 1;
+
+  return (T) ((value - range.lo) * (NO_DATA - 1) / (range.hi - range.lo) + 0.5f);
+}
+
+template <typename T>
+float AttributeHistory<T>::dequantize(T value) {
+  return range.lo + (float) value * (range.hi - range.lo) / (NO_DATA - 1);
+}
+
+/* add a sample, returns true when it closed an average (see lastAverage()) */
+template <typename T>
+bool AttributeHistory<T>::add(float value, uint32_t time) {
+
+  T    q = quantize(value);
+  bool closed = false;
+
+  // raw tier, the 16 bit times only tell apart samples up to 0xFFFF s apart
+  while (raw_count) {
+    uint16_t oldest = (raw_head + HISTORY_RAW_SAMPLES - raw_count) % HISTORY_RAW_SAMPLES;
+    uint32_t since  = raw_last_time - (uint16_t) ((uint16_t) raw_last_time - raw_time[oldest]);
+    if (time - since <= 0xFFFF)
+      break;
+    -- raw_count;
+  }
+
+  raw_time [raw_head] = (uint16_t) time;
+  raw_value[raw_head] = q;
+  raw_head = (raw_head + 1) % HISTORY_RAW_SAMPLES;
+  if (raw_count < HISTORY_RAW_SAMPLES) ++ raw_count;
+  raw_last_time = time;
+
+  // averages tier, close the bucket when the sample falls in a new one
+  uint32_t slot = time / HISTORY_AVG_PERIOD_SEC;
+  if (avg_acc_count && slot != avg_acc_slot) {
+    closeAverage();
+    closed = true;
+  }
+  avg_acc_slot = slot;
+  avg_acc_sum += q;
+  ++ avg_acc_count;
+
+  // hourly tier
+  slot = time / 3600;
+  if (hour_acc_count && slot != hour_acc_slot) {
+    closeHour();
+  }
+  hour_acc_slot = slot;
+  hour_acc_sum += q;
+  ++ hour_acc_count;
+  if (q < hour_acc_min) hour_acc_min = q;
+  if (q > hour_acc_max) hour_acc_max = q;
+
+  return closed;
+}
+
+template <typename T>
+bool AttributeHistory<T>::lastAverage(HistorySample_t & out) {
+
+  if (avg_closed == false)
+    return false;
+
+  out.time = avg_last_slot * HISTORY_AVG_PERIOD_SEC;
+  out.avg  = out.min = out.max = dequantize(avg[avg_last_slot % HISTORY_AVG_SLOTS]);
+  return true;
+}
+
+template <typename T>
+void AttributeHistory<T>::closeAverage() {
+
+  // mark the buckets without samples as gaps (no more than the whole ring)
+  if (avg_closed && avg_acc_slot > avg_last_slot + 1) {
+    uint32_t gap = avg_acc_slot - avg_last_slot - 1;
+    if (gap > HISTORY_AVG_SLOTS) gap = HISTORY_AVG_SLOTS;
+    while (gap) {
+      avg[(avg_acc_slot - gap) % HISTORY_AVG_SLOTS] = NO_DATA;
+      -- gap;
+    }
+  }
+
+  avg[avg_acc_slot % HISTORY_AVG_SLOTS] = (T) ((avg_acc_sum + avg_acc_count / 2) / avg_acc_count);
+  avg_closed    = true;
+  avg_last_slot = avg_acc_slot;
+  avg_acc_sum   = 0;
+  avg_acc_count = 0;
+}
+
+template <typename T>
+void AttributeHistory<T>::closeHour() {
+
+  if (hour_closed && hour_acc_slot > hour_last_slot + 1) {
+    uint32_t gap = hour_acc_slot - hour_last_slot - 1;
+    if (gap > HISTORY_HOUR_SLOTS) gap = HISTORY_HOUR_SLOTS;
+    while (gap) {
+      uint32_t idx = (hour_acc_slot - gap) % HISTORY_HOUR_SLOTS;
+      hour_min[idx] = hour_max[idx] = hour_avg[idx] = NO_DATA;
+      -- gap;
+    }
+  }
+
+  uint32_t idx = hour_acc_slot % HISTORY_HOUR_SLOTS;
+  hour_min[idx] = hour_acc_min;
+  hour_max[idx] = hour_acc_max;
+  hour_avg[idx] = (T) ((hour_acc_sum + hour_acc_count / 2) / hour_acc_count);
+
+  hour_closed    = true;
+  hour_last_slot = hour_acc_slot;
+  hour_acc_sum   = 0;
+  hour_acc_count = 0;
+  hour_acc_min   = NO_DATA;
+  hour_acc_max   = 0;
+}
+
+template <typename T>
+size_t AttributeHistory<T>::queryRaw(uint32_t from, uint32_t to, HistorySample_t * out, size_t max_count) {
+
+  size_t   count = 0;
+  uint16_t idx   = (raw_head + HISTORY_RAW_SAMPLES - raw_count) % HISTORY_RAW_SAMPLES;
+
+  for (uint16_t i = 0; i < raw_count && count < max_count; ++ i) {
+
+    // rebuild the full time from the 16 bit distance to the newest sample
+    uint32_t time = raw_last_time - (uint16_t) ((uint16_t) raw_last_time - raw_time[idx]);
+
+    if (time >= from && time <= to) {
+      out[count].time = time;
+      out[count].min  = out[count].max = out[count].avg = dequantize(raw_value[idx]);
+      ++ count;
+    }
+    idx = (idx + 1) % HISTORY_RAW_SAMPLES;
+  }
+
+  return count;
+}
+
+template <typename T>
+size_t AttributeHistory<T>::query(HistoryTier tier, uint32_t from, uint32_t to, HistorySample_t * out, size_t max_count) {
+
+  if (tier == HISTORY_TIER_RAW) {
+    return queryRaw(from, to, out, max_count);
+  }
+
+  bool     hourly    = (tier == HISTORY_TIER_HOURLY);
+  uint32_t period    = hourly ? 3600 : HISTORY_AVG_PERIOD_SEC;
+  uint32_t slots     = hourly ? HISTORY_HOUR_SLOTS : HISTORY_AVG_SLOTS;
+  bool     closed    = hourly ? hour_closed    : avg_closed;
+  uint32_t last_slot = hourly ? hour_last_slot : avg_last_slot;
+  uint32_t acc_slot  = hourly ? hour_acc_slot  : avg_acc_slot;
+  uint16_t acc_count = hourly ? hour_acc_count : avg_acc_count;
+  size_t   count     = 0;
+
+  // closed slots still in the ring
+  uint32_t first = (last_slot >= slots) ? last_slot - slots + 1 : 0;
+  if (first < from / period) first = from / period;
+
+  for (uint32_t slot = first; closed && slot <= last_slot && slot <= to / period && count < max_count; ++ slot) {
+
+    uint32_t idx = slot % slots;
+    T        val = hourly ? hour_avg[idx] : avg[idx];
+
+    if (val == NO_DATA)
+      continue;
+
+    out[count].time = slot * period;
+    out[count].avg  = dequantize(val);
+    out[count].min  = hourly ? dequantize(hour_min[idx]) : out[count].avg;
+    out[count].max  = hourly ? dequantize(hour_max[idx]) : out[count].avg;
+    ++ count;
+  }
+
+  // slot still being accumulated
+  if (acc_count && count < max_count && acc_slot >= from / period && acc_slot <= to / period) {
+
+    uint32_t sum = hourly ? hour_acc_sum : avg_acc_sum;
+
+    out[count].time = acc_slot * period;
+    out[count].avg  = dequantize((T) ((sum + acc_count / 2) / acc_count));
+    out[count].min  = hourly ? dequantize(hour_acc_min) : out[count].avg;
+    out[count].max  = hourly ? dequantize(hour_acc_max) : out[count].avg;
+    ++ count;
+  }
+
+  return count;
+}
+
+#endif//_HISTORY_H_
@@ -67,6 +67,8 @@
 #define LOG_TAG_LEDSTRIP "[" CONSOLE_GREEN   "   NEO" CONSOLE_RESET "] "
 #define LOG_TAG_DISPLAY  "["                 "  DISP"               "] "
 #define LOG_TAG_CONFIG   "["                 "   CFG"               "] "
+#define LOG_TAG_TSLOG    "[" CONSOLE_CYAN    " TSLOG" CONSOLE_RESET "] "
+#define LOG_TAG_ALERT    "[" CONSOLE_RED     " ALERT" CONSOLE_RESET "] "
 
 /*
  * Boot-time printing
@@ -33,6 +33,14 @@
 #include "dht_sensor.h"
 #include "hass.h"
 #include "led_strip.h"
+#include "wallclock.h"
+#include "tslog.h"
+#include "ts_export.h"
+#include "alerts.h"
+#include "aggregate.h"
+#include "snapshot.h"
+#include "species.h"
+#include "collab.h"
 
 #define LOG_TAG LOG_TAG_MAIN
 #include "log.h"
@@ -52,6 +60,9 @@ DisplayScreen_MiFloraAttributes screenAttrCond  (ATTR_ID_CONDUCTIVITY);
 DisplayScreen_MiFloraAttributes screenAttrTemp  (ATTR_ID_TEMPERATURE);
 DisplayScreen_MiFloraAttributes screenAttrLight (ATTR_ID_ILLUMINANCE);
 DisplayScreen_MiFloraAttributes screenAttrRSSI  (ATTR_ID_RSSI);
+DisplayScreen_MiFloraAttributes screenAttrDLI   (ATTR_ID_DLI);
+DisplayScreen_MiFloraAttributes screenAttrVPD   (ATTR_ID_VPD);
+DisplayScreen_Zones             screenZones;
 DisplayScreen_Station           screenStation;
 
 // for debug only
@@ -149,6 +160,9 @@ void setup() {
   // print configuration to serial
   config.print(Serial, "config.cfg");
 
+  // start NTP, the clock gets set once the network is up
+  wallclock.begin();
+
   // setup display
   display.begin();
   BOOT_PRINT(true, "TFT display");
@@ -170,10 +184,44 @@ void setup() {
   ledstrip.begin();
   BOOT_PRINT(true, "NEO ledstrip");
 
+  // open the flash log
+  success = tslog.begin();
+  BOOT_PRINT(success, "Flash log (#%u)", (unsigned int) tslog.recordCount());
+
+  // map the species profiles, before the devices refer to them
+  success = species.begin();
+  BOOT_PRINT(success, "Species profiles (#%u)", species.count());
+
   // load mi flora devices from SPIFFS
   success = fleet.begin("/devices.cfg");
   BOOT_PRINT(success, "Loading devices (#%d)", fleet.count());
 
+  // restore the last known values, before the network brings fresh ones
+  success = snapshot.begin();
+  BOOT_PRINT(success, "Snapshot (#%u values)", snapshot.restoredValues());
+
+  // messages spooled while offline, sent after connecting
+  success = mqtt.beginQueue();
+  MQTT::QueueStats_t mqtt_stats;
+  mqtt.queueStats(mqtt_stats);
+  BOOT_PRINT(success, "MQTT spool (#%u)", mqtt_stats.spooled);
+
+  // compile alert rules
+  success = alerts.begin("/rules.cfg");
+  BOOT_PRINT(success, "Alert rules (#%u)", alerts.count());
+
+  // hourly and daily aggregates
+  success = aggregator.begin();
+  BOOT_PRINT(success, "Aggregates");
+
+  // collaboration with the other stations, plant ownership
+  success = collab.begin();
+  BOOT_PRINT(success, "Collaboration");
+
+  // snapshots exchanged with the other stations, for warm starts
+  success = snapshot.beginMQTT();
+  BOOT_PRINT(success, "Snapshot exchange");
+
   /*
   for (int i = 0 ; i < 20; ++i) {
     auto device = new MiFloraDevice("00:00:00:01:02:03");
@@ -203,6 +251,9 @@ void setup() {
   config.formatTopic(topic, ConfigMain::MQTT_TOPIC_COMMAND, "ble");
   mqtt.subscribeTo(topic.c_str()  , onMQTT_BLECommand   );
 
+  // export of the flash log
+  tsexport.begin();
+
   //
   // load screens
   //
@@ -210,6 +261,10 @@ void setup() {
   // screen that shows a single plant per page
   display.screenAdd(&screenFleet);
 
+  // screen that shows a zone per page, only when zones are configured
+  display.screenAdd(&screenZones);
+  screenZones.enable(fleet.zones().empty() == false);
+
   // screen that shows a single attribute for all plants in the fleet
   // when the number of plants exceeds the maximum devices shown per page
   // it creates and additional page for the rest of devices
@@ -217,6 +272,8 @@ void setup() {
   display.screenAdd(&screenAttrCond);
   display.screenAdd(&screenAttrTemp);
   display.screenAdd(&screenAttrLight);
+  display.screenAdd(&screenAttrDLI);
+  display.screenAdd(&screenAttrVPD);
   display.screenAdd(&screenAttrRSSI);
 
   // station screen, shows information about the station
@@ -357,6 +414,9 @@ bool onButtonsEvent(Buttons::Events event, uint8_t btn) {
       // restart
       case Buttons::BTN_MODEB: {
         LOG_LN("Restarting core..");
+        snapshot.save();
+        mqtt.spill();
+        tslog.flush();
         ESP.restart();
         handled = true;
       } break;
@@ -24,6 +24,7 @@
 
 #include "mqtt.h"
 #include "config.h"
+#include "wallclock.h"
 
 #define LOG_TAG LOG_TAG_MQTT
 #include "log.h"
@@ -34,12 +35,49 @@ MQTT mqtt;
  * Class handling MQTT connection and subscriptions
  */ 
 MQTT::MQTT() :
-    taskHandle(MQTT_UPDATE_INTERVAL, TASK_FOREVER, s_taskHandleCbk, &scheduler, false) {    
-
-    setClient(wifiClient);
+    tlsClient(wifiClient),
+    batch(wifiClient),
+    transport(batch, s_pubackCbk),
+    client5(batch, s_subscribeCbk, s_pubackCbk),
+    taskHandle(MQTT_UPDATE_INTERVAL, TASK_FOREVER, s_taskHandleCbk, &scheduler, false),
+    taskDrain(MQTT_QUEUE_DRAIN_MS, TASK_FOREVER, s_drainCbk, &scheduler, false),
+    taskApply(MQTT_RX_APPLY_MS, TASK_FOREVER, s_applyCbk, &scheduler, false),
+    queues{ 
+        MQTTQueue(queueBuffer, MQTT_QUEUE_ALERTS),
+        MQTTQueue(queueBuffer + MQTT_QUEUE_ALERTS, MQTT_QUEUE_STATE),
+        MQTTQueue(queueBuffer + MQTT_QUEUE_ALERTS + MQTT_QUEUE_STATE, MQTT_QUEUE_DIAGNOSTICS),
+        MQTTQueue(queueBuffer + MQTT_QUEUE_ALERTS + MQTT_QUEUE_STATE + MQTT_QUEUE_DIAGNOSTICS, MQTT_QUEUE_DISCOVERY) },
+    spoolReady(false),
+    spillPending(0),
+    replayStart(0),
+    inflightCount(0),
+    nextPacketId(1),
+    spoolSent(false),
+    spoolDup(false),
+    spoolPacketId(0),
+    subscribed(0),
+    rxTable(rxBuffer, sizeof(rxBuffer)),
+    rxRetained(false),
+    rxSettled(false),
+    connectedAt(0) {    
+
+    memset(&stats, 0, sizeof(stats));
+    queues[PRIORITY_DIAGNOSTIC].setReplace(true);
+    setClient(transport);
     setCallback(s_subscribeCbk);
 }
 
+/* pick up the messages spooled before a restart, SPIFFS must be mounted */
+bool MQTT::beginQueue() {
+
+    // budget of the station, shared by all the classes
+    budgetMessages.configure(config.mqtt_rate_msgs, config.mqtt_burst_msgs, millis());
+    budgetBytes.configure(config.mqtt_rate_bytes, config.mqtt_burst_bytes, millis());
+
+    spoolReady = spool.begin(MQTT_SPOOL_SIZE, MQTTQueue::recordSize(0, MQTT_QUEUE_MAX_MESSAGE));
+    return spoolReady;
+}
+
 /* connect to MQTT server according to configuration */
 bool MQTT::begin() {
 
@@ -70,7 +108,39 @@ bool MQTT::begin() {
         LOG_F("Client id generated: %s", clientid.c_str());
     }
 
+    // go through TLS if configured, the CA certificate is parsed once
+    if (config.mqtt_tls) {
+        if (tlsClient.hasCACert() == false && tlsClient.loadCACert(config.mqtt_tls_ca_file) == false)
+            return false;
+
+        tlsClient.setSessionStore(config.mqtt_tls_session_nvs);
+        batch.setClient(tlsClient);
+    }
+
+    // packets written close together leave in one segment
+    batch.setBatching(config.mqtt_batch, MQTT_BATCH_DEADLINE_MS);
+
     // do connect and set will topic as the availability topic
+    if (config.mqtt_version == 5) {
+        MQTT5Codec::Connect_t connect5;
+
+        connect5.client_id    = clientid.c_str();
+        connect5.username     = config.mqtt_username;
+        connect5.password     = config.mqtt_password;
+        connect5.will_topic   = config.station_availability_topic;
+        connect5.will_payload = config.station_payload_offline;
+        connect5.will_retain  = true;
+        connect5.keep_alive   = MQTT_KEEPALIVE;
+        connect5.session_expiry = config.mqtt_session_expiry_sec;
+
+        // messages carry the station publishing them
+        client5.setUserProperty(config.mqtt_station_property ? "station" : NULL, config.station_name);
+
+        if (!client5.connect(config.mqtt_host, config.mqtt_port, connect5, getBufferSize())) {
+            LOG_F("Connection failed: %d", state());
+            return false;
+        }
+    } else
     if (!connect(
         // client id
         clientid.c_str(), 
@@ -78,7 +148,9 @@ bool MQTT::begin() {
         config.mqtt_username, 
         config.mqtt_password,
         // will topic, qos, retain and payload
-        config.station_availability_topic, 0, true,  config.station_payload_offline )) {
+        config.station_availability_topic, 0, true,  config.station_payload_offline,
+        // keep the session if configured, MQTT 3.1.1 has no expiry for it
+        config.mqtt_session_expiry_sec == 0 )) {
 
         LOG_F("Connection failed: %d", state());
         return false;
@@ -86,104 +158,810 @@ bool MQTT::begin() {
 
     // MQTT connected
     LOG_F("Connected (%s:%d)!", config.mqtt_host, config.mqtt_port);
+    connectedAt = millis();
+    rxSettled   = false;
+
+    // Nagle's algorithm holds small segments until the previous ones are acknowledged
+    wifiClient.setNoDelay(config.mqtt_nodelay);
+
+    if (config.mqtt_tls)
+        LOG_F("TLS handshake %s in %lu ms, %u bytes of heap", 
+            tlsClient.handshakeResumed() ? "resumed" : "full",
+            tlsClient.handshakeTime(), (unsigned int) tlsClient.handshakeHeap());
 
-    // publish online state
+    // publish online state, ahead of the queued messages
     std::string topic;
     config.formatTopic(topic, ConfigMain::MQTT_TOPIC_AVAILABILITY);
-    publish(topic.c_str(), config.station_payload_online, true);
+    publishDirect(topic.c_str(), (const uint8_t *) config.station_payload_online, 
+        strlen(config.station_payload_online), true);
 
-    // redo subscriptions
+    // a session kept by the broker still has the subscriptions sent
+    // since boot, only the ones added meanwhile are sent
+    bool session = config.mqtt_version == 5 ? client5.sessionPresent() : transport.sessionPresent();
+    if (session == false)
+        subscribed = 0;
+
+    LOG_F("Session %s, sending %u of %u subscriptions", session ? "resumed" : "new",
+        (unsigned int) (subscriptions.size() - subscribed), (unsigned int) subscriptions.size());
     resendSubscriptions();
 
     // start task for handling MQTT receiving packets
     taskHandle.restartDelayed();
+
+    // QoS 1 messages not acknowledged before are sent again
+    if (inflightCount > 0) {
+        LOG_F("Resending %u unacknowledged messages", inflightCount);
+        stats.resent += inflightCount;
+        inflightCount = 0;
+    }
+    for (auto & queue : queues)
+        queue.unsend(session);
+    spoolDup  = spoolSent;
+    spoolSent = false;
+    if (session == false)
+        spoolPacketId = 0;
+
+    // start sending the queued messages, the spooled ones first
+    if (spool.empty() == false) {
+        LOG_F("Replaying %u spooled messages", spool.count());
+    }
+    taskDrain.restartDelayed();
     return true;
 }
 
 void MQTT::end() {
-    disconnect();
+    if (config.mqtt_version == 5) 
+        client5.disconnect();
+    else
+        disconnect();
     taskHandle.disable();
+    taskDrain.disable();
 }
 
-/* resubscribe to all known subscriptions, useful when reconnecting */
+/* resubscribe to the subscriptions not in the broker session, useful when reconnecting */
 void MQTT::resendSubscriptions() {
 
-    for (auto sub : subscriptions) {
-        subscribe(sub.topic.c_str());
+    while (subscribed < subscriptions.size()) {
+        if (subscribeTopic(subscriptions[subscribed]) == false)
+            break;
+        subscribed ++;
     }
 }
 
+/* send a SUBSCRIBE, with MQTT 5 the station's own messages are not sent back */
+bool MQTT::subscribeTopic(const Subscription_t & subscription) {
+
+    if (config.mqtt_version == 5)
+        return client5.subscribe(subscription.topic.c_str(), MQTT5Codec::SUB_NO_LOCAL | 
+            (subscription.retained ? 0 : MQTT5Codec::SUB_NO_RETAINED));
+    return subscribe(subscription.topic.c_str());
+}
+
+/* connection state, of the client in use */
+boolean MQTT::connected() {
+    return config.mqtt_version == 5 ? client5.connected() : PubSubClient::connected();
+}
+
+int MQTT::state() {
+    return config.mqtt_version == 5 ? client5.state() : PubSubClient::state();
+}
+
+boolean MQTT::loop() {
+    return config.mqtt_version == 5 ? client5.loop() : PubSubClient::loop();
+}
+
 /* check if a subscription exists, for a given topic */
 bool MQTT::hasSubscription(const char * topic) {
-    return getSubscriptionHandler(topic) != NULL;
+
+    for (auto & subscription : subscriptions) {
+        if (strcasecmp(topic, subscription.topic.c_str()) == 0)
+            return true;
+    }
+    return false;
 }
 
-/* return subscription callback handler */
+/* return the handler of the route matching a received topic */
 MQTT::Callback_t MQTT::getSubscriptionHandler(const char * topic, void **param) {
-
-    for (auto sub : subscriptions) {
-        if (strcasecmp(topic, sub.topic.c_str()) == 0) {
-            if (param != NULL)
-                * param = sub.param;
-            return sub.handler;
-        }
-    }
-    return NULL;
+    return router.match(topic, param);
 }
 
-/* subscribe to a given topic with a handler */
-bool MQTT::subscribeTo(const char * topic, Callback_t callback, void * param) {
+/* 
+ * Subscribe to a given topic, or filter, with a handler. Without retained,
+ * the broker doesn't send the retained messages on subscribing; MQTT 3.1.1
+ * has no such option and always sends them.
+ */
+bool MQTT::subscribeTo(const char * topic, Callback_t callback, void * param, bool retained) {
     
-    std::string strTopic(topic);
-
     // subscribing for the same topic is now allowed
     if (hasSubscription(topic))
         return false;
 
-    // add to subscriptions
-    Subscription_t entry = {.topic = topic, .handler = callback, .param = param };
-    subscriptions.push_back(entry);
+    // a wildcard subscription may have no handler of its own,
+    // its topics are handled by the routes added with route()
+    if (callback != NULL && router.add(topic, callback, param) == false)
+        return false;
+
+    subscriptions.push_back({ topic, retained });
 
     LOG_F("Subscription [%p] -> %s (param=%p)", callback, topic, param);
 
     // if MQTT is not connected, this subscription will get active
     // when it does get connected, via redoSubscriptions()
-    if (connected()) subscribe(topic);
+    if (connected()) resendSubscriptions();
     return true;
 }
 
+/* 
+ * Change whether a subscription gets the retained messages, and subscribe
+ * again for them. Not connected, it is sent on connecting, with the ones
+ * after it, even if the broker kept the session.
+ */
+bool MQTT::resubscribe(const char * topic, bool retained) {
+
+    for (size_t index = 0; index < subscriptions.size(); index ++) {
+        Subscription_t & subscription = subscriptions[index];
+
+        if (strcasecmp(topic, subscription.topic.c_str()) != 0)
+            continue;
+
+        subscription.retained = retained;
+        if (connected() && subscribeTopic(subscription))
+            return true;
+
+        if (subscribed > index)
+            subscribed = index;
+        return false;
+    }
+    return false;
+}
+
+/* handle a topic received through a wildcard subscription, no subscribe is sent */
+bool MQTT::route(const char * topic, Callback_t callback, void * param) {
+    return router.add(topic, callback, param);
+}
+
 /* callback called by PubSubClient when a message is received from the MQTT server */
 void MQTT::subscribeCbk(char * topic, uint8_t * payload, unsigned int len) {
 
+    // the retained values flood in on connect, they are applied a few at a time
+    if (config.mqtt_version == 5 ? client5.retained() : transport.retained()) {
+        acceptRetained(topic, payload, len);
+        return;
+    }
+
     LOG_F(CONSOLE_YELLOW "RX %3uB" CONSOLE_RESET" T:%s", len, topic);
+    deliver(topic, payload, len, false);
+}
+
+/* invoke the handler of a topic */
+void MQTT::deliver(const char * topic, uint8_t * payload, unsigned int len, bool retained) {
 
-    // invoke subscribers
     void * param = NULL;
     auto handlerCbk = getSubscriptionHandler(topic, &param);
     if (handlerCbk != NULL) {
+        rxRetained = retained;
         handlerCbk(topic, payload, len, param);
+        rxRetained = false;
     } else {
-        LOG_F("Failed finding subscription for %s!", topic);
+        LOG_F("No route for %s, dropped", topic);
+    }
+}
+
+/* 
+ * Keep the latest retained value of a topic, replacing the one not applied
+ * yet. Topics without a route are dropped right away. A full table makes
+ * room by applying its oldest values.
+ */
+void MQTT::acceptRetained(const char * topic, uint8_t * payload, unsigned int len) {
+
+    void * param;
+
+    stats.retained ++;
+    if (router.match(topic, &param) == NULL)
+        return;
+
+    while (rxTable.fits(topic, len) == false) {
+        if (rxTable.empty()) {
+            deliver(topic, payload, len, true);
+            return;
+        }
+        applyRetained();
     }
+
+    rxTable.push(topic, payload, len, true, 0);
+    if (taskApply.isEnabled() == false)
+        taskApply.enable();
 }
 
-/* publish */
+/* apply the oldest retained value */
+bool MQTT::applyRetained() {
+
+    MQTTQueue::Message_t message;
+
+    if (rxTable.front(message) == false)
+        return false;
+
+    // the record is ours, handlers get it as received
+    deliver(message.topic, (uint8_t *) message.payload, message.length, true);
+    rxTable.pop();
+    return true;
+}
+
+/* receive, PubSubClient reads a single packet on each loop() */
+void MQTT::handleCbk() {
+
+    loop();
+    for (unsigned int n = 1; n < MQTT_RX_BURST && config.mqtt_version != 5 && transport.available() > 0; n ++)
+        loop();
+}
+
+/* apply a few retained values on each run, between the other tasks */
+void MQTT::applyCbk() {
+
+    for (unsigned int n = 0; n < MQTT_RX_APPLY_BURST && applyRetained(); n ++);
+
+    if (rxTable.empty() == false)
+        return;
+
+    taskApply.disable();
+
+    // settled once nothing more is waiting to be received
+    if (rxSettled == false && connectedAt != 0) {
+        stats.settle_ms = millis() - connectedAt;
+        if (transport.available() > 0)
+            return;
+
+        rxSettled = true;
+        LOG_F("Retained messages applied %lu ms after connecting (received=%lu replaced=%u)",
+            stats.settle_ms, stats.retained, rxTable.coalesced());
+    }
+}
+
+/* publish, the message is queued and sent by the drain task */
 boolean MQTT::publish(const char* topic, const char* payload) {
-    LOG_F(CONSOLE_GREEN "TX %3uB" CONSOLE_RESET " T:%s", strlen(payload), topic);
-    return PubSubClient::publish(topic, payload);
+    return enqueue(topic, (const uint8_t *) payload, strlen(payload), false, PRIORITY_STATE);
 }
 
-boolean MQTT::publish(const char* topic, const char* payload, boolean retained) {
-    LOG_F(CONSOLE_GREEN "TX %3uB" CONSOLE_RESET " T:%s %s", strlen(payload), topic,  retained ? "(retain)" : "");
-    return PubSubClient::publish(topic, payload, retained);
+boolean MQTT::publish(const char* topic, const char* payload, boolean retained, Priority priority) {
+    return enqueue(topic, (const uint8_t *) payload, strlen(payload), retained, priority);
 }
 
 boolean MQTT::publish(const char* topic, const uint8_t * payload, unsigned int plength) {
-    LOG_F(CONSOLE_GREEN "TX %3uB" CONSOLE_RESET " T:%s", plength, topic);
-    return PubSubClient::publish(topic, payload, plength);
+    return enqueue(topic, payload, plength, false, PRIORITY_STATE);
+}
+
+boolean MQTT::publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, 
+                      Priority priority) {
+    return enqueue(topic, payload, plength, retained, priority);
+}
+
+/* for payloads that don't fit the client buffer, streamed when sent */
+boolean MQTT::publishLarge(const char* topic, const char* payload, boolean retained, Priority priority) {
+    return enqueue(topic, (const uint8_t *) payload, strlen(payload), retained, priority);
+}
+
+/* send right away, bypassing the queue and the budget, fails if not connected */
+boolean MQTT::publishDirect(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained) {
+
+    MQTTQueue::Message_t message;
+
+    message.topic    = topic;
+    message.payload  = payload;
+    message.length   = plength;
+    message.retained = retained;
+    message.time     = 0;
+    message.dup      = false;
+    message.packet_id = 0;
+    message.ref      = 0;
+    return send(message) == SEND_OK;
+}
+
+/* 
+ * Stream a message straight into the client, bypassing the queue and the
+ * budget like publishDirect(). The payload is written in pieces with
+ * writeDirect(), their lengths must add up to the one given here.
+ */
+boolean MQTT::beginDirect(const char* topic, unsigned int plength, boolean retained) {
+
+    if (connected() == false)
+        return false;
+
+    budgetMessages.force(1);
+    budgetBytes.force(strlen(topic) + plength);
+    logSend(topic, plength, retained, " (streamed)");
+
+    if (config.mqtt_version == 5)
+        return client5.beginPublish(topic, plength, retained, 0, false, config.mqtt_message_expiry_sec);
+    return beginPublish(topic, plength, retained);
+}
+
+boolean MQTT::writeDirect(const uint8_t * data, size_t len) {
+
+    if (config.mqtt_version == 5)
+        return client5.writePayload(data, len);
+    return write(data, len) == len;
+}
+
+boolean MQTT::endDirect() {
+
+    if (config.mqtt_version == 5)
+        return client5.connected();
+    return endPublish() != 0;
+}
+
+/* logged in pieces, printf allocates for lines over its 64 bytes buffer */
+void MQTT::logSend(const char * topic, unsigned int length, bool retained, const char * note) {
+    LOG_PART_START(CONSOLE_GREEN "TX ");
+    LOG_PART(length);
+    LOG_PART("B" CONSOLE_RESET " T:");
+    LOG_PART(topic);
+    LOG_PART(retained ? " (retain)" : "");
+    LOG_PART_END(note);
+}
+
+/* send one message, streaming the ones that don't fit the client buffer */
+/* 
+ * Write a message to the client. An MQTT 5 message queued for longer than
+ * its expiry isn't sent, the caller drops it as if it was.
+ */
+MQTT::SendResult MQTT::send(const MQTTQueue::Message_t & message, uint16_t packet_id) {
+
+    uint32_t expiry = config.mqtt_message_expiry_sec;
+    bool     success;
+
+    if (connected() == false)
+        return SEND_FAILED;
+
+    // the time spent queued counts against the expiry
+    if (config.mqtt_version == 5 && expiry && message.time && wallclock.isSynced()) {
+        uint32_t age = wallclock.now() - message.time;
+        if (age >= expiry) {
+            LOG_F("Expired after %us in the queue, dropped", age);
+            stats.expired ++;
+            return SEND_EXPIRED;
+        }
+        expiry -= age;
+    }
+
+    // counts against the budget, what isn't held by it leaves a debt
+    budgetMessages.force(1);
+    budgetBytes.force(strlen(message.topic) + message.length);
+
+    logSend(message.topic, message.length, message.retained, 
+        packet_id ? (message.dup ? " (qos1, dup)" : " (qos1)") : "");
+
+    if (config.mqtt_version == 5) {
+        success = client5.publish(message.topic, message.payload, message.length, message.retained, 
+            packet_id, message.dup, expiry);
+    } else
+    if (packet_id != 0) {
+        // PubSubClient only builds QoS 0 packets
+        success = transport.publishQoS1(message.topic, message.payload, message.length, 
+            message.retained, message.dup, packet_id);
+    } else
+    if (message.length + strlen(message.topic) + 7 <= getBufferSize()) {
+        // fixed header, topic length and topic
+        success = PubSubClient::publish(message.topic, message.payload, message.length, message.retained);
+    } else
+    if (beginPublish(message.topic, message.length, message.retained)) {
+        bool written = write(message.payload, message.length) == message.length;
+        success = endPublish() != 0 && written;
+    } else {
+        success = false;
+    }
+
+    return success ? SEND_OK : SEND_FAILED;
+}
+
+/* 
+ * Queue a message in the queue of its class. Alerts and state filling their
+ * queue are marked for the drain task to move their oldest messages to the
+ * spool, SPIFFS isn't written here. If still full, diagnostics, alerts and
+ * state drop their oldest, discovery is refused until the queue drains.
+ */
+boolean MQTT::enqueue(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, 
+                      Priority priority) {
+
+    MQTTQueue & queue = queues[priority];
+    uint32_t    time  = wallclock.isSynced() ? wallclock.now() : 0;
+
+    // too large for the queue, can only go out now
+    if (MQTTQueue::recordSize(strlen(topic), plength) > MQTTQueue::recordSize(0, MQTT_QUEUE_MAX_MESSAGE)) {
+        MQTTQueue::Message_t message = { topic, payload, plength, (bool) retained, time, false, 0, 0 };
+        if (send(message) == SEND_OK)
+            return true;
+
+        LOG_F("Message too large to queue (%uB), dropped T:%s", plength, topic);
+        stats.dropped ++;
+        return false;
+    }
+
+    while (queue.fits(topic, plength) == false) {
+        if (priority == PRIORITY_DISCOVERY)
+            return false;
+
+        // the spool didn't keep up, or there's none, the oldest message makes room
+        if (queue.empty()) {
+            stats.dropped ++;
+            return false;
+        }
+        dropOldest(priority);
+    }
+
+    queue.push(topic, payload, plength, retained, time);
+
+    // spilled by the drain task, running even while offline
+    if (spoolReady && priority <= PRIORITY_STATE && 
+        queue.bytes() > queue.capacity() * MQTT_QUEUE_SPILL_PERCENT / 100) {
+        spillPending |= 1 << priority;
+        taskDrain.enableIfNot();
+    }
+
+    unsigned int depth = 0;
+    for (auto & each : queues)
+        depth += each.count();
+    if (depth > stats.max_depth)
+        stats.max_depth = depth;
+
+    // messages queued while the task is enabled are sent on its next run
+    return true;
+}
+
+/* move the oldest queued message of a class to the spool */
+bool MQTT::spillOldest(uint8_t priority) {
+
+    MQTTQueue::Message_t message;
+
+    if (spoolReady == false || queues[priority].front(message) == false)
+        return false;
+
+    if (spool.append(message) == false)
+        return false;
+
+    // if it was in flight, it is sent again from the spool
+    forget(priority, message.ref);
+    queues[priority].pop();
+    stats.spilled ++;
+    return true;
 }
 
-boolean MQTT::publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained) {
-    LOG_F(CONSOLE_GREEN "TX %3uB" CONSOLE_RESET " T:%s %s", plength, topic, retained ? "(retain)" : "");
-    return PubSubClient::publish(topic, payload, plength, retained);
+/* 
+ * Move the oldest alerts and state of the marked classes still over their
+ * mark to the spool, down to half of it, so SPIFFS is written in runs.
+ */
+void MQTT::spillMarked() {
+
+    for (uint8_t priority = PRIORITY_ALERT; priority <= PRIORITY_STATE; priority ++) {
+        MQTTQueue & queue = queues[priority];
+        size_t      mark  = queue.capacity() * MQTT_QUEUE_SPILL_PERCENT / 100;
+
+        if ((spillPending & (1 << priority)) == 0 || queue.bytes() <= mark)
+            continue;
+
+        while (queue.bytes() > mark / 2 && spillOldest(priority));
+    }
+    spillPending = 0;
+}
+
+/* make room for a message, when the spool didn't */
+void MQTT::dropOldest(uint8_t priority) {
+
+    MQTTQueue::Message_t message;
+
+    if (queues[priority].front(message) == false)
+        return;
+
+    forget(priority, message.ref);
+    queues[priority].pop();
+    stats.dropped ++;
+    LOG_F("Queue full, dropped the oldest message (dropped=%lu)", stats.dropped);
+}
+
+/* a QoS 1 message left the queue before its PUBACK */
+void MQTT::forget(uint8_t priority, uint32_t ref) {
+
+    for (uint8_t i = 0; i < inflightCount; i ++) {
+        if (inflight[i].spooled == false && inflight[i].priority == priority && inflight[i].ref == ref) {
+            inflight[i] = inflight[-- inflightCount];
+            return;
+        }
+    }
+}
+
+/* a spooled message was delivered */
+void MQTT::replayed(uint32_t time) {
+
+    stats.replayed ++;
+
+    if (spool.empty()) {
+        stats.replay_ms = millis() - replayStart;
+        LOG_F("Spool replayed in %lu ms (replayed=%lu spilled=%lu dropped=%lu), last message was %lds old",
+            stats.replay_ms, stats.replayed, stats.spilled, stats.dropped + spool.dropped(),
+            time && wallclock.isSynced() ? (long) (wallclock.now() - time) : -1L);
+        replayStart = 0;
+    }
+}
+
+/* move the alerts and state queued to the spool, before a restart */
+void MQTT::spill() {
+
+    unsigned int count = queues[PRIORITY_ALERT].count() + queues[PRIORITY_STATE].count();
+
+    while (spillOldest(PRIORITY_ALERT));
+    while (spillOldest(PRIORITY_STATE));
+
+    unsigned int left = queues[PRIORITY_ALERT].count() + queues[PRIORITY_STATE].count();
+    if (count > 0) {
+        LOG_F("Spilled %u queued messages, %u left", count - left, left);
+    }
+}
+
+/* send a burst of queued messages, written out together */
+void MQTT::drainCbk() {
+
+    // messages published directly wait at most for the batch deadline
+    batch.poll();
+
+    if (connected() == false) {
+        if (spillPending)
+            spillMarked();
+        return;
+    }
+
+    if (config.mqtt_qos > 0)
+        drainQoS1();
+    else
+        drain();
+
+    batch.flush();
+
+    // online, only what the burst didn't bring under the mark is spilled
+    if (spillPending)
+        spillMarked();
+}
+
+/* 
+ * Oldest message of the first class with one queued, from a class down.
+ * For QoS 1, the oldest not sent yet.
+ */
+uint8_t MQTT::firstQueued(MQTTQueue::Message_t & message, uint8_t from, bool unsent) {
+
+    for (uint8_t priority = from; priority < PRIORITY_COUNT; priority ++) {
+        if (unsent ? queues[priority].unsent(message) : queues[priority].front(message))
+            return priority;
+    }
+    return PRIORITY_COUNT;
+}
+
+/* the budget of the station has room for a message, refilled since the last check */
+bool MQTT::budget(const MQTTQueue::Message_t & message) {
+
+    unsigned long now = millis();
+
+    budgetMessages.refill(now);
+    budgetBytes.refill(now);
+
+    if (budgetMessages.has(1) && budgetBytes.has(strlen(message.topic) + message.length))
+        return true;
+
+    stats.throttled ++;
+    return false;
+}
+
+/* 
+ * Send QoS 0 messages. Alerts go first, then the spooled messages, older 
+ * than the queued ones, then the other classes in order, within the budget.
+ */
+void MQTT::drain() {
+
+    MQTTQueue::Message_t message;
+
+    for (unsigned int sent = 0; sent < MQTT_QUEUE_BURST; sent ++) {
+
+        // an expired message is dropped as if sent
+        if (queues[PRIORITY_ALERT].front(message)) {
+            if (send(message) == SEND_FAILED)
+                return;
+            queues[PRIORITY_ALERT].pop();
+            continue;
+        }
+
+        if (spool.empty() == false) {
+            // the record can't be read now (no memory for it), it's retried on the next run
+            if (spool.front(message) == false)
+                return;
+            if (budget(message) == false)
+                return;
+            if (replayStart == 0)
+                replayStart = millis();
+            if (send(message) == SEND_FAILED)
+                return;
+
+            spool.pop();
+            replayed(message.time);
+            continue;
+        }
+
+        uint8_t priority = firstQueued(message, PRIORITY_STATE, false);
+        if (priority == PRIORITY_COUNT || budget(message) == false)
+            return;
+        if (send(message) == SEND_FAILED)
+            return;
+        queues[priority].pop();
+    }
+}
+
+/* 
+ * Send QoS 1 messages up to the in-flight window, without waiting for the
+ * PUBACK of each. They stay queued until acknowledged, in pubackCbk().
+ * Spooled messages go one at a time, the spool reads a single record.
+ * The classes go in the same order as for QoS 0.
+ */
+void MQTT::drainQoS1() {
+
+    MQTTQueue::Message_t  message;
+    MQTTSpool::Position_t position;
+
+    // take the PUBACKs received since the last run, it reopens the window
+    for (uint8_t n = inflightCount; n > 0 && transport.available() > 0; n --)
+        loop();
+
+    // the server may take fewer
+    unsigned int window = config.mqtt_inflight;
+    if (config.mqtt_version == 5 && client5.receiveMaximum() < window)
+        window = client5.receiveMaximum();
+
+    for (unsigned int sent = 0; sent < MQTT_QUEUE_BURST && inflightCount < window; sent ++) {
+
+        if (queues[PRIORITY_ALERT].unsent(message)) {
+            if (sendQoS1(message, PRIORITY_ALERT) == false)
+                return;
+            continue;
+        }
+
+        if (spool.empty() == false) {
+            if (spoolSent || spool.front(message, &position) == false || budget(message) == false)
+                return;
+            if (replayStart == 0)
+                replayStart = millis();
+            // sent before reconnecting, with the packet id the broker session holds
+            if (spoolDup) {
+                message.dup       = true;
+                message.packet_id = spoolPacketId;
+            }
+            if (sendQoS1(message, PRIORITY_STATE, &position) == false)
+                return;
+            continue;
+        }
+
+        uint8_t priority = firstQueued(message, PRIORITY_STATE, true);
+        if (priority == PRIORITY_COUNT || budget(message) == false)
+            return;
+        if (sendQoS1(message, priority) == false)
+            return;
+    }
+}
+
+/* 
+ * Send a message and wait for its PUBACK, spooled at the position given. A
+ * message sent before keeps its packet id, the others take the next one.
+ */
+bool MQTT::sendQoS1(const MQTTQueue::Message_t & message, uint8_t priority, 
+                    const MQTTSpool::Position_t * spooled) {
+
+    uint16_t packet_id = message.packet_id;
+
+    if (packet_id == 0 || inflightId(packet_id))
+        packet_id = newPacketId();
+
+    // a message that fails stays marked sent, unsend() resets it on reconnect
+    if (spooled == NULL)
+        queues[priority].markSent(message.ref, packet_id);
+
+    switch (send(message, packet_id)) {
+        case SEND_FAILED:
+            return false;
+
+        // never went out, no PUBACK will come: it leaves the queue, or the spool, now
+        case SEND_EXPIRED:
+            if (spooled != NULL) {
+                spool.pop();
+                replayed(message.time);
+            } else {
+                queues[priority].ack(message.ref);
+            }
+            return true;
+
+        case SEND_OK:
+            break;
+    }
+
+    inflight[inflightCount].packet_id = packet_id;
+    inflight[inflightCount].spooled   = spooled != NULL;
+    inflight[inflightCount].priority  = priority;
+    inflight[inflightCount].ref       = message.ref;
+    if (spooled != NULL)
+        inflight[inflightCount].at    = *spooled;
+    inflightCount ++;
+
+    if (spooled) {
+        spoolSent     = true;
+        spoolPacketId = packet_id;
+    }
+    return true;
+}
+
+/* a packet id in flight */
+bool MQTT::inflightId(uint16_t packet_id) {
+
+    for (uint8_t i = 0; i < inflightCount; i ++) {
+        if (inflight[i].packet_id == packet_id)
+            return true;
+    }
+    return false;
+}
+
+/* the next packet id, not used by a message in flight */
+uint16_t MQTT::newPacketId() {
+
+    uint16_t packet_id;
+
+    do {
+        packet_id = nextPacketId ++;
+        if (nextPacketId == 0)
+            nextPacketId = 1;
+    } while (inflightId(packet_id));
+
+    return packet_id;
+}
+
+/* the broker acknowledged a QoS 1 message */
+void MQTT::pubackCbk(uint16_t packet_id) {
+
+    MQTTQueue::Message_t  message;
+    MQTTSpool::Position_t position;
+
+    for (uint8_t i = 0; i < inflightCount; i ++) {
+        if (inflight[i].packet_id != packet_id)
+            continue;
+
+        if (inflight[i].spooled) {
+            // its segment may have been dropped for new ones meanwhile, then the oldest is another record
+            if (spool.front(message, &position) && 
+                position.seq == inflight[i].at.seq && position.offset == inflight[i].at.offset) {
+                spool.pop();
+                replayed(message.time);
+            }
+            spoolSent = false;
+            spoolDup  = false;
+        } else {
+            queues[inflight[i].priority].ack(inflight[i].ref);
+        }
+
+        stats.acked ++;
+        inflight[i] = inflight[-- inflightCount];
+        return;
+    }
+
+    LOG_F("PUBACK for unknown packet %u", packet_id);
+}
+
+/* counters of the outbound queue */
+void MQTT::queueStats(QueueStats_t & result) {
+
+    result           = stats;
+    result.depth     = 0;
+    result.bytes     = 0;
+    result.coalesced = 0;
+    result.spooled   = spool.count();
+    result.inflight  = inflightCount;
+
+    for (auto & queue : queues) {
+        result.depth     += queue.count();
+        result.bytes     += queue.bytes();
+        result.coalesced += queue.coalesced();
+    }
+    result.dropped   = stats.dropped + spool.dropped();
+    result.writes    = batch.writes();
+    result.segments  = batch.segments();
 }
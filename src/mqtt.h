@@ -27,10 +27,20 @@
 
 #include <WiFi.h>
 #include <PubSubClient.h>
-#include <list>
-#include <utility>
+#include <vector>
+#include <string>
+#include <firmware_config.h>
 
 #include "scheduler.h"
+#include "topic_router.h"
+#include "mqtt_queue.h"
+#include "mqtt_spool.h"
+#include "mqtt_transport.h"
+#include "mqtt5_client.h"
+#include "tls_client.h"
+#include "batch_client.h"
+#include "token_bucket.h"
+#include "topic_arena.h"
 
 #define MQTT_UPDATE_INTERVAL 100 /* ms */
 
@@ -40,48 +50,193 @@
 class MQTT : public PubSubClient {
     public:
     
-        typedef void (*Callback_t)(const char *, uint8_t *, unsigned int, void * param);
+        typedef TopicRouter::Handler_t Callback_t;
 
+        /* subscription sent on connecting */
         typedef struct {
             std::string topic;
-            Callback_t  handler;
-            void *      param;
+            bool        retained;   // get the retained messages on subscribing (MQTT 5)
         } Subscription_t;
 
-        typedef std::list<Subscription_t> SubscriptionList_t;
+        typedef std::vector<Subscription_t> SubscriptionList_t;
+
+        /* classes of outbound messages, sent in this order */
+        enum Priority {
+            PRIORITY_ALERT,         // alert states and events, not held by the budget
+            PRIORITY_STATE,         // plant, zone and sensor values, collaboration
+            PRIORITY_DIAGNOSTIC,    // signal levels, only the last value of a topic counts
+            PRIORITY_DISCOVERY,     // home assistant discovery, refused while its queue is full
+            PRIORITY_COUNT
+        };
+
+        /* outbound queue counters */
+        typedef struct {
+            unsigned int  depth;        // messages queued in RAM
+            size_t        bytes;        // bytes used in RAM
+            unsigned int  max_depth;
+            unsigned int  spooled;      // messages in the flash spool
+            unsigned int  inflight;     // QoS 1 messages waiting for their PUBACK
+            unsigned long acked;        // QoS 1 messages acknowledged
+            unsigned long resent;       // QoS 1 messages sent again after reconnecting
+            unsigned long coalesced;    // messages replaced by a newer value of their topic
+            unsigned long spilled;      // messages moved to the spool
+            unsigned long replayed;     // messages sent from the spool
+            unsigned long dropped;
+            unsigned long expired;      // MQTT 5 messages past their expiry while queued
+            unsigned long replay_ms;    // time taken by the last spool replay
+            unsigned long throttled;    // sends held back by the budget of the station
+            unsigned long retained;     // retained messages received
+            unsigned long settle_ms;    // from connecting to the retained messages all applied
+            unsigned long writes;       // writes of the MQTT clients
+            unsigned long segments;     // writes to the network, after batching
+        } QueueStats_t;
 
     public:
         MQTT();
 
+        bool       beginQueue();
         bool       begin();
         void       end();
 
-        bool       subscribeTo(const char * topic, Callback_t callback, void * param = NULL);
+        boolean    connected();
+        int        state();
+        boolean    loop();
+
+        bool       subscribeTo(const char * topic, Callback_t callback, void * param = NULL, bool retained = true);
+        bool       resubscribe(const char * topic, bool retained);
+        bool       route(const char * topic, Callback_t callback, void * param = NULL);
         bool       hasSubscription(const char * topic);
         Callback_t getSubscriptionHandler(const char * topic, void ** param = NULL);
         
         boolean    publish(const char* topic, const char* payload);
-        boolean    publish(const char* topic, const char* payload, boolean retained);
+        boolean    publish(const char* topic, const char* payload, boolean retained, Priority priority = PRIORITY_STATE);
         boolean    publish(const char* topic, const uint8_t * payload, unsigned int plength);
-        boolean    publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+        boolean    publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, 
+                           Priority priority = PRIORITY_STATE);
+        boolean    publishLarge(const char* topic, const char* payload, boolean retained, Priority priority = PRIORITY_STATE);
+        boolean    publishDirect(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+        boolean    beginDirect(const char* topic, unsigned int plength, boolean retained);
+        boolean    writeDirect(const uint8_t * data, size_t len);
+        boolean    endDirect();
+
+        void       spill();
+        void       queueStats(QueueStats_t & stats);
+
+        bool       isRetained();
+        TopicArena & topics();
 
     protected: 
+        /* outcome of sending a queued message */
+        enum SendResult {
+            SEND_FAILED,            // not connected or not written, stays queued
+            SEND_OK,
+            SEND_EXPIRED            // past its MQTT 5 expiry, not sent, to be dropped
+        };
+
+        /* QoS 1 message waiting for its PUBACK */
+        typedef struct {
+            uint16_t       packet_id;
+            bool           spooled;     // or in a RAM queue
+            uint8_t        priority;    // the RAM queue
+            uint32_t       ref;         // of the record in the RAM queue
+            MQTTSpool::Position_t at;   // of the record in the spool
+        } Inflight_t;
+
         WiFiClient         wifiClient;
+        TLSClient          tlsClient;
+        BatchClient        batch;
+        MQTTTransport      transport;
+        MQTT5Client        client5;
         Task               taskHandle;
+        Task               taskDrain;
+        Task               taskApply;
         SubscriptionList_t subscriptions;
-
+        TopicRouter        router;
+        TopicArena         arena;
+        uint8_t            queueBuffer[MQTT_QUEUE_SIZE] __attribute__((aligned(4))); // record headers are read in place
+        MQTTQueue          queues[PRIORITY_COUNT];
+        TokenBucket        budgetMessages;
+        TokenBucket        budgetBytes;
+        MQTTSpool          spool;
+        bool               spoolReady;
+        uint8_t            spillPending; // classes over their spill mark, a bit each
+        QueueStats_t       stats;
+        unsigned long      replayStart;
+        Inflight_t         inflight[MQTT_INFLIGHT_MAX];
+        uint8_t            inflightCount;
+        uint16_t           nextPacketId;
+        bool               spoolSent;   // the spooled message is in flight
+        bool               spoolDup;    // and was sent before reconnecting
+        uint16_t           spoolPacketId; // it was sent with
+        size_t             subscribed;  // subscriptions sent in the broker session
+        uint8_t            rxBuffer[MQTT_RX_TABLE_SIZE] __attribute__((aligned(4)));
+        MQTTQueue          rxTable;     // latest retained value of each topic, not applied yet
+        bool               rxRetained;  // the message being handled is a retained one
+        bool               rxSettled;   // the retained messages of the connection were applied
+        unsigned long      connectedAt;
+
+        boolean    enqueue(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, 
+                           Priority priority);
+        SendResult send(const MQTTQueue::Message_t & message, uint16_t packet_id = 0);
+        bool       sendQoS1(const MQTTQueue::Message_t & message, uint8_t priority, 
+                            const MQTTSpool::Position_t * spooled = NULL);
+        bool       inflightId(uint16_t packet_id);
+        uint16_t   newPacketId();
+        bool       budget(const MQTTQueue::Message_t & message);
+        uint8_t    firstQueued(MQTTQueue::Message_t & message, uint8_t from, bool unsent);
+        bool       spillOldest(uint8_t priority);
+        void       spillMarked();
+        void       dropOldest(uint8_t priority);
+        void       forget(uint8_t priority, uint32_t ref);
+        void       replayed(uint32_t time);
+        void       drainCbk();
+        void       drain();
+        void       drainQoS1();
+        void       pubackCbk(uint16_t packet_id);
         void       resendSubscriptions();
+        bool       subscribeTopic(const Subscription_t & subscription);
+        void       logSend(const char * topic, unsigned int length, bool retained, const char * note);
         void       subscribeCbk(char * topic, uint8_t * payload, unsigned int len);
+        void       deliver(const char * topic, uint8_t * payload, unsigned int len, bool retained);
+        void       acceptRetained(const char * topic, uint8_t * payload, unsigned int len);
+        bool       applyRetained();
+        void       handleCbk();
+        void       applyCbk();
 
         static void s_subscribeCbk(char * topic, uint8_t * payload, unsigned int len);
         static void s_taskHandleCbk();
+        static void s_drainCbk();
+        static void s_applyCbk();
+        static void s_pubackCbk(uint16_t packet_id);
 };
 
 extern MQTT mqtt;
 
 /* inlines for MQTT */
 inline void MQTT::s_taskHandleCbk() {
-    mqtt.loop();
+    mqtt.handleCbk();
+}
+
+inline void MQTT::s_drainCbk() {
+    mqtt.drainCbk();
+}
+
+inline void MQTT::s_applyCbk() {
+    mqtt.applyCbk();
+}
+
+/* the handler being called got a retained message, a value from the past */
+inline bool MQTT::isRetained() {
+    return rxRetained;
+}
+
+/* precomputed topics of the periodic publishes */
+inline TopicArena & MQTT::topics() {
+    return arena;
+}
+
+inline void MQTT::s_pubackCbk(uint16_t packet_id) {
+    mqtt.pubackCbk(packet_id);
 }
 
 inline void MQTT::s_subscribeCbk(char * topic, uint8_t * payload, unsigned int len) {
@@ -0,0 +1,331 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "mqtt5_client.h"
+#include "config.h"
+
+#define LOG_TAG LOG_TAG_MQTT
+#include "log.h"
+
+MQTT5Client::MQTT5Client(Client & client, Callback_t callback, AckHandler_t ack_handler)
+  : _client(&client)
+  , _callback(callback)
+  , _ack_handler(ack_handler)
+  , _buffer(NULL)
+  , _buffer_size(0)
+  , _state(MQTT_DISCONNECTED)
+  , _user_key(NULL)
+  , _user_value(NULL)
+  , _keep_alive(MQTT_KEEPALIVE)
+  , _next_packet_id(1)
+  , _last_in(0)
+  , _last_out(0)
+  , _ping_outstanding(false)
+  , _retained(false)
+  , _receive(RECEIVE_HEADER)
+  , _header(0)
+  , _shift(0)
+  , _length(0)
+  , _position(0) {
+  memset(&_connack, 0, sizeof(_connack));
+}
+
+/* connect and wait for the CONNACK, as PubSubClient does */
+bool MQTT5Client::connect(const char * host, uint16_t port, const MQTT5Codec::Connect_t & connect, size_t buffer_size) {
+
+  if (_buffer_size != buffer_size) {
+    free(_buffer);
+    _buffer      = (uint8_t *) malloc(buffer_size);
+    _buffer_size = _buffer ? buffer_size : 0;
+  }
+
+  if (_buffer == NULL || _client->connect(host, port) == 0) {
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+
+  size_t size = MQTT5Codec::encodeConnect(_buffer, _buffer_size, connect);
+  _receive    = RECEIVE_HEADER;
+  _keep_alive = connect.keep_alive;
+
+  if (size == 0 || write(_buffer, size) == false) {
+    close(MQTT_CONNECT_FAILED);
+    return false;
+  }
+
+  unsigned long start = millis();
+  while (millis() - start < MQTT_SOCKET_TIMEOUT * 1000UL) {
+
+    if (receive() == false) {
+      delay(1);
+      continue;
+    }
+
+    if ((_header >> 4) != MQTT5Codec::CONNACK || _position != _length ||
+        MQTT5Codec::decodeConnack(_buffer, _length, _connack) == false) {
+      close(MQTT_CONNECT_FAILED);
+      return false;
+    }
+
+    if (_connack.reason != 0) {
+      LOG_F("Connection refused, reason 0x%02x", _connack.reason);
+      close(_connack.reason);
+      return false;
+    }
+
+    LOG_F("MQTT 5 connected, receive maximum %u, topic aliases %u", 
+      _connack.receive_maximum, _connack.topic_alias_maximum);
+
+    _aliases.reset(_connack.topic_alias_maximum);
+    _last_in          = millis();
+    _ping_outstanding = false;
+    _state            = MQTT_CONNECTED;
+    return true;
+  }
+
+  close(MQTT_CONNECTION_TIMEOUT);
+  return false;
+}
+
+void MQTT5Client::disconnect() {
+
+  uint8_t packet[2];
+
+  if (connected())
+    write(packet, MQTT5Codec::encodeSimple(packet, MQTT5Codec::DISCONNECT));
+  close(MQTT_DISCONNECTED);
+}
+
+void MQTT5Client::close(int state) {
+  _client->stop();
+  _state = state;
+}
+
+bool MQTT5Client::connected() {
+
+  if (_state == MQTT_CONNECTED && _client->connected() == 0)
+    _state = MQTT_CONNECTION_LOST;
+  return _state == MQTT_CONNECTED;
+}
+
+bool MQTT5Client::write(const uint8_t * data, size_t size) {
+
+  if (_client->write(data, size) != size)
+    return false;
+
+  _last_out = millis();
+  return true;
+}
+
+/* read what is available, true when a whole packet is in the buffer */
+bool MQTT5Client::receive() {
+
+  while (_client->available() > 0) {
+    switch (_receive) {
+
+      case RECEIVE_HEADER:
+        _header   = _client->read();
+        _length   = 0;
+        _shift    = 0;
+        _position = 0;
+        _receive  = RECEIVE_LENGTH;
+        break;
+
+      case RECEIVE_LENGTH: {
+        uint8_t digit = _client->read();
+        _length |= (uint32_t) (digit & 0x7F) << _shift;
+        _shift  += 7;
+
+        if ((digit & 0x80) == 0) {
+          _receive = RECEIVE_BODY;
+          if (_length == 0) {
+            _receive = RECEIVE_HEADER;
+            return true;
+          }
+        }
+      } break;
+
+      case RECEIVE_BODY: {
+        // the part not fitting the buffer is read and dropped
+        uint8_t   skip[32];
+        uint8_t * into  = _position < _buffer_size ? _buffer + _position : skip;
+        size_t    room  = _position < _buffer_size ? _buffer_size - _position : sizeof(skip);
+        size_t    want  = _length - _position;
+        int       count = _client->read(into, want < room ? want : room);
+
+        if (count <= 0)
+          return false;
+
+        _position += count;
+        if (_position == _length) {
+          _receive = RECEIVE_HEADER;
+          if (_length > _buffer_size) {
+            LOG_F("Packet of %u bytes dropped, buffer is %u", _length, (unsigned int) _buffer_size);
+            continue;
+          }
+          return true;
+        }
+      } break;
+    }
+  }
+  return false;
+}
+
+/* handle the packet in the buffer */
+void MQTT5Client::handle() {
+
+  uint16_t packet_id;
+  uint8_t  reason;
+
+  _last_in = millis();
+
+  switch (_header >> 4) {
+
+    case MQTT5Codec::PUBLISH: {
+      MQTT5Codec::Received_t received;
+
+      if (MQTT5Codec::decodePublish(_header & 0x0F, _buffer, _length, received) == false) {
+        LOG_F("Malformed PUBLISH dropped");
+        return;
+      }
+
+      // subscriptions are QoS 0, but the server may still send QoS 1
+      if (received.qos > 0) {
+        uint8_t puback[4] = { MQTT5Codec::PUBACK << 4, 2, 
+          (uint8_t) (received.packet_id >> 8), (uint8_t) (received.packet_id & 0xFF) };
+        write(puback, sizeof(puback));
+      }
+
+      _retained = received.retained;
+      if (_callback != NULL)
+        _callback(received.topic, received.payload, received.payload_len);
+    } break;
+
+    case MQTT5Codec::PUBACK:
+      if (MQTT5Codec::decodePuback(_buffer, _length, packet_id, reason) == false)
+        return;
+      if (reason >= 0x80) {
+        LOG_F("Publish %u refused, reason 0x%02x", packet_id, reason);
+      }
+      if (_ack_handler != NULL)
+        _ack_handler(packet_id);
+      break;
+
+    case MQTT5Codec::SUBACK:
+      if (MQTT5Codec::decodeSuback(_buffer, _length, packet_id, reason) && reason >= 0x80) {
+        LOG_F("Subscription %u refused, reason 0x%02x", packet_id, reason);
+      }
+      break;
+
+    case MQTT5Codec::PINGRESP:
+      _ping_outstanding = false;
+      break;
+
+    case MQTT5Codec::DISCONNECT:
+      LOG_F("Disconnected by the server, reason 0x%02x", _length > 0 ? _buffer[0] : 0);
+      close(MQTT_CONNECTION_LOST);
+      break;
+  }
+}
+
+/* keep the connection alive and handle the received packets */
+bool MQTT5Client::loop() {
+
+  if (connected() == false)
+    return false;
+
+  unsigned long now      = millis();
+  unsigned long interval = _keep_alive * 1000UL;
+
+  if (_keep_alive && (now - _last_in > interval || now - _last_out > interval)) {
+    if (_ping_outstanding) {
+      close(MQTT_CONNECTION_TIMEOUT);
+      return false;
+    }
+
+    uint8_t packet[2];
+    write(packet, MQTT5Codec::encodeSimple(packet, MQTT5Codec::PINGREQ));
+    _last_in          = now;
+    _ping_outstanding = true;
+  }
+
+  while (_state == MQTT_CONNECTED && receive())
+    handle();
+
+  return connected();
+}
+
+bool MQTT5Client::subscribe(const char * topic, uint8_t options) {
+
+  uint8_t packet[MQTT5_PUBLISH_HEADER];
+  size_t  size;
+
+  if (connected() == false)
+    return false;
+
+  size = MQTT5Codec::encodeSubscribe(packet, sizeof(packet), _next_packet_id ++, topic, options);
+  if (_next_packet_id == 0)
+    _next_packet_id = 1;
+
+  return size > 0 && write(packet, size);
+}
+
+/* publish, by topic alias when it has one; a packet id makes it QoS 1 */
+bool MQTT5Client::publish(const char * topic, const uint8_t * payload, unsigned int length, bool retained, 
+                          uint16_t packet_id, bool dup, uint32_t expiry) {
+
+  return beginPublish(topic, length, retained, packet_id, dup, expiry) && 
+    (length == 0 || write(payload, length));
+}
+
+/* write a PUBLISH up to its payload, the payload follows with writePayload() */
+bool MQTT5Client::beginPublish(const char * topic, unsigned int length, bool retained, 
+                               uint16_t packet_id, bool dup, uint32_t expiry) {
+
+  uint8_t                header[MQTT5_PUBLISH_HEADER];
+  MQTT5Codec::Publish_t  publish;
+  bool                   is_new;
+
+  if (connected() == false)
+    return false;
+
+  publish.topic_alias = _aliases.lookup(topic, millis(), MQTT5_ALIAS_IDLE_SEC * 1000UL, is_new);
+  publish.topic       = publish.topic_alias && is_new == false ? "" : topic;
+  publish.topic_len   = strlen(publish.topic);
+  publish.qos         = packet_id ? 1 : 0;
+  publish.retained    = retained;
+  publish.dup         = dup;
+  publish.packet_id   = packet_id;
+  publish.expiry      = expiry;
+  publish.user_key    = _user_key;
+  publish.user_value  = _user_value;
+  publish.payload_len = length;
+
+  size_t size = MQTT5Codec::encodePublish(header, sizeof(header), publish);
+  if (size == 0)
+    return false;
+
+  return write(header, size);
+}
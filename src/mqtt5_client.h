@@ -0,0 +1,147 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _MQTT5_CLIENT_H_
+#define _MQTT5_CLIENT_H_
+
+#include <Arduino.h>
+#include <Client.h>
+#include <PubSubClient.h>
+
+#include "mqtt5_codec.h"
+
+#define MQTT5_PUBLISH_HEADER 256 /* room for a PUBLISH packet up to its payload */
+
+/*
+ * Minimal MQTT 5 client, used instead of PubSubClient when configured.
+ *
+ * It keeps the connection states of PubSubClient (MQTT_CONNECTED, ...).
+ * Published topics get topic aliases while the server allows them, and each
+ * PUBLISH can carry a message expiry and the user property set with
+ * setUserProperty(). Received packets are read without blocking, a packet
+ * larger than the buffer is dropped.
+ */
+class MQTT5Client {
+
+  public:
+    typedef void (*Callback_t)(char * topic, uint8_t * payload, unsigned int len);
+    typedef void (*AckHandler_t)(uint16_t packet_id);
+
+  public:
+    MQTT5Client(Client & client, Callback_t callback, AckHandler_t ack_handler);
+
+    bool     connect(const char * host, uint16_t port, const MQTT5Codec::Connect_t & connect, size_t buffer_size);
+    void     disconnect();
+    bool     connected();
+    int      state();
+    bool     loop();
+
+    bool     subscribe(const char * topic, uint8_t options);
+    bool     publish(const char * topic, const uint8_t * payload, unsigned int length, bool retained, 
+                     uint16_t packet_id, bool dup, uint32_t expiry);
+    bool     beginPublish(const char * topic, unsigned int length, bool retained, 
+                          uint16_t packet_id, bool dup, uint32_t expiry);
+    bool     writePayload(const uint8_t * data, size_t size);
+
+    void     setClient(Client & client);
+    void     setUserProperty(const char * key, const char * value);
+    uint16_t receiveMaximum();
+    bool     sessionPresent();
+    bool     retained();
+    uint16_t topicAliases();
+
+  protected:
+    enum ReceiveState {
+      RECEIVE_HEADER,
+      RECEIVE_LENGTH,
+      RECEIVE_BODY
+    };
+
+    Client *              _client;
+    Callback_t            _callback;
+    AckHandler_t          _ack_handler;
+    uint8_t *             _buffer;
+    size_t                _buffer_size;
+    int                   _state;
+    MQTT5Codec::Connack_t _connack;
+    MQTT5TopicAliases     _aliases;
+    const char *          _user_key;
+    const char *          _user_value;
+    uint16_t              _keep_alive;
+    uint16_t              _next_packet_id;
+    unsigned long         _last_in;
+    unsigned long         _last_out;
+    bool                  _ping_outstanding;
+    bool                  _retained;      // of the PUBLISH handed to the callback
+
+    // packet being received
+    uint8_t               _receive;
+    uint8_t               _header;
+    uint8_t               _shift;
+    uint32_t              _length;
+    uint32_t              _position;
+
+    bool                  receive();
+    void                  handle();
+    bool                  write(const uint8_t * data, size_t size);
+    void                  close(int state);
+};
+
+/* inlines for MQTT5Client */
+inline int MQTT5Client::state() {
+  return _state;
+}
+
+/* payload of the PUBLISH started with beginPublish(), in as many pieces as needed */
+inline bool MQTT5Client::writePayload(const uint8_t * data, size_t size) {
+  return write(data, size);
+}
+
+inline void MQTT5Client::setClient(Client & client) {
+  _client = &client;
+}
+
+inline void MQTT5Client::setUserProperty(const char * key, const char * value) {
+  _user_key   = key;
+  _user_value = value;
+}
+
+inline uint16_t MQTT5Client::receiveMaximum() {
+  return _connack.receive_maximum;
+}
+
+inline bool MQTT5Client::sessionPresent() {
+  return _connack.session_present;
+}
+
+inline bool MQTT5Client::retained() {
+  return _retained;
+}
+
+inline uint16_t MQTT5Client::topicAliases() {
+  return _aliases.count();
+}
+
+#endif//_MQTT5_CLIENT_H_
@@ -0,0 +1,396 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "mqtt5_codec.h"
+
+#include <string.h>
+
+/* writers of the MQTT data types, big endian */
+static inline uint8_t * _put16(uint8_t * out, uint16_t value) {
+  *out++ = value >> 8;
+  *out++ = value & 0xFF;
+  return out;
+}
+
+static inline uint8_t * _put32(uint8_t * out, uint32_t value) {
+  out = _put16(out, value >> 16);
+  return _put16(out, value & 0xFFFF);
+}
+
+static inline uint8_t * _putString(uint8_t * out, const char * str, size_t len) {
+  out = _put16(out, len);
+  memcpy(out, str, len);
+  return out + len;
+}
+
+static inline uint16_t _get16(const uint8_t * data) {
+  return (data[0] << 8) | data[1];
+}
+
+size_t MQTT5Codec::writeVarint(uint8_t * buffer, uint32_t value) {
+  size_t pos = 0;
+
+  do {
+    uint8_t digit = value & 0x7F;
+    value >>= 7;
+    buffer[pos++] = value ? (digit | 0x80) : digit;
+  } while (value);
+  return pos;
+}
+
+bool MQTT5Codec::readVarint(const uint8_t * & data, const uint8_t * end, uint32_t & value) {
+  value = 0;
+
+  for (int shift = 0; shift < 28; shift += 7) {
+    if (data >= end)
+      return false;
+    uint8_t digit = *data++;
+    value |= (uint32_t) (digit & 0x7F) << shift;
+    if ((digit & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+/* skip a property not used by the station, by the size of its type */
+bool MQTT5Codec::skipProperty(uint8_t id, const uint8_t * & data, const uint8_t * end) {
+
+  size_t size;
+
+  switch (id) {
+    // byte
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+      size = 1; break;
+    // two byte integer
+    case 0x13: case 0x21: case 0x22: case 0x23:
+      size = 2; break;
+    // four byte integer
+    case 0x02: case 0x11: case 0x18: case 0x27:
+      size = 4; break;
+    // variable byte integer
+    case 0x0B: {
+      uint32_t value;
+      return readVarint(data, end, value);
+    }
+    // string or binary data
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+      if (end - data < 2) return false;
+      size = 2 + _get16(data); break;
+    // string pair
+    case 0x26: {
+      if (end - data < 2) return false;
+      size_t key = 2 + _get16(data);
+      if ((size_t) (end - data) < key + 2) return false;
+      size = key + 2 + _get16(data + key);
+    } break;
+    default:
+      return false;
+  }
+
+  if ((size_t) (end - data) < size)
+    return false;
+  data += size;
+  return true;
+}
+
+size_t MQTT5Codec::encodeConnect(uint8_t * buffer, size_t capacity, const Connect_t & connect) {
+
+  size_t client_len   = strlen(connect.client_id);
+  size_t will_topic   = connect.will_topic ? strlen(connect.will_topic) : 0;
+  size_t will_payload = connect.will_topic ? strlen(connect.will_payload) : 0;
+  size_t username     = connect.username ? strlen(connect.username) : 0;
+  size_t password     = connect.password ? strlen(connect.password) : 0;
+
+  // protocol name, level, flags, keep alive and properties
+  uint32_t properties = connect.session_expiry ? 1 + 4 : 0;
+  uint32_t remaining  = 6 + 1 + 1 + 2 + 1 + properties + 2 + client_len;
+  if (connect.will_topic) remaining += 1 + 2 + will_topic + 2 + will_payload;
+  if (connect.username)   remaining += 2 + username;
+  if (connect.password)   remaining += 2 + password;
+
+  if (1 + varintSize(remaining) + remaining > capacity)
+    return 0;
+
+  // a session kept by the server is resumed
+  uint8_t flags = connect.session_expiry ? 0 : 0x02;
+  if (connect.will_topic) flags |= 0x04 | (connect.will_retain ? 0x20 : 0);
+  if (connect.password)   flags |= 0x40;
+  if (connect.username)   flags |= 0x80;
+
+  uint8_t * out = buffer;
+  *out++ = CONNECT << 4;
+  out   += writeVarint(out, remaining);
+  out    = _putString(out, "MQTT", 4);
+  *out++ = 5;
+  *out++ = flags;
+  out    = _put16(out, connect.keep_alive);
+  *out++ = properties;
+  if (connect.session_expiry) {
+    *out++ = PROP_SESSION_EXPIRY;
+    out    = _put32(out, connect.session_expiry);
+  }
+  out    = _putString(out, connect.client_id, client_len);
+  if (connect.will_topic) {
+    *out++ = 0;
+    out    = _putString(out, connect.will_topic, will_topic);
+    out    = _putString(out, connect.will_payload, will_payload);
+  }
+  if (connect.username) out = _putString(out, connect.username, username);
+  if (connect.password) out = _putString(out, connect.password, password);
+  return out - buffer;
+}
+
+/* the packet up to the payload, which follows it as is */
+size_t MQTT5Codec::encodePublish(uint8_t * buffer, size_t capacity, const Publish_t & publish) {
+
+  size_t key_len   = publish.user_key ? strlen(publish.user_key) : 0;
+  size_t value_len = publish.user_key ? strlen(publish.user_value) : 0;
+
+  uint32_t properties = 0;
+  if (publish.topic_alias) properties += 1 + 2;
+  if (publish.expiry)      properties += 1 + 4;
+  if (publish.user_key)    properties += 1 + 2 + key_len + 2 + value_len;
+
+  uint32_t variable  = 2 + publish.topic_len + (publish.qos ? 2 : 0) + varintSize(properties) + properties;
+  uint32_t remaining = variable + publish.payload_len;
+
+  if (1 + varintSize(remaining) + variable > capacity)
+    return 0;
+
+  uint8_t * out = buffer;
+  *out++ = (PUBLISH << 4) | (publish.dup ? 0x08 : 0) | (publish.qos << 1) | (publish.retained ? 0x01 : 0);
+  out   += writeVarint(out, remaining);
+  out    = _putString(out, publish.topic, publish.topic_len);
+  if (publish.qos) 
+    out  = _put16(out, publish.packet_id);
+
+  out   += writeVarint(out, properties);
+  if (publish.topic_alias) {
+    *out++ = PROP_TOPIC_ALIAS;
+    out    = _put16(out, publish.topic_alias);
+  }
+  if (publish.expiry) {
+    *out++ = PROP_MESSAGE_EXPIRY;
+    out    = _put32(out, publish.expiry);
+  }
+  if (publish.user_key) {
+    *out++ = PROP_USER_PROPERTY;
+    out    = _putString(out, publish.user_key, key_len);
+    out    = _putString(out, publish.user_value, value_len);
+  }
+  return out - buffer;
+}
+
+size_t MQTT5Codec::encodeSubscribe(uint8_t * buffer, size_t capacity, uint16_t packet_id, const char * topic, uint8_t options) {
+
+  size_t   topic_len = strlen(topic);
+  uint32_t remaining = 2 + 1 + 2 + topic_len + 1;
+
+  if (1 + varintSize(remaining) + remaining > capacity)
+    return 0;
+
+  uint8_t * out = buffer;
+  *out++ = (SUBSCRIBE << 4) | 0x02;
+  out   += writeVarint(out, remaining);
+  out    = _put16(out, packet_id);
+  *out++ = 0;
+  out    = _putString(out, topic, topic_len);
+  *out++ = options;
+  return out - buffer;
+}
+
+bool MQTT5Codec::decodeConnack(const uint8_t * body, size_t len, Connack_t & connack) {
+
+  const uint8_t * data = body;
+  const uint8_t * end  = body + len;
+  uint32_t        properties;
+
+  if (len < 2)
+    return false;
+
+  connack.session_present     = data[0] & 0x01;
+  connack.reason              = data[1];
+  connack.receive_maximum     = 65535;
+  connack.topic_alias_maximum = 0;
+  connack.maximum_packet_size = 0;
+  data += 2;
+
+  // a refused connection may have no properties
+  if (data == end)
+    return true;
+
+  if (readVarint(data, end, properties) == false || (uint32_t) (end - data) < properties)
+    return false;
+
+  end = data + properties;
+  while (data < end) {
+    uint8_t id = *data++;
+
+    switch (id) {
+      case PROP_RECEIVE_MAXIMUM:
+        if (end - data < 2) return false;
+        connack.receive_maximum = _get16(data);
+        data += 2;
+        break;
+      case PROP_TOPIC_ALIAS_MAXIMUM:
+        if (end - data < 2) return false;
+        connack.topic_alias_maximum = _get16(data);
+        data += 2;
+        break;
+      case PROP_MAXIMUM_PACKET_SIZE:
+        if (end - data < 4) return false;
+        connack.maximum_packet_size = ((uint32_t) _get16(data) << 16) | _get16(data + 2);
+        data += 4;
+        break;
+      default:
+        if (skipProperty(id, data, end) == false)
+          return false;
+    }
+  }
+  return true;
+}
+
+/* decode in place, the topic is moved over its length to be NUL terminated */
+bool MQTT5Codec::decodePublish(uint8_t flags, uint8_t * body, size_t len, Received_t & received) {
+
+  const uint8_t * data = body;
+  const uint8_t * end  = body + len;
+  uint32_t        properties;
+
+  if (len < 2)
+    return false;
+
+  uint16_t topic_len = _get16(data);
+  if (len < 2u + topic_len)
+    return false;
+  data += 2 + topic_len;
+
+  received.qos       = (flags >> 1) & 0x03;
+  received.retained  = flags & 0x01;
+  received.packet_id = 0;
+  if (received.qos) {
+    if (end - data < 2) return false;
+    received.packet_id = _get16(data);
+    data += 2;
+  }
+
+  if (readVarint(data, end, properties) == false || (uint32_t) (end - data) < properties)
+    return false;
+  data += properties;
+
+  received.payload     = (uint8_t *) data;
+  received.payload_len = end - data;
+
+  memmove(body, body + 2, topic_len);
+  body[topic_len] = '\0';
+  received.topic = (char *) body;
+  return true;
+}
+
+bool MQTT5Codec::decodePuback(const uint8_t * body, size_t len, uint16_t & packet_id, uint8_t & reason) {
+
+  if (len < 2)
+    return false;
+
+  packet_id = _get16(body);
+  reason    = len > 2 ? body[2] : 0;
+  return true;
+}
+
+bool MQTT5Codec::decodeSuback(const uint8_t * body, size_t len, uint16_t & packet_id, uint8_t & reason) {
+
+  const uint8_t * data = body + 2;
+  const uint8_t * end  = body + len;
+  uint32_t        properties;
+
+  if (len < 3)
+    return false;
+
+  packet_id = _get16(body);
+  if (readVarint(data, end, properties) == false || (uint32_t) (end - data) <= properties)
+    return false;
+
+  reason = data[properties];
+  return true;
+}
+
+MQTT5TopicAliases::MQTT5TopicAliases()
+  : _maximum(0)
+  , _count(0) {
+}
+
+/* forget the aliases, for a new connection allowing up to maximum */
+void MQTT5TopicAliases::reset(uint16_t maximum) {
+  _maximum = maximum < MAX_ALIASES ? maximum : MAX_ALIASES;
+  _count   = 0;
+}
+
+/* 
+ * Alias of a topic, 0 if it has none. When is_new is set, the alias was
+ * just given to the topic and it must be sent along with it this time.
+ */
+uint16_t MQTT5TopicAliases::lookup(const char * topic, uint32_t now, uint32_t idle, bool & is_new) {
+
+  uint32_t hash = 2166136261u;
+  size_t   len;
+  int      oldest = -1;
+
+  for (len = 0; topic[len] != '\0'; len ++) {
+    hash ^= (uint8_t) topic[len];
+    hash *= 16777619u;
+  }
+
+  is_new = false;
+  if (_maximum == 0 || len >= MAX_TOPIC)
+    return 0;
+
+  for (uint16_t i = 0; i < _count; i ++) {
+    Alias_t & alias = _aliases[i];
+
+    if (alias.hash == hash && strcmp(alias.topic, topic) == 0) {
+      alias.used = now;
+      return i + 1;
+    }
+    if (oldest < 0 || (int32_t) (alias.used - _aliases[oldest].used) < 0)
+      oldest = i;
+  }
+
+  // a free alias, or the one of a topic not published for a while
+  int index;
+  if (_count < _maximum) {
+    index = _count ++;
+  } else 
+  if (oldest >= 0 && now - _aliases[oldest].used >= idle) {
+    index = oldest;
+  } else {
+    return 0;
+  }
+
+  _aliases[index].hash = hash;
+  _aliases[index].used = now;
+  memcpy(_aliases[index].topic, topic, len + 1);
+  is_new = true;
+  return index + 1;
+}
@@ -0,0 +1,188 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _MQTT5_CODEC_H_
+#define _MQTT5_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Encoding and decoding of the MQTT 5 packets used by the station.
+ *
+ * This file does not depend on Arduino, so it can be tested on the host.
+ *
+ * Packets are built into a caller provided buffer. A PUBLISH is built up
+ * to its properties, the payload is written after it as is, so it is never
+ * copied. Received packets are decoded in place, from the bytes following
+ * the fixed header.
+ */
+class MQTT5Codec {
+
+  public:
+    /* control packet types */
+    enum PacketType {
+      CONNECT     = 1,
+      CONNACK     = 2,
+      PUBLISH     = 3,
+      PUBACK      = 4,
+      SUBSCRIBE   = 8,
+      SUBACK      = 9,
+      PINGREQ     = 12,
+      PINGRESP    = 13,
+      DISCONNECT  = 14
+    };
+
+    /* properties */
+    enum Property {
+      PROP_MESSAGE_EXPIRY      = 0x02,
+      PROP_SESSION_EXPIRY      = 0x11,
+      PROP_RECEIVE_MAXIMUM     = 0x21,
+      PROP_TOPIC_ALIAS_MAXIMUM = 0x22,
+      PROP_TOPIC_ALIAS         = 0x23,
+      PROP_MAXIMUM_QOS         = 0x24,
+      PROP_USER_PROPERTY       = 0x26,
+      PROP_MAXIMUM_PACKET_SIZE = 0x27
+    };
+
+    /* subscription options */
+    enum SubscribeOption {
+      SUB_NO_LOCAL    = 0x04,
+      SUB_NO_RETAINED = 0x20    // retain handling 2, no retained messages on subscribing
+    };
+
+    /* largest fixed header, a type byte and a 4 byte remaining length */
+    static const size_t MAX_FIXED_HEADER = 5;
+
+    typedef struct {
+      const char *    client_id;
+      const char *    username;       // NULL if none
+      const char *    password;       // NULL if none
+      const char *    will_topic;     // NULL if none
+      const char *    will_payload;
+      bool            will_retain;
+      uint16_t        keep_alive;     // seconds
+      uint32_t        session_expiry; // seconds, 0 for a clean start
+    } Connect_t;
+
+    typedef struct {
+      uint8_t         reason;
+      bool            session_present;
+      uint16_t        receive_maximum;
+      uint16_t        topic_alias_maximum;
+      uint32_t        maximum_packet_size;  // 0 if not limited
+    } Connack_t;
+
+    typedef struct {
+      const char *    topic;          // empty when sent by alias
+      uint16_t        topic_len;
+      uint16_t        topic_alias;    // 0 if none
+      uint8_t         qos;
+      bool            retained;
+      bool            dup;
+      uint16_t        packet_id;
+      uint32_t        expiry;         // seconds, 0 for none
+      const char *    user_key;       // user property, NULL if none
+      const char *    user_value;
+      unsigned int    payload_len;
+    } Publish_t;
+
+    typedef struct {
+      char *          topic;          // NUL terminated, in the packet buffer
+      uint8_t *       payload;
+      unsigned int    payload_len;
+      uint16_t        packet_id;
+      uint8_t         qos;
+      bool            retained;
+    } Received_t;
+
+  public:
+    static size_t encodeConnect(uint8_t * buffer, size_t capacity, const Connect_t & connect);
+    static size_t encodePublish(uint8_t * buffer, size_t capacity, const Publish_t & publish);
+    static size_t encodeSubscribe(uint8_t * buffer, size_t capacity, uint16_t packet_id, const char * topic, uint8_t options);
+    static size_t encodeSimple(uint8_t * buffer, uint8_t type);
+
+    static bool   decodeConnack(const uint8_t * body, size_t len, Connack_t & connack);
+    static bool   decodePublish(uint8_t flags, uint8_t * body, size_t len, Received_t & received);
+    static bool   decodePuback(const uint8_t * body, size_t len, uint16_t & packet_id, uint8_t & reason);
+    static bool   decodeSuback(const uint8_t * body, size_t len, uint16_t & packet_id, uint8_t & reason);
+
+    static size_t varintSize(uint32_t value);
+
+  protected:
+    static size_t writeVarint(uint8_t * buffer, uint32_t value);
+    static bool   readVarint(const uint8_t * & data, const uint8_t * end, uint32_t & value);
+    static bool   skipProperty(uint8_t id, const uint8_t * & data, const uint8_t * end);
+};
+
+/*
+ * Topic aliases of the published topics, valid for one connection.
+ *
+ * Topics get an alias the first time they are published, while the server
+ * allows more. An alias is taken back from a topic not published for a while,
+ * so the topics published often keep theirs.
+ */
+class MQTT5TopicAliases {
+
+  public:
+    static const uint8_t  MAX_ALIASES = 16;
+    static const size_t   MAX_TOPIC   = 64;
+
+  public:
+    MQTT5TopicAliases();
+
+    void     reset(uint16_t maximum);
+    uint16_t lookup(const char * topic, uint32_t now, uint32_t idle, bool & is_new);
+    uint16_t count();
+
+  protected:
+    typedef struct {
+      uint32_t hash;
+      uint32_t used;            // time of the last publish
+      char     topic[MAX_TOPIC];
+    } Alias_t;
+
+    Alias_t   _aliases[MAX_ALIASES];
+    uint16_t  _maximum;
+    uint16_t  _count;
+};
+
+/* inlines for MQTT5Codec */
+inline size_t MQTT5Codec::varintSize(uint32_t value) {
+  return value < 128 ? 1 : value < 16384 ? 2 : value < 2097152 ? 3 : 4;
+}
+
+inline size_t MQTT5Codec::encodeSimple(uint8_t * buffer, uint8_t type) {
+  buffer[0] = type << 4;
+  buffer[1] = 0;
+  return 2;
+}
+
+/* inlines for MQTT5TopicAliases */
+inline uint16_t MQTT5TopicAliases::count() {
+  return _count;
+}
+
+#endif//_MQTT5_CODEC_H_
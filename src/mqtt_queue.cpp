@@ -0,0 +1,307 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "mqtt_queue.h"
+
+#include <string.h>
+
+MQTTQueue::MQTTQueue(uint8_t * buffer, size_t capacity)
+  : _buffer(buffer)
+  , _capacity(capacity & ~3)
+  , _head(0)
+  , _tail(0)
+  , _used(0)
+  , _count(0)
+  , _coalesced(0)
+  , _replace(false) {
+}
+
+/* FNV-1a of a topic, also returns its length */
+uint32_t MQTTQueue::topicHash(const char * topic, size_t * len) {
+  uint32_t hash = 2166136261u;
+  const char * ch = topic;
+
+  while (*ch != '\0') {
+    hash ^= (uint8_t) *ch++;
+    hash *= 16777619u;
+  }
+  *len = ch - topic;
+  return hash;
+}
+
+/* check if a message would fit, as the ring is now */
+bool MQTTQueue::fits(const char * topic, unsigned int length) {
+
+  size_t size = recordSize(strlen(topic), length);
+
+  // the space left at the end, if not used, is lost to a pad
+  size_t end_free = _head >= _tail && _used < _capacity ? _capacity - _head : 0;
+  size_t free     = _capacity - _used;
+
+  if (size > 0xFFFF)
+    return false;
+  if (_used == 0)
+    return size <= _capacity;
+  if (_head >= _tail)
+    return size <= end_free || (size <= _tail && size + end_free <= free);
+  return size <= free;
+}
+
+bool MQTTQueue::push(const char * topic, const uint8_t * payload, unsigned int length, bool retained, uint32_t time) {
+
+  size_t   topic_len;
+  uint32_t hash = topicHash(topic, &topic_len);
+  size_t   size = recordSize(topic_len, length);
+
+  if (fits(topic, length) == false)
+    return false;
+
+  // an older value of the topic is no longer needed
+  if (retained || _replace) {
+    uint8_t flags = retained ? FLAG_RETAINED : 0;
+    size_t offset = _tail;
+    size_t walked = 0;
+
+    while (walked < _used) {
+      Header_t * header = at(offset);
+
+      // a pad too small for a header
+      if (_capacity - offset < sizeof(Header_t) || header->size == 0) {
+        walked += _capacity - offset;
+        offset  = 0;
+        continue;
+      }
+      if (header->flags == flags && header->hash == hash && header->topic_len == topic_len &&
+          memcmp(header + 1, topic, topic_len) == 0) {
+        header->flags |= FLAG_DEAD;
+        _count --;
+        _coalesced ++;
+        break;
+      }
+      walked += header->size;
+      offset += header->size;
+      if (offset >= _capacity) 
+        offset = 0;
+    }
+  }
+
+  // wrap, padding the end of the ring
+  if (_used > 0 && _head >= _tail && _capacity - _head < size) {
+    Header_t * pad = at(_head);
+    size_t pad_size = _capacity - _head;
+
+    if (pad_size >= sizeof(Header_t)) {
+      memset(pad, 0, sizeof(Header_t));
+      pad->size  = pad_size;
+      pad->flags = FLAG_PAD;
+    } else 
+    if (pad_size > 0) {
+      // too small for a header, a zero size means the same
+      memset(pad, 0, pad_size);
+    }
+    _used += pad_size;
+    _head  = 0;
+  } else
+  if (_used == 0) {
+    _head = _tail = 0;
+  }
+
+  Header_t * header    = at(_head);
+  header->size         = size;
+  header->flags        = retained ? FLAG_RETAINED : 0;
+  header->reserved     = 0;
+  header->hash         = hash;
+  header->time         = time;
+  header->topic_len    = topic_len;
+  header->payload_len  = length;
+  header->packet_id    = 0;
+
+  char * record_topic = (char *) (header + 1);
+  memcpy(record_topic, topic, topic_len + 1);
+  if (length > 0)
+    memcpy(record_topic + topic_len + 1, payload, length);
+
+  _head += size;
+  if (_head >= _capacity)
+    _head = 0;
+  _used += size;
+  _count ++;
+  return true;
+}
+
+/* drop pads and dead records at the tail */
+void MQTTQueue::skipDead() {
+
+  while (_used > 0) {
+    size_t end_left = _capacity - _tail;
+
+    // a pad too small for a header
+    if (end_left < sizeof(Header_t)) {
+      _used -= end_left;
+      _tail  = 0;
+      continue;
+    }
+
+    Header_t * header = at(_tail);
+    if (header->size == 0) {
+      _used -= end_left;
+      _tail  = 0;
+      continue;
+    }
+    if ((header->flags & (FLAG_DEAD | FLAG_PAD)) == 0)
+      break;
+
+    _used -= header->size;
+    _tail += header->size;
+    if (_tail >= _capacity)
+      _tail = 0;
+  }
+
+  if (_used == 0)
+    _head = _tail = 0;
+}
+
+/* oldest message in the queue, stays valid until pop() */
+bool MQTTQueue::front(Message_t & message) {
+
+  skipDead();
+  if (_count == 0)
+    return false;
+
+  fill(message, _tail);
+  return true;
+}
+
+void MQTTQueue::fill(Message_t & message, size_t offset) {
+
+  Header_t * header = at(offset);
+  message.topic     = (const char *) (header + 1);
+  message.payload   = (const uint8_t *) (message.topic + header->topic_len + 1);
+  message.length    = header->payload_len;
+  message.retained  = header->flags & FLAG_RETAINED;
+  message.time      = header->time;
+  message.dup       = header->flags & FLAG_DUP;
+  message.packet_id = header->packet_id;
+  message.ref       = offset;
+}
+
+void MQTTQueue::pop() {
+
+  skipDead();
+  if (_count == 0)
+    return;
+
+  Header_t * header = at(_tail);
+  _used -= header->size;
+  _tail += header->size;
+  if (_tail >= _capacity)
+    _tail = 0;
+  _count --;
+
+  skipDead();
+}
+
+/* oldest message not sent yet */
+bool MQTTQueue::unsent(Message_t & message) {
+
+  size_t offset = _tail;
+  size_t walked = 0;
+
+  while (walked < _used) {
+    Header_t * header = at(offset);
+
+    // a pad too small for a header
+    if (_capacity - offset < sizeof(Header_t) || header->size == 0) {
+      walked += _capacity - offset;
+      offset  = 0;
+      continue;
+    }
+    if ((header->flags & (FLAG_DEAD | FLAG_PAD | FLAG_SENT)) == 0) {
+      fill(message, offset);
+      return true;
+    }
+    walked += header->size;
+    offset += header->size;
+    if (offset >= _capacity) 
+      offset = 0;
+  }
+  return false;
+}
+
+/* a message handed out by unsent() went out with a packet id, it stays until ack() */
+void MQTTQueue::markSent(uint32_t ref, uint16_t packet_id) {
+
+  Header_t * header = at(ref);
+
+  if ((header->flags & (FLAG_DEAD | FLAG_PAD)) == 0) {
+    header->flags    |= FLAG_SENT;
+    header->packet_id = packet_id;
+  }
+}
+
+/* drop a sent message, acknowledged by the broker */
+void MQTTQueue::ack(uint32_t ref) {
+
+  Header_t * header = at(ref);
+
+  if ((header->flags & (FLAG_SENT | FLAG_DEAD | FLAG_PAD)) != FLAG_SENT)
+    return;
+
+  header->flags |= FLAG_DEAD;
+  _count --;
+  skipDead();
+}
+
+/* 
+ * Messages sent and not acknowledged go out again, as duplicates. With the
+ * session kept by the broker they must keep their packet ids (MQTT-4.4.0-1),
+ * in a new session the ids are given again.
+ */
+void MQTTQueue::unsend(bool session) {
+
+  size_t offset = _tail;
+  size_t walked = 0;
+
+  while (walked < _used) {
+    Header_t * header = at(offset);
+
+    // a pad too small for a header
+    if (_capacity - offset < sizeof(Header_t) || header->size == 0) {
+      walked += _capacity - offset;
+      offset  = 0;
+      continue;
+    }
+    if ((header->flags & (FLAG_DEAD | FLAG_PAD | FLAG_SENT)) == FLAG_SENT) {
+      header->flags &= ~FLAG_SENT;
+      header->flags |= FLAG_DUP;
+      if (session == false)
+        header->packet_id = 0;
+    }
+    walked += header->size;
+    offset += header->size;
+    if (offset >= _capacity) 
+      offset = 0;
+  }
+}
@@ -0,0 +1,159 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _MQTT_QUEUE_H_
+#define _MQTT_QUEUE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Bounded queue of outbound MQTT messages, in a fixed ring of bytes.
+ *
+ * This file does not depend on Arduino, so it can be tested on the host.
+ *
+ * Each message is one record, its header followed by the NUL terminated
+ * topic and the payload, padded to 4 bytes. A record that doesn't fit the
+ * end of the ring is preceded by a pad record and goes at its start.
+ *
+ * A retained message replaces the queued retained message of the same topic,
+ * only the last retained value of a topic matters to the broker. With
+ * setReplace() non-retained messages replace the ones of their topic too,
+ * for queues of values rather than events. Replaced records stay in the
+ * ring, marked dead, until the queue gets to them.
+ *
+ * For QoS 1 the queue also keeps the messages in flight: unsent() finds
+ * the oldest message not sent yet, markSent() marks it, ack() drops it when
+ * the broker acknowledges it, in any order, and unsend() makes the ones not
+ * acknowledged go out again, as duplicates, after a reconnect. They keep
+ * their packet id while the broker keeps the session. Sent records are not
+ * replaced by newer retained values.
+ */
+class MQTTQueue {
+
+  public:
+    enum Flags {
+      FLAG_RETAINED = 0x01,
+      FLAG_DEAD     = 0x02,
+      FLAG_PAD      = 0x04,
+      FLAG_SENT     = 0x08,
+      FLAG_DUP      = 0x10
+    };
+
+    typedef struct {
+      uint16_t size;        // of the whole record
+      uint8_t  flags;
+      uint8_t  reserved;
+      uint32_t hash;        // of the topic
+      uint32_t time;        // wall clock when published, 0 if not known
+      uint16_t topic_len;
+      uint16_t payload_len;
+      uint16_t packet_id;   // QoS 1 id it was sent with, resent with the same one
+    } Header_t;
+
+    typedef struct {
+      const char *    topic;
+      const uint8_t * payload;
+      unsigned int    length;
+      bool            retained;
+      uint32_t        time;
+      bool            dup;      // sent before, not acknowledged
+      uint16_t        packet_id; // it was sent with, 0 if none
+      uint32_t        ref;      // of the record, for ack()
+    } Message_t;
+
+  public:
+    MQTTQueue(uint8_t * buffer, size_t capacity);
+
+    void         setReplace(bool replace);
+
+    bool         push(const char * topic, const uint8_t * payload, unsigned int length, bool retained, uint32_t time);
+    bool         front(Message_t & message);
+    void         pop();
+
+    bool         unsent(Message_t & message);
+    void         markSent(uint32_t ref, uint16_t packet_id);
+    void         ack(uint32_t ref);
+    void         unsend(bool session);
+
+    bool         fits(const char * topic, unsigned int length);
+    bool         empty();
+    unsigned int count();
+    size_t       bytes();
+    size_t       capacity();
+    unsigned int coalesced();
+
+    static size_t   recordSize(size_t topic_len, size_t payload_len);
+    static uint32_t topicHash(const char * topic, size_t * len);
+
+  protected:
+    uint8_t *    _buffer;
+    size_t       _capacity;
+    size_t       _head;       // where the next record goes
+    size_t       _tail;       // oldest record
+    size_t       _used;       // bytes, including pads and dead records
+    unsigned int _count;      // live records
+    unsigned int _coalesced;
+    bool         _replace;    // non-retained messages replace their topic too
+
+    Header_t *   at(size_t offset);
+    void         skipDead();
+    void         fill(Message_t & message, size_t offset);
+};
+
+/* inlines for MQTTQueue */
+inline void MQTTQueue::setReplace(bool replace) {
+  _replace = replace;
+}
+
+inline bool MQTTQueue::empty() {
+  return _count == 0;
+}
+
+inline unsigned int MQTTQueue::count() {
+  return _count;
+}
+
+inline size_t MQTTQueue::bytes() {
+  return _used;
+}
+
+inline size_t MQTTQueue::capacity() {
+  return _capacity;
+}
+
+inline unsigned int MQTTQueue::coalesced() {
+  return _coalesced;
+}
+
+inline MQTTQueue::Header_t * MQTTQueue::at(size_t offset) {
+  return (Header_t *) (_buffer + offset);
+}
+
+inline size_t MQTTQueue::recordSize(size_t topic_len, size_t payload_len) {
+  return (sizeof(Header_t) + topic_len + 1 + payload_len + 3) & ~3;
+}
+
+#endif//_MQTT_QUEUE_H_
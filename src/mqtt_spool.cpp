@@ -0,0 +1,354 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "mqtt_spool.h"
+
+#define LOG_TAG LOG_TAG_MQTT
+#include "log.h"
+
+MQTTSpool::MQTTSpool()
+  : _segment_size(0)
+  , _max_record(0)
+  , _seq(0)
+  , _write(-1)
+  , _read(-1)
+  , _scratch(NULL)
+  , _loaded(false)
+  , _count(0)
+  , _bytes(0)
+  , _dropped(0) {
+  memset(_segments, 0, sizeof(_segments));
+}
+
+MQTTSpool::~MQTTSpool() {
+  if (_read >= 0)
+    _file.close();
+  free(_scratch);
+}
+
+/* pick up the segments left by a previous run */
+bool MQTTSpool::begin(size_t budget, size_t max_record) {
+
+  char name[24];
+
+  _segment_size = budget / MQTT_SPOOL_SEGMENTS;
+  _max_record   = max_record;
+
+  for (int index = 0; index < MQTT_SPOOL_SEGMENTS; index ++) {
+    FileHeader_t         file_header;
+    MQTTQueue::Header_t  header;
+    Segment_t &          segment = _segments[index];
+
+    path(name, index);
+    if (SPIFFS.exists(name) == false)
+      continue;
+
+    File file = SPIFFS.open(name, FILE_READ);
+    if (!file || file.read((uint8_t *) &file_header, sizeof(file_header)) != sizeof(file_header) ||
+        file_header.magic != MAGIC || file_header.seq == 0) {
+      if (file) file.close();
+      SPIFFS.remove(name);
+      continue;
+    }
+
+    // count the records, a record cut by a reset ends the segment
+    size_t offset = sizeof(file_header);
+    size_t size   = file.size();
+    segment.count = 0;
+
+    while (offset + sizeof(header) <= size) {
+      if (file.seek(offset) == false ||
+          file.read((uint8_t *) &header, sizeof(header)) != sizeof(header) ||
+          header.size != sizeof(header) + header.topic_len + 1 + header.payload_len ||
+          header.size > _max_record || offset + header.size > size)
+        break;
+
+      offset += header.size;
+      segment.count ++;
+    }
+    file.close();
+
+    if (segment.count == 0) {
+      SPIFFS.remove(name);
+      continue;
+    }
+
+    segment.seq  = file_header.seq;
+    segment.size = size;
+    if (segment.seq > _seq)
+      _seq = segment.seq;
+
+    _count += segment.count;
+    _bytes += size;
+  }
+
+  // appending starts a new segment, the last one may end with a cut record
+  _write = -1;
+  _read  = -1;
+
+  if (_count > 0) {
+    LOG_F("Spool has %u messages (%u bytes) from before the restart", _count, (unsigned int) _bytes);
+  }
+  return true;
+}
+
+/* segment with the oldest messages */
+int MQTTSpool::oldest() {
+
+  int index = -1;
+
+  for (int i = 0; i < MQTT_SPOOL_SEGMENTS; i ++) {
+    if (_segments[i].seq == 0)
+      continue;
+    if (index < 0 || _segments[i].seq < _segments[index].seq)
+      index = i;
+  }
+  return index;
+}
+
+/* start a segment, removing the oldest one if all are used */
+int MQTTSpool::newSegment() {
+
+  char         name[24];
+  int          index = -1;
+  FileHeader_t file_header;
+
+  for (int i = 0; i < MQTT_SPOOL_SEGMENTS; i ++) {
+    if (_segments[i].seq == 0) {
+      index = i;
+      break;
+    }
+  }
+
+  if (index < 0) {
+    index = oldest();
+    LOG_F("Spool full, dropping %u messages", _segments[index].count);
+    _dropped += _segments[index].count;
+    removeSegment(index);
+  }
+
+  file_header.magic = MAGIC;
+  file_header.seq   = ++ _seq;
+
+  path(name, index);
+  File file = SPIFFS.open(name, FILE_WRITE);
+  if (!file) 
+    return -1;
+
+  bool success = file.write((const uint8_t *) &file_header, sizeof(file_header)) == sizeof(file_header);
+  file.close();
+
+  if (success == false) {
+    SPIFFS.remove(name);
+    return -1;
+  }
+
+  _segments[index].seq   = file_header.seq;
+  _segments[index].size  = sizeof(file_header);
+  _segments[index].count = 0;
+  _bytes += sizeof(file_header);
+  return index;
+}
+
+/* remove a segment, its messages not replayed are gone */
+void MQTTSpool::removeSegment(int index) {
+
+  char name[24];
+  Segment_t & segment = _segments[index];
+
+  if (index == _read) {
+    _file.close();
+    _read   = -1;
+    _loaded = false;
+  }
+  if (index == _write)
+    _write = -1;
+
+  path(name, index);
+  SPIFFS.remove(name);
+
+  _count -= segment.count;
+  _bytes -= segment.size;
+  memset(&segment, 0, sizeof(segment));
+
+  if (_count == 0 && _scratch != NULL) {
+    free(_scratch);
+    _scratch = NULL;
+  }
+}
+
+/* append a message, to the newest segment while it has room */
+bool MQTTSpool::append(const MQTTQueue::Message_t & message) {
+
+  char                name[24];
+  size_t              topic_len;
+  MQTTQueue::Header_t header;
+
+  header.hash        = MQTTQueue::topicHash(message.topic, &topic_len);
+  header.size        = sizeof(header) + topic_len + 1 + message.length;
+  header.flags       = message.retained ? MQTTQueue::FLAG_RETAINED : 0;
+  header.reserved    = 0;
+  header.time        = message.time;
+  header.topic_len   = topic_len;
+  header.payload_len = message.length;
+  header.packet_id   = message.packet_id;
+
+  // spilled while in flight, it goes out again as a duplicate with its packet id
+  if (message.packet_id != 0)
+    header.flags |= MQTTQueue::FLAG_DUP;
+
+  if (_segment_size == 0 || header.size > _max_record)
+    return false;
+
+  // the segment being replayed is not appended to
+  if (_write < 0 || _write == _read || _segments[_write].size + header.size > _segment_size) {
+    _write = newSegment();
+    if (_write < 0) 
+      return false;
+  }
+
+  Segment_t & segment = _segments[_write];
+
+  path(name, _write);
+  File file = SPIFFS.open(name, FILE_APPEND);
+  if (!file) 
+    return false;
+
+  bool success = 
+    file.write((const uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+    file.write((const uint8_t *) message.topic, topic_len + 1) == topic_len + 1 &&
+    (message.length == 0 || file.write(message.payload, message.length) == message.length);
+  file.close();
+
+  // a partly written record ends the segment
+  if (success == false) {
+    _write = -1;
+    return false;
+  }
+
+  segment.size  += header.size;
+  segment.count ++;
+  _count ++;
+  _bytes += header.size;
+  return true;
+}
+
+/* read the oldest message into the scratch buffer, if not already there */
+bool MQTTSpool::load() {
+
+  char                name[24];
+  MQTTQueue::Header_t header;
+
+  if (_loaded)
+    return true;
+
+  while (_count > 0) {
+
+    if (_read < 0) {
+      _read = oldest();
+      if (_read < 0)
+        return false;
+
+      // new messages go to another segment from now on
+      if (_read == _write)
+        _write = -1;
+
+      path(name, _read);
+      _file = SPIFFS.open(name, FILE_READ);
+      if (!_file || _file.seek(sizeof(FileHeader_t)) == false) {
+        _dropped += _segments[_read].count;
+        removeSegment(_read);
+        continue;
+      }
+    }
+
+    Segment_t & segment = _segments[_read];
+    if (segment.count == 0) {
+      removeSegment(_read);
+      continue;
+    }
+
+    if (_scratch == NULL) {
+      _scratch = (uint8_t *) malloc(_max_record);
+      if (_scratch == NULL)
+        return false;
+    }
+
+    _position.seq    = segment.seq;
+    _position.offset = _file.position();
+
+    size_t rest = 0;
+    if (_file.read((uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+        header.size == sizeof(header) + header.topic_len + 1 + header.payload_len &&
+        header.size <= _max_record) {
+      rest = header.size - sizeof(header);
+    }
+
+    if (rest == 0 || _file.read(_scratch, rest) != rest) {
+      LOG_F("Spool segment %d is corrupted, dropping %u messages", _read, segment.count);
+      _dropped += segment.count;
+      removeSegment(_read);
+      continue;
+    }
+
+    _message.topic     = (const char *) _scratch;
+    _message.payload   = _scratch + header.topic_len + 1;
+    _message.length    = header.payload_len;
+    _message.retained  = header.flags & MQTTQueue::FLAG_RETAINED;
+    _message.time      = header.time;
+    _message.dup       = header.flags & MQTTQueue::FLAG_DUP;
+    _message.packet_id = header.packet_id;
+    _loaded = true;
+    return true;
+  }
+  return false;
+}
+
+/* oldest spooled message, stays valid until pop() */
+bool MQTTSpool::front(MQTTQueue::Message_t & message, Position_t * position) {
+
+  if (load() == false)
+    return false;
+
+  message = _message;
+  if (position != NULL)
+    *position = _position;
+  return true;
+}
+
+void MQTTSpool::pop() {
+
+  if (_loaded == false)
+    return;
+
+  Segment_t & segment = _segments[_read];
+  _loaded = false;
+  segment.count --;
+  _count --;
+
+  // segment replayed
+  if (segment.count == 0) 
+    removeSegment(_read);
+}
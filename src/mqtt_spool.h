@@ -0,0 +1,133 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _MQTT_SPOOL_H_
+#define _MQTT_SPOOL_H_
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+
+#include "mqtt_queue.h"
+
+#define MQTT_SPOOL_SEGMENTS 4 /* files the spool budget is split into */
+
+/*
+ * Store-and-forward spool of outbound MQTT messages, in SPIFFS.
+ *
+ * Messages that don't fit the RAM queue while the broker is not reachable
+ * are appended here, oldest first, and replayed in order when it is back.
+ * The spool is a ring of a few segment files (/mqtt_spool.<n>), each with a
+ * sequence number: when the budget is used up, the oldest segment is removed
+ * and its messages are counted as dropped. Segments are removed once they
+ * are replayed; what is left is picked up again after a restart, a restart
+ * in the middle of a segment's replay sends its first messages again.
+ *
+ * Segment layout:
+ *   header:  magic u32, sequence u32
+ *   records: MQTTQueue::Header_t (size without padding), topic + NUL, payload
+ */
+class MQTTSpool {
+
+  public:
+    static const uint32_t MAGIC = 0x32505351; // "QSP2", records with their packet id
+
+    /* segment file header */
+    typedef struct __attribute__((packed)) {
+      uint32_t magic;
+      uint32_t seq;
+    } FileHeader_t;
+
+    /* where a record is, segment sequence and offset, to tell it's still the oldest */
+    typedef struct {
+      uint32_t seq;
+      uint32_t offset;
+    } Position_t;
+
+  public:
+    MQTTSpool();
+    ~MQTTSpool();
+
+    bool          begin(size_t budget, size_t max_record);
+
+    bool          append(const MQTTQueue::Message_t & message);
+    bool          front(MQTTQueue::Message_t & message, Position_t * position = NULL);
+    void          pop();
+
+    bool          empty();
+    unsigned int  count();
+    size_t        bytes();
+    unsigned long dropped();
+
+  protected:
+    typedef struct {
+      uint32_t     seq;       // 0 if the segment is not used
+      size_t       size;
+      unsigned int count;     // messages not replayed yet
+    } Segment_t;
+
+    Segment_t     _segments[MQTT_SPOOL_SEGMENTS];
+    size_t        _segment_size;
+    size_t        _max_record;
+    uint32_t      _seq;
+    int           _write;     // segment appended to, -1 if none
+    int           _read;      // segment being replayed, -1 if none
+    File          _file;      // of the segment being replayed
+    uint8_t *     _scratch;   // record being replayed
+    bool          _loaded;
+    MQTTQueue::Message_t _message;
+    Position_t    _position;  // of the loaded record
+    unsigned int  _count;
+    size_t        _bytes;
+    unsigned long _dropped;
+
+    void          path(char * buffer, int index);
+    int           oldest();
+    int           newSegment();
+    void          removeSegment(int index);
+    bool          load();
+};
+
+/* inlines for MQTTSpool */
+inline bool MQTTSpool::empty() {
+  return _count == 0;
+}
+
+inline unsigned int MQTTSpool::count() {
+  return _count;
+}
+
+inline size_t MQTTSpool::bytes() {
+  return _bytes;
+}
+
+inline unsigned long MQTTSpool::dropped() {
+  return _dropped;
+}
+
+inline void MQTTSpool::path(char * buffer, int index) {
+  sprintf(buffer, "/mqtt_spool.%d", index);
+}
+
+#endif//_MQTT_SPOOL_H_
@@ -0,0 +1,187 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "mqtt_transport.h"
+
+MQTTTransport::MQTTTransport(Client & client, AckHandler_t handler)
+  : _client(&client)
+  , _handler(handler)
+  , _state(PARSE_HEADER)
+  , _type(0)
+  , _shift(0)
+  , _remaining(0)
+  , _position(0)
+  , _packet_id(0)
+  , _session_present(false)
+  , _retained(false) {
+}
+
+int MQTTTransport::connect(IPAddress ip, uint16_t port) {
+  reset();
+  return _client->connect(ip, port);
+}
+
+int MQTTTransport::connect(const char * host, uint16_t port) {
+  reset();
+  return _client->connect(host, port);
+}
+
+size_t MQTTTransport::write(uint8_t data) {
+  return _client->write(data);
+}
+
+size_t MQTTTransport::write(const uint8_t * buffer, size_t size) {
+  return _client->write(buffer, size);
+}
+
+int MQTTTransport::available() {
+  return _client->available();
+}
+
+int MQTTTransport::read() {
+  int data = _client->read();
+
+  if (data >= 0) {
+    uint8_t byte = data;
+    parse(&byte, 1);
+  }
+  return data;
+}
+
+int MQTTTransport::read(uint8_t * buffer, size_t size) {
+  int count = _client->read(buffer, size);
+
+  if (count > 0)
+    parse(buffer, count);
+  return count;
+}
+
+int MQTTTransport::peek() {
+  return _client->peek();
+}
+
+void MQTTTransport::flush() {
+  _client->flush();
+}
+
+void MQTTTransport::stop() {
+  _client->stop();
+  reset();
+}
+
+uint8_t MQTTTransport::connected() {
+  return _client->connected();
+}
+
+MQTTTransport::operator bool() {
+  return (bool) *_client;
+}
+
+/* follow the received packets, looking for PUBACKs */
+void MQTTTransport::parse(const uint8_t * data, size_t size) {
+
+  while (size > 0) {
+    switch (_state) {
+
+      case PARSE_HEADER:
+        _type      = *data >> 4;
+        _remaining = 0;
+        _shift     = 0;
+        _position  = 0;
+        _packet_id = 0;
+        _state     = PARSE_LENGTH;
+
+        // PubSubClient reads a whole packet before its callback
+        if (_type == PACKET_PUBLISH)
+          _retained = *data & 0x01;
+        data ++; size --;
+        break;
+
+      case PARSE_LENGTH:
+        _remaining |= (uint32_t) (*data & 0x7F) << _shift;
+        _shift     += 7;
+        _state      = (*data & 0x80) ? PARSE_LENGTH : PARSE_BODY;
+        data ++; size --;
+
+        if (_state == PARSE_BODY && _remaining == 0)
+          _state = PARSE_HEADER;
+        break;
+
+      case PARSE_BODY: {
+        // only the first bytes are needed, the acknowledge flags
+        // of a CONNACK and the packet identifier of a PUBACK
+        if ((_type == PACKET_PUBACK || _type == PACKET_CONNACK) && _position < 2) {
+          if (_type == PACKET_CONNACK && _position == 0)
+            _session_present = *data & 0x01;
+          _packet_id = (_packet_id << 8) | *data;
+          _position ++;
+          _remaining --;
+          data ++; size --;
+        } else {
+          size_t skip = size < _remaining ? size : _remaining;
+          _remaining -= skip;
+          data       += skip;
+          size       -= skip;
+        }
+
+        if (_remaining == 0) {
+          if (_type == PACKET_PUBACK && _position == 2 && _handler != NULL)
+            _handler(_packet_id);
+          _state = PARSE_HEADER;
+        }
+      } break;
+    }
+  }
+}
+
+/* write a QoS 1 PUBLISH packet, PubSubClient only builds QoS 0 ones */
+bool MQTTTransport::publishQoS1(const char * topic, const uint8_t * payload, unsigned int length, 
+                                bool retained, bool dup, uint16_t packet_id) {
+
+  uint8_t  header[5 + 2 + 2];
+  size_t   topic_len = strlen(topic);
+  uint32_t remaining = 2 + topic_len + 2 + length;
+  size_t   pos       = 0;
+
+  header[pos++] = (PACKET_PUBLISH << 4) | (dup ? 0x08 : 0) | 0x02 | (retained ? 0x01 : 0);
+  do {
+    uint8_t digit = remaining & 0x7F;
+    remaining >>= 7;
+    header[pos++] = remaining ? (digit | 0x80) : digit;
+  } while (remaining);
+  header[pos++] = topic_len >> 8;
+  header[pos++] = topic_len & 0xFF;
+
+  if (_client->write(header, pos) != pos ||
+      _client->write((const uint8_t *) topic, topic_len) != topic_len)
+    return false;
+
+  header[0] = packet_id >> 8;
+  header[1] = packet_id & 0xFF;
+  if (_client->write(header, 2) != 2)
+    return false;
+
+  return length == 0 || _client->write(payload, length) == length;
+}
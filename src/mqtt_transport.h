@@ -0,0 +1,115 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _MQTT_TRANSPORT_H_
+#define _MQTT_TRANSPORT_H_
+
+#include <Arduino.h>
+#include <Client.h>
+
+/*
+ * Client wrapping the network client of the MQTT connection.
+ *
+ * PubSubClient reads and writes through it as through the network client.
+ * It follows the packets received, to hand the PUBACKs of the QoS 1
+ * messages, which PubSubClient ignores, to a handler and to keep the
+ * session present flag of the CONNACK and the retain flag of the last
+ * PUBLISH, and is used to write the packets PubSubClient can't build.
+ */
+class MQTTTransport : public Client {
+
+  public:
+    typedef void (*AckHandler_t)(uint16_t packet_id);
+
+    /* MQTT control packet types */
+    enum PacketType {
+      PACKET_CONNACK = 2,
+      PACKET_PUBLISH = 3,
+      PACKET_PUBACK  = 4
+    };
+
+  public:
+    MQTTTransport(Client & client, AckHandler_t handler);
+
+    int     connect(IPAddress ip, uint16_t port) override;
+    int     connect(const char * host, uint16_t port) override;
+    size_t  write(uint8_t data) override;
+    size_t  write(const uint8_t * buffer, size_t size) override;
+    int     available() override;
+    int     read() override;
+    int     read(uint8_t * buffer, size_t size) override;
+    int     peek() override;
+    void    flush() override;
+    void    stop() override;
+    uint8_t connected() override;
+    operator bool() override;
+
+    void    setClient(Client & client);
+    bool    publishQoS1(const char * topic, const uint8_t * payload, unsigned int length, 
+                        bool retained, bool dup, uint16_t packet_id);
+    bool    sessionPresent();
+    bool    retained();
+
+  protected:
+    enum ParseState {
+      PARSE_HEADER,
+      PARSE_LENGTH,
+      PARSE_BODY
+    };
+
+    Client *     _client;
+    AckHandler_t _handler;
+    uint8_t      _state;
+    uint8_t      _type;
+    uint8_t      _shift;
+    uint32_t     _remaining;
+    uint32_t     _position;
+    uint16_t     _packet_id;
+    bool         _session_present;
+    bool         _retained;
+
+    void         reset();
+    void         parse(const uint8_t * data, size_t size);
+};
+
+/* inlines for MQTTTransport */
+inline void MQTTTransport::reset() {
+  _state           = PARSE_HEADER;
+  _session_present = false;
+}
+
+inline void MQTTTransport::setClient(Client & client) {
+  _client = &client;
+}
+
+inline bool MQTTTransport::sessionPresent() {
+  return _session_present;
+}
+
+inline bool MQTTTransport::retained() {
+  return _retained;
+}
+
+#endif//_MQTT_TRANSPORT_H_
@@ -25,6 +25,9 @@
 #include "network.h"
 #include "config.h"
 #include "led_strip.h"
+#include "snapshot.h"
+#include "tslog.h"
+#include "number_format.h"
 
 #define LOG_TAG LOG_TAG_NETWORK
 #include "log.h"
@@ -34,12 +37,35 @@ Network net;
 Network::Network() 
     : taskCheckWiFi(5000, TASK_FOREVER, s_taskCheckWiFiCbk, &scheduler, false)
     , state(STATE_DISCONNECTED)
-    , lastDisconnect(0) {
+    , lastDisconnect(0)
+    , mqttBackoff(0)
+    , signalTopic(TopicArena::INVALID) {
 
 }
 
+/*
+ * Delay before retrying a failed MQTT connect. It doubles on each failure
+ * up to MQTT_RECONNECT_MAX_MS and is jittered over its upper half, so the
+ * stations of a site don't all reconnect at once after a broker restart.
+ */
+unsigned long Network::nextMQTTRetry() {
+
+    mqttBackoff = mqttBackoff ? mqttBackoff * 2 : MQTT_RECONNECT_MIN_MS;
+    if (mqttBackoff > MQTT_RECONNECT_MAX_MS)
+        mqttBackoff = MQTT_RECONNECT_MAX_MS;
+
+    return mqttBackoff / 2 + random(mqttBackoff / 2 + 1);
+}
+
 void Network::begin() {
 
+    // signal topic, kept in the arena so publishing it doesn't allocate
+    if (signalTopic == TopicArena::INVALID) {
+        std::string prefix;
+        config.formatTopic(prefix, ConfigMain::MQTT_TOPIC_WIFI, "");
+        signalTopic = mqtt.topics().add(prefix.c_str(), MQTT_TOPIC_LEVEL_MAX);
+    }
+
     // connect WiFi
     LOG_F("Wifi connect SSID:%s", config.wifi_ssid);
     WiFi.begin(config.wifi_ssid, config.wifi_password);
@@ -112,6 +138,9 @@ void Network::taskCheckWiFiCbk() {
                     LOG_LN("Restarting core due to WiFi inactivity!");
                     LOG_LN(" ---- ");
 
+                    snapshot.save();
+                    mqtt.spill();
+                    tslog.flush();
                     ESP.restart();
 
                     // should not reach
@@ -138,11 +167,15 @@ void Network::taskCheckWiFiCbk() {
             // connect to MQTT
             if (!mqtt.begin()) {
 
-                // failed connecting, retry in 1 second
-                taskCheckWiFi.setInterval(1000);
+                // failed connecting, retry later and later
+                unsigned long retry = nextMQTTRetry();
+                LOG_F("MQTT connect failed, retrying in %lu ms", retry);
+                taskCheckWiFi.setInterval(retry);
                 return;
             } 
 
+            mqttBackoff = 0;
+
             // mqtt connected => ledstrip is now in control of MQTT commands
             ledstrip.clear();
             ledstrip.show();
@@ -201,12 +234,12 @@ void Network::taskCheckWiFiCbk() {
             unsigned long now_sec = millis()/1000;
 
             if ((now_sec - lastPublished) > config.wifi_publish_min_interval_sec) {
-                std::string topic;
-                char val[6];
+                const char * topic = mqtt.topics().topic(signalTopic, "signal");
+                char val[NUMBER_FORMAT_SIZE];
+                size_t len = NumberFormat::formatInt(val, WiFi.RSSI());
 
-                config.formatTopic(topic, ConfigMain::MQTT_TOPIC_WIFI, "signal");
-                sprintf(val, "%d", WiFi.RSSI());
-                mqtt.publish(topic.c_str(), val);
+                if (topic != NULL)
+                    mqtt.publish(topic, (const uint8_t *) val, len, false, MQTT::PRIORITY_DIAGNOSTIC);
 
                 lastPublished = now_sec;
             }
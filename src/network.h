@@ -53,7 +53,10 @@ class Network {
         Task taskCheckWiFi;
         State state;
         unsigned long lastDisconnect;
+        unsigned long mqttBackoff;
+        uint16_t signalTopic;
 
+        unsigned long nextMQTTRetry();
         void taskCheckWiFiCbk();
         static void s_taskCheckWiFiCbk();
 };
@@ -0,0 +1,120 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "number_format.h"
+
+#include <string.h>
+
+/* up to 4 decimals, the scaled value must fit 32 bits */
+static const uint32_t s_scales[] = { 1, 10, 100, 1000, 10000 };
+
+size_t NumberFormat::formatUInt(char * buffer, uint32_t value) {
+
+  char   digits[10];
+  size_t count = 0;
+
+  do {
+    digits[count ++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+
+  for (size_t i = 0; i < count; i ++)
+    buffer[i] = digits[count - 1 - i];
+  buffer[count] = '\0';
+  return count;
+}
+
+size_t NumberFormat::formatInt(char * buffer, int32_t value) {
+
+  if (value >= 0)
+    return formatUInt(buffer, value);
+
+  buffer[0] = '-';
+  return 1 + formatUInt(buffer + 1, - (int64_t) value);
+}
+
+size_t NumberFormat::formatFixed(char * buffer, float value, unsigned int decimals) {
+
+  if (decimals > 4)
+    decimals = 4;
+
+  // out of range, not a number
+  if (!(value > -2e9f / s_scales[decimals] && value < 2e9f / s_scales[decimals])) {
+    buffer[0] = 'n'; buffer[1] = 'a'; buffer[2] = 'n'; buffer[3] = '\0';
+    return 3;
+  }
+
+  // the float is mantissa * 2^shift, scaled exactly in 64 bit integers
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  bool     negative = bits >> 31;
+  int      exponent = (bits >> 23) & 0xFF;
+  uint32_t mantissa = bits & 0x7FFFFF;
+  uint32_t fixed    = 0;
+
+  if (exponent > 0)
+    mantissa |= 0x800000;
+  else
+    exponent = 1;
+
+  int      shift    = exponent - 150;
+  uint64_t scaled   = (uint64_t) mantissa * s_scales[decimals];
+
+  if (shift >= 0) {
+    // in range, at most a few bits
+    fixed = (uint32_t) (scaled << shift);
+  } else
+  if (shift > -40) {
+    // rounded half to even, as printf does with the exact value
+    uint64_t rest = scaled & ((1ULL << -shift) - 1);
+    uint64_t half = 1ULL << (-shift - 1);
+
+    fixed = (uint32_t) (scaled >> -shift);
+    if (rest > half || (rest == half && (fixed & 1)))
+      fixed ++;
+  }
+
+  uint32_t whole    = fixed / s_scales[decimals];
+  uint32_t fraction = fixed % s_scales[decimals];
+  size_t   len      = 0;
+
+  // unlike printf, no "-0.00" when nothing is left after rounding
+  if (negative && fixed > 0)
+    buffer[len ++] = '-';
+
+  len += formatUInt(buffer + len, whole);
+  if (decimals == 0)
+    return len;
+
+  buffer[len ++] = '.';
+  for (unsigned int i = decimals; i > 0; i --) {
+    buffer[len + i - 1] = '0' + fraction % 10;
+    fraction /= 10;
+  }
+  len += decimals;
+  buffer[len] = '\0';
+  return len;
+}
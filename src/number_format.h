@@ -0,0 +1,56 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _NUMBER_FORMAT_H_
+#define _NUMBER_FORMAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Numbers as text for the publish path, the digits made with integer
+ * arithmetic, fixed point values scaled from the bits of the float with no
+ * double (soft float on the ESP32).
+ *
+ * This file does not depend on Arduino, so it can be tested on the host.
+ *
+ * The text is the same as of "%d", "%u" and "%.<n>f", except that there is
+ * no "-0.00".
+ * printf is avoided as it may allocate, for floating point or for output
+ * longer than its buffer.
+ * Buffers must hold NUMBER_FORMAT_SIZE bytes, the text is NUL terminated
+ * and its length returned.
+ */
+#define NUMBER_FORMAT_SIZE 16
+
+class NumberFormat {
+
+  public:
+    static size_t formatInt(char * buffer, int32_t value);
+    static size_t formatUInt(char * buffer, uint32_t value);
+    static size_t formatFixed(char * buffer, float value, unsigned int decimals);
+};
+
+#endif//_NUMBER_FORMAT_H_
@@ -26,6 +26,8 @@
 #include <ArduinoOTA.h>
 #include "ota.h"
 #include "ui.h"
+#include "snapshot.h"
+#include "tslog.h"
 
 #define LOG_TAG LOG_TAG_OTA
 #include "log.h"
@@ -64,6 +66,10 @@ void OTA::begin() {
       // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
       LOG_LN("Start updating " + type);
       ota.running = true;
+
+      // keep the plant values and the pending samples across the update
+      snapshot.save();
+      tslog.flush();
       delay(100);
 
       // stop scheduler and watchdog
@@ -0,0 +1,105 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "ownership.h"
+
+PlantOwnership::PlantOwnership()
+  : _rssi(0)
+  , _heard(0)
+  , _has_rssi(false)
+  , _owner(false)
+  , _announce(false)
+  , _remote_rssi(0)
+  , _remote(0)
+  , _remote_claim(0)
+  , _remote_data(0)
+  , _changes(0) {
+}
+
+/* the plant was heard over BLE by this station */
+void PlantOwnership::heard(int rssi, unsigned long now) {
+
+  if (_has_rssi == false || isHeard(now) == false) {
+    _rssi = rssi;
+  } else {
+    _rssi += ALPHA * (rssi - _rssi);
+  }
+  _heard    = now;
+  _has_rssi = true;
+}
+
+/* another station advertised that it owns the plant */
+void PlantOwnership::remoteClaim(uint32_t station, int rssi, unsigned long now) {
+
+  // keep the best of the claiming stations, they sort it out between them
+  if (station != _remote && hasRemote(now) && rssi <= _remote_rssi)
+    return;
+
+  if (station != _remote) {
+    _remote      = station;
+    _remote_data = now;
+  }
+  _remote_rssi  = rssi;
+  _remote_claim = now;
+}
+
+/* another station sent a reading of the plant */
+void PlantOwnership::remoteReading(uint32_t station, unsigned long now) {
+  if (station == _remote)
+    _remote_data = now;
+}
+
+bool PlantOwnership::hasRemote(unsigned long now) {
+  return _remote != 0 && 
+    (now - _remote_claim) < TIMEOUT_MS && 
+    (now - _remote_data) < TIMEOUT_MS;
+}
+
+/* decide if this station owns the plant, returns true when that changed */
+bool PlantOwnership::update(uint32_t self, unsigned long now) {
+
+  bool owner;
+
+  if (isHeard(now) == false) {
+    owner = false;
+  } else
+  if (hasRemote(now) == false) {
+    owner = true;
+  } else
+  if (_owner) {
+    // both claim it
+    owner = rssi() > _remote_rssi || (rssi() == _remote_rssi && self < _remote);
+  } else {
+    owner = rssi() > _remote_rssi + HYSTERESIS;
+  }
+
+  if (owner == _owner)
+    return false;
+
+  _owner    = owner;
+  _announce = owner;
+  _changes ++;
+  return true;
+}
@@ -0,0 +1,112 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _OWNERSHIP_H_
+#define _OWNERSHIP_H_
+
+#include <stdint.h>
+
+/*
+ * Which station publishes a plant, when more stations hear it.
+ *
+ * This file does not depend on Arduino, so it can be simulated on the host.
+ *
+ * Stations advertise their smoothed RSSI of a plant and whether they own it.
+ * A station takes a plant owned by another only when it hears it better by
+ * the hysteresis; when two stations claim the same plant, the best signal
+ * wins and the station id breaks ties. Claims expire when the owner stops
+ * advertising or stops sending readings, so the others take over.
+ *
+ * Times are in ms, from millis().
+ */
+class PlantOwnership {
+
+  public:
+    static const unsigned long TIMEOUT_MS = 90000;  // claims and own readings expire after this
+    static const int           HYSTERESIS = 6;      // dB better to take over a plant
+    static constexpr float     ALPHA      = 0.2f;   // smoothing of the RSSI
+
+  public:
+    PlantOwnership();
+
+    void         heard(int rssi, unsigned long now);
+    void         remoteClaim(uint32_t station, int rssi, unsigned long now);
+    void         remoteReading(uint32_t station, unsigned long now);
+    bool         update(uint32_t self, unsigned long now);
+
+    bool         isOwner();
+    bool         isHeard(unsigned long now);
+    int          rssi();
+    uint32_t     remoteOwner();
+    unsigned int changes();
+
+    bool         needsAnnounce();
+    void         announced();
+
+  protected:
+    float         _rssi;
+    unsigned long _heard;
+    bool          _has_rssi;
+    bool          _owner;
+    bool          _announce;
+    int8_t        _remote_rssi;
+    uint32_t      _remote;
+    unsigned long _remote_claim;
+    unsigned long _remote_data;
+    uint16_t      _changes;
+
+    bool          hasRemote(unsigned long now);
+};
+
+/* inlines for PlantOwnership */
+inline bool PlantOwnership::isOwner() {
+  return _owner;
+}
+
+inline bool PlantOwnership::isHeard(unsigned long now) {
+  return _has_rssi && (now - _heard) < TIMEOUT_MS;
+}
+
+inline int PlantOwnership::rssi() {
+  return (int) (_rssi + (_rssi < 0 ? -0.5f : 0.5f));
+}
+
+inline uint32_t PlantOwnership::remoteOwner() {
+  return _remote;
+}
+
+inline unsigned int PlantOwnership::changes() {
+  return _changes;
+}
+
+inline bool PlantOwnership::needsAnnounce() {
+  return _announce && _owner;
+}
+
+inline void PlantOwnership::announced() {
+  _announce = false;
+}
+
+#endif//_OWNERSHIP_H_
@@ -0,0 +1,427 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "rule_vm.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+
+/*
+ * Recursive descent parser emitting straight into the code arena
+ */
+class RuleParser {
+
+  public:
+    RuleParser(RuleCode & rc, const char * expr, const RuleSymbol_t * symbols, size_t symbols_count)
+      : code(rc.code), p(expr), symbols(symbols), symbols_count(symbols_count) {}
+
+    bool parse(RuleCode::Program_t & out, const char ** error);
+
+  protected:
+    std::vector<uint8_t> & code;
+    const char *           p;
+    const RuleSymbol_t *   symbols;
+    size_t                 symbols_count;
+
+    uint32_t    deps       = 0;
+    bool        uses_age   = false;
+    int         depth      = 0;
+    int         last_slot  = -1;
+    bool        negated    = false;  // under an odd number of "not"
+    bool        cmp_values = false;  // the current comparison reads plant values
+    bool        cmp_age    = false;  // the current comparison reads "age"
+    const char *error      = NULL;
+
+    void skipSpaces();
+    bool accept(const char * token);
+    bool acceptWord(const char * word);
+    bool fail(const char * message);
+
+    void emit(uint8_t op, int stack_delta);
+    void emitSlot(uint8_t op, uint8_t slot);
+
+    bool parseOr();
+    bool parseAnd();
+    bool parseNot();
+    bool parseCompare();
+    bool parseSum();
+    bool parseTerm();
+    bool parseUnary();
+    bool parsePrimary();
+};
+
+void RuleParser::skipSpaces() {
+  while (isspace((unsigned char)*p)) p++;
+}
+
+bool RuleParser::accept(const char * token) {
+  skipSpaces();
+  size_t len = strlen(token);
+  if (strncmp(p, token, len) != 0) return false;
+  p += len;
+  return true;
+}
+
+bool RuleParser::acceptWord(const char * word) {
+  skipSpaces();
+  size_t len = strlen(word);
+  if (strncasecmp(p, word, len) != 0) return false;
+  if (isalnum((unsigned char)p[len]) || p[len] == '_') return false;
+  p += len;
+  return true;
+}
+
+bool RuleParser::fail(const char * message) {
+  if (error == NULL) error = message;
+  return false;
+}
+
+void RuleParser::emit(uint8_t op, int stack_delta) {
+  code.push_back(op);
+  depth += stack_delta;
+  if (depth > RULE_MAX_STACK) fail("expression too deep");
+}
+
+void RuleParser::emitSlot(uint8_t op, uint8_t slot) {
+  emit(op, 1);
+  code.push_back(slot);
+}
+
+bool RuleParser::parse(RuleCode::Program_t & out, const char ** error_out) {
+
+  out.offset   = code.size();
+  out.for_sec  = 0;
+
+  bool ok = parseOr();
+
+  // optional "for <duration>" trailer
+  if (ok && acceptWord("for")) {
+    ok = RuleCode::parseDuration(p, out.for_sec) || fail("invalid duration");
+    p += strlen(p);
+  }
+
+  skipSpaces();
+  if (ok && *p != '\0') ok = fail("unexpected trailing input");
+
+  if (!ok) {
+    code.resize(out.offset);
+    if (error_out) *error_out = error ? error : "syntax error";
+    return false;
+  }
+
+  emit(RuleCode::OP_END, 0);
+  out.deps     = deps;
+  out.uses_age = uses_age;
+  return true;
+}
+
+bool RuleParser::parseOr() {
+  if (!parseAnd()) return false;
+  while (acceptWord("or")) {
+    if (!parseAnd()) return false;
+    emit(RuleCode::OP_OR, -1);
+  }
+  return true;
+}
+
+bool RuleParser::parseAnd() {
+  if (!parseNot()) return false;
+  while (acceptWord("and")) {
+    if (!parseNot()) return false;
+    emit(RuleCode::OP_AND, -1);
+  }
+  return true;
+}
+
+bool RuleParser::parseNot() {
+  if (acceptWord("not")) {
+    negated = !negated;
+    bool ok = parseNot();
+    negated = !negated;
+    if (!ok) return false;
+    emit(RuleCode::OP_NOT, 0);
+    return true;
+  }
+  return parseCompare();
+}
+
+bool RuleParser::parseCompare() {
+
+  // a bare min/max refers to the last symbol of this comparison
+  last_slot = -1;
+
+  // operands of an enclosing comparison, with parenthesis in between
+  bool outer_values = cmp_values, outer_age = cmp_age;
+  cmp_values = cmp_age = false;
+
+  bool ok = parseSum();
+
+  uint8_t op = RuleCode::OP_END;
+  if (ok) {
+    if      (accept("<="))  op = RuleCode::OP_LE;
+    else if (accept(">="))  op = RuleCode::OP_GE;
+    else if (accept("=="))  op = RuleCode::OP_EQ;
+    else if (accept("!="))  op = RuleCode::OP_NE;
+    else if (accept("<"))   op = RuleCode::OP_LT;
+    else if (accept(">"))   op = RuleCode::OP_GT;
+  }
+
+  if (ok && op != RuleCode::OP_END) {
+    ok = parseSum();
+    if (ok) {
+      emit(op, -1);
+
+      // the hysteresis is for plant values, "age" must trip on time
+      if (op != RuleCode::OP_EQ && op != RuleCode::OP_NE) {
+        int8_t direction = (cmp_values && cmp_age == false) ? (negated ? -1 : 1) : 0;
+        code.push_back((uint8_t) direction);
+      }
+    }
+  }
+
+  cmp_values |= outer_values;
+  cmp_age    |= outer_age;
+  return ok && error == NULL;
+}
+
+bool RuleParser::parseSum() {
+  if (!parseTerm()) return false;
+  for (;;) {
+    if      (accept("+")) { if (!parseTerm()) return false; emit(RuleCode::OP_ADD, -1); }
+    else if (accept("-")) { if (!parseTerm()) return false; emit(RuleCode::OP_SUB, -1); }
+    else return true;
+  }
+}
+
+bool RuleParser::parseTerm() {
+  if (!parseUnary()) return false;
+  for (;;) {
+    if      (accept("*")) { if (!parseUnary()) return false; emit(RuleCode::OP_MUL, -1); }
+    else if (accept("/")) { if (!parseUnary()) return false; emit(RuleCode::OP_DIV, -1); }
+    else return true;
+  }
+}
+
+bool RuleParser::parseUnary() {
+  if (accept("-")) {
+    if (!parseUnary()) return false;
+    emit(RuleCode::OP_NEG, 0);
+    return true;
+  }
+  return parsePrimary();
+}
+
+bool RuleParser::parsePrimary() {
+
+  skipSpaces();
+
+  // parenthesis
+  if (accept("(")) {
+    if (!parseOr()) return false;
+    if (!accept(")")) return fail("missing ')'");
+    return true;
+  }
+
+  // number
+  if (isdigit((unsigned char)*p) || *p == '.') {
+    char * end;
+    float value = strtof(p, &end);
+    if (end == p) return fail("invalid number");
+    p = end;
+
+    // duration literal ("age > 2h")
+    if (strchr("smhd", *p) && *p && !isalnum((unsigned char)p[1])) {
+      switch (*p++) {
+        case 'm': value *= 60;    break;
+        case 'h': value *= 3600;  break;
+        case 'd': value *= 86400; break;
+      }
+    }
+
+    emit(RuleCode::OP_PUSH, 1);
+    uint8_t bytes[sizeof(float)];
+    memcpy(bytes, &value, sizeof(float));
+    code.insert(code.end(), bytes, bytes + sizeof(float));
+    return error == NULL;
+  }
+
+  // identifier
+  if (!isalpha((unsigned char)*p)) return fail("expected a value");
+
+  const char * start = p;
+  while (isalnum((unsigned char)*p) || *p == '_') p++;
+  size_t len = p - start;
+
+  if (len == 3 && strncasecmp(start, "age", 3) == 0) {
+    uses_age = true;
+    cmp_age  = true;
+    emit(RuleCode::OP_LOAD_AGE, 1);
+    return error == NULL;
+  }
+
+  if (len == 3 && (strncasecmp(start, "min", 3) == 0 || strncasecmp(start, "max", 3) == 0)) {
+    if (last_slot < 0) return fail("min/max without a value to refer to");
+    bool is_min = tolower((unsigned char)start[1]) == 'i';
+    cmp_values  = true;
+    emitSlot(is_min ? RuleCode::OP_LOAD_MIN : RuleCode::OP_LOAD_MAX, last_slot);
+    return error == NULL;
+  }
+
+  for (size_t i = 0; i < symbols_count; i++) {
+    if (strlen(symbols[i].name) != len || strncasecmp(symbols[i].name, start, len) != 0)
+      continue;
+
+    uint8_t slot = symbols[i].slot;
+    if (slot >= RULE_MAX_SLOTS) return fail("invalid slot");
+
+    // value limits
+    if      (accept(".min")) { emitSlot(RuleCode::OP_LOAD_MIN, slot); }
+    else if (accept(".max")) { emitSlot(RuleCode::OP_LOAD_MAX, slot); }
+    else                     { emitSlot(RuleCode::OP_LOAD, slot); }
+
+    deps      |= 1u << slot;
+    last_slot  = slot;
+    cmp_values = true;
+    return error == NULL;
+  }
+
+  return fail("unknown value name");
+}
+
+/*
+ * RuleCode
+ */
+RuleCode::RuleCode() {
+}
+
+bool RuleCode::compile(const char * expr, const RuleSymbol_t * symbols, size_t symbols_count,
+                       Program_t & out, const char ** error) {
+  RuleParser parser(*this, expr, symbols, symbols_count);
+  return parser.parse(out, error);
+}
+
+static inline bool truth(float value) {
+  // NaN is false
+  return value != 0.0f && value == value;
+}
+
+static inline bool unknown(float value) {
+  return value != value;
+}
+
+/* comparison result, unknown when either side is */
+static inline float compare(float a, float b, bool result) {
+  return (unknown(a) || unknown(b)) ? NAN : (float) result;
+}
+
+/* three-valued logic: a known side may decide alone, else unknown wins */
+static inline float logicAnd(float a, float b) {
+  if ((a == 0.0f) || (b == 0.0f)) return 0.0f;
+  return (unknown(a) || unknown(b)) ? NAN : 1.0f;
+}
+
+static inline float logicOr(float a, float b) {
+  if (truth(a) || truth(b)) return 1.0f;
+  return (unknown(a) || unknown(b)) ? NAN : 0.0f;
+}
+
+bool RuleCode::evaluate(const Program_t & program, const RuleContext_t & ctx, float bias) {
+
+  float stack[RULE_MAX_STACK];
+  int   sp = 0;
+  float b;
+
+  const uint8_t * pc = code.data() + program.offset;
+
+  // ordered comparisons are biased by the hysteresis in the direction
+  // given by the compiler: "a < b" becomes "a < b + bias * direction"
+  for (;;) {
+    switch (*pc++) {
+
+      case OP_END:
+        return sp > 0 && truth(stack[sp - 1]);
+
+      case OP_PUSH:
+        memcpy(&stack[sp++], pc, sizeof(float));
+        pc += sizeof(float);
+        break;
+
+      case OP_LOAD:     stack[sp++] = ctx.values[*pc++]; break;
+      case OP_LOAD_MIN: stack[sp++] = ctx.mins[*pc++];   break;
+      case OP_LOAD_MAX: stack[sp++] = ctx.maxs[*pc++];   break;
+      case OP_LOAD_AGE: stack[sp++] = ctx.age;           break;
+
+      case OP_NEG: stack[sp - 1] = -stack[sp - 1];          break;
+      case OP_ADD: sp--; stack[sp - 1] += stack[sp];        break;
+      case OP_SUB: sp--; stack[sp - 1] -= stack[sp];        break;
+      case OP_MUL: sp--; stack[sp - 1] *= stack[sp];        break;
+      case OP_DIV: sp--; stack[sp - 1] /= stack[sp];        break;
+
+      case OP_LT: sp--; b = bias * (int8_t) *pc++; stack[sp - 1] = compare(stack[sp - 1], stack[sp], stack[sp - 1] <  stack[sp] + b); break;
+      case OP_LE: sp--; b = bias * (int8_t) *pc++; stack[sp - 1] = compare(stack[sp - 1], stack[sp], stack[sp - 1] <= stack[sp] + b); break;
+      case OP_GT: sp--; b = bias * (int8_t) *pc++; stack[sp - 1] = compare(stack[sp - 1], stack[sp], stack[sp - 1] >  stack[sp] - b); break;
+      case OP_GE: sp--; b = bias * (int8_t) *pc++; stack[sp - 1] = compare(stack[sp - 1], stack[sp], stack[sp - 1] >= stack[sp] - b); break;
+      case OP_EQ: sp--; stack[sp - 1] = compare(stack[sp - 1], stack[sp], stack[sp - 1] == stack[sp]); break;
+      case OP_NE: sp--; stack[sp - 1] = compare(stack[sp - 1], stack[sp], stack[sp - 1] != stack[sp]); break;
+
+      case OP_AND: sp--; stack[sp - 1] = logicAnd(stack[sp - 1], stack[sp]); break;
+      case OP_OR:  sp--; stack[sp - 1] = logicOr(stack[sp - 1], stack[sp]);  break;
+      case OP_NOT: if (!unknown(stack[sp - 1])) stack[sp - 1] = !truth(stack[sp - 1]); break;
+
+      default:
+        return false;
+    }
+  }
+}
+
+bool RuleCode::parseDuration(const char * str, uint32_t & seconds) {
+
+  char * end;
+  float value = strtof(str, &end);
+  if (end == str || value < 0) return false;
+
+  while (isspace((unsigned char)*end)) end++;
+
+  float unit = 1;
+  switch (tolower((unsigned char)*end)) {
+    case '\0':
+    case 's': unit = 1;     break;
+    case 'm': unit = 60;    break;
+    case 'h': unit = 3600;  break;
+    case 'd': unit = 86400; break;
+    default: return false;
+  }
+
+  // unit words ("30 min", "2 hours") are fine, anything else is not
+  if (*end) end++;
+  while (isalpha((unsigned char)*end)) end++;
+  while (isspace((unsigned char)*end)) end++;
+  if (*end != '\0') return false;
+
+  seconds = (uint32_t)(value * unit + 0.5f);
+  return true;
+}
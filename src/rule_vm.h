@@ -0,0 +1,143 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _RULE_VM_H_
+#define _RULE_VM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Compiler and interpreter for alert rule expressions.
+ *
+ * Expressions are compiled once into a shared bytecode arena and evaluated
+ * on a small float stack. This file does not depend on Arduino, values are
+ * addressed through slots, mapped to names by the caller's symbol table.
+ *
+ * Grammar:
+ *   rule    := expr [ "for" duration ]
+ *   expr    := and { "or" and }
+ *   and     := not { "and" not }
+ *   not     := "not" not | cmp
+ *   cmp     := sum [ ("<" | "<=" | ">" | ">=" | "==" | "!=") sum ]
+ *   sum     := term { ("+" | "-") term }
+ *   term    := unary { ("*" | "/") unary }
+ *   unary   := "-" unary | primary
+ *   primary := number | symbol [ ".min" | ".max" ] | "min" | "max" | "age" | "(" expr ")"
+ *
+ * A bare "min" or "max" is the limit of the last symbol in the comparison
+ * ("temp > max"), "age" is the time in seconds since the last update.
+ * Numbers may carry a s/m/h/d duration suffix ("age > 2h"), the "for"
+ * duration may also spell the unit out ("for 30 min").
+ *
+ * Missing values and limits evaluate to NaN and make a comparison unknown
+ * (NaN) rather than false. "not" keeps it unknown, "and"/"or" only settle it
+ * when the other side decides alone, and a rule that ends unknown is false.
+ *
+ * The hysteresis bias is applied to the ordered comparisons that read plant
+ * values and not "age", in the direction that keeps the rule as it is: it is
+ * reversed for comparisons under an odd number of "not".
+ */
+
+#define RULE_MAX_STACK   16 // deepest expression accepted
+#define RULE_MAX_SLOTS   32 // slots addressable by symbols (bits of the dependency mask)
+
+/* name of a value slot */
+typedef struct {
+  const char * name;
+  uint8_t      slot;
+} RuleSymbol_t;
+
+/* values an expression is evaluated against, indexed by slot */
+typedef struct {
+  const float * values;
+  const float * mins;
+  const float * maxs;
+  float         age;
+} RuleContext_t;
+
+class RuleCode {
+
+  public:
+    enum Op {
+      OP_END,
+      OP_PUSH,      // 4 bytes float follow
+      OP_LOAD,      // slot follows
+      OP_LOAD_MIN,  // slot follows
+      OP_LOAD_MAX,  // slot follows
+      OP_LOAD_AGE,
+      OP_NEG,
+      OP_ADD,
+      OP_SUB,
+      OP_MUL,
+      OP_DIV,
+      OP_LT,        // bias direction follows (int8_t, -1, 0 or 1)
+      OP_LE,        // bias direction follows
+      OP_GT,        // bias direction follows
+      OP_GE,        // bias direction follows
+      OP_EQ,
+      OP_NE,
+      OP_AND,
+      OP_OR,
+      OP_NOT
+    };
+
+    /* a compiled expression */
+    typedef struct {
+      uint32_t offset;    // in the code arena
+      uint32_t deps;      // bit mask of the slots it reads
+      bool     uses_age;  // depends on the passing of time
+      uint32_t for_sec;   // optional "for" duration
+    } Program_t;
+
+  public:
+    RuleCode();
+
+    bool   compile(const char * expr, const RuleSymbol_t * symbols, size_t symbols_count,
+                   Program_t & out, const char ** error);
+    bool   evaluate(const Program_t & program, const RuleContext_t & ctx, float bias);
+
+    size_t size();
+    void   clear();
+
+    static bool parseDuration(const char * str, uint32_t & seconds);
+
+  protected:
+    friend class RuleParser;
+
+    std::vector<uint8_t> code;
+};
+
+/* inlines for RuleCode */
+inline size_t RuleCode::size() {
+  return code.size();
+}
+
+inline void RuleCode::clear() {
+  code.clear();
+}
+
+#endif//_RULE_VM_H_
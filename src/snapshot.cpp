@@ -0,0 +1,556 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <new>
+#include <Preferences.h>
+
+#include "snapshot.h"
+#include "wallclock.h"
+#include "mqtt.h"
+
+#define LOG_TAG LOG_TAG_FLEET
+#include "log.h"
+
+/* largest record of a plant: id, address, name, masks, all values and limits */
+#define SNAPSHOT_MAX_DEVICE_BYTES (2 + 1 + 17 + 1 + 31 + 4 + ATTR_ID_MAX * 16)
+
+FleetSnapshot snapshot;
+
+FleetSnapshot::FleetSnapshot()
+  : _task_save(SNAPSHOT_SAVE_SEC * TASK_SECOND, TASK_FOREVER, s_taskSaveCbk, &scheduler, false)
+  , _task_populated(TASK_SECOND, TASK_FOREVER, s_taskPopulatedCbk, &scheduler, false)
+  , _task_publish(0, TASK_ONCE, s_taskPublishCbk, &scheduler, false)
+  , _task_warm(TASK_SECOND, TASK_FOREVER, s_taskWarmCbk, &scheduler, false)
+  , _restored_values(0)
+  , _populated_ms(0)
+  , _warm_started(false)
+  , _warm_values(0)
+  , _warm_chunks(0)
+  , _warm_waited(0)
+  , _warm_requests(0)
+  , _published_ms(0) {
+}
+
+bool FleetSnapshot::begin() {
+
+  bool success = true;
+
+  // measure how long it takes until every plant shows its values
+  _task_populated.enable();
+
+  if (config.snapshot_save_sec == 0)
+    return true;
+
+  success = restore();
+
+  _task_save.setInterval(config.snapshot_save_sec * TASK_SECOND);
+  _task_save.enableDelayed(config.snapshot_save_sec * TASK_SECOND);
+  return success;
+}
+
+/* serve snapshots to the other stations, and ask the peer for its own */
+bool FleetSnapshot::beginMQTT() {
+
+  std::string topic;
+  bool        success;
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_SNAPSHOT, config.station_name, "get");
+  success = mqtt.subscribeTo(topic.c_str(), s_onRequest);
+
+  if (config.snapshot_peer == NULL || *config.snapshot_peer == '\0')
+    return success;
+
+  // a chunk must fit the buffer of the receiving client
+  if (mqtt.getBufferSize() < SNAPSHOT_BUFFER_SIZE)
+    mqtt.setBufferSize(SNAPSHOT_BUFFER_SIZE);
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_SNAPSHOT, config.snapshot_peer);
+  success &= mqtt.subscribeTo(topic.c_str(), s_onChunk);
+  success &= request();
+
+  // the peer may be down, the retained values are the fallback
+  _task_warm.enable();
+  return success;
+}
+
+/* ask the peer for its snapshot, queued it goes out after connecting and subscribing */
+bool FleetSnapshot::request() {
+
+  std::string topic;
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_SNAPSHOT, config.snapshot_peer, "get");
+  _warm_requests ++;
+
+  LOG_F("Warm start requested from %s (%u of %u)", config.snapshot_peer, _warm_requests, SNAPSHOT_WARM_REQUESTS);
+  return mqtt.publish(topic.c_str(), config.station_name, false);
+}
+
+static inline uint8_t * putBytes(uint8_t * p, const void * data, size_t len) {
+  memcpy(p, data, len);
+  return p + len;
+}
+
+static inline uint8_t * putString(uint8_t * p, const std::string & str, size_t max_len) {
+  uint8_t len = str.size() > max_len ? max_len : str.size();
+  *p++ = len;
+  return putBytes(p, str.c_str(), len);
+}
+
+/* record of a plant, at most SNAPSHOT_MAX_DEVICE_BYTES */
+size_t FleetSnapshot::encodeDevice(uint8_t * buffer, MiFloraDevice * device, unsigned long now) {
+
+  uint8_t * p        = buffer;
+  int16_t   id       = device->getID();
+  uint8_t   has_mask = 0;
+  uint8_t   ble_mask = 0;
+  uint8_t   min_mask = 0;
+  uint8_t   max_mask = 0;
+
+  for (unsigned int i = 0; i < ATTR_ID_MAX; ++ i) {
+    DeviceAttribute * attr = device->attributeByID((AttributeID) i);
+    if (attr->hasValue()) {
+      has_mask |= 1 << i;
+      ble_mask |= attr->getSource() == SOURCE_BLE ? 1 << i : 0;
+    }
+    min_mask |= attr->hasMin() ? 1 << i : 0;
+    max_mask |= attr->hasMax() ? 1 << i : 0;
+  }
+
+  p = putBytes(p, &id, sizeof(id));
+  p = putString(p, device->getAddress(), 17);
+  p = putString(p, device->getName(), 31);
+  *p++ = has_mask;
+  *p++ = ble_mask;
+  *p++ = min_mask;
+  *p++ = max_mask;
+
+  for (unsigned int i = 0; i < ATTR_ID_MAX; ++ i) {
+    if ((has_mask & (1 << i)) == 0)
+      continue;
+
+    DeviceAttribute * attr = device->attributeByID((AttributeID) i);
+    float    value = attr->get();
+    uint32_t age   = (now - attr->lastUpdated()) / 1000;
+
+    p = putBytes(p, &value, sizeof(value));
+    p = putBytes(p, &age, sizeof(age));
+  }
+
+  for (unsigned int i = 0; i < ATTR_ID_MAX; ++ i) {
+    if (min_mask & (1 << i)) {
+      float limit = device->attributeByID((AttributeID) i)->getMin();
+      p = putBytes(p, &limit, sizeof(limit));
+    }
+  }
+
+  for (unsigned int i = 0; i < ATTR_ID_MAX; ++ i) {
+    if (max_mask & (1 << i)) {
+      float limit = device->attributeByID((AttributeID) i)->getMax();
+      p = putBytes(p, &limit, sizeof(limit));
+    }
+  }
+
+  return p - buffer;
+}
+
+size_t FleetSnapshot::encode(uint8_t * buffer, size_t size) {
+
+  uint8_t *     p     = buffer + sizeof(Header_t);
+  unsigned long now   = millis();
+  Header_t      header;
+  
+  header.magic      = MAGIC;
+  header.version    = VERSION;
+  header.count      = 0;
+  header.chunk      = SNAPSHOT_CHUNK_LAST;
+  header.saved_time = wallclock.isSynced() ? wallclock.now() : 0;
+
+  for (auto device : fleet.devices()) {
+
+    if (header.count == 0xFF || (size_t) (p - buffer) + SNAPSHOT_MAX_DEVICE_BYTES > size)
+      break;
+
+    p += encodeDevice(p, device, now);
+    header.count ++;
+  }
+
+  memcpy(buffer, &header, sizeof(header));
+  return p - buffer;
+}
+
+/* 
+ * Restore the values of a blob, from NVS or from the peer. A value is only
+ * restored when the plant has none, or a restored one older than it.
+ */
+bool FleetSnapshot::decode(const uint8_t * buffer, size_t size, unsigned int & restored) {
+
+  const uint8_t * p   = buffer + sizeof(Header_t);
+  const uint8_t * end = buffer + size;
+  Header_t        header;
+  uint32_t        downtime = 0;
+
+  if (size < sizeof(Header_t))
+    return false;
+
+  memcpy(&header, buffer, sizeof(header));
+  if (header.magic != MAGIC || header.version == 0 || header.version > VERSION) {
+    LOG_F("Snapshot version %u not supported", (unsigned int) header.version);
+    return false;
+  }
+
+  // the clock may have survived a software restart
+  if (header.saved_time && wallclock.isSynced() && wallclock.now() > header.saved_time) {
+    downtime = wallclock.now() - header.saved_time;
+  }
+
+  restored = 0;
+
+  for (unsigned int n = 0; n < header.count; ++ n) {
+
+    int16_t     id;
+    std::string address;
+    std::string name;
+    uint8_t     has_mask, ble_mask;
+    uint8_t     min_mask = 0, max_mask = 0;
+    bool        any      = false;
+
+    // fixed part and strings
+    if (p + sizeof(id) + 1 > end) return false;
+    memcpy(&id, p, sizeof(id)); p += sizeof(id);
+
+    if (p >= end || p + 1 + *p > end) return false;
+    address.assign((const char *) p + 1, *p); p += 1 + *p;
+
+    if (p >= end || p + 1 + *p + 2 > end) return false;
+    name.assign((const char *) p + 1, *p); p += 1 + *p;
+
+    has_mask = *p++;
+    ble_mask = *p++;
+
+    // limits came with version 2
+    if (header.version >= 2) {
+      if (p + 2 > end) return false;
+      min_mask = *p++;
+      max_mask = *p++;
+    }
+
+    // discovered plants come back with their id and name
+    MiFloraDevice * device = fleet.findByAddress(address.c_str());
+    if (device == NULL && config.flora_discover_devices) {
+      device = new MiFloraDevice(address);
+      device->setID(id);
+      device->setName(name.c_str());
+      fleet.addDevice(device);
+    }
+
+    for (unsigned int i = 0; i < ATTR_ID_MAX; ++ i) {
+      if ((has_mask & (1 << i)) == 0)
+        continue;
+
+      float    value;
+      uint32_t age;
+
+      if (p + sizeof(value) + sizeof(age) > end) return false;
+      memcpy(&value, p, sizeof(value)); p += sizeof(value);
+      memcpy(&age  , p, sizeof(age));   p += sizeof(age);
+
+      age += downtime;
+
+      // values that would be reset anyway
+      if (device == NULL || (config.flora_stale_sec && age >= config.flora_stale_sec))
+        continue;
+
+      // values read since boot, or restored fresher, are kept
+      DeviceAttribute * attr = device->attributeByID((AttributeID) i);
+      if (attr->hasValue() && (attr->isRestored() == false || 
+          millis() - attr->lastUpdated() <= (unsigned long) age * 1000))
+        continue;
+
+      attr->restore(value, ble_mask & (1 << i) ? SOURCE_BLE : SOURCE_MQTT, (unsigned long) age * 1000);
+      restored ++;
+      any = true;
+    }
+
+    // limits only fill the ones not configured on this station
+    for (unsigned int i = 0; i < 2 * ATTR_ID_MAX; ++ i) {
+      bool    is_max = i >= ATTR_ID_MAX;
+      uint8_t bit    = 1 << (i % ATTR_ID_MAX);
+      float   limit;
+
+      if (((is_max ? max_mask : min_mask) & bit) == 0)
+        continue;
+
+      if (p + sizeof(limit) > end) return false;
+      memcpy(&limit, p, sizeof(limit)); p += sizeof(limit);
+
+      if (device == NULL)
+        continue;
+
+      DeviceAttribute * attr = device->attributeByID((AttributeID) (i % ATTR_ID_MAX));
+      if (is_max == false && attr->hasMin() == false) attr->setMin(limit);
+      if (is_max == true  && attr->hasMax() == false) attr->setMax(limit);
+    }
+
+    if (device && any) {
+      device->onRestored();
+    }
+  }
+
+  return true;
+}
+
+/* write the fleet to NVS */
+bool FleetSnapshot::save() {
+
+  Preferences prefs;
+  size_t      capacity = sizeof(Header_t) + fleet.count() * SNAPSHOT_MAX_DEVICE_BYTES;
+  uint8_t *   buffer;
+  size_t      len;
+  bool        has_values = false;
+
+  // don't replace a good snapshot with an empty fleet
+  for (auto device : fleet.devices()) {
+    has_values |= device->moisture.hasValue() || device->temperature.hasValue();
+  }
+  if (has_values == false)
+    return false;
+
+  buffer = (uint8_t *) malloc(capacity);
+  if (buffer == NULL) {
+    LOG_F("No memory for the snapshot (%u bytes)", (unsigned int) capacity);
+    return false;
+  }
+
+  len = encode(buffer, capacity);
+
+  bool success = prefs.begin(SNAPSHOT_NVS_NAMESPACE, false) && 
+                 prefs.putBytes(SNAPSHOT_NVS_KEY, buffer, len) == len;
+  prefs.end();
+  free(buffer);
+
+  LOG_F("Saved snapshot of %u plants (%u bytes): %s", 
+    fleet.count(), (unsigned int) len, success ? "success" : "failed");
+  return success;
+}
+
+/* read the fleet back from NVS */
+bool FleetSnapshot::restore() {
+
+  Preferences prefs;
+  size_t      len;
+  uint8_t *   buffer;
+  bool        success;
+
+  if (prefs.begin(SNAPSHOT_NVS_NAMESPACE, true) == false) {
+    LOG_LN("No snapshot to restore");
+    return true;
+  }
+
+  len = prefs.getBytesLength(SNAPSHOT_NVS_KEY);
+  if (len == 0) {
+    prefs.end();
+    LOG_LN("No snapshot to restore");
+    return true;
+  }
+
+  buffer = (uint8_t *) malloc(len);
+  if (buffer == NULL) {
+    prefs.end();
+    return false;
+  }
+
+  success = prefs.getBytes(SNAPSHOT_NVS_KEY, buffer, len) == len && decode(buffer, len, _restored_values);
+  prefs.end();
+  free(buffer);
+
+  LOG_F("Restored %u values of %u plants from snapshot: %s", 
+    _restored_values, fleet.count(), success ? "success" : "corrupted");
+  return success;
+}
+
+/* 
+ * Publish the fleet in chunks, each plant encoded straight into the MQTT
+ * client: a first pass sizes the chunk, the PUBLISH is started with that
+ * length and the plants are encoded again, one record at a time, into it.
+ */
+bool FleetSnapshot::publish() {
+
+  auto &        devices = fleet.devices();
+  std::string   topic;
+  uint8_t       record[SNAPSHOT_MAX_DEVICE_BYTES];
+  unsigned long now     = millis();
+  size_t        first   = 0;
+  size_t        bytes   = 0;
+  Header_t      header;
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_SNAPSHOT, config.station_name);
+  _published_ms = now;
+
+  header.magic      = MAGIC;
+  header.version    = VERSION;
+  header.chunk      = 0;
+  header.saved_time = wallclock.isSynced() ? wallclock.now() : 0;
+
+  // an empty fleet is still answered, with an empty last chunk
+  do {
+    size_t len  = sizeof(Header_t);
+    size_t last = first;
+
+    while (last < devices.size() && last - first < 0xFF) {
+      size_t size = encodeDevice(record, devices[last], now);
+      if (len + size > SNAPSHOT_CHUNK_SIZE)
+        break;
+      len += size;
+      last ++;
+    }
+
+    header.count  = last - first;
+    header.chunk |= last == devices.size() ? SNAPSHOT_CHUNK_LAST : 0;
+
+    bool success = mqtt.beginDirect(topic.c_str(), len, false) &&
+                   mqtt.writeDirect((const uint8_t *) &header, sizeof(header));
+
+    for (size_t i = first; success && i < last; ++ i) {
+      size_t size = encodeDevice(record, devices[i], now);
+      success = mqtt.writeDirect(record, size);
+    }
+
+    if (success == false || mqtt.endDirect() == false) {
+      LOG_F("Failed publishing snapshot chunk %u", (unsigned int) (header.chunk & ~SNAPSHOT_CHUNK_LAST));
+      return false;
+    }
+
+    bytes += len;
+    first  = last;
+    header.chunk ++;
+  } while (first < devices.size());
+
+  LOG_F("Published snapshot of %u plants in %u chunks (%u bytes)", 
+    (unsigned int) devices.size(), (unsigned int) (header.chunk & ~SNAPSHOT_CHUNK_LAST), (unsigned int) bytes);
+  return true;
+}
+
+/* 
+ * Requests coming close together are answered once, outside the MQTT
+ * callback. Anyone can ask and a snapshot writes the whole fleet, so one
+ * coming too soon after the last is answered when SNAPSHOT_PUBLISH_MIN_SEC
+ * is over, along with the ones arriving meanwhile.
+ */
+void FleetSnapshot::onRequest() {
+
+  unsigned long since = millis() - _published_ms;
+
+  if (_task_publish.isEnabled())
+    return;
+
+  if (_published_ms != 0 && since < SNAPSHOT_PUBLISH_MIN_SEC * 1000UL)
+    _task_publish.restartDelayed(SNAPSHOT_PUBLISH_MIN_SEC * 1000UL - since);
+  else
+    _task_publish.restart();
+}
+
+/* a chunk of the peer's snapshot, the warm start is done with the last one */
+void FleetSnapshot::onChunk(uint8_t * payload, unsigned int len) {
+
+  Header_t     header;
+  unsigned int restored;
+
+  if (_warm_started || len < sizeof(Header_t))
+    return;
+
+  memcpy(&header, payload, sizeof(header));
+  if (decode(payload, len, restored) == false) {
+    LOG_F("Snapshot chunk %u from %s corrupted", (unsigned int) (header.chunk & ~SNAPSHOT_CHUNK_LAST), 
+      config.snapshot_peer);
+    return;
+  }
+
+  _warm_values += restored;
+  _warm_chunks ++;
+
+  if (header.chunk & SNAPSHOT_CHUNK_LAST) {
+    _warm_started = true;
+    LOG_F("Warm start from %s: %u values in %u chunks, %lu ms after boot", 
+      config.snapshot_peer, _warm_values, _warm_chunks, millis());
+  }
+}
+
+void FleetSnapshot::taskSaveCbk() {
+  save();
+}
+
+/* counts the time connected without the peer's snapshot, falls back to the retained values */
+void FleetSnapshot::taskWarmCbk() {
+
+  if (_warm_started) {
+    _task_warm.disable();
+    return;
+  }
+
+  if (mqtt.connected() == false || ++ _warm_waited % SNAPSHOT_WARM_TIMEOUT_SEC != 0)
+    return;
+
+  // once, the subscription then keeps asking for them on every connect
+  if (_warm_requests == 1) {
+    LOG_F("No snapshot from %s in %u s", config.snapshot_peer, _warm_waited);
+    fleet.fetchRetained();
+  }
+
+  if (_warm_requests >= SNAPSHOT_WARM_REQUESTS) {
+    LOG_F("Warm start from %s given up", config.snapshot_peer);
+    _task_warm.disable();
+    return;
+  }
+  request();
+}
+
+/* logs when every plant got its values, restored and then fresh ones */
+void FleetSnapshot::taskPopulatedCbk() {
+
+  static const AttributeID shown[] = {
+    ATTR_ID_MOISTURE, ATTR_ID_TEMPERATURE, ATTR_ID_CONDUCTIVITY, ATTR_ID_ILLUMINANCE
+  };
+
+  bool populated = fleet.count() > 0;
+  bool fresh     = populated;
+
+  for (auto device : fleet.devices()) {
+    for (auto id : shown) {
+      DeviceAttribute * attr = device->attributeByID(id);
+      populated &= attr->hasValue();
+      fresh     &= attr->hasValue() && attr->isRestored() == false;
+    }
+  }
+
+  if (populated && _populated_ms == 0) {
+    _populated_ms = millis();
+    LOG_F("Fleet populated %lu ms after boot (%u values restored)", _populated_ms, _restored_values);
+  }
+
+  if (fresh) {
+    LOG_F("Fleet fresh %lu ms after boot", millis());
+    _task_populated.disable();
+  }
+}
@@ -0,0 +1,169 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <Arduino.h>
+
+#include "scheduler.h"
+#include "device.h"
+
+/* NVS namespace and key of the snapshot blob */
+#define SNAPSHOT_NVS_NAMESPACE "fleet"
+#define SNAPSHOT_NVS_KEY       "snapshot"
+
+/* chunk field of the header: index of the chunk, flagged on the last one */
+#define SNAPSHOT_CHUNK_LAST    0x8000
+
+/*
+ * Warm-start snapshot of the fleet, kept in NVS.
+ *
+ * The plants (address, id and name, so discovered plants keep them) with
+ * their last values, sources and ages are saved periodically and before
+ * controlled restarts, then restored at boot before the network comes up.
+ * Restored values are flagged (see DeviceAttribute::isRestored()) and keep
+ * their age: the time the station was down is added when the clock
+ * survived the restart, otherwise it is taken as none.
+ *
+ * The same snapshot is exchanged over MQTT for warm-starting a station
+ * from another one, in place of the flood of retained values:
+ *  - a request (any payload) on <root_topic>/station/<name>/snapshot/get
+ *    makes the station publish its fleet on <root_topic>/station/<name>/snapshot,
+ *    in chunks of up to SNAPSHOT_CHUNK_SIZE bytes, each a blob of its own.
+ *    The chunks are encoded plant by plant straight into the MQTT client.
+ *  - with snapshot:peer set, the station asks that peer after boot and
+ *    restores the values it doesn't have, or has older ones of. With MQTT 5
+ *    the retained plant values are then not sent by the broker at all.
+ *    Without an answer in SNAPSHOT_WARM_TIMEOUT_SEC of being connected, the
+ *    plant values are subscribed to again with their retained messages and
+ *    the peer is asked again, up to SNAPSHOT_WARM_REQUESTS times.
+ *  - requests are answered with at most one snapshot every
+ *    SNAPSHOT_PUBLISH_MIN_SEC, the ones in between by the next one.
+ *
+ * Blob layout (little endian):
+ *   header:  magic u32, version u8, count u8, chunk u16, saved epoch u32
+ *   plant:   id i16, address len u8 + chars, name len u8 + chars,
+ *            has value mask u8, from BLE mask u8, has min mask u8, has max mask u8,
+ *            for each value in the mask: value f32, age in seconds u32
+ *            for each min, then each max in the masks: limit f32
+ * Version 1 blobs, from before the limits, have no min and max masks.
+ */
+class FleetSnapshot {
+
+  public:
+    static const uint32_t MAGIC   = 0x504E5346; // "FSNP"
+    static const uint8_t  VERSION = 2;
+
+    /* blob header */
+    typedef struct __attribute__((packed)) {
+      uint32_t magic;
+      uint8_t  version;
+      uint8_t  count;
+      uint16_t chunk;       // SNAPSHOT_CHUNK_LAST on the last one, or the only one
+      uint32_t saved_time;  // epoch seconds, 0 if the clock was not set
+    } Header_t;
+
+  public:
+    FleetSnapshot();
+
+    bool         begin();
+    bool         beginMQTT();
+    bool         save();
+    bool         restore();
+    bool         publish();
+
+    unsigned int restoredValues();
+    bool         warmStarted();
+
+  protected:
+    Task          _task_save;
+    Task          _task_populated;
+    Task          _task_publish;
+    Task          _task_warm;
+    unsigned int  _restored_values;
+    unsigned long _populated_ms;
+    bool          _warm_started;    // from the snapshot of the peer
+    unsigned int  _warm_values;
+    unsigned int  _warm_chunks;
+    unsigned int  _warm_waited;     // seconds connected without the peer's snapshot
+    unsigned int  _warm_requests;
+    unsigned long _published_ms;    // last snapshot published, 0 if none
+
+    size_t        encode(uint8_t * buffer, size_t size);
+    bool          decode(const uint8_t * buffer, size_t size, unsigned int & restored);
+    static size_t encodeDevice(uint8_t * buffer, MiFloraDevice * device, unsigned long now);
+
+    bool          request();
+    void          onRequest();
+    void          onChunk(uint8_t * payload, unsigned int len);
+
+    void          taskSaveCbk();
+    void          taskPopulatedCbk();
+    void          taskWarmCbk();
+    static void   s_taskSaveCbk();
+    static void   s_taskPopulatedCbk();
+    static void   s_taskPublishCbk();
+    static void   s_taskWarmCbk();
+    static void   s_onRequest(const char * topic, uint8_t * payload, unsigned int len, void * param);
+    static void   s_onChunk(const char * topic, uint8_t * payload, unsigned int len, void * param);
+};
+
+extern FleetSnapshot snapshot;
+
+/* inlines for FleetSnapshot */
+inline unsigned int FleetSnapshot::restoredValues() {
+  return _restored_values;
+}
+
+inline bool FleetSnapshot::warmStarted() {
+  return _warm_started;
+}
+
+inline void FleetSnapshot::s_taskSaveCbk() {
+  snapshot.taskSaveCbk();
+}
+
+inline void FleetSnapshot::s_taskPopulatedCbk() {
+  snapshot.taskPopulatedCbk();
+}
+
+inline void FleetSnapshot::s_taskPublishCbk() {
+  snapshot.publish();
+}
+
+inline void FleetSnapshot::s_taskWarmCbk() {
+  snapshot.taskWarmCbk();
+}
+
+inline void FleetSnapshot::s_onRequest(const char *, uint8_t *, unsigned int, void *) {
+  snapshot.onRequest();
+}
+
+inline void FleetSnapshot::s_onChunk(const char *, uint8_t * payload, unsigned int len, void *) {
+  snapshot.onChunk(payload, len);
+}
+
+#endif//_SNAPSHOT_H_
@@ -0,0 +1,66 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "species.h"
+
+#define LOG_TAG LOG_TAG_FLEET
+#include "log.h"
+
+SpeciesProfiles species;
+
+SpeciesProfiles::SpeciesProfiles()
+  : _partition(NULL)
+  , _mapped(NULL)
+  , _map_handle(0) {
+}
+
+bool SpeciesProfiles::begin() {
+
+  _partition = esp_partition_find_first(
+    ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SPECIES_PARTITION_LABEL);
+
+  if (_partition == NULL) {
+    LOG_LN("No '" SPECIES_PARTITION_LABEL "' partition, species profiles not available");
+    return false;
+  }
+
+  if (esp_partition_mmap(_partition, 0, _partition->size, 
+        SPI_FLASH_MMAP_DATA, (const void **) &_mapped, &_map_handle) != ESP_OK) {
+    LOG_LN("Failed mapping partition!");
+    _mapped = NULL;
+    return false;
+  }
+
+  // an erased or half written partition is not used
+  if (speciesValidate(_mapped, _partition->size) == false) {
+    LOG_LN("No valid species database, flash one built by tools/speciesdb");
+    spi_flash_munmap(_map_handle);
+    _mapped = NULL;
+    return false;
+  }
+
+  LOG_F("Species database with %u profiles", count());
+  return true;
+}
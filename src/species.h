@@ -0,0 +1,75 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _SPECIES_H_
+#define _SPECIES_H_
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#include "species_db.h"
+
+/* label of the flash partition holding the profiles (see partitions_tslog.csv) */
+#define SPECIES_PARTITION_LABEL "species"
+
+/*
+ * Species profiles, used straight from the memory mapped flash partition,
+ * so they take no RAM no matter how many plants use them.
+ *
+ * The partition is written from the host, see tools/speciesdb.
+ */
+class SpeciesProfiles {
+
+  public:
+    SpeciesProfiles();
+
+    bool                     begin();
+    const SpeciesProfile_t * find(const char * key);
+
+    bool                     isReady();
+    unsigned int             count();
+
+  protected:
+    const esp_partition_t *  _partition;
+    const uint8_t *          _mapped;
+    spi_flash_mmap_handle_t  _map_handle;
+};
+
+extern SpeciesProfiles species;
+
+/* inlines for SpeciesProfiles */
+inline bool SpeciesProfiles::isReady() {
+  return _mapped != NULL;
+}
+
+inline unsigned int SpeciesProfiles::count() {
+  return _mapped ? ((const SpeciesDBHeader_t *) _mapped)->count : 0;
+}
+
+inline const SpeciesProfile_t * SpeciesProfiles::find(const char * key) {
+  return _mapped ? speciesFind(_mapped, key) : NULL;
+}
+
+#endif//_SPECIES_H_
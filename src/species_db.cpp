@@ -0,0 +1,99 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <string.h>
+#include <ctype.h>
+
+#include "species_db.h"
+
+/* FNV-1a, case insensitive */
+uint32_t speciesHash(const char * key) {
+
+  uint32_t hash = 2166136261u;
+
+  while (*key) {
+    hash ^= (uint8_t) tolower((unsigned char) *key++);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* standard crc32 (as zlib), bitwise: it only runs once at boot */
+uint32_t speciesCRC(const uint8_t * data, size_t len) {
+
+  uint32_t crc = 0xFFFFFFFF;
+
+  while (len--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; ++ bit) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+bool speciesValidate(const uint8_t * db, size_t size) {
+
+  const SpeciesDBHeader_t * header = (const SpeciesDBHeader_t *) db;
+
+  if (size < sizeof(SpeciesDBHeader_t))
+    return false;
+
+  if (header->magic != SPECIES_DB_MAGIC || header->version != SPECIES_DB_VERSION)
+    return false;
+
+  size_t entries_size = (size_t) header->count * sizeof(SpeciesProfile_t);
+  if (sizeof(SpeciesDBHeader_t) + entries_size > size)
+    return false;
+
+  return speciesCRC(db + sizeof(SpeciesDBHeader_t), entries_size) == header->crc;
+}
+
+/* database must be validated first */
+const SpeciesProfile_t * speciesFind(const uint8_t * db, const char * key) {
+
+  const SpeciesDBHeader_t * header  = (const SpeciesDBHeader_t *) db;
+  const SpeciesProfile_t *  entries = (const SpeciesProfile_t *) (db + sizeof(SpeciesDBHeader_t));
+  uint32_t hash = speciesHash(key);
+
+  // first entry with this hash
+  uint32_t lo = 0, hi = header->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (entries[mid].hash < hash) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // collisions are next to each other
+  for (; lo < header->count && entries[lo].hash == hash; ++ lo) {
+    if (strncasecmp(entries[lo].key, key, SPECIES_KEY_LEN) == 0)
+      return &entries[lo];
+  }
+
+  return NULL;
+}
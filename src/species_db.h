@@ -0,0 +1,92 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _SPECIES_DB_H_
+#define _SPECIES_DB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary database of plant species profiles: limits of the plant values and
+ * the full scale of their bars on the display.
+ *
+ * This file does not depend on Arduino, it's also built on the host by the
+ * generator in tools/speciesdb, which makes the database out of a CSV file.
+ *
+ * Layout (little endian):
+ *   header   SpeciesDBHeader_t
+ *   entries  SpeciesProfile_t[count], sorted by hash
+ *
+ * Keys are lowercase, the hash is FNV-1a over the key. Lookups are a binary
+ * search on the hash, straight over the flash mapped database.
+ */
+
+#define SPECIES_DB_MAGIC      0x42445053 // "SPDB"
+#define SPECIES_DB_VERSION    1
+#define SPECIES_KEY_LEN       28
+
+enum SpeciesValue {
+  SPECIES_MOISTURE,
+  SPECIES_TEMPERATURE,
+  SPECIES_CONDUCTIVITY,
+  SPECIES_ILLUMINANCE,
+  SPECIES_VALUES
+};
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+  uint32_t crc;       // crc32 of the entries
+  uint32_t reserved;
+} SpeciesDBHeader_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t hash;
+  char     key[SPECIES_KEY_LEN];        // NUL padded
+  int32_t  min[SPECIES_VALUES];
+  int32_t  max[SPECIES_VALUES];
+  uint32_t display_max[SPECIES_VALUES]; // full scale of the bar, 0 for the default
+  uint8_t  has_min;                     // bit mask over SpeciesValue
+  uint8_t  has_max;
+  uint16_t reserved;
+} SpeciesProfile_t;
+
+uint32_t                 speciesHash(const char * key);
+uint32_t                 speciesCRC(const uint8_t * data, size_t len);
+bool                     speciesValidate(const uint8_t * db, size_t size);
+const SpeciesProfile_t * speciesFind(const uint8_t * db, const char * key);
+
+/* inlines for SpeciesProfile_t */
+inline bool speciesHasMin(const SpeciesProfile_t * profile, SpeciesValue value) {
+  return profile->has_min & (1 << value);
+}
+
+inline bool speciesHasMax(const SpeciesProfile_t * profile, SpeciesValue value) {
+  return profile->has_max & (1 << value);
+}
+
+#endif//_SPECIES_DB_H_
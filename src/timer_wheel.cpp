@@ -0,0 +1,142 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+#include "timer_wheel.h"
+
+/*
+ * Hierarchical timer wheel
+ */
+TimerWheel::TimerWheel()
+  : current(0)
+  , count(0) {
+
+  for (uint8_t level = 0; level < LEVELS; ++ level) {
+    for (uint32_t slot = 0; slot < SLOTS; ++ slot) {
+      slots[level][slot] = NULL;
+    }
+  }
+}
+
+/* (re)schedule a timer to expire after the given number of ticks */
+void TimerWheel::schedule(Timer * timer, uint32_t ticks) {
+
+  // re-scheduling is just an unlink and link
+  if (timer->isPending()) {
+    cancel(timer);
+  }
+
+  // expiring "now" would land in the slot that was already processed
+  if (ticks == 0) ticks = 1;
+  if (ticks > MAX_TICKS) ticks = MAX_TICKS;
+
+  timer->expire_tick = current + ticks;
+  link(timer);
+  ++ count;
+}
+
+/* remove timer from the wheel, without invoking it */
+void TimerWheel::cancel(Timer * timer) {
+
+  if (timer->isPending() == false)
+    return;
+
+  * timer->pprev = timer->next;
+  if (timer->next) {
+    timer->next->pprev = timer->pprev;
+  }
+
+  timer->next  = NULL;
+  timer->pprev = NULL;
+  -- count;
+}
+
+/* place the timer in the slot matching its distance from the current tick */
+void TimerWheel::link(Timer * timer) {
+
+  uint32_t delta = timer->expire_tick - current;
+  uint8_t  level = 0;
+  Timer ** head;
+
+  // find the lowest level that can hold this distance
+  while (level < LEVELS - 1 && delta >= (1UL << (LEVEL_BITS * (level + 1)))) {
+    ++ level;
+  }
+
+  head = &slots[level][(timer->expire_tick >> (LEVEL_BITS * level)) & SLOT_MASK];
+
+  // push front
+  timer->next  = * head;
+  timer->pprev = head;
+  if (* head) {
+    (* head)->pprev = &timer->next;
+  }
+  * head = timer;
+}
+
+/* move the timers of the current upper level slot to lower levels */
+void TimerWheel::cascade(uint8_t level) {
+
+  Timer ** head  = &slots[level][(current >> (LEVEL_BITS * level)) & SLOT_MASK];
+  Timer *  timer = * head;
+
+  * head = NULL;
+
+  while (timer) {
+    Timer * next = timer->next;
+    link(timer);
+    timer = next;
+  }
+}
+
+/* advance the wheel, firing callbacks of expired timers */
+void TimerWheel::advance(uint32_t ticks) {
+
+  while (ticks --) {
+
+    ++ current;
+
+    // on level wrap, pull timers down from the upper levels,
+    // highest level first so they can land in the lower ones
+    uint8_t top = 1;
+    while (top < LEVELS && (current & ((1UL << (LEVEL_BITS * top)) - 1)) == 0) {
+      ++ top;
+    }
+    for (uint8_t level = top - 1; level >= 1; -- level) {
+      cascade(level);
+    }
+
+    // everything left in the lowest slot expires now
+    Timer ** head = &slots[0][current & SLOT_MASK];
+    while (* head) {
+      Timer * timer = * head;
+
+      // unlink before invoking, callback is free to re-schedule
+      cancel(timer);
+
+      if (timer->callback) {
+        timer->callback(timer->param);
+      }
+    }
+  }
+}
@@ -0,0 +1,118 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * Timers are intrusive nodes owned by the caller, so scheduling, re-scheduling
+ * and cancelling are O(1) and never allocate. Each tick only touches the timers
+ * that expire in that tick (plus an amortized cascade from the upper levels),
+ * no matter how many timers are pending.
+ *
+ * With 3 levels of 64 slots, timers up to 64^3 ticks in the future are kept
+ * exact; longer intervals are capped to that maximum.
+ */
+class TimerWheel {
+
+  public:
+    static const uint8_t  LEVEL_BITS = 6;
+    static const uint8_t  LEVELS     = 3;
+    static const uint32_t SLOTS      = 1 << LEVEL_BITS;
+    static const uint32_t SLOT_MASK  = SLOTS - 1;
+    static const uint32_t MAX_TICKS  = (1UL << (LEVEL_BITS * LEVELS)) - 1;
+
+    typedef void (*Callback_t)(void * param);
+
+    /* Timer node, embed it in the object that needs to be timed */
+    class Timer {
+      public:
+        Timer(Callback_t callback = NULL, void * param = NULL);
+
+        bool     isPending();
+        uint32_t expires();
+        void     setCallback(Callback_t callback, void * param);
+
+      protected:
+        friend class TimerWheel;
+
+        Timer *    next;
+        Timer **   pprev;
+        uint32_t   expire_tick;
+        Callback_t callback;
+        void *     param;
+    };
+
+  public:
+    TimerWheel();
+
+    void     schedule(Timer * timer, uint32_t ticks);
+    void     cancel(Timer * timer);
+    void     advance(uint32_t ticks = 1);
+
+    uint32_t now();
+    uint32_t pending();
+
+  protected:
+    uint32_t current;
+    uint32_t count;
+    Timer *  slots[LEVELS][SLOTS];
+
+    void     link(Timer * timer);
+    void     cascade(uint8_t level);
+};
+
+/* inlines for TimerWheel::Timer */
+inline TimerWheel::Timer::Timer(Callback_t _callback, void * _param)
+  : next(NULL), pprev(NULL), expire_tick(0), callback(_callback), param(_param) {
+}
+
+inline bool TimerWheel::Timer::isPending() {
+  return pprev != NULL;
+}
+
+inline uint32_t TimerWheel::Timer::expires() {
+  return expire_tick;
+}
+
+inline void TimerWheel::Timer::setCallback(Callback_t _callback, void * _param) {
+  callback = _callback;
+  param    = _param;
+}
+
+/* inlines for TimerWheel */
+inline uint32_t TimerWheel::now() {
+  return current;
+}
+
+inline uint32_t TimerWheel::pending() {
+  return count;
+}
+
+#endif//_TIMER_WHEEL_H_
@@ -0,0 +1,401 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "tls_client.h"
+#include "config.h"
+
+#include <SPIFFS.h>
+#include <Preferences.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/version.h>
+
+#define LOG_TAG LOG_TAG_MQTT
+#include "log.h"
+
+/* the session id is private from mbedtls 3 */
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+#define TLS_SESSION_ID(session)     (session).MBEDTLS_PRIVATE(id)
+#define TLS_SESSION_ID_LEN(session) (session).MBEDTLS_PRIVATE(id_len)
+#else
+#define TLS_SESSION_ID(session)     (session).id
+#define TLS_SESSION_ID_LEN(session) (session).id_len
+#endif
+
+TLSClient::TLSClient(Client & transport)
+  : _transport(transport)
+  , _ready(false)
+  , _connected(false)
+  , _nvs(false)
+  , _has_session(false)
+  , _has_ca(false)
+  , _peeked(-1)
+  , _handshake_ms(0)
+  , _handshake_heap(0)
+  , _resumed(false) {
+
+  mbedtls_entropy_init(&_entropy);
+  mbedtls_ctr_drbg_init(&_drbg);
+  mbedtls_x509_crt_init(&_ca);
+  mbedtls_ssl_config_init(&_config);
+  mbedtls_ssl_init(&_ssl);
+  mbedtls_ssl_session_init(&_session);
+}
+
+/* load the CA certificate (PEM) verifying the broker from SPIFFS */
+bool TLSClient::loadCACert(const char * filename) {
+
+  File file = SPIFFS.open(filename, FILE_READ);
+  if (!file) {
+    LOG_F("No CA certificate in %s", filename);
+    return false;
+  }
+
+  // the PEM parser needs the terminating NUL in the length
+  size_t size = file.size();
+  char * pem  = (char *) malloc(size + 1);
+  if (pem == NULL) {
+    file.close();
+    return false;
+  }
+
+  bool success = file.read((uint8_t *) pem, size) == size;
+  file.close();
+  pem[size] = '\0';
+
+  mbedtls_x509_crt_free(&_ca);
+  mbedtls_x509_crt_init(&_ca);
+
+  int ret = success ? mbedtls_x509_crt_parse(&_ca, (const unsigned char *) pem, size + 1) : -1;
+  free(pem);
+
+  if (ret != 0) {
+    LOG_F("Failed parsing the CA certificate %s: -0x%04x", filename, -ret);
+    return false;
+  }
+
+  _has_ca = true;
+  return true;
+}
+
+/* random generator and configuration, shared by all the connections */
+bool TLSClient::setup() {
+
+  static const char personalization[] = "miflora_rbs";
+
+  if (_ready)
+    return true;
+  if (_has_ca == false)
+    return false;
+
+  if (mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy, 
+        (const unsigned char *) personalization, sizeof(personalization)) != 0 ||
+      mbedtls_ssl_config_defaults(&_config, MBEDTLS_SSL_IS_CLIENT, 
+        MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+    return false;
+
+  mbedtls_ssl_conf_authmode(&_config, MBEDTLS_SSL_VERIFY_REQUIRED);
+  mbedtls_ssl_conf_ca_chain(&_config, &_ca, NULL);
+  mbedtls_ssl_conf_rng(&_config, mbedtls_ctr_drbg_random, &_drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&_config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+  if (_nvs)
+    restoreSession();
+
+  _ready = true;
+  return true;
+}
+
+int TLSClient::s_send(void * ctx, const unsigned char * buffer, size_t len) {
+
+  Client * client = (Client *) ctx;
+
+  if (client->connected() == 0)
+    return MBEDTLS_ERR_NET_SEND_FAILED;
+
+  size_t count = client->write(buffer, len);
+  return count > 0 ? (int) count : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+int TLSClient::s_recv(void * ctx, unsigned char * buffer, size_t len) {
+
+  Client * client = (Client *) ctx;
+
+  if (client->available() <= 0) 
+    return client->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+
+  int count = client->read(buffer, len);
+  return count > 0 ? count : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+/* handshake, offering the last session, measuring time and heap */
+bool TLSClient::handshake(const char * host) {
+
+  mbedtls_ssl_session session;
+  int                 ret;
+
+  mbedtls_ssl_free(&_ssl);
+  mbedtls_ssl_init(&_ssl);
+
+  unsigned long start     = millis();
+  size_t        heap      = ESP.getFreeHeap();
+  size_t        heap_low  = heap;
+  size_t        boot_low  = ESP.getMinFreeHeap();
+
+  if (mbedtls_ssl_setup(&_ssl, &_config) != 0 || mbedtls_ssl_set_hostname(&_ssl, host) != 0)
+    return false;
+
+  mbedtls_ssl_set_bio(&_ssl, &_transport, s_send, s_recv, NULL);
+
+  bool offered = _has_session && mbedtls_ssl_set_session(&_ssl, &_session) == 0;
+
+  while ((ret = mbedtls_ssl_handshake(&_ssl)) != 0) {
+
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      LOG_F("TLS handshake failed: -0x%04x", -ret);
+      return false;
+    }
+
+    if (ESP.getFreeHeap() < heap_low)
+      heap_low = ESP.getFreeHeap();
+
+    if (millis() - start > TLS_HANDSHAKE_TIMEOUT_MS) {
+      LOG_LN("TLS handshake timed out");
+      return false;
+    }
+    delay(1);
+  }
+
+  // a new low of the heap since boot was reached inside a step
+  if (ESP.getMinFreeHeap() < boot_low && ESP.getMinFreeHeap() < heap_low)
+    heap_low = ESP.getMinFreeHeap();
+
+  _handshake_ms   = millis() - start;
+  _handshake_heap = heap - heap_low;
+
+  // the server resumed the session when it kept its id
+  mbedtls_ssl_session_init(&session);
+  if (mbedtls_ssl_get_session(&_ssl, &session) != 0) {
+    mbedtls_ssl_session_free(&session);
+    _resumed = false;
+    return true;
+  }
+
+  _resumed = offered && TLS_SESSION_ID_LEN(session) > 0 &&
+             TLS_SESSION_ID_LEN(session) == TLS_SESSION_ID_LEN(_session) &&
+             memcmp(TLS_SESSION_ID(session), TLS_SESSION_ID(_session), TLS_SESSION_ID_LEN(session)) == 0;
+
+  mbedtls_ssl_session_free(&_session);
+  _session     = session;
+  _has_session = true;
+
+  if (_nvs && _resumed == false)
+    saveSession();
+  return true;
+}
+
+/* keep the session in NVS, to resume it after a restart */
+void TLSClient::saveSession() {
+
+  Preferences prefs;
+  size_t      len = 0;
+
+  mbedtls_ssl_session_save(&_session, NULL, 0, &len);
+  if (len == 0)
+    return;
+
+  uint8_t * buffer = (uint8_t *) malloc(len);
+  if (buffer == NULL)
+    return;
+
+  if (mbedtls_ssl_session_save(&_session, buffer, len, &len) == 0 &&
+      prefs.begin(TLS_NVS_NAMESPACE, false)) {
+    prefs.putBytes(TLS_NVS_KEY, buffer, len);
+    prefs.end();
+  }
+  free(buffer);
+}
+
+void TLSClient::restoreSession() {
+
+  Preferences prefs;
+
+  if (prefs.begin(TLS_NVS_NAMESPACE, true) == false)
+    return;
+
+  size_t    len    = prefs.getBytesLength(TLS_NVS_KEY);
+  uint8_t * buffer = len ? (uint8_t *) malloc(len) : NULL;
+
+  if (buffer != NULL && prefs.getBytes(TLS_NVS_KEY, buffer, len) == len) {
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_session_init(&_session);
+    _has_session = mbedtls_ssl_session_load(&_session, buffer, len) == 0;
+
+    LOG_F("TLS session from NVS: %s", _has_session ? "restored" : "not usable");
+  }
+
+  prefs.end();
+  free(buffer);
+}
+
+int TLSClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int TLSClient::connect(const char * host, uint16_t port) {
+
+  if (_connected)
+    stop();
+
+  if (setup() == false) {
+    LOG_LN("TLS not set up, no CA certificate");
+    return 0;
+  }
+
+  if (_transport.connect(host, port) == 0)
+    return 0;
+
+  if (handshake(host) == false) {
+    stop();
+    return 0;
+  }
+
+  _connected = true;
+  _peeked    = -1;
+  return 1;
+}
+
+size_t TLSClient::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t TLSClient::write(const uint8_t * buffer, size_t size) {
+
+  size_t        done  = 0;
+  unsigned long start = millis();
+
+  while (_connected && done < size) {
+    int ret = mbedtls_ssl_write(&_ssl, buffer + done, size - done);
+
+    if (ret > 0) {
+      done += ret;
+      continue;
+    }
+    if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+        millis() - start > TLS_HANDSHAKE_TIMEOUT_MS) {
+      _connected = false;
+      break;
+    }
+    delay(1);
+  }
+  return done;
+}
+
+/* decrypted bytes ready, processing a received record if there are none */
+int TLSClient::available() {
+
+  if (_connected == false)
+    return 0;
+
+  int count = (_peeked >= 0) + mbedtls_ssl_get_bytes_avail(&_ssl);
+
+  if (count == 0 && _transport.available() > 0) {
+    int ret = mbedtls_ssl_read(&_ssl, NULL, 0);
+
+    if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+      _connected = false;
+    count = mbedtls_ssl_get_bytes_avail(&_ssl);
+  }
+  return count;
+}
+
+int TLSClient::read() {
+  uint8_t data;
+  return read(&data, 1) == 1 ? data : -1;
+}
+
+int TLSClient::read(uint8_t * buffer, size_t size) {
+
+  int count = 0;
+
+  if (size == 0)
+    return 0;
+
+  if (_peeked >= 0) {
+    buffer[count ++] = _peeked;
+    _peeked = -1;
+    if (size == 1 || mbedtls_ssl_get_bytes_avail(&_ssl) == 0)
+      return count;
+  }
+
+  if (_connected == false)
+    return count ? count : -1;
+
+  int ret = mbedtls_ssl_read(&_ssl, buffer + count, size - count);
+  if (ret > 0)
+    return count + ret;
+
+  if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+    _connected = false;
+  return count ? count : -1;
+}
+
+int TLSClient::peek() {
+
+  if (_peeked < 0) {
+    uint8_t data;
+    if (read(&data, 1) == 1)
+      _peeked = data;
+  }
+  return _peeked;
+}
+
+void TLSClient::flush() {
+  _transport.flush();
+}
+
+/* close, the session is kept for the next connect */
+void TLSClient::stop() {
+
+  if (_connected)
+    mbedtls_ssl_close_notify(&_ssl);
+
+  _connected = false;
+  _peeked    = -1;
+  _transport.stop();
+
+  // the record buffers are large, free them until the next connect
+  mbedtls_ssl_free(&_ssl);
+  mbedtls_ssl_init(&_ssl);
+}
+
+uint8_t TLSClient::connected() {
+  return _connected && (_transport.connected() || available() > 0);
+}
+
+TLSClient::operator bool() {
+  return _connected;
+}
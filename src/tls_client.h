@@ -0,0 +1,129 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _TLS_CLIENT_H_
+#define _TLS_CLIENT_H_
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+
+/* NVS namespace and key of the saved TLS session */
+#define TLS_NVS_NAMESPACE   "mqtt"
+#define TLS_NVS_KEY         "tls_session"
+
+/*
+ * TLS client over another client, the WiFi client of the MQTT connection.
+ *
+ * WiFiClientSecure has no way to offer a previous session to the server, so
+ * the handshake is done here with mbedtls. The session of the last handshake
+ * is kept in RAM, and optionally in NVS to survive restarts, and offered on
+ * the next connect: a resumed handshake skips the certificate verification
+ * and the key exchange, the costly part on the ESP32.
+ *
+ * The time and the heap taken by each handshake are kept for reporting,
+ * the heap is sampled between the handshake steps.
+ */
+class TLSClient : public Client {
+
+  public:
+    TLSClient(Client & transport);
+
+    bool     loadCACert(const char * filename);
+    bool     hasCACert();
+    void     setSessionStore(bool nvs);
+
+    int      connect(IPAddress ip, uint16_t port) override;
+    int      connect(const char * host, uint16_t port) override;
+    size_t   write(uint8_t data) override;
+    size_t   write(const uint8_t * buffer, size_t size) override;
+    int      available() override;
+    int      read() override;
+    int      read(uint8_t * buffer, size_t size) override;
+    int      peek() override;
+    void     flush() override;
+    void     stop() override;
+    uint8_t  connected() override;
+    operator bool() override;
+
+    unsigned long handshakeTime();
+    size_t        handshakeHeap();
+    bool          handshakeResumed();
+
+  protected:
+    Client &                 _transport;
+    bool                     _ready;        // rng, config and CA set up
+    bool                     _connected;
+    bool                     _nvs;
+    bool                     _has_session;
+    bool                     _has_ca;
+    int                      _peeked;
+
+    mbedtls_entropy_context  _entropy;
+    mbedtls_ctr_drbg_context _drbg;
+    mbedtls_x509_crt         _ca;
+    mbedtls_ssl_config       _config;
+    mbedtls_ssl_context      _ssl;
+    mbedtls_ssl_session      _session;
+
+    unsigned long            _handshake_ms;
+    size_t                   _handshake_heap;
+    bool                     _resumed;
+
+    bool         setup();
+    bool         handshake(const char * host);
+    void         saveSession();
+    void         restoreSession();
+
+    static int   s_send(void * ctx, const unsigned char * buffer, size_t len);
+    static int   s_recv(void * ctx, unsigned char * buffer, size_t len);
+};
+
+/* inlines for TLSClient */
+inline bool TLSClient::hasCACert() {
+  return _has_ca;
+}
+
+inline void TLSClient::setSessionStore(bool nvs) {
+  _nvs = nvs;
+}
+
+inline unsigned long TLSClient::handshakeTime() {
+  return _handshake_ms;
+}
+
+inline size_t TLSClient::handshakeHeap() {
+  return _handshake_heap;
+}
+
+inline bool TLSClient::handshakeResumed() {
+  return _resumed;
+}
+
+#endif//_TLS_CLIENT_H_
@@ -0,0 +1,80 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "token_bucket.h"
+
+TokenBucket::TokenBucket()
+  : _rate(0)
+  , _capacity(0)
+  , _milli(0)
+  , _last_ms(0) {
+}
+
+/* start full, without a capacity it holds a second of tokens */
+void TokenBucket::configure(uint32_t rate, uint32_t capacity, uint32_t now_ms) {
+  _rate     = rate;
+  _capacity = capacity ? capacity : rate;
+  _milli    = (int64_t) _capacity * 1000;
+  _last_ms  = now_ms;
+}
+
+void TokenBucket::refill(uint32_t now_ms) {
+
+  uint32_t elapsed = now_ms - _last_ms;
+  _last_ms = now_ms;
+
+  if (_rate == 0)
+    return;
+
+  // a token per second is a thousandth of a token per millisecond
+  _milli += (int64_t) elapsed * _rate;
+  if (_milli > (int64_t) _capacity * 1000)
+    _milli = (int64_t) _capacity * 1000;
+}
+
+bool TokenBucket::has(uint32_t cost) {
+
+  if (_rate == 0)
+    return true;
+  if (cost > _capacity)
+    cost = _capacity;
+  return _milli >= (int64_t) cost * 1000;
+}
+
+void TokenBucket::take(uint32_t cost) {
+  if (_rate > 0)
+    _milli -= (int64_t) cost * 1000;
+}
+
+/* take even without tokens, the debt is capped to one full bucket */
+void TokenBucket::force(uint32_t cost) {
+
+  if (_rate == 0)
+    return;
+
+  _milli -= (int64_t) cost * 1000;
+  if (_milli < - (int64_t) _capacity * 1000)
+    _milli = - (int64_t) _capacity * 1000;
+}
@@ -0,0 +1,69 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _TOKEN_BUCKET_H_
+#define _TOKEN_BUCKET_H_
+
+#include <stdint.h>
+
+/*
+ * Token bucket, refilled at a rate per second up to its capacity.
+ *
+ * This file does not depend on Arduino, so it can be tested on the host.
+ *
+ * A cost larger than the capacity is let through once the bucket is full,
+ * and force() takes tokens even when there are none, leaving a debt the
+ * other costs wait for. A rate of 0 means no limit.
+ */
+class TokenBucket {
+
+  public:
+    TokenBucket();
+
+    void     configure(uint32_t rate, uint32_t capacity, uint32_t now_ms);
+    void     refill(uint32_t now_ms);
+    bool     has(uint32_t cost);
+    void     take(uint32_t cost);
+    void     force(uint32_t cost);
+    bool     limited();
+    int32_t  tokens();
+
+  protected:
+    uint32_t _rate;         // tokens per second
+    uint32_t _capacity;
+    int64_t  _milli;        // thousandths of a token, negative when in debt
+    uint32_t _last_ms;
+};
+
+/* inlines for TokenBucket */
+inline bool TokenBucket::limited() {
+  return _rate > 0;
+}
+
+inline int32_t TokenBucket::tokens() {
+  return (int32_t) (_milli / 1000);
+}
+
+#endif//_TOKEN_BUCKET_H_
@@ -0,0 +1,76 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "topic_arena.h"
+#include <string.h>
+
+#define ENTRY_HEADER 2
+
+TopicArena::TopicArena()
+  : _count(0) {
+}
+
+uint16_t TopicArena::add(const char * prefix, size_t level_room) {
+
+  size_t prefix_len = strlen(prefix);
+  size_t offset     = _arena.size();
+
+  // the header holds both lengths in a byte and the id must fit 16 bits
+  if (prefix_len > 0xFF || level_room > 0xFF)
+    return INVALID;
+  if (offset + ENTRY_HEADER + prefix_len + level_room + 1 >= INVALID)
+    return INVALID;
+
+  _arena.resize(offset + ENTRY_HEADER + prefix_len + level_room + 1, '\0');
+  _arena[offset]     = (char) prefix_len;
+  _arena[offset + 1] = (char) level_room;
+  memcpy(&_arena[offset + ENTRY_HEADER], prefix, prefix_len);
+
+  _count ++;
+  return (uint16_t) offset;
+}
+
+const char * TopicArena::topic(uint16_t id, const char * level) {
+
+  if (id == INVALID || (size_t) id + ENTRY_HEADER > _arena.size())
+    return NULL;
+
+  char * entry      = &_arena[id];
+  size_t prefix_len = (uint8_t) entry[0];
+  size_t level_room = (uint8_t) entry[1];
+  size_t level_len  = strlen(level);
+
+  // a level that does not fit is a programming error, not a runtime one
+  if (level_len > level_room)
+    return NULL;
+
+  char * topic = entry + ENTRY_HEADER;
+  memcpy(topic + prefix_len, level, level_len + 1);
+  return topic;
+}
+
+const char * TopicArena::prefix(uint16_t id) {
+  return topic(id, "");
+}
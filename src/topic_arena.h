@@ -0,0 +1,76 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _TOPIC_ARENA_H_
+#define _TOPIC_ARENA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Topics of the publish path, precomputed into a single compact arena.
+ *
+ * This file does not depend on Arduino, so it can be tested on the host.
+ *
+ * Each owner, a device or a sensor, adds its topic prefix once and gets back
+ * an id. Publishing then writes the last topic level in place, right after
+ * the prefix, so no topic is formatted or allocated per message. Storing
+ * the prefix with room for the last level, rather than one topic per
+ * attribute, keeps the arena to about one topic per owner.
+ *
+ * Entries are [prefix length][level room][prefix][level room + NUL]. The
+ * returned topics stay valid until the next add() or topic() for the same
+ * owner; the arena only grows while adding owners, not while publishing.
+ */
+class TopicArena {
+
+  public:
+    static const uint16_t INVALID = 0xFFFF;
+
+    TopicArena();
+
+    uint16_t     add(const char * prefix, size_t level_room);
+    const char * topic(uint16_t id, const char * level);
+    const char * prefix(uint16_t id);
+
+    size_t       size();
+    size_t       count();
+
+  protected:
+    std::vector<char> _arena;
+    size_t            _count;
+};
+
+/* inlines for TopicArena */
+inline size_t TopicArena::size() {
+  return _arena.size();
+}
+
+inline size_t TopicArena::count() {
+  return _count;
+}
+
+#endif//_TOPIC_ARENA_H_
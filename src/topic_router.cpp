@@ -0,0 +1,178 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "topic_router.h"
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+TopicRouter::TopicRouter() {
+  // root node, the level before the first '/'
+  newNode("", 0, 0);
+}
+
+/* case insensitive FNV-1a of a topic level, also returns its length */
+uint32_t TopicRouter::levelHash(const char * level, size_t * len) {
+  uint32_t hash = 2166136261u;
+  const char * ch = level;
+
+  while (*ch != '\0' && *ch != '/') {
+    hash ^= (uint8_t) tolower((unsigned char) *ch);
+    hash *= 16777619u;
+    ++ ch;
+  }
+  *len = ch - level;
+  return hash;
+}
+
+int16_t TopicRouter::newNode(const char * level, size_t len, uint32_t hash) {
+
+  // node indexes and text offsets are 16 bit
+  if (_nodes.size() >= 0x7FFF || _text.size() + len > 0xFFFF || len > 0xFF)
+    return NONE;
+
+  Node_t node = {
+    .hash = hash, .offset = (uint16_t) _text.size(), .len = (uint8_t) len, .reserved = 0,
+    .child = NONE, .sibling = NONE, .plus = NONE, .hash_all = NONE, .route = NONE
+  };
+
+  _text.insert(_text.end(), level, level + len);
+  _nodes.push_back(node);
+  return _nodes.size() - 1;
+}
+
+int16_t TopicRouter::findChild(int16_t node, const char * level, size_t len, uint32_t hash) {
+
+  for (int16_t child = _nodes[node].child; child != NONE; child = _nodes[child].sibling) {
+    const Node_t & n = _nodes[child];
+    if (n.hash == hash && n.len == len && strncasecmp(&_text[n.offset], level, len) == 0)
+      return child;
+  }
+  return NONE;
+}
+
+/* walk the levels of a filter, optionally creating the missing nodes */
+int16_t TopicRouter::find(const char * filter, bool create) {
+
+  int16_t node = 0;
+  const char * level = filter;
+
+  while (node != NONE) {
+    size_t   len;
+    uint32_t hash = levelHash(level, &len);
+    int16_t  next;
+
+    if (len == 1 && *level == '+') {
+      next = _nodes[node].plus;
+      if (next == NONE && create && (next = newNode(level, len, hash)) != NONE)
+        _nodes[node].plus = next;
+    } else 
+    if (len == 1 && *level == '#') {
+      // '#' must be the last level
+      if (level[1] != '\0')
+        return NONE;
+      next = _nodes[node].hash_all;
+      if (next == NONE && create && (next = newNode(level, len, hash)) != NONE)
+        _nodes[node].hash_all = next;
+    } else {
+      next = findChild(node, level, len, hash);
+      if (next == NONE && create) {
+        next = newNode(level, len, hash);
+        if (next != NONE) {
+          _nodes[next].sibling = _nodes[node].child;
+          _nodes[node].child = next;
+        }
+      }
+    }
+
+    node = next;
+    if (level[len] == '\0')
+      break;
+    level += len + 1;
+  }
+  return node;
+}
+
+/* add a handler for a filter, a filter has a single handler */
+bool TopicRouter::add(const char * filter, Handler_t handler, void * param) {
+
+  int16_t node = find(filter, true);
+  if (node == NONE || _nodes[node].route != NONE)
+    return false;
+
+  Route_t route = { .handler = handler, .param = param };
+  _routes.push_back(route);
+  _nodes[node].route = _routes.size() - 1;
+  return true;
+}
+
+bool TopicRouter::has(const char * filter) {
+  int16_t node = find(filter, false);
+  return node != NONE && _nodes[node].route != NONE;
+}
+
+/* the node of the route matching the rest of the topic, or NONE */
+int16_t TopicRouter::matchFrom(int16_t node, const char * topic) {
+
+  const Node_t & n = _nodes[node];
+
+  // '#' also matches the parent level, "a/#" matches "a"
+  if (*topic == '\0') {
+    if (n.route != NONE) return node;
+    if (n.hash_all != NONE && _nodes[n.hash_all].route != NONE) return n.hash_all;
+    return NONE;
+  }
+
+  size_t       len;
+  uint32_t     hash = levelHash(topic, &len);
+  const char * rest = topic[len] == '/' ? topic + len + 1 : topic + len;
+  int16_t      found;
+
+  int16_t child = findChild(node, topic, len, hash);
+  if (child != NONE && (found = matchFrom(child, rest)) != NONE)
+    return found;
+
+  if (n.plus != NONE && (found = matchFrom(n.plus, rest)) != NONE)
+    return found;
+
+  if (n.hash_all != NONE && _nodes[n.hash_all].route != NONE)
+    return n.hash_all;
+
+  return NONE;
+}
+
+/* handler of the best route for a received topic */
+TopicRouter::Handler_t TopicRouter::match(const char * topic, void ** param) {
+
+  int16_t node = matchFrom(0, topic);
+  if (node == NONE)
+    return NULL;
+
+  const Route_t & route = _routes[_nodes[node].route];
+  if (param != NULL)
+    * param = route.param;
+  return route.handler;
+}
@@ -0,0 +1,101 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _TOPIC_ROUTER_H_
+#define _TOPIC_ROUTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Routes received topics to their handlers, over a trie of topic levels.
+ *
+ * This file does not depend on Arduino, so it can be benchmarked on the host.
+ *
+ * Filters follow the MQTT syntax: '+' matches one level and '#' matches the
+ * remaining levels. Literal levels are matched case insensitive, like the
+ * subscriptions always were. When more filters match, literal levels win
+ * over '+' and '+' wins over '#'.
+ *
+ * Routes are not removed. Adding one allocates, matching a topic does not.
+ */
+class TopicRouter {
+
+  public:
+    typedef void (*Handler_t)(const char * topic, uint8_t * payload, unsigned int len, void * param);
+
+  public:
+    TopicRouter();
+
+    bool         add(const char * filter, Handler_t handler, void * param);
+    bool         has(const char * filter);
+    Handler_t    match(const char * topic, void ** param);
+
+    unsigned int countRoutes();
+    unsigned int countNodes();
+
+  protected:
+    static const int16_t NONE = -1;
+
+    typedef struct {
+      uint32_t hash;      // hash of the level, for scanning siblings
+      uint16_t offset;    // level text in _text
+      uint8_t  len;
+      uint8_t  reserved;
+      int16_t  child;     // first literal child
+      int16_t  sibling;   // next literal sibling
+      int16_t  plus;      // '+' child
+      int16_t  hash_all;  // '#' child
+      int16_t  route;     // index in _routes
+    } Node_t;
+
+    typedef struct {
+      Handler_t handler;
+      void *    param;
+    } Route_t;
+
+    std::vector<Node_t>  _nodes;
+    std::vector<char>    _text;
+    std::vector<Route_t> _routes;
+
+    int16_t  find(const char * filter, bool create);
+    int16_t  findChild(int16_t node, const char * level, size_t len, uint32_t hash);
+    int16_t  newNode(const char * level, size_t len, uint32_t hash);
+    int16_t  matchFrom(int16_t node, const char * topic);
+
+    static uint32_t levelHash(const char * level, size_t * len);
+};
+
+/* inlines for TopicRouter */
+inline unsigned int TopicRouter::countRoutes() {
+  return _routes.size();
+}
+
+inline unsigned int TopicRouter::countNodes() {
+  return _nodes.size();
+}
+
+#endif//_TOPIC_ROUTER_H_
@@ -0,0 +1,173 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <string.h>
+#include "ts_codec.h"
+
+/*
+ * Encoder
+ */
+TSBlockEncoder::TSBlockEncoder(uint8_t * _buffer, size_t _capacity)
+  : buffer(_buffer)
+  , capacity(_capacity)
+  , length(0)
+  , samples(0)
+  , prev_time(0)
+  , prev_delta(0)
+  , prev_value(0) {
+}
+
+/* start a new block, discarding anything encoded so far */
+bool TSBlockEncoder::begin(uint64_t device, uint8_t attr, float lo, float hi, uint16_t index) {
+
+  TSBlockHeader_t header;
+
+  if (capacity < sizeof(header) + MAX_SAMPLE_SIZE)
+    return false;
+
+  header.magic    = TS_BLOCK_MAGIC;
+  header.version  = TS_BLOCK_VERSION;
+  header.attr     = attr;
+  header.count    = 0;
+  header.index    = index;
+  header.flags    = 0;
+  header.reserved = 0;
+  header.lo       = lo;
+  header.hi       = hi;
+  for (int b = 0; b < 6; ++ b)
+    header.mac[b] = (uint8_t) (device >> (40 - 8 * b));
+  memcpy(buffer, &header, sizeof(header));
+
+  length     = sizeof(header);
+  samples    = 0;
+  prev_time  = 0;
+  prev_delta = 0;
+  prev_value = 0;
+  return true;
+}
+
+/* append a sample, returns false when the block is full */
+bool TSBlockEncoder::add(uint32_t time, uint16_t value) {
+
+  if (capacity - length < MAX_SAMPLE_SIZE || samples == 0xFFFF)
+    return false;
+
+  if (samples == 0) {
+    putVarint(time);
+    putVarint(tsZigZag(value));
+  } else {
+    int32_t delta = (int32_t) (time - prev_time);
+    putVarint(tsZigZag(delta - prev_delta));
+    putVarint(tsZigZag((int32_t) value - (int32_t) prev_value));
+    prev_delta = delta;
+  }
+
+  prev_time  = time;
+  prev_value = value;
+  ++ samples;
+  return true;
+}
+
+/* complete the header, returns the size of the block */
+size_t TSBlockEncoder::finish(uint8_t flags) {
+
+  TSBlockHeader_t * header = (TSBlockHeader_t *) buffer;
+
+  header->count = samples;
+  header->flags = flags;
+  return length;
+}
+
+void TSBlockEncoder::putVarint(uint32_t value) {
+
+  while (value >= 0x80) {
+    buffer[length ++] = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+  buffer[length ++] = (uint8_t) value;
+}
+
+/*
+ * Decoder
+ */
+TSBlockDecoder::TSBlockDecoder(const uint8_t * _buffer, size_t _length)
+  : buffer(_buffer)
+  , length(_length)
+  , pos(sizeof(TSBlockHeader_t))
+  , valid(false)
+  , samples(0)
+  , prev_time(0)
+  , prev_delta(0)
+  , prev_value(0) {
+
+  if (length < sizeof(hdr))
+    return;
+
+  memcpy(&hdr, buffer, sizeof(hdr));
+  valid = (hdr.magic == TS_BLOCK_MAGIC && hdr.version == TS_BLOCK_VERSION);
+}
+
+/* get the next sample, returns false at the end of the block or on error */
+bool TSBlockDecoder::next(uint32_t & time, uint16_t & value) {
+
+  uint32_t t, v;
+
+  if (valid == false || samples == hdr.count)
+    return false;
+
+  if (getVarint(t) == false || getVarint(v) == false) {
+    valid = false;
+    return false;
+  }
+
+  if (samples == 0) {
+    time  = t;
+    value = (uint16_t) tsUnZigZag(v);
+  } else {
+    prev_delta += tsUnZigZag(t);
+    time  = prev_time + (uint32_t) prev_delta;
+    value = (uint16_t) (prev_value + tsUnZigZag(v));
+  }
+
+  prev_time  = time;
+  prev_value = value;
+  ++ samples;
+  return true;
+}
+
+bool TSBlockDecoder::getVarint(uint32_t & value) {
+
+  uint8_t shift = 0;
+  value = 0;
+
+  while (pos < length && shift < 35) {
+    uint8_t byte = buffer[pos ++];
+    value |= (uint32_t) (byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+    shift += 7;
+  }
+  return false;
+}
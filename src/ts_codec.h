@@ -0,0 +1,155 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _TS_CODEC_H_
+#define _TS_CODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Compressed block format for the series of one attribute of one plant.
+ *
+ * This file does not depend on Arduino, it's also built on the host by the
+ * decoder in tools/tsdecode.
+ *
+ * Layout (little endian):
+ *   header   TSBlockHeader_t
+ *   sample 0 varint(time), varint(zigzag(value))
+ *   sample n varint(zigzag(delta of delta time)), varint(zigzag(delta value))
+ *
+ * Values are the 16 bit quantized values of the flash log, mapped linearly
+ * over [lo, hi] given in the header. Samples are taken at a near constant
+ * period and plant values move slowly, so most samples take 2 bytes.
+ */
+
+#define TS_BLOCK_MAGIC        0x5354 // "TS"
+#define TS_BLOCK_VERSION      2
+#define TS_BLOCK_FLAG_LAST    0x01   // last block of a response
+
+typedef struct __attribute__((packed)) {
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  attr;
+  uint8_t  mac[6];  // device address, most significant byte first
+  uint16_t count;
+  uint16_t index;   // block index within a response
+  uint8_t  flags;
+  uint8_t  reserved;
+  float    lo;
+  float    hi;
+} TSBlockHeader_t;
+
+/*
+ * Encoder writing into a caller provided buffer
+ */
+class TSBlockEncoder {
+
+  public:
+    /* worst case size of a sample */
+    static const size_t MAX_SAMPLE_SIZE = 10;
+
+  public:
+    TSBlockEncoder(uint8_t * buffer, size_t capacity);
+
+    bool     begin(uint64_t device, uint8_t attr, float lo, float hi, uint16_t index = 0);
+    bool     add(uint32_t time, uint16_t value);
+    size_t   finish(uint8_t flags = 0);
+
+    uint16_t count();
+    size_t   size();
+
+  protected:
+    uint8_t * buffer;
+    size_t    capacity;
+    size_t    length;
+    uint16_t  samples;
+    uint32_t  prev_time;
+    int32_t   prev_delta;
+    uint16_t  prev_value;
+
+    void      putVarint(uint32_t value);
+};
+
+/*
+ * Decoder iterating the samples of a block
+ */
+class TSBlockDecoder {
+
+  public:
+    TSBlockDecoder(const uint8_t * buffer, size_t length);
+
+    bool     isValid();
+    const TSBlockHeader_t & header();
+
+    bool     next(uint32_t & time, uint16_t & value);
+    float    toFloat(uint16_t value);
+
+  protected:
+    const uint8_t * buffer;
+    size_t          length;
+    size_t          pos;
+    TSBlockHeader_t hdr;
+    bool            valid;
+    uint16_t        samples;
+    uint32_t        prev_time;
+    int32_t         prev_delta;
+    uint16_t        prev_value;
+
+    bool            getVarint(uint32_t & value);
+};
+
+/* zig-zag mapping of signed to unsigned, small magnitudes give small values */
+inline uint32_t tsZigZag(int32_t value) {
+  return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+inline int32_t tsUnZigZag(uint32_t value) {
+  return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+/* inlines for TSBlockEncoder */
+inline uint16_t TSBlockEncoder::count() {
+  return samples;
+}
+
+inline size_t TSBlockEncoder::size() {
+  return length;
+}
+
+/* inlines for TSBlockDecoder */
+inline bool TSBlockDecoder::isValid() {
+  return valid;
+}
+
+inline const TSBlockHeader_t & TSBlockDecoder::header() {
+  return hdr;
+}
+
+inline float TSBlockDecoder::toFloat(uint16_t value) {
+  return hdr.lo + (float) value * (hdr.hi - hdr.lo) / 0xFFFF;
+}
+
+#endif//_TS_CODEC_H_
@@ -0,0 +1,240 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "ts_export.h"
+#include "history.h"
+#include "wallclock.h"
+#include "config.h"
+#include "mqtt.h"
+
+#define LOG_TAG LOG_TAG_TSLOG
+#include "log.h"
+
+TSExport tsexport;
+
+/* attribute names, as used in the plant topics */
+static const struct {
+  const char * name;
+  AttributeID  id;
+} _attributes[] = {
+  { "moisture"    , ATTR_ID_MOISTURE     },
+  { "temp"        , ATTR_ID_TEMPERATURE  },
+  { "conductivity", ATTR_ID_CONDUCTIVITY },
+  { "light"       , ATTR_ID_ILLUMINANCE  },
+};
+
+/* state of an export in progress */
+typedef struct {
+  uint8_t *              buffer;
+  TSBlockEncoder *       encoder;
+  const HistoryRange_t * range;
+  const char *           topic;
+  uint64_t               device;
+  AttributeID            attr;
+  uint16_t               blocks;
+  size_t                 samples;
+  bool                   failed;
+} ExportContext_t;
+
+/* publish the current block and start the next one */
+static bool _publishBlock(ExportContext_t & ctx, uint8_t flags) {
+
+  size_t size = ctx.encoder->finish(flags);
+
+  if (mqtt.publishDirect(ctx.topic, ctx.buffer, size, false) == false) {
+    ctx.failed = true;
+    return false;
+  }
+
+  ++ ctx.blocks;
+  ctx.encoder->begin(ctx.device, ctx.attr, ctx.range->lo, ctx.range->hi, ctx.blocks);
+  return true;
+}
+
+/* resolve a requested time, zero or negative values are relative to now */
+static uint32_t _resolveTime(long value, uint32_t now, uint32_t def) {
+
+  if (value > 0)
+    return (uint32_t) value;
+
+  // clock not set yet, or relative to a time before epoch
+  if (now == 0 || (uint32_t) -value > now)
+    return def;
+
+  return now - (uint32_t) -value;
+}
+
+TSExport::TSExport()
+  : _request_device(NULL)
+  , _request_attr(ATTR_ID_NONE)
+  , _request_from(0)
+  , _request_to(0)
+  , _task_export(0, TASK_ONCE, s_taskExportCbk, &scheduler, false) {
+}
+
+bool TSExport::begin() {
+
+  std::string topic;
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_COMMAND, "export");
+  return mqtt.subscribeTo(topic.c_str(), s_onCommand);
+}
+
+/* export the logged samples of a plant attribute, returns the number of samples */
+size_t TSExport::exportSeries(MiFloraDevice * device, AttributeID attr, uint32_t from, uint32_t to) {
+
+  ExportContext_t ctx;
+  std::string     topic;
+  size_t          capacity;
+
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_EXPORT, device->getAddress().c_str());
+
+  // block must fit the MQTT buffer along with the fixed header and the topic
+  capacity = mqtt.getBufferSize();
+  if (capacity <= 7 + topic.length() + sizeof(TSBlockHeader_t) + TSBlockEncoder::MAX_SAMPLE_SIZE) {
+    LOG_LN("MQTT buffer too small for exporting!");
+    return 0;
+  }
+  capacity -= 7 + topic.length();
+
+  ctx.buffer = (uint8_t *) malloc(capacity);
+  if (ctx.buffer == NULL) {
+    LOG_LN("OOM!");
+    return 0;
+  }
+
+  TSBlockEncoder encoder(ctx.buffer, capacity);
+
+  ctx.encoder = &encoder;
+  ctx.range   = DeviceHistory::rangeOf(attr);
+  ctx.topic   = topic.c_str();
+  ctx.device  = device->getMAC();
+  ctx.attr    = attr;
+  ctx.blocks  = 0;
+  ctx.samples = 0;
+  ctx.failed  = false;
+
+  encoder.begin(ctx.device, ctx.attr, ctx.range->lo, ctx.range->hi, 0);
+  tslog.query(from, to, s_visitSample, &ctx);
+
+  // last block is always sent, even when empty, to mark the end of the reply
+  if (ctx.failed == false) {
+    _publishBlock(ctx, TS_BLOCK_FLAG_LAST);
+  }
+
+  LOG_F("Exported %u samples of %s in %u blocks%s", 
+    (unsigned int) ctx.samples, device->getAddress().c_str(), 
+    (unsigned int) ctx.blocks, ctx.failed ? " (failed publishing)" : "");
+
+  free(ctx.buffer);
+  return ctx.samples;
+}
+
+bool TSExport::s_visitSample(const TSLogSample_t & sample, void * param) {
+
+  ExportContext_t & ctx = * (ExportContext_t *) param;
+
+  if (sample.device != ctx.device || sample.attr != ctx.attr)
+    return true;
+
+  // block is full, ship it and continue in a new one
+  if (ctx.encoder->add(sample.time, sample.raw) == false) {
+    if (_publishBlock(ctx, 0) == false)
+      return false;
+    ctx.encoder->add(sample.time, sample.raw);
+  }
+
+  ++ ctx.samples;
+  return true;
+}
+
+void TSExport::onCommand(uint8_t * payload, unsigned int len) {
+
+  char           request[96];
+  char *         token;
+  char *         saveptr;
+  MiFloraDevice * device;
+  AttributeID    attr = ATTR_ID_NONE;
+  long           from = -86400, to = 0;
+  uint32_t       now  = wallclock.isSynced() ? wallclock.now() : 0;
+
+  if (len >= sizeof(request)) {
+    LOG_LN("Export request too long");
+    return;
+  }
+
+  if (_request_device) {
+    LOG_LN("Export in progress, request dropped");
+    return;
+  }
+  memcpy(request, payload, len);
+  request[len] = '\0';
+
+  // device by address or name
+  token = strtok_r(request, " ", &saveptr);
+  if (token == NULL) 
+    return;
+
+  device = fleet.findByAddress(token);
+  if (device == NULL) device = fleet.findByName(token);
+  if (device == NULL) {
+    LOG_F("Export: unknown device %s", token);
+    return;
+  }
+
+  // attribute
+  token = strtok_r(NULL, " ", &saveptr);
+  for (size_t i = 0; token && i < sizeof(_attributes) / sizeof(_attributes[0]); ++ i) {
+    if (strcasecmp(token, _attributes[i].name) == 0) {
+      attr = _attributes[i].id;
+    }
+  }
+  if (attr == ATTR_ID_NONE) {
+    LOG_F("Export: unknown attribute %s", token ? token : "");
+    return;
+  }
+
+  // time range, negative values are relative to now
+  token = strtok_r(NULL, " ", &saveptr);
+  if (token) from = strtol(token, NULL, 10);
+  token = strtok_r(NULL, " ", &saveptr);
+  if (token) to = strtol(token, NULL, 10);
+
+  // the blocks are published by the task, outside of the MQTT callback
+  _request_device = device;
+  _request_attr   = attr;
+  _request_from   = _resolveTime(from, now, 0);
+  _request_to     = _resolveTime(to, now, 0xFFFFFFFF);
+  _task_export.restart();
+}
+
+void TSExport::taskExportCbk() {
+
+  if (_request_device == NULL)
+    return;
+
+  exportSeries(_request_device, _request_attr, _request_from, _request_to);
+  _request_device = NULL;
+}
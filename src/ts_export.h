@@ -0,0 +1,83 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _TS_EXPORT_H_
+#define _TS_EXPORT_H_
+
+#include "scheduler.h"
+#include "tslog.h"
+#include "device.h"
+#include "ts_codec.h"
+
+/*
+ * Bulk export of the flash log over MQTT.
+ *
+ * Request on <command_topic>/export:
+ *   <device address or name> <moisture|temp|conductivity|light> [from] [to]
+ * where from/to are epoch seconds, or seconds relative to now when zero or negative
+ * (defaults to the last 24 hours).
+ *
+ * The reply is a sequence of compressed blocks (see ts_codec.h) published on
+ * <root_topic>/station/<station_name>/export/<device address>, each one
+ * fitting the MQTT buffer; the last one is flagged TS_BLOCK_FLAG_LAST.
+ * The reply is sent by a task, not from the MQTT callback, one request at a time.
+ */
+class TSExport {
+
+  public:
+    TSExport();
+
+    bool   begin();
+    size_t exportSeries(MiFloraDevice * device, AttributeID attr, uint32_t from, uint32_t to);
+
+  protected:
+    /* request waiting for the export task */
+    MiFloraDevice * _request_device;
+    AttributeID     _request_attr;
+    uint32_t        _request_from;
+    uint32_t        _request_to;
+
+    Task            _task_export;
+
+    void   onCommand(uint8_t * payload, unsigned int len);
+    void   taskExportCbk();
+
+    static void s_taskExportCbk();
+    static void s_onCommand(const char * topic, uint8_t * payload, unsigned int len, void * param);
+    static bool s_visitSample(const TSLogSample_t & sample, void * param);
+};
+
+extern TSExport tsexport;
+
+/* inlines for TSExport */
+inline void TSExport::s_onCommand(const char *, uint8_t * payload, unsigned int len, void *) {
+  tsexport.onCommand(payload, len);
+}
+
+inline void TSExport::s_taskExportCbk() {
+  tsexport.taskExportCbk();
+}
+
+#endif//_TS_EXPORT_H_
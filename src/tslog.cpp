@@ -0,0 +1,458 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <rom/crc.h>
+
+#include "tslog.h"
+#include "history.h"
+#include "config.h"
+
+#define LOG_TAG LOG_TAG_TSLOG
+#include "log.h"
+
+TSLog tslog;
+
+TSLog::TSLog()
+  : _partition(NULL)
+  , _mapped(NULL)
+  , _map_handle(0)
+  , _pages(0)
+  , _page_open(false)
+  , _page(0)
+  , _page_seq(0)
+  , _page_base_time(0)
+  , _page_count(0)
+  , _page_devices(0)
+  , _pending_count(0)
+  , _stat_records(0)
+  , _stat_bytes(0)
+  , _stat_erases(0)
+  , _task_flush(TSLOG_FLUSH_SEC * TASK_SECOND, TASK_FOREVER, s_taskFlushCbk, &scheduler, false) {
+}
+
+bool TSLog::begin() {
+
+  const PageHeader_t * header;
+  bool found = false;
+
+  if (config.tslog_enabled == false) {
+    LOG_LN("Disabled by configuration");
+    return true;
+  }
+
+  _partition = esp_partition_find_first(
+    ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TSLOG_PARTITION_LABEL);
+
+  if (_partition == NULL) {
+    LOG_LN("No '" TSLOG_PARTITION_LABEL "' partition, check the partition table!");
+    return false;
+  }
+
+  _pages = _partition->size / PAGE_SIZE;
+
+  if (esp_partition_mmap(_partition, 0, _pages * PAGE_SIZE, 
+        SPI_FLASH_MMAP_DATA, (const void **) &_mapped, &_map_handle) != ESP_OK) {
+    LOG_LN("Failed mapping partition!");
+    _mapped = NULL;
+    return false;
+  }
+
+  // the newest page is where appending continues
+  for (uint32_t page = 0; page < _pages; ++ page) {
+
+    if (pageValid(page) == false)
+      continue;
+
+    header = pageHeader(page);
+    if (found == false || (int32_t) (header->seq - _page_seq) > 0) {
+      _page     = page;
+      _page_seq = header->seq;
+      found     = true;
+    }
+  }
+
+  if (found) {
+    header = pageHeader(_page);
+
+    // page was not sealed before reboot, keep filling it
+    if (header->count == 0xFFFF) {
+      _page_count     = pageRecordCount(_page);
+      _page_devices   = pageDeviceCount(_page);
+      _page_base_time = header->base_time;
+      _page_open      = true;
+    }
+  } else {
+    // empty log, first page opened will be page 0
+    _page     = _pages - 1;
+    _page_seq = 0;
+  }
+
+  _task_flush.setInterval(config.tslog_flush_sec * TASK_SECOND);
+  _task_flush.enableDelayed();
+
+  LOG_F("%u pages of %u records, head page:%u seq:%u", 
+    (unsigned int) _pages, (unsigned int) RECORDS_PER_PAGE, 
+    (unsigned int) _page, (unsigned int) _page_seq);
+  return true;
+}
+
+/* queue a sample for writing, written when the batch is full or on flush */
+bool TSLog::append(uint64_t device, AttributeID attr, uint32_t time, float value) {
+
+  if (isReady() == false)
+    return false;
+
+  Pending_t & pending = _pending[_pending_count ++];
+
+  pending.time   = time;
+  pending.device = device;
+  pending.attr   = (uint8_t) attr;
+  pending.value  = quantize(attr, value);
+  ++ _stat_records;
+
+  if (_pending_count == TSLOG_BATCH_RECORDS) {
+    return flush();
+  }
+  return true;
+}
+
+/* write pending samples to flash */
+bool TSLog::flush() {
+
+  Record_t batch[TSLOG_BATCH_RECORDS];
+  uint32_t batch_count = 0;
+  uint32_t oldest;
+  bool     ret = true;
+
+  if (isReady() == false || _pending_count == 0) {
+    _pending_count = 0;
+    return isReady();
+  }
+
+  for (uint16_t i = 0; i < _pending_count && ret; ++ i) {
+
+    const Pending_t & pending = _pending[i];
+    int device = _page_open ? findDevice(pending.device) : -1;
+
+    // space taken by the record, and by the device address on its first record in the page
+    uint32_t used = sizeof(PageHeader_t) + (_page_count + batch_count + 1) * sizeof(Record_t) +
+                    (_page_devices + (device < 0 ? 1 : 0)) * sizeof(Device_t);
+
+    // current page can't take this record, it's full or out of its time range
+    if (_page_open && (
+          used > PAGE_SIZE ||
+          (device < 0 && _page_devices >= MAX_DEVICES) ||
+          pending.time < _page_base_time ||
+          pending.time - _page_base_time > MAX_OFFSET)) {
+
+      if (batch_count) {
+        ret = writeRecords(batch, batch_count);
+        batch_count = 0;
+      }
+      ret = ret && sealPage();
+      device = -1;
+    }
+
+    if (ret && _page_open == false) {
+      // base the page before the oldest sample left, late ones still fit
+      oldest = pending.time;
+      for (uint16_t j = i + 1; j < _pending_count; ++ j) {
+        if (_pending[j].time < oldest)
+          oldest = _pending[j].time;
+      }
+      ret = openPage(oldest > TSLOG_BACKDATE_SEC ? oldest - TSLOG_BACKDATE_SEC : 0);
+    }
+
+    // the address is written ahead of the records referring to it
+    if (ret && device < 0) {
+      ret    = writeDevice(pending.device);
+      device = _page_devices - 1;
+    }
+
+    Record_t & record = batch[batch_count ++];
+    record.offset = (uint16_t) (pending.time - _page_base_time);
+    record.device = (uint8_t) device;
+    record.attr   = pending.attr;
+    record.value  = pending.value;
+  }
+
+  if (ret && batch_count) {
+    ret = writeRecords(batch, batch_count);
+  }
+
+  if (ret == false) {
+    LOG_F("Failed writing page %u, dropped %u records", 
+      (unsigned int) _page, (unsigned int) _pending_count);
+  }
+
+  _pending_count = 0;
+  return ret;
+}
+
+/* visit all samples in [from, to], oldest page first, returns visited count */
+size_t TSLog::query(uint32_t from, uint32_t to, TSLogVisitor_t visitor, void * param) {
+
+  TSLogSample_t sample;
+  size_t count = 0;
+
+  if (isReady() == false)
+    return 0;
+
+  for (uint32_t i = 1; i <= _pages; ++ i) {
+
+    uint32_t page = (_page + i) % _pages;
+
+    if (pageValid(page) == false)
+      continue;
+
+    const PageHeader_t * header  = pageHeader(page);
+    const Record_t *     records = pageRecords(page);
+    uint32_t             records_count = pageRecordCount(page);
+    uint32_t             devices_count = pageDeviceCount(page);
+
+    // whole page is newer than the range
+    if (header->base_time > to)
+      continue;
+
+    // sealed pages must match their CRC
+    if (header->count != 0xFFFF && header->crc != crc32_le(
+          crc32_le(0, (const uint8_t *) records, records_count * sizeof(Record_t)),
+          (const uint8_t *) pageDevice(page, devices_count - 1), devices_count * sizeof(Device_t))) {
+      LOG_F("Page %u seq:%u is corrupted, skipped", (unsigned int) page, (unsigned int) header->seq);
+      continue;
+    }
+
+    for (uint32_t r = 0; r < records_count; ++ r) {
+
+      sample.time = header->base_time + records[r].offset;
+      if (sample.time < from || sample.time > to || records[r].device >= devices_count)
+        continue;
+
+      const Device_t * device = pageDevice(page, records[r].device);
+      sample.device = 0;
+      for (int b = 0; b < 6; ++ b)
+        sample.device = (sample.device << 8) | device->mac[b];
+      sample.attr   = (AttributeID) records[r].attr;
+      sample.value  = dequantize(sample.attr, records[r].value);
+      sample.raw    = records[r].value;
+      ++ count;
+
+      if (visitor(sample, param) == false)
+        return count;
+    }
+  }
+
+  // samples not written yet
+  for (uint16_t i = 0; i < _pending_count; ++ i) {
+
+    const Pending_t & pending = _pending[i];
+    if (pending.time < from || pending.time > to)
+      continue;
+
+    sample.time   = pending.time;
+    sample.device = pending.device;
+    sample.attr   = (AttributeID) pending.attr;
+    sample.value  = dequantize(sample.attr, pending.value);
+    sample.raw    = pending.value;
+    ++ count;
+
+    if (visitor(sample, param) == false)
+      break;
+  }
+
+  return count;
+}
+
+uint32_t TSLog::recordCount() {
+
+  uint32_t count = _pending_count;
+
+  for (uint32_t page = 0; isReady() && page < _pages; ++ page) {
+    if (pageValid(page)) {
+      count += pageRecordCount(page);
+    }
+  }
+  return count;
+}
+
+uint16_t TSLog::quantize(AttributeID attr, float value) {
+
+  const HistoryRange_t * range = DeviceHistory::rangeOf(attr);
+
+  if (range == NULL || value <= range->lo) return 0;
+  if (value >= range->hi) return 0xFFFF;
+
+  return (uint16_t) ((value - range->lo) * 0xFFFF / (range->hi - range->lo) + 0.5f);
+}
+
+float TSLog::dequantize(AttributeID attr, uint16_t value) {
+
+  const HistoryRange_t * range = DeviceHistory::rangeOf(attr);
+
+  if (range == NULL) 
+    return 0.0f;
+
+  return range->lo + (float) value * (range->hi - range->lo) / 0xFFFF;
+}
+
+bool TSLog::pageValid(uint32_t page) {
+  return pageHeader(page)->magic == PAGE_MAGIC;
+}
+
+uint32_t TSLog::pageRecordCount(uint32_t page) {
+
+  if (_page_open && page == _page) {
+    return _page_count;
+  }
+
+  const PageHeader_t * header = pageHeader(page);
+  if (header->count != 0xFFFF) {
+    return header->count <= RECORDS_PER_PAGE ? header->count : 0;
+  }
+
+  // open page, records end at the first erased one
+  const Record_t * records = pageRecords(page);
+  uint32_t count = 0;
+  while (count < RECORDS_PER_PAGE && records[count].offset != 0xFFFF) {
+    ++ count;
+  }
+  return count;
+}
+
+uint32_t TSLog::pageDeviceCount(uint32_t page) {
+
+  static const uint8_t erased[sizeof(Device_t)] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+  if (_page_open && page == _page) {
+    return _page_devices;
+  }
+
+  const PageHeader_t * header = pageHeader(page);
+  if (header->devices != 0xFFFF) {
+    return header->devices <= MAX_DEVICES ? header->devices : 0;
+  }
+
+  // open page, the table ends at the first erased address
+  uint32_t count = 0;
+  while (count < MAX_DEVICES && memcmp(pageDevice(page, count)->mac, erased, sizeof(erased)) != 0) {
+    ++ count;
+  }
+  return count;
+}
+
+/* index of the device in the table of the open page, -1 if not there yet */
+int TSLog::findDevice(uint64_t device) {
+
+  uint8_t mac[sizeof(Device_t)];
+
+  for (int b = 0; b < 6; ++ b)
+    mac[b] = (uint8_t) (device >> (40 - 8 * b));
+
+  for (uint32_t index = 0; index < _page_devices; ++ index) {
+    if (memcmp(pageDevice(_page, index)->mac, mac, sizeof(mac)) == 0)
+      return (int) index;
+  }
+  return -1;
+}
+
+/* erase the oldest page and make it the new head */
+bool TSLog::openPage(uint32_t base_time) {
+
+  PageHeader_t header;
+  uint32_t page = (_page + 1) % _pages;
+
+  if (esp_partition_erase_range(_partition, page * PAGE_SIZE, PAGE_SIZE) != ESP_OK) {
+    return false;
+  }
+  ++ _stat_erases;
+
+  memset(&header, 0xFF, sizeof(header));
+  header.magic     = PAGE_MAGIC;
+  header.seq       = _page_seq + 1;
+  header.base_time = base_time;
+
+  if (esp_partition_write(_partition, page * PAGE_SIZE, &header, sizeof(header)) != ESP_OK) {
+    return false;
+  }
+  _stat_bytes += sizeof(header);
+
+  _page           = page;
+  _page_seq       = header.seq;
+  _page_base_time = base_time;
+  _page_count     = 0;
+  _page_devices   = 0;
+  _page_open      = true;
+  return true;
+}
+
+/* program counts and CRC over the erased header fields */
+bool TSLog::sealPage() {
+
+  uint32_t base  = _page * PAGE_SIZE;
+  uint16_t counts[2] = { (uint16_t) _page_count, (uint16_t) _page_devices };
+  uint32_t crc   = crc32_le(0, (const uint8_t *) pageRecords(_page), _page_count * sizeof(Record_t));
+
+  crc = crc32_le(crc, (const uint8_t *) pageDevice(_page, _page_devices - 1), _page_devices * sizeof(Device_t));
+  _page_open = false;
+
+  if (esp_partition_write(_partition, base + offsetof(PageHeader_t, count), counts, sizeof(counts)) != ESP_OK ||
+      esp_partition_write(_partition, base + offsetof(PageHeader_t, crc), &crc, sizeof(crc)) != ESP_OK) {
+    return false;
+  }
+  _stat_bytes += sizeof(counts) + sizeof(crc);
+  return true;
+}
+
+bool TSLog::writeRecords(const Record_t * records, uint32_t count) {
+
+  uint32_t offset = _page * PAGE_SIZE + sizeof(PageHeader_t) + _page_count * sizeof(Record_t);
+
+  if (esp_partition_write(_partition, offset, records, count * sizeof(Record_t)) != ESP_OK) {
+    return false;
+  }
+  _page_count += count;
+  _stat_bytes += count * sizeof(Record_t);
+  return true;
+}
+
+bool TSLog::writeDevice(uint64_t device) {
+
+  Device_t entry;
+  uint32_t offset = (_page + 1) * PAGE_SIZE - (_page_devices + 1) * sizeof(Device_t);
+
+  for (int b = 0; b < 6; ++ b)
+    entry.mac[b] = (uint8_t) (device >> (40 - 8 * b));
+
+  if (esp_partition_write(_partition, offset, &entry, sizeof(entry)) != ESP_OK) {
+    return false;
+  }
+  ++ _page_devices;
+  _stat_bytes += sizeof(entry);
+  return true;
+}
+
+void TSLog::taskFlushCbk() {
+  flush();
+}
@@ -0,0 +1,210 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _TSLOG_H_
+#define _TSLOG_H_
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <firmware_config.h>
+
+#include "scheduler.h"
+#include "attribute_id.h"
+
+/* label of the flash partition holding the log (see partitions_tslog.csv) */
+#define TSLOG_PARTITION_LABEL "tslog"
+
+/* sample replayed from the log */
+typedef struct {
+  uint32_t    time;   // epoch seconds
+  uint64_t    device; // device address, see MiFloraDevice::getMAC()
+  AttributeID attr;
+  float       value;
+  uint16_t    raw;    // quantized value, as kept in flash
+} TSLogSample_t;
+
+/* visitor for log queries, return false to stop the query */
+typedef bool (*TSLogVisitor_t)(const TSLogSample_t & sample, void * param);
+
+/*
+ * Append-only log of samples, kept in a dedicated flash partition.
+ *
+ * The partition is split in pages of one flash sector, used as a circular
+ * log. A page is erased once, when it is opened, then records are programmed
+ * in batches into its erased space, and finally the page is sealed by writing
+ * its record count and CRC into the header. Each sector is thus erased once
+ * per pass over the partition, no matter how often the batches are flushed.
+ *
+ * Records grow from the header up, the addresses of the plants they refer to
+ * grow from the end of the page down, each address kept once per page.
+ * Record times are offsets from the page base time, set back from the oldest
+ * sample of the page by TSLOG_BACKDATE_SEC: averages are appended when their
+ * slot closes, late for plants not heard for a while, and still fit the page.
+ *
+ * Reading goes through a memory mapping of the whole partition, no copies.
+ */
+class TSLog {
+
+  public:
+    static const uint32_t PAGE_SIZE    = 4096;
+    static const uint32_t PAGE_MAGIC   = 0x334C5354; // "TSL3", pages of older formats are ignored
+    static const uint16_t MAX_OFFSET   = 0xFFFE;     // 0xFFFF marks erased records
+    static const uint32_t MAX_DEVICES  = 0xFF;       // devices of a page, indexes fit a record
+
+    /* page header, count, devices and crc are left erased while the page is open */
+    typedef struct {
+      uint32_t magic;
+      uint32_t seq;
+      uint32_t base_time;
+      uint16_t count;
+      uint16_t devices;
+      uint32_t crc;
+      uint32_t padding[3];
+    } PageHeader_t;
+
+    /* record as kept in flash */
+    typedef struct {
+      uint16_t offset;  // seconds since page base_time, first so an erased record reads 0xFFFF
+      uint8_t  device;  // index in the device table of the page
+      uint8_t  attr;
+      uint16_t value;   // quantized over the attribute's history range
+    } Record_t;
+
+    /* device table entry, indexed from the end of the page */
+    typedef struct {
+      uint8_t  mac[6];  // device address, most significant byte first, erased reads FF:FF:FF:FF:FF:FF
+    } Device_t;
+
+    static const uint32_t RECORDS_PER_PAGE = (PAGE_SIZE - sizeof(PageHeader_t) - sizeof(Device_t)) / sizeof(Record_t);
+
+  public:
+    TSLog();
+
+    bool     begin();
+
+    bool     append(uint64_t device, AttributeID attr, uint32_t time, float value);
+    bool     flush();
+    size_t   query(uint32_t from, uint32_t to, TSLogVisitor_t visitor, void * param);
+
+    bool     isReady();
+    uint32_t pageCount();
+    uint32_t recordCount();
+
+    /* wear statistics since boot */
+    uint32_t statRecords();
+    uint32_t statBytesWritten();
+    uint32_t statErases();
+
+    static uint16_t quantize(AttributeID attr, float value);
+    static float    dequantize(AttributeID attr, uint16_t value);
+
+  protected:
+    /* record waiting in RAM to be written */
+    typedef struct {
+      uint32_t time;
+      uint64_t device;
+      uint8_t  attr;
+      uint16_t value;
+    } Pending_t;
+
+    const esp_partition_t *  _partition;
+    const uint8_t *          _mapped;
+    spi_flash_mmap_handle_t  _map_handle;
+    uint32_t                 _pages;
+
+    /* page currently being appended */
+    bool                     _page_open;
+    uint32_t                 _page;
+    uint32_t                 _page_seq;
+    uint32_t                 _page_base_time;
+    uint32_t                 _page_count;
+    uint32_t                 _page_devices;
+
+    Pending_t                _pending[TSLOG_BATCH_RECORDS];
+    uint16_t                 _pending_count;
+
+    uint32_t                 _stat_records;
+    uint32_t                 _stat_bytes;
+    uint32_t                 _stat_erases;
+
+    Task                     _task_flush;
+
+    const PageHeader_t *     pageHeader(uint32_t page);
+    const Record_t *         pageRecords(uint32_t page);
+    uint32_t                 pageRecordCount(uint32_t page);
+    const Device_t *         pageDevice(uint32_t page, uint32_t index);
+    uint32_t                 pageDeviceCount(uint32_t page);
+    int                      findDevice(uint64_t device);
+    bool                     pageValid(uint32_t page);
+
+    bool                     openPage(uint32_t base_time);
+    bool                     sealPage();
+    bool                     writeRecords(const Record_t * records, uint32_t count);
+    bool                     writeDevice(uint64_t device);
+
+    void                     taskFlushCbk();
+    static void              s_taskFlushCbk();
+};
+
+extern TSLog tslog;
+
+/* inlines for TSLog */
+inline bool TSLog::isReady() {
+  return _mapped != NULL;
+}
+
+inline uint32_t TSLog::pageCount() {
+  return _pages;
+}
+
+inline uint32_t TSLog::statRecords() {
+  return _stat_records;
+}
+
+inline uint32_t TSLog::statBytesWritten() {
+  return _stat_bytes;
+}
+
+inline uint32_t TSLog::statErases() {
+  return _stat_erases;
+}
+
+inline const TSLog::PageHeader_t * TSLog::pageHeader(uint32_t page) {
+  return (const PageHeader_t *) (_mapped + page * PAGE_SIZE);
+}
+
+inline const TSLog::Record_t * TSLog::pageRecords(uint32_t page) {
+  return (const Record_t *) (_mapped + page * PAGE_SIZE + sizeof(PageHeader_t));
+}
+
+inline const TSLog::Device_t * TSLog::pageDevice(uint32_t page, uint32_t index) {
+  return (const Device_t *) (_mapped + (page + 1) * PAGE_SIZE - (index + 1) * sizeof(Device_t));
+}
+
+inline void TSLog::s_taskFlushCbk() {
+  tslog.taskFlushCbk();
+}
+
+#endif//_TSLOG_H_
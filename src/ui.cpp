@@ -23,7 +23,10 @@
  */
 
 #include "ui.h"
+#include "zone.h"
 #include "config.h"
+#include "history.h"
+#include "wallclock.h"
 #include <Arduino.h>
 
 /*
@@ -89,6 +92,12 @@ void ProgressBar::draw() {
   }
 }
 
+/* bar range of a value, from the species profile when it has one */
+static long displayMax(MiFloraDevice * device, SpeciesValue value, long fallback) {
+  const SpeciesProfile_t * profile = device->getSpecies();
+  return (profile && profile->display_max[value]) ? profile->display_max[value] : fallback;
+}
+
 void ProgressBar::drawAttribute(MiFloraDevice * device, DeviceAttribute * attr, const char * given_label) {
 
     char value_str[32];
@@ -98,10 +107,12 @@ void ProgressBar::drawAttribute(MiFloraDevice * device, DeviceAttribute * attr,
     // green  = recently updated (20 seconds)
     // yellow = not updated in a while (2 minutes)
     // white  = updated
+    // gray   = restored from before the last restart
     // red    = no value is present or not updated for one hour
     
     color_label = 
       attr->hasValue() == false               ? Display_Color_Red    :
+      attr->isRestored()                      ? Display_Color_Gray   :
       lastUpdated < UI_UPDATE_TIME_RECENT_MS  ? (attr->getSource() == SOURCE_BLE ? Display_Color_Green : Display_Color_Cyan) : 
       lastUpdated < UI_UPDATE_TIME_WARNING_MS ? Display_Color_White  : 
       lastUpdated < UI_UPDATE_TIME_STALL_MS   ? Display_Color_Yellow :  Display_Color_Red;
@@ -122,28 +133,28 @@ void ProgressBar::drawAttribute(MiFloraDevice * device, DeviceAttribute * attr,
       // moisture
       if (attr == &device->moisture) {
         val = device->moisture.get();
-        percentage = map(val, 0, 80, 0, 100);
+        percentage = map(val, 0, displayMax(device, SPECIES_MOISTURE, 80), 0, 100);
         sprintf(value_str, "%u%%", device->moisture.getUInt());
       } else
   
       // temperature
       if (attr == &device->temperature) {
         val = device->temperature.get();
-        percentage = map(val, 0, 50, 0, 100);
+        percentage = map(val, 0, displayMax(device, SPECIES_TEMPERATURE, 50), 0, 100);
         sprintf(value_str, "%.1fC", device->temperature.get());
       } else
   
       // light
       if (attr == &device->illuminance) {
         val = device->illuminance.get();
-        percentage = map(val, 0, 5000, 0, 100);
+        percentage = map(val, 0, displayMax(device, SPECIES_ILLUMINANCE, 5000), 0, 100);
         sprintf(value_str, "%ulu", device->illuminance.getUInt());
       } else
   
       // conductivity
       if (attr == &device->conductivity) {
         val = device->conductivity.get();
-        percentage = map(val, 0, 2000, 0, 100);
+        percentage = map(val, 0, displayMax(device, SPECIES_CONDUCTIVITY, 2000), 0, 100);
         sprintf(value_str, "%uus", (int) device->conductivity.getUInt());
       } else
   
@@ -152,6 +163,25 @@ void ProgressBar::drawAttribute(MiFloraDevice * device, DeviceAttribute * attr,
         val = device->RSSI.get();
         percentage = map(val, -100, -50, 0, 100);
         sprintf(value_str, "%ddb", device->RSSI.getInt());
+      } else
+
+      // daily light integral
+      if (attr == &device->dli) {
+        percentage = (int) (device->dli.get() * 100 / 40);
+        sprintf(value_str, "%.1fmol", device->dli.get());
+      } else
+
+      // vapour pressure deficit
+      if (attr == &device->vpd) {
+        percentage = (int) (device->vpd.get() * 100 / 3);
+        sprintf(value_str, "%.2fkPa", device->vpd.get());
+      }
+
+      // trend of the last hour, arrows of the display font
+      if (device->history() != NULL) {
+        int trend = device->history()->trend(attr->getID(), wallclock.uptime());
+        if (trend != 0)
+          strcat(value_str, trend > 0 ? "\x18" : "\x19");
       }
 
       int restore_color = color;
@@ -253,10 +283,27 @@ void DisplayScreen_MiFloraFleet::updateFor(MiFloraDevice * device) {
   bar.drawAttribute(device, &device->RSSI);
   bar.moveDown();
 
-  // print address  
+  // print watering forecast, or the address when there is none
   display.setCursor(5, display.height()-10);
-  display.setTextColor(Display_Color_Gray);
-  display.print(device->getAddress().c_str());
+  if (device->forecast().isValid()) {
+    char water[16];
+    uint32_t left = device->forecast().secondsLeft(millis() / 1000);
+
+    if (left < 3600) {
+      strcpy(water, "water now");
+    } else
+    if (left < 3600 * 48) {
+      sprintf(water, "water in %uh", (unsigned int) (left / 3600));
+    } else {
+      sprintf(water, "water in %ud", (unsigned int) (left / (24 * 3600)));
+    }
+
+    display.setTextColor(left < 24 * 3600 ? Display_Color_Orange : Display_Color_Cyan);
+    display.print(water);
+  } else {
+    display.setTextColor(Display_Color_Gray);
+    display.print(device->getAddress().c_str());
+  }
 
   // print last seen
   char seen[12];
@@ -354,6 +401,75 @@ void DisplayScreen_MiFloraAttributes::update() {
 #include "ble_tracker.h"
 #include "dht_sensor.h"
 
+/*
+ * Screen for showing zones
+ */
+DisplayScreen_Zones::DisplayScreen_Zones()
+  : index(0) {
+}
+
+void DisplayScreen_Zones::update() {
+
+  ProgressBar bar;
+  char value[32];
+
+  display.fillScreen(Display_Background_Color);
+  display.setCursor(0,0);
+  display.setTextSize(1);
+
+  if (index >= fleet.zones().size()) {
+    display.setTextSize(2);
+    display.print("N/A");
+    return;
+  }
+
+  Zone * zone = fleet.zones().at(index);
+
+  // zone name
+  display.setTextColor(Display_Text_Color);
+  display.print("[");
+  display.print(zone->memberCount());
+  display.print("] ");
+
+  display.setTextSize(2);
+  display.setTextWrap(false);
+  display.println(zone->getName().c_str());
+  display.setTextSize(1);
+
+  // moisture, same scale as the plants
+  bar.label = "Mean";
+  bar.value = value;
+  if (zone->hasMoisture()) {
+    sprintf(value, "%.0f%%", zone->moistureMean());
+    bar.percentage = map((long) zone->moistureMean(), 0, 80, 0, 100);
+  } else {
+    strcpy(value, "n/a");
+    bar.percentage = 0;
+  }
+  bar.draw();
+  bar.moveDown();
+
+  bar.label = "Min";
+  if (zone->hasMoisture()) {
+    sprintf(value, "%.0f%%", zone->moistureMin());
+    bar.percentage = map((long) zone->moistureMin(), 0, 80, 0, 100);
+  } else {
+    strcpy(value, "n/a");
+    bar.percentage = 0;
+  }
+  bar.draw();
+  bar.moveDown(15);
+
+  // plant counters
+  display.setCursor(5, bar.y_off);
+  display.setTextColor(zone->outOfLimits() ? Display_Color_Orange : Display_Color_Green);
+  display.printf("%u out of limits", zone->outOfLimits());
+
+  display.setCursor(5, bar.y_off + 15);
+  display.setTextColor(zone->stale() ? Display_Color_Red : Display_Color_Green);
+  display.printf("%u not heard of", zone->stale());
+}
+
 void DisplayScreen_Station::update() {
   
   ProgressBar bar;
@@ -97,6 +97,26 @@ class DisplayScreen_MiFloraAttributes : public DisplayScreen {
     uint16_t    pageIdx;
 };
 
+/*
+ * Screen for showing zones, a zone per page
+ */
+class DisplayScreen_Zones : public DisplayScreen {
+  public:
+
+    DisplayScreen_Zones();
+
+    /* from DisplayScreen */
+    void     update();
+    uint16_t pageCount();
+    uint16_t pageNext();
+    uint16_t pagePrev();
+    uint16_t pageIndex();
+    bool     pageSelect(uint16_t page);
+
+  protected:
+    uint16_t index;
+};
+
 /*
  * Screen for showing station sensor data
  */ 
@@ -170,4 +190,28 @@ inline bool DisplayScreen_MiFloraAttributes::pageSelect(uint16_t page) {
   return true;
 }
 
+/* inlines for DisplayScreen_Zones */
+inline uint16_t DisplayScreen_Zones::pageCount() {
+  return fleet.zones().size();
+}
+inline uint16_t DisplayScreen_Zones::pageNext() {
+  if (pageCount() == 0) return 0;
+  index = (index + 1) % pageCount();
+  return index;
+}
+inline uint16_t DisplayScreen_Zones::pagePrev() {
+  if (pageCount() == 0) return 0;
+  index = (index == 0 ? pageCount() : index) - 1;
+  return index;
+}
+inline uint16_t DisplayScreen_Zones::pageIndex() {
+  return index;
+}
+inline bool DisplayScreen_Zones::pageSelect(uint16_t page) {
+  if (page >= pageCount())
+    return false;
+  index = page;
+  return true;
+}
+
 #endif//_UI_H_
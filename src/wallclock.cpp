@@ -0,0 +1,59 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "wallclock.h"
+#include "config.h"
+
+#define LOG_TAG LOG_TAG_MAIN
+#include "log.h"
+
+WallClock wallclock;
+
+WallClock::WallClock()
+  : _last_ms(0)
+  , _wraps(0) {
+}
+
+/* 
+ * Seconds since boot, going on past the wrap of millis() after 49.7 days.
+ * A wrap is noticed by the next call, so this must be called at least
+ * once in that time; the stale task of the fleet calls it every second.
+ */
+uint32_t WallClock::uptime() {
+
+  uint32_t ms = millis();
+  if (ms < _last_ms)
+    _wraps ++;
+  _last_ms = ms;
+
+  return (uint32_t) ((((uint64_t) _wraps << 32) | ms) / 1000);
+}
+
+void WallClock::begin() {
+
+  // SNTP starts polling by itself when the network comes up
+  configTzTime(config.ntp_timezone, config.ntp_server);
+  LOG_F("NTP server:%s timezone:%s", config.ntp_server, config.ntp_timezone);
+}
@@ -0,0 +1,75 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _WALLCLOCK_H_
+#define _WALLCLOCK_H_
+
+#include <Arduino.h>
+#include <time.h>
+
+/*
+ * Wall clock, synchronized over NTP once the network is up.
+ *
+ * Until the first synchronization the clock is not valid, and anything
+ * needing absolute time must check isSynced() first.
+ */
+class WallClock {
+
+  public:
+    /* anything before this is considered not synchronized (2021-01-01) */
+    static const time_t VALID_AFTER = 1609459200;
+
+  public:
+    WallClock();
+
+    void     begin();
+
+    bool     isSynced();
+    uint32_t now();
+    uint32_t uptime();
+    uint32_t fromUptime(uint32_t uptime_sec);
+
+  protected:
+    uint32_t _last_ms;
+    uint32_t _wraps;
+};
+
+extern WallClock wallclock;
+
+/* inlines for WallClock */
+inline bool WallClock::isSynced() {
+  return time(NULL) > VALID_AFTER;
+}
+
+inline uint32_t WallClock::now() {
+  return (uint32_t) time(NULL);
+}
+
+/* convert uptime seconds (see uptime()) to epoch seconds, clock must be synced */
+inline uint32_t WallClock::fromUptime(uint32_t uptime_sec) {
+  return now() - (uptime() - uptime_sec);
+}
+
+#endif//_WALLCLOCK_H_
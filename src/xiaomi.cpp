@@ -130,6 +130,7 @@ bool parse_xiaomi_message(const std::vector<uint8_t> &message, struct XiaomiPars
   }
   
   last_frame_count = message[4];
+  result.frame_count = message[4];
   result.is_duplicate = false;
   result.raw_offset = result.has_capability ? 12 : 11;
 
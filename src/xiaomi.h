@@ -73,6 +73,7 @@ struct XiaomiParseResult {
   bool has_capability;  // 0x20
   bool has_encryption;  // 0x08
   bool is_duplicate;    // true if the packet is duplicate
+  uint8_t frame_count;  // frame counter of the device
   int raw_offset;
 };
 
@@ -0,0 +1,137 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include <ctype.h>
+
+#include "zone.h"
+#include "mqtt.h"
+
+#define LOG_TAG LOG_TAG_FLEET
+#include "log.h"
+
+Zone::Zone(const char * zone_name)
+  : name(zone_name)
+  , dirty(true) {
+
+  // id usable in topics and HASS unique ids: "Living room" => "living_room"
+  for (const char * ch = zone_name; *ch; ++ ch) {
+    if (isalnum((unsigned char) *ch)) {
+      id.push_back(tolower((unsigned char) *ch));
+    } else
+    if (id.empty() == false && id.back() != '_') {
+      id.push_back('_');
+    }
+  }
+  while (id.empty() == false && id.back() == '_') {
+    id.pop_back();
+  }
+}
+
+/* add a plant, returns the slot to report its updates with */
+int Zone::addMember(MiFloraDevice * device) {
+
+  // plants start unavailable until heard of
+  members.push_back(device);
+  dirty = true;
+
+  return totals.add();
+}
+
+bool Zone::isOutOfLimits(MiFloraDevice * device) {
+
+  for (unsigned int i = 0 ; i < device->attributeCount(); ++ i) {
+    DeviceAttribute * attr = device->attributeAt(i);
+    if (attr->hasValue() && attr->inLimits() == false)
+      return true;
+  }
+  return false;
+}
+
+/* replace the member's old contribution with the current one */
+void Zone::onMemberUpdate(int slot) {
+
+  MiFloraDevice * device = members[slot];
+  ZoneTotals::Member_t contribution;
+
+  contribution.has_moisture  = device->moisture.hasValue();
+  contribution.moisture      = device->moisture.get();
+  contribution.out_of_limits = isOutOfLimits(device);
+  contribution.stale         = device->isAvailable() == false;
+
+  if (totals.update(slot, contribution)) {
+    dirty = true;
+  }
+}
+
+/* the zone goes with its first available member, so one station publishes it */
+bool Zone::publishes() {
+
+  for (auto device : members) {
+    if (device->isAvailable())
+      return device->publishes();
+  }
+  return true;
+}
+
+/* publish the zone values if they changed since the last time */
+bool Zone::publish() {
+
+  std::string topic;
+  std::string subtopic("zone/");
+  char value[16];
+  bool success = true;
+
+  if (dirty == false || publishes() == false)
+    return true;
+
+  subtopic.append(id);
+
+  // "None" makes HASS show the sensor as unknown
+  if (hasMoisture()) {
+    sprintf(value, "%.1f", moistureMean());
+  } else {
+    strcpy(value, "None");
+  }
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, subtopic.c_str(), "moisture_mean");
+  success &= mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
+
+  if (hasMoisture()) {
+    sprintf(value, "%.1f", moistureMin());
+  }
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, subtopic.c_str(), "moisture_min");
+  success &= mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
+
+  sprintf(value, "%u", outOfLimits());
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, subtopic.c_str(), "out_of_limits");
+  success &= mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
+
+  sprintf(value, "%u", stale());
+  config.formatTopic(topic, ConfigMain::MQTT_TOPIC_FLORA, subtopic.c_str(), "stale");
+  success &= mqtt.publish(topic.c_str(), value, config.flora_mqtt_retain);
+
+  // retry next time if anything failed
+  dirty = !success;
+  return success;
+}
@@ -0,0 +1,112 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#ifndef _ZONE_H_
+#define _ZONE_H_
+
+#include <Arduino.h>
+#include <vector>
+#include <string>
+
+#include "device.h"
+#include "zone_totals.h"
+
+/*
+ * Group of plants sharing a place (room, bench..), set with "zone = " in
+ * devices.cfg.
+ *
+ * The zone keeps the contribution of each member and updates its totals
+ * (ZoneTotals) when a member changes, without going over the fleet: mean and
+ * minimum moisture, plants out of limits and plants gone stale.
+ *
+ * Values are published (retained) on <flora_base_topic>/zone/<zone_id>/<value>,
+ * by the station publishing the first available member, as every collaborating
+ * station has the same totals, or by all of them when no member is available.
+ */
+class Zone {
+
+  public:
+    Zone(const char * name);
+
+    const std::string & getName();
+    const std::string & getID();
+
+    int                 addMember(MiFloraDevice * device);
+    void                onMemberUpdate(int slot);
+    unsigned int        memberCount();
+
+    bool                hasMoisture();
+    float               moistureMean();
+    float               moistureMin();
+    unsigned int        outOfLimits();
+    unsigned int        stale();
+
+    bool                publishes();
+    bool                publish();
+
+    static bool         isOutOfLimits(MiFloraDevice * device);
+
+  protected:
+    std::string                  name;
+    std::string                  id;
+    std::vector<MiFloraDevice *> members;
+    ZoneTotals                   totals;
+    bool                         dirty;
+};
+
+/* inlines for Zone */
+inline const std::string & Zone::getName() {
+  return name;
+}
+
+inline const std::string & Zone::getID() {
+  return id;
+}
+
+inline unsigned int Zone::memberCount() {
+  return members.size();
+}
+
+inline bool Zone::hasMoisture() {
+  return totals.hasMoisture();
+}
+
+inline float Zone::moistureMean() {
+  return totals.moistureMean();
+}
+
+inline float Zone::moistureMin() {
+  return totals.moistureMin();
+}
+
+inline unsigned int Zone::outOfLimits() {
+  return totals.outOfLimits();
+}
+
+inline unsigned int Zone::stale() {
+  return totals.stale();
+}
+
+#endif//_ZONE_H_
@@ -0,0 +1,111 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+#include "zone_totals.h"
+
+ZoneTotals::ZoneTotals()
+  : moisture_sum(0)
+  , moisture_count(0)
+  , moisture_min(0)
+  , out_of_limits(0)
+  , stale_count(0) {
+}
+
+/* add a member, returns its slot */
+int ZoneTotals::add() {
+
+  Member_t member = { false, 0, false, true };
+
+  // members start unavailable until heard of
+  members.push_back(member);
+  stale_count ++;
+
+  return members.size() - 1;
+}
+
+/* replace the member's old contribution, returns whether it changed */
+bool ZoneTotals::update(int slot, const Member_t & contribution) {
+
+  Member_t & member  = members[slot];
+  bool       changed = false;
+
+  // moisture mean and minimum
+  bool  has_moisture = contribution.has_moisture;
+  float moisture     = has_moisture ? contribution.moisture : 0;
+  bool  was_min      = member.has_moisture && member.moisture <= moisture_min;
+
+  if (member.has_moisture) {
+    moisture_sum -= member.moisture;
+    moisture_count --;
+  }
+  if (has_moisture) {
+    moisture_sum += moisture;
+    moisture_count ++;
+  }
+  if (moisture_count == 0) {
+    moisture_sum = 0; // no rounding left overs
+  }
+
+  if (has_moisture != member.has_moisture || moisture != member.moisture) {
+    changed = true;
+  }
+
+  member.has_moisture = has_moisture;
+  member.moisture     = moisture;
+
+  if (has_moisture && (moisture_count == 1 || moisture < moisture_min)) {
+    moisture_min = moisture;
+  } else
+  if (was_min) {
+    recomputeMin();
+  }
+
+  // members out of limits
+  if (contribution.out_of_limits != member.out_of_limits) {
+    out_of_limits += contribution.out_of_limits ? 1 : -1;
+    member.out_of_limits = contribution.out_of_limits;
+    changed = true;
+  }
+
+  // members not heard of
+  if (contribution.stale != member.stale) {
+    stale_count += contribution.stale ? 1 : -1;
+    member.stale = contribution.stale;
+    changed = true;
+  }
+  return changed;
+}
+
+void ZoneTotals::recomputeMin() {
+
+  bool found = false;
+
+  for (auto & member : members) {
+    if (member.has_moisture && (found == false || member.moisture < moisture_min)) {
+      moisture_min = member.moisture;
+      found = true;
+    }
+  }
+}
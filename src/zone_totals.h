@@ -0,0 +1,104 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+#ifndef _ZONE_TOTALS_H_
+#define _ZONE_TOTALS_H_
+
+#include <vector>
+
+/*
+ * Running totals of a zone over what each member contributes.
+ *
+ * This file does not depend on Arduino, so it can be tested on the host.
+ *
+ * A member contributes its moisture, if it has one, whether it is out of
+ * limits and whether it is stale. An update swaps the member's old
+ * contribution for the new one, without going over the other members:
+ * only the minimum is recomputed, when the member holding it rises or
+ * loses its value.
+ */
+class ZoneTotals {
+
+  public:
+    /* what a member currently adds to the totals */
+    typedef struct {
+      bool  has_moisture;
+      float moisture;
+      bool  out_of_limits;
+      bool  stale;
+    } Member_t;
+
+  public:
+    ZoneTotals();
+
+    int          add();
+    bool         update(int slot, const Member_t & contribution);
+
+    unsigned int count();
+    bool         hasMoisture();
+    float        moistureMean();
+    float        moistureMin();
+    unsigned int outOfLimits();
+    unsigned int stale();
+
+  protected:
+    std::vector<Member_t> members;
+
+    double                moisture_sum;  // float would drift over fractional values
+    unsigned int          moisture_count;
+    float                 moisture_min;
+    unsigned int          out_of_limits;
+    unsigned int          stale_count;
+
+    void                  recomputeMin();
+};
+
+/* inlines for ZoneTotals */
+inline unsigned int ZoneTotals::count() {
+  return members.size();
+}
+
+inline bool ZoneTotals::hasMoisture() {
+  return moisture_count > 0;
+}
+
+inline float ZoneTotals::moistureMean() {
+  return moisture_count ? moisture_sum / moisture_count : 0;
+}
+
+inline float ZoneTotals::moistureMin() {
+  return moisture_min;
+}
+
+inline unsigned int ZoneTotals::outOfLimits() {
+  return out_of_limits;
+}
+
+inline unsigned int ZoneTotals::stale() {
+  return stale_count;
+}
+
+#endif//_ZONE_TOTALS_H_
@@ -0,0 +1,131 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host simulation of the MQTT write batching (src/batch_client.cpp): the
+ * writes of the MQTT clients go through BatchClient into a link counting
+ * TCP segments, and the WiFi airtime of the segments and of the broker's
+ * ACKs is estimated, with and without batching.
+ *
+ * Build:
+ *   g++ -O2 -I../host -I../../src -I../../include -o batchsim batchsim.cpp \
+ *     ../../src/batch_client.cpp
+ *
+ * Usage:
+ *   ./batchsim
+ *
+ * Airtime model: 802.11n MCS7 (65 Mbit/s), 150 us of preamble, DIFS, mean
+ * backoff, SIFS and MAC ACK per frame, 76 bytes of TCP/IP and 802.11/LLC
+ * headers per segment, one segment per write without batching (Nagle off)
+ * and a delayed ACK from the broker for every second segment. Not measured
+ * on hardware.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "batch_client.h"
+
+static const double FRAME_US       = 40 + 50 + 44 + 16;
+static const double BYTES_PER_US   = 65e6 / 8 / 1e6;
+static const size_t HEADERS        = 40 + 36;
+
+static double _airtime(size_t payload) {
+  return FRAME_US + (payload + HEADERS) / BYTES_PER_US;
+}
+
+/* network client counting what would go on the air */
+class Link : public Client {
+  public:
+    unsigned long segments = 0;
+    double        airtime  = 0;
+
+    size_t write(const uint8_t *, size_t size) override {
+      for (size_t left = size; left > 0; ) {
+        size_t segment = left < MQTT_BATCH_SIZE ? left : MQTT_BATCH_SIZE;
+        ++ segments;
+        airtime += _airtime(segment);
+        left    -= segment;
+      }
+      return size;
+    }
+    size_t  write(uint8_t data) override            { return write(&data, 1); }
+    int     connect(IPAddress, uint16_t) override   { return 1; }
+    int     connect(const char *, uint16_t) override { return 1; }
+    int     available() override                    { return 0; }
+    int     read() override                         { return -1; }
+    int     read(uint8_t *, size_t) override        { return 0; }
+    int     peek() override                         { return -1; }
+    void    flush() override                        {}
+    void    stop() override                         {}
+    uint8_t connected() override                    { return 1; }
+    operator bool() override                        { return true; }
+};
+
+/* packets of the same size, each made of the given writes, flushed every burst */
+static void _run(const char * name, unsigned int packets, std::vector<size_t> writes, unsigned int burst) {
+
+  static uint8_t data[2048];
+  size_t packet = 0;
+  for (size_t w : writes)
+    packet += w;
+
+  printf("%s: %u packets of %zu B in %zu writes, %u per burst\n", name, packets, packet, writes.size(), burst);
+
+  for (int batching = 0; batching < 2; ++ batching) {
+
+    Link        link;
+    BatchClient client(link);
+    client.setBatching(batching, MQTT_BATCH_DEADLINE_MS);
+
+    for (unsigned int p = 0; p < packets; ++ p) {
+      for (size_t w : writes)
+        client.write(data, w);
+      if ((p + 1) % burst == 0)
+        client.flush();
+    }
+    client.flush();
+
+    double acks = ((link.segments + 1) / 2) * _airtime(0);
+    printf("  %-10s %5lu writes, %4lu segments, station %7.1f us, broker ACKs %6.1f us\n",
+      batching ? "batched" : "unbatched", client.writes(), link.segments, link.airtime, acks);
+  }
+}
+
+int main() {
+
+  // readings of 12 plants, 6 values each, drained from the queue in bursts
+  _run("readings, QoS 0",  72, { 95 }, MQTT_QUEUE_BURST);
+
+  // QoS 1 PUBLISH: header and topic length, topic, packet id, payload
+  _run("readings, QoS 1",  72, { 4, 80, 2, 11 }, MQTT_QUEUE_BURST);
+
+  // discovery configs, larger than the PubSubClient buffer: header and topic, then payload,
+  // published directly and written out by the deadline
+  _run("discovery",        60, { 80, 540 }, 60);
+  return 0;
+}
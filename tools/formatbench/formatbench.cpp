@@ -0,0 +1,210 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host benchmark of the periodic publish path (src/number_format.cpp,
+ * src/topic_arena.cpp): a plant value formatted, its topic made and the
+ * reading and TX lines logged, as before with std::string, sprintf and
+ * printf, and as now. Heap allocations are counted by replacing operator
+ * new and by modelling the malloc of Arduino's Print::printf for output
+ * longer than its 64 byte buffer.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o formatbench formatbench.cpp \
+ *     ../../src/number_format.cpp ../../src/topic_arena.cpp
+ *
+ * Usage:
+ *   ./formatbench [publishes]
+ *
+ * formatFixed() and formatInt() are checked against printf first, the
+ * benchmark exits with 1 on a mismatch. Host timings, not ESP32 ones.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <string>
+
+#include "number_format.h"
+#include "topic_arena.h"
+
+static size_t          _allocs;
+static char            _sink[256];
+static volatile size_t _sink_len;
+
+void * operator new(size_t size) {
+  ++ _allocs;
+  void * p = malloc(size);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+void operator delete(void * p) noexcept         { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+
+static const char *  BASE     = "miflora_rbs";
+static const char *  ADDRESS  = "c4:7c:8d:6a:12:34";
+static const char *  NAME     = "Ficus benjamina living room";
+static const char *  LEVELS[] = { "temp", "conductivity", "light", "moisture" };
+static const float   VALUES[] = { 21.37f, 412, 1380, 37 };
+
+/* Print::printf, a 64 byte buffer on the stack, malloc when longer */
+static void _printf(const char * format, ...) {
+
+  char    local[64];
+  char *  buffer = local;
+  va_list args;
+
+  va_start(args, format);
+  int len = vsnprintf(local, sizeof(local), format, args);
+  va_end(args);
+
+  if (len >= (int) sizeof(local)) {
+    buffer = (char *) malloc(len + 1);
+    ++ _allocs;
+    va_start(args, format);
+    vsnprintf(buffer, len + 1, format, args);
+    va_end(args);
+  }
+  _sink_len = len;
+  if (buffer != local)
+    free(buffer);
+}
+
+static void _print(const char * text) {
+  _sink_len += strlen(text);
+}
+
+static void _publish(const char * topic, const char * payload, size_t length) {
+  size_t topic_len = strlen(topic);
+  memcpy(_sink, topic, topic_len);
+  memcpy(_sink + topic_len, payload, length);
+  _sink_len = topic_len + length;
+}
+
+static void _formatTopic(std::string & result, const char * address, const char * level) {
+  result.assign(BASE);
+  result.append("/");
+  result.append(address);
+  result.append("/");
+  result.append(level);
+}
+
+static int _check() {
+
+  char expected[32], text[NUMBER_FORMAT_SIZE];
+  int  mismatches = 0;
+
+  for (int i = -100000; i <= 100000; ++ i) {
+    float value = i * 0.00137f;
+    snprintf(expected, sizeof(expected), "%.2f", value);
+    NumberFormat::formatFixed(text, value, 2);
+    // no "-0.00" on purpose
+    if (strcmp(expected, text) != 0 && strcmp(expected, "-0.00") != 0) {
+      if (mismatches ++ < 5)
+        printf("  %.9g: printf %s, formatFixed %s\n", value, expected, text);
+    }
+  }
+  // exact binary ties, rounded half to even as printf does
+  for (float value : { 0.125f, 0.375f, 2.5f, 1.0625f }) {
+    for (unsigned int decimals = 0; decimals <= 3; ++ decimals) {
+      snprintf(expected, sizeof(expected), "%.*f", decimals, value);
+      NumberFormat::formatFixed(text, value, decimals);
+      if (strcmp(expected, text) != 0 && mismatches ++ < 5)
+        printf("  %.9g: printf %s, formatFixed %s\n", value, expected, text);
+    }
+  }
+  for (long i = -3000000; i < 3000000; i += 7) {
+    snprintf(expected, sizeof(expected), "%ld", i);
+    NumberFormat::formatInt(text, i);
+    if (strcmp(expected, text) != 0)
+      ++ mismatches;
+  }
+  return mismatches;
+}
+
+int main(int argc, char ** argv) {
+
+  const int publishes = argc > 1 ? atoi(argv[1]) : 1000000;
+  char      value[NUMBER_FORMAT_SIZE];
+  size_t    len;
+
+  int mismatches = _check();
+  printf("formatFixed/formatInt against printf: %d mismatches\n", mismatches);
+
+  // before: std::string topic, sprintf value, printf log lines
+  _allocs = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < publishes; ++ i) {
+    int         k = i & 3;
+    std::string topic;
+
+    if (k == 0)
+      len = sprintf(value, "%.2f", VALUES[k] + (i % 50) * 0.01f);
+    else
+      len = sprintf(value, "%u", (unsigned int) VALUES[k]);
+
+    _formatTopic(topic, ADDRESS, LEVELS[k]);
+    _publish(topic.c_str(), value, len);
+    _printf("[DEVICE] From BLE %s %s->%s\r\n", NAME, LEVELS[k], value);
+    _printf("\x1b[32mTX %3uB\x1b[0m T:%s %s%s\r\n", (unsigned int) len, topic.c_str(), "", "");
+  }
+  double before_ns     = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  size_t before_allocs = _allocs;
+
+  // now: the topic from the arena, the value and the log lines without printf
+  TopicArena  arena;
+  std::string prefix;
+  _formatTopic(prefix, ADDRESS, "");
+  uint16_t id = arena.add(prefix.c_str(), 16);
+
+  _allocs = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < publishes; ++ i) {
+    int k = i & 3;
+
+    if (k == 0)
+      len = NumberFormat::formatFixed(value, VALUES[k] + (i % 50) * 0.01f, 2);
+    else
+      len = NumberFormat::formatUInt(value, (unsigned int) VALUES[k]);
+
+    const char * topic = arena.topic(id, LEVELS[k]);
+    _publish(topic, value, len);
+    _print("[DEVICE] From BLE "); _print(NAME); _print(" "); _print(LEVELS[k]); _print("->"); _print(value);
+    _print("\x1b[32mTX "); _print(value); _print("B\x1b[0m T:"); _print(topic);
+  }
+  double after_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%d publishes of the four plant values:\n", publishes);
+  printf("  before: %.2f allocations per publish, %4.0f ns\n", (double) before_allocs / publishes, before_ns / publishes);
+  printf("  after:  %.2f allocations per publish, %4.0f ns\n", (double) _allocs / publishes, after_ns / publishes);
+  printf("  topic arena: %zu bytes per plant, %zu for four topics\n", 
+    arena.size(), 4 * (prefix.size() + 1) + strlen("temp") + strlen("conductivity") + strlen("light") + strlen("moisture"));
+  return mismatches ? 1 : 0;
+}
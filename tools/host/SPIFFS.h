@@ -0,0 +1,139 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+/*
+ * Host stand-in for the SPIFFS file system, files kept in RAM by name. A
+ * write budget makes writes stop part way, as a reset or a full file system
+ * would, for the tools to check what is recovered. Operations are counted.
+ */
+
+#ifndef _HOST_SPIFFS_H_
+#define _HOST_SPIFFS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+/* the files and the counters */
+struct HostSPIFFS {
+  std::map<std::string, std::vector<uint8_t> > files;
+  size_t   write_budget;   // bytes written before writes fail, SIZE_MAX for no limit
+  uint64_t bytes_written;
+  uint64_t bytes_read;
+  uint32_t opens;
+
+  void init() {
+    files.clear();
+    write_budget  = SIZE_MAX;
+    bytes_written = bytes_read = 0;
+    opens = 0;
+  }
+};
+
+inline HostSPIFFS & hostSPIFFS() {
+  static HostSPIFFS fs = { {}, SIZE_MAX, 0, 0, 0 };
+  return fs;
+}
+
+class File {
+
+  public:
+    File() : _data(NULL), _position(0), _writable(false) {}
+    File(std::vector<uint8_t> * data, bool writable) 
+      : _data(data), _position(writable ? data->size() : 0), _writable(writable) {}
+
+    operator bool() const { return _data != NULL; }
+
+    size_t read(uint8_t * buffer, size_t size) {
+      if (_data == NULL || _position >= _data->size()) return 0;
+      if (size > _data->size() - _position) size = _data->size() - _position;
+      memcpy(buffer, &(*_data)[_position], size);
+      _position += size;
+      hostSPIFFS().bytes_read += size;
+      return size;
+    }
+
+    size_t write(const uint8_t * buffer, size_t size) {
+      HostSPIFFS & fs = hostSPIFFS();
+      if (_data == NULL || _writable == false) return 0;
+      if (size > fs.write_budget) size = fs.write_budget;
+      if (fs.write_budget != SIZE_MAX) fs.write_budget -= size;
+      _data->insert(_data->end(), buffer, buffer + size);
+      _position = _data->size();
+      fs.bytes_written += size;
+      return size;
+    }
+
+    bool   seek(size_t position) {
+      if (_data == NULL || position > _data->size()) return false;
+      _position = position;
+      return true;
+    }
+
+    size_t size() const     { return _data ? _data->size() : 0; }
+    size_t position() const { return _position; }
+    void   close()          { _data = NULL; }
+
+  protected:
+    std::vector<uint8_t> * _data;
+    size_t                 _position;
+    bool                   _writable;
+};
+
+class HostFS {
+
+  public:
+    bool exists(const char * path) { 
+      return hostSPIFFS().files.count(path) > 0; 
+    }
+
+    bool remove(const char * path) { 
+      return hostSPIFFS().files.erase(path) > 0; 
+    }
+
+    File open(const char * path, const char * mode) {
+      HostSPIFFS & fs = hostSPIFFS();
+      fs.opens ++;
+      if (strcmp(mode, FILE_READ) == 0) {
+        auto found = fs.files.find(path);
+        return found == fs.files.end() ? File() : File(&found->second, false);
+      }
+      std::vector<uint8_t> & data = fs.files[path];
+      if (strcmp(mode, FILE_WRITE) == 0)
+        data.clear();
+      return File(&data, true);
+    }
+};
+
+inline HostFS SPIFFS;
+
+#endif//_HOST_SPIFFS_H_
@@ -0,0 +1,74 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host stand-in for the task scheduler: tasks are declared and enabled but
+ * never run, the tools call the task callbacks themselves.
+ */
+
+#ifndef _HOST_TASK_SCHEDULER_H_
+#define _HOST_TASK_SCHEDULER_H_
+
+#define TASK_MILLISECOND 1UL
+#define TASK_SECOND      1000UL
+#define TASK_MINUTE      60000UL
+#define TASK_HOUR        3600000UL
+#define TASK_FOREVER     (-1)
+#define TASK_ONCE        1
+
+typedef void (*TaskCallback)();
+
+class Scheduler {
+  public:
+    bool execute() { return true; }
+};
+
+class Task {
+  public:
+    Task(unsigned long interval = 0, long iterations = 0, TaskCallback callback = NULL,
+         Scheduler * scheduler = NULL, bool enable = false)
+      : _interval(interval), _callback(callback), _enabled(enable) { (void) iterations; (void) scheduler; }
+
+    void          setInterval(unsigned long interval) { _interval = interval; }
+    unsigned long getInterval()                       { return _interval; }
+    bool          enable()                            { return _enabled = true; }
+    bool          enableDelayed(unsigned long = 0)    { return _enabled = true; }
+    bool          enableIfNot()                       { bool was = _enabled; _enabled = true; return was; }
+    bool          disable()                           { bool was = _enabled; _enabled = false; return was; }
+    bool          restart()                           { return _enabled = true; }
+    bool          restartDelayed(unsigned long = 0)   { return _enabled = true; }
+    bool          isEnabled()                         { return _enabled; }
+
+    /* run the callback in place of the scheduler */
+    void          run()                               { if (_callback) _callback(); }
+
+  private:
+    unsigned long _interval;
+    TaskCallback  _callback;
+    bool          _enabled;
+};
+
+#endif//_HOST_TASK_SCHEDULER_H_
@@ -0,0 +1,132 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host stand-in for the ESP-IDF partition API, over one partition kept in
+ * RAM with NOR flash semantics: erase sets whole sectors to 0xFF, writes
+ * can only clear bits. Operations are counted for the tools to report.
+ */
+
+#ifndef _HOST_ESP_PARTITION_H_
+#define _HOST_ESP_PARTITION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+typedef int esp_err_t;
+#define ESP_OK                    0
+#define ESP_FAIL                  -1
+#define SPI_FLASH_SEC_SIZE        4096
+
+typedef enum { ESP_PARTITION_TYPE_APP = 0, ESP_PARTITION_TYPE_DATA = 1 } esp_partition_type_t;
+typedef enum { ESP_PARTITION_SUBTYPE_ANY = 0xff } esp_partition_subtype_t;
+typedef enum { SPI_FLASH_MMAP_DATA, SPI_FLASH_MMAP_INST } spi_flash_mmap_memory_t;
+typedef uint32_t spi_flash_mmap_handle_t;
+
+typedef struct {
+  esp_partition_type_t    type;
+  esp_partition_subtype_t subtype;
+  uint32_t                address;
+  uint32_t                size;
+  char                    label[17];
+  bool                    encrypted;
+} esp_partition_t;
+
+/* the partition, its contents and its counters */
+struct HostPartition {
+  esp_partition_t      info;
+  std::vector<uint8_t> flash;
+  uint64_t             bytes_written;
+  uint64_t             bytes_erased;
+  uint32_t             writes;
+  uint32_t             erases;
+  uint32_t             bad_writes;   // writes that tried setting bits back to 1
+
+  void init(const char * label, uint32_t size) {
+    memset(&info, 0, sizeof(info));
+    info.type = ESP_PARTITION_TYPE_DATA;
+    info.size = size;
+    strncpy(info.label, label, sizeof(info.label) - 1);
+    flash.assign(size, 0xFF);
+    bytes_written = bytes_erased = 0;
+    writes = erases = bad_writes = 0;
+  }
+};
+
+inline HostPartition & hostPartition() {
+  static HostPartition partition;
+  return partition;
+}
+
+inline const esp_partition_t * esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char * label) {
+  HostPartition & p = hostPartition();
+  return (p.info.size && strcmp(p.info.label, label) == 0) ? &p.info : NULL;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t *, size_t offset, void * dst, size_t size) {
+  HostPartition & p = hostPartition();
+  if (offset + size > p.flash.size()) return ESP_FAIL;
+  memcpy(dst, &p.flash[offset], size);
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t *, size_t offset, const void * src, size_t size) {
+  HostPartition & p = hostPartition();
+  const uint8_t * bytes = (const uint8_t *) src;
+  if (offset + size > p.flash.size()) return ESP_FAIL;
+  for (size_t i = 0; i < size; ++ i) {
+    if ((bytes[i] & ~p.flash[offset + i]) != 0) ++ p.bad_writes;
+    p.flash[offset + i] &= bytes[i];
+  }
+  p.bytes_written += size;
+  ++ p.writes;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t offset, size_t size) {
+  HostPartition & p = hostPartition();
+  if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE || offset + size > p.flash.size()) return ESP_FAIL;
+  memset(&p.flash[offset], 0xFF, size);
+  p.bytes_erased += size;
+  p.erases += size / SPI_FLASH_SEC_SIZE;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_partition_mmap(const esp_partition_t *, size_t offset, size_t size,
+    spi_flash_mmap_memory_t, const void ** out, spi_flash_mmap_handle_t * handle) {
+  HostPartition & p = hostPartition();
+  if (offset + size > p.flash.size()) return ESP_FAIL;
+  *out    = &p.flash[offset];
+  *handle = 1;
+  return ESP_OK;
+}
+
+inline void spi_flash_munmap(spi_flash_mmap_handle_t) {
+}
+
+#endif//_HOST_ESP_PARTITION_H_
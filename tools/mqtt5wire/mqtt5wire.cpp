@@ -0,0 +1,167 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host check of the MQTT 5 codec (src/mqtt5_codec.cpp) and of the bytes it
+ * puts on the wire, against MQTT 3.1.1, for the messages of one BLE frame.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o mqtt5wire mqtt5wire.cpp ../../src/mqtt5_codec.cpp
+ *
+ * Usage:
+ *   ./mqtt5wire
+ *
+ * Sizes are of QoS 0 PUBLISH packets with a station named station1. The
+ * 3.1.1 size is computed from the fixed header, topic and payload, as
+ * PubSubClient writes them. Alias sizes are those after the first message
+ * of a topic, which also sends its name. Before the table, encoded packets
+ * are decoded back and the topic aliases are exercised; any mismatch fails
+ * the run.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mqtt5_codec.h"
+
+static int _errors = 0;
+
+#define CHECK(cond) { if (!(cond)) { printf("FAILED: %s (line %d)\n", #cond, __LINE__); ++ _errors; } }
+
+static size_t _size311(const char * topic, size_t payload) {
+  size_t remaining = 2 + strlen(topic) + payload;
+  return 1 + MQTT5Codec::varintSize(remaining) + remaining;
+}
+
+static size_t _size5(const char * topic, size_t payload, bool alias, const char * station) {
+
+  uint8_t buffer[256];
+  MQTT5Codec::Publish_t publish;
+
+  memset(&publish, 0, sizeof(publish));
+  publish.topic       = alias ? "" : topic;
+  publish.topic_len   = strlen(publish.topic);
+  publish.topic_alias = alias ? 1 : 0;
+  publish.user_key    = station ? "station" : NULL;
+  publish.user_value  = station;
+  publish.payload_len = payload;
+
+  return MQTT5Codec::encodePublish(buffer, sizeof(buffer), publish) + payload;
+}
+
+/* encode and decode back a PUBLISH, a CONNACK, and topic aliases */
+static void _roundTrips() {
+
+  uint8_t buffer[512];
+  MQTT5Codec::Publish_t publish;
+
+  memset(&publish, 0, sizeof(publish));
+  publish.topic       = "a/b/c";
+  publish.topic_len   = 5;
+  publish.topic_alias = 3;
+  publish.qos         = 1;
+  publish.packet_id   = 77;
+  publish.expiry      = 600;
+  publish.user_key    = "station";
+  publish.user_value  = "st1";
+  publish.payload_len = 4;
+
+  size_t len = MQTT5Codec::encodePublish(buffer, sizeof(buffer), publish);
+  memcpy(buffer + len, "1234", 4);
+  len += 4;
+
+  // remaining length, then the body
+  size_t   pos = 1;
+  uint32_t remaining = 0;
+  for (int shift = 0; pos < len; shift += 7) {
+    uint8_t digit = buffer[pos ++];
+    remaining |= (uint32_t) (digit & 0x7F) << shift;
+    if ((digit & 0x80) == 0) break;
+  }
+  CHECK(pos + remaining == len);
+
+  MQTT5Codec::Received_t received;
+  CHECK(MQTT5Codec::decodePublish(buffer[0] & 0x0F, buffer + pos, remaining, received));
+  CHECK(strcmp(received.topic, "a/b/c") == 0);
+  CHECK(received.payload_len == 4 && memcmp(received.payload, "1234", 4) == 0);
+  CHECK(received.packet_id == 77 && received.qos == 1);
+
+  // session present, success, topic alias maximum 10, receive maximum 20, reason string
+  uint8_t connack[] = { 1, 0, 11, 0x22, 0, 10, 0x21, 0, 20, 0x1F, 0, 2, 'o', 'k' };
+  MQTT5Codec::Connack_t ack;
+  CHECK(MQTT5Codec::decodeConnack(connack, sizeof(connack), ack));
+  CHECK(ack.session_present && ack.topic_alias_maximum == 10 && ack.receive_maximum == 20);
+
+  // two aliases, the idle one is reassigned
+  MQTT5TopicAliases aliases;
+  bool is_new;
+  aliases.reset(2);
+  CHECK(aliases.lookup("x", 0, 100, is_new) == 1 && is_new);
+  CHECK(aliases.lookup("y", 1, 100, is_new) == 2 && is_new);
+  CHECK(aliases.lookup("x", 2, 100, is_new) == 1 && is_new == false);
+  CHECK(aliases.lookup("z", 50, 100, is_new) == 0);
+  CHECK(aliases.lookup("z", 102, 100, is_new) == 2 && is_new);
+}
+
+int main() {
+
+  static const struct {
+    const char * topic;
+    size_t       payload;
+    bool         frame;     // part of what one BLE frame publishes
+  } messages[] = {
+    { "miflora_rbs/c4:7c:8d:6a:5c:ff/conductivity",   3, true  },
+    { "miflora_rbs/c4:7c:8d:6a:5c:ff/moisture",       2, true  },
+    { "miflora_rbs/c4:7c:8d:6a:5c:ff/temp",           4, true  },
+    { "miflora_rbs/c4:7c:8d:6a:5c:ff/light",          4, true  },
+    { "miflora_rbs/collab",                          29, true  },
+    { "miflora_rbs/c4:7c:8d:6a:5c:ff/state",        160, false },
+  };
+
+  _roundTrips();
+
+  size_t frame311 = 0, frame5 = 0, frame5_alias = 0, frame5_station = 0;
+
+  printf("%-44s %5s %5s %8s %13s\n", "topic", "3.1.1", "v5", "v5 alias", "alias+station");
+  for (auto & m : messages) {
+    size_t s311     = _size311(m.topic, m.payload);
+    size_t s5       = _size5(m.topic, m.payload, false, NULL);
+    size_t sAlias   = _size5(m.topic, m.payload, true, NULL);
+    size_t sStation = _size5(m.topic, m.payload, true, "station1");
+
+    printf("%-44s %5zu %5zu %8zu %13zu\n", m.topic, s311, s5, sAlias, sStation);
+    if (m.frame) {
+      frame311       += s311;
+      frame5         += s5;
+      frame5_alias   += sAlias;
+      frame5_station += sStation;
+    }
+  }
+  printf("one BLE frame (4 values and a collab record): 3.1.1 %zu B, v5 %zu B, alias %zu B, alias+station %zu B\n",
+    frame311, frame5, frame5_alias, frame5_station);
+
+  return _errors ? 1 : 0;
+}
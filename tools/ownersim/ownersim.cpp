@@ -0,0 +1,165 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host simulation of the plant ownership between stations (src/ownership.cpp):
+ * three stations hear one plant for a day, the owner is switched off half
+ * way, and the published frames, adverts and ownership changes are counted.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -I../../include -o ownersim ownersim.cpp ../../src/ownership.cpp
+ *
+ * Usage:
+ *   ./ownersim [-all]
+ *
+ * The stations have a mean RSSI of -62, -65 and -76 dBm with 4 dB of noise,
+ * the plant sends a frame every 3 s, each station hears 90% of them, and
+ * the stations advertise every 30 s. With -all every station publishes
+ * every frame it hears, as before the arbitration.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include "ownership.h"
+
+typedef struct {
+  uint32_t       id;
+  double         mean_rssi;
+  PlantOwnership ownership;
+  bool           alive;
+  unsigned long  published;
+  unsigned long  adverts;
+} Station_t;
+
+static const unsigned long HOUR_MS   = 3600000UL;
+static const unsigned long FRAME_MS  = 3000;
+static const unsigned long ADVERT_MS = 30000;
+
+int main(int argc, char ** argv) {
+
+  bool arbitrate = (argc < 2 || strcmp(argv[1], "-all") != 0);
+
+  std::mt19937 rng(1);
+  std::normal_distribution<double>       noise(0, 4);
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  std::vector<Station_t> stations = {
+    { 0x1111, -62, PlantOwnership(), true, 0, 0 },
+    { 0x2222, -65, PlantOwnership(), true, 0, 0 },
+    { 0x3333, -76, PlantOwnership(), true, 0, 0 },
+  };
+
+  unsigned long end = 24 * HOUR_MS, kill = 12 * HOUR_MS;
+  unsigned long killed_at = 0, takeover = 0;
+  unsigned long no_owner_ms = 0, two_owners_ms = 0;
+
+  for (unsigned long now = 0; now < end; now += FRAME_MS) {
+
+    // the owner goes away half way
+    if (now == kill) {
+      for (auto & station : stations) {
+        if (station.alive && station.ownership.isOwner()) {
+          station.alive = false;
+          killed_at     = now;
+          break;
+        }
+      }
+    }
+
+    // a frame of the plant, heard by each station with some luck
+    for (auto & station : stations) {
+      if (station.alive == false || uniform(rng) > 0.9)
+        continue;
+
+      station.ownership.heard((int) (station.mean_rssi + noise(rng)), now);
+      bool publishes = true;
+      if (arbitrate) {
+        station.ownership.update(station.id, now);
+        publishes = station.ownership.isOwner();
+      }
+      if (publishes == false)
+        continue;
+
+      ++ station.published;
+      for (auto & other : stations) {
+        if (&other != &station)
+          other.ownership.remoteReading(station.id, now);
+      }
+    }
+
+    // adverts, staggered between the stations
+    for (size_t i = 0; arbitrate && i < stations.size(); ++ i) {
+      Station_t & station = stations[i];
+      if (station.alive == false || (now + i * 3 * FRAME_MS) % ADVERT_MS)
+        continue;
+
+      station.ownership.update(station.id, now);
+      if (station.ownership.isHeard(now) == false)
+        continue;
+
+      ++ station.adverts;
+      if (station.ownership.isOwner() == false)
+        continue;
+      for (auto & other : stations) {
+        if (&other != &station)
+          other.ownership.remoteClaim(station.id, station.ownership.rssi(), now);
+      }
+    }
+
+    if (arbitrate == false)
+      continue;
+
+    int owners = 0;
+    for (auto & station : stations)
+      owners += station.alive && station.ownership.isOwner();
+
+    if (owners == 0) no_owner_ms   += FRAME_MS;
+    if (owners > 1)  two_owners_ms += FRAME_MS;
+    if (killed_at && takeover == 0 && owners == 1)
+      takeover = now;
+  }
+
+  unsigned long published = 0, adverts = 0;
+  for (auto & station : stations) {
+    printf("station %04x, %.0f dBm: %lu frames published, %lu adverts, %u ownership changes\n",
+      (unsigned int) station.id, station.mean_rssi, station.published, station.adverts, 
+      station.ownership.changes());
+    published += station.published;
+    adverts   += station.adverts;
+  }
+
+  printf("%s: %.0f published frames/h, %.0f adverts/h",
+    arbitrate ? "arbitration" : "everyone publishes", published / 24.0, adverts / 24.0);
+  if (arbitrate) {
+    printf(", no owner %lu s, more owners %lu s, takeover %lu s after the owner was lost",
+      no_owner_ms / 1000, two_owners_ms / 1000, takeover ? (takeover - killed_at) / 1000 : 0);
+  }
+  printf("\n");
+  return 0;
+}
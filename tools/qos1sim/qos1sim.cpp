@@ -0,0 +1,337 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host simulation of QoS 1 publishing against a local broker model: the
+ * real MQTTQueue and MQTTTransport are driven as MQTT::drainQoS1() and
+ * MQTT::pubackCbk() do, over a link with a round trip time that drops now
+ * and then. The broker parses the PUBLISH packets, counts each message
+ * once by its sequence number and answers QoS 1 ones with a PUBACK.
+ *
+ * Build:
+ *   g++ -O2 -I../host -I../../src -I../../include -o qos1sim qos1sim.cpp \
+ *     ../../src/mqtt_queue.cpp ../../src/mqtt_transport.cpp
+ *
+ * Usage:
+ *   ./qos1sim
+ *
+ * Delivery: 10 messages/s for an hour, the link drops every 30 s on
+ * average, the station notices 3 s later and reconnects 1 s after that.
+ * Throughput: the queue kept full for 60 s over a 40 ms round trip, for
+ * in-flight windows of 1 to 16. The drain task runs every
+ * MQTT_QUEUE_DRAIN_MS with bursts of MQTT_QUEUE_BURST and reads the
+ * PUBACKs received first, the handle task reads the rest every 100 ms. The
+ * queue is the MQTT_QUEUE_STATE one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <firmware_config.h>
+
+#include "mqtt_queue.h"
+#include "mqtt_transport.h"
+
+static const char *        TOPIC     = "miflora_rbs/c4:7c:8d:6a:00:00/moisture";
+static const unsigned long HANDLE_MS = 100; // MQTT_UPDATE_INTERVAL of mqtt.h
+
+typedef struct {
+  unsigned long at;
+  std::vector<uint8_t> data;
+} Chunk_t;
+
+/* QoS 1 message waiting for its PUBACK, as in MQTT */
+typedef struct {
+  uint16_t packet_id;
+  uint32_t ref;
+} Inflight_t;
+
+typedef struct {
+  unsigned long produced;
+  unsigned long delivered;
+  unsigned long dropped;    // by the full queue
+  unsigned long dups;       // delivered more than once
+  double        rate;       // delivered per second
+} Result_t;
+
+static unsigned long           _now;
+static std::mt19937            _rng(42);
+static MQTTQueue *             _queue;
+static std::vector<Inflight_t> _inflight;
+
+static void _pubackCbk(uint16_t packet_id) {
+  for (size_t i = 0; i < _inflight.size(); ++ i) {
+    if (_inflight[i].packet_id == packet_id) {
+      _queue->ack(_inflight[i].ref);
+      _inflight[i] = _inflight.back();
+      _inflight.pop_back();
+      return;
+    }
+  }
+}
+
+/* the link and the broker at its other end */
+class Broker : public Client {
+  public:
+    std::deque<Chunk_t>  up, down;
+    std::vector<uint8_t> rx;        // bytes arrived at the station
+    std::vector<uint8_t> buffer;    // bytes arrived at the broker, not parsed yet
+    std::set<uint32_t>   seen;
+    unsigned long        delivered = 0, dups = 0;
+    unsigned long        rtt = 40;
+
+    void reset() {
+      up.clear(); down.clear(); rx.clear(); buffer.clear();
+    }
+
+    /* move what's due across the link, lost if it's down */
+    void run(bool link) {
+      for (; up.empty() == false && up.front().at <= _now; up.pop_front())
+        if (link) receive(up.front().data);
+      for (; down.empty() == false && down.front().at <= _now; down.pop_front())
+        if (link) rx.insert(rx.end(), down.front().data.begin(), down.front().data.end());
+    }
+
+    void receive(const std::vector<uint8_t> & data) {
+
+      buffer.insert(buffer.end(), data.begin(), data.end());
+
+      while (buffer.size() >= 2) {
+        size_t   pos = 1;
+        uint32_t remaining = 0;
+        uint8_t  byte;
+
+        for (int shift = 0; ; shift += 7) {
+          if (pos >= buffer.size())
+            return;
+          byte = buffer[pos ++];
+          remaining |= (byte & 0x7F) << shift;
+          if ((byte & 0x80) == 0)
+            break;
+        }
+        if (buffer.size() < pos + remaining)
+          return;
+
+        const uint8_t * packet = &buffer[pos];
+        if ((buffer[0] >> 4) == MQTTTransport::PACKET_PUBLISH) {
+          int      qos    = (buffer[0] >> 1) & 3;
+          size_t   offset = 2 + (packet[0] << 8 | packet[1]);
+          uint16_t id     = 0;
+          uint32_t seq;
+
+          if (qos > 0) {
+            id = packet[offset] << 8 | packet[offset + 1];
+            offset += 2;
+          }
+          memcpy(&seq, packet + offset, sizeof(seq));
+          if (seen.insert(seq).second) ++ delivered; else ++ dups;
+
+          if (qos > 0)
+            down.push_back({ _now + rtt / 2, { 0x40, 2, (uint8_t) (id >> 8), (uint8_t) id } });
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + pos + remaining);
+      }
+    }
+
+    size_t  write(const uint8_t * data, size_t size) override {
+      up.push_back({ _now + rtt / 2, std::vector<uint8_t>(data, data + size) });
+      return size;
+    }
+    size_t  write(uint8_t data) override            { return write(&data, 1); }
+    int     connect(IPAddress, uint16_t) override   { return 1; }
+    int     connect(const char *, uint16_t) override { return 1; }
+    int     available() override                    { return rx.size(); }
+    int     read() override {
+      uint8_t data;
+      return read(&data, 1) == 1 ? data : -1;
+    }
+    int     read(uint8_t * data, size_t size) override {
+      size_t count = size < rx.size() ? size : rx.size();
+      memcpy(data, rx.data(), count);
+      rx.erase(rx.begin(), rx.begin() + count);
+      return count;
+    }
+    int     peek() override                         { return rx.empty() ? -1 : rx[0]; }
+    void    flush() override                        {}
+    void    stop() override                         {}
+    uint8_t connected() override                    { return 1; }
+    operator bool() override                        { return true; }
+};
+
+static Broker        _broker;
+static MQTTTransport _transport(_broker, _pubackCbk);
+
+static void _publishQoS0(const MQTTQueue::Message_t & message) {
+
+  size_t topic_len = strlen(message.topic);
+  std::vector<uint8_t> packet = { 0x30, (uint8_t) (2 + topic_len + message.length), 0, (uint8_t) topic_len };
+
+  packet.insert(packet.end(), message.topic, message.topic + topic_len);
+  packet.insert(packet.end(), message.payload, message.payload + message.length);
+  _broker.write(packet.data(), packet.size());
+}
+
+/* a burst of the drain task */
+static void _drain(int qos, unsigned int window, uint16_t & next_id) {
+
+  MQTTQueue::Message_t message;
+  uint8_t              puback[4];
+
+  // the PUBACKs received since the last run reopen the window
+  for (size_t n = _inflight.size(); qos > 0 && n > 0 && _transport.available() > 0; -- n)
+    _transport.read(puback, sizeof(puback));
+
+  for (int sent = 0; sent < MQTT_QUEUE_BURST; ++ sent) {
+    if (qos == 0) {
+      if (_queue->front(message) == false)
+        return;
+      _publishQoS0(message);
+      _queue->pop();
+      continue;
+    }
+
+    if (_inflight.size() >= window || _queue->unsent(message) == false)
+      return;
+
+    // resent with the packet id it had, the broker keeps the session
+    uint16_t packet_id = message.packet_id;
+    if (packet_id == 0) {
+      packet_id = next_id ++;
+      if (next_id == 0)
+        next_id = 1;
+    }
+
+    _queue->markSent(message.ref, packet_id);
+    _transport.publishQoS1(message.topic, message.payload, message.length, message.retained, message.dup, packet_id);
+    _inflight.push_back({ packet_id, message.ref });
+  }
+}
+
+/* the oldest message makes room, forgotten if it was in flight */
+static void _dropOldest() {
+
+  MQTTQueue::Message_t message;
+
+  _queue->front(message);
+  for (size_t i = 0; i < _inflight.size(); ++ i) {
+    if (_inflight[i].ref == message.ref) {
+      _inflight[i] = _inflight.back();
+      _inflight.pop_back();
+      break;
+    }
+  }
+  _queue->pop();
+}
+
+static Result_t _run(int qos, unsigned int window, double produced_per_s, double drops_per_s, 
+                     unsigned long detect_ms, unsigned long duration_ms) {
+
+  static uint8_t buffer[MQTT_QUEUE_STATE];
+
+  MQTTQueue queue(buffer, sizeof(buffer));
+  Result_t  result = {};
+  uint8_t   payload[24] = {};
+  uint16_t  next_id = 1;
+  double    due = 0;
+  bool      link = true, noticed = true;
+  unsigned long down_since = 0;
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  _queue = &queue;
+  _inflight.clear();
+  _broker.reset();
+  _broker.seen.clear();
+  _broker.delivered = _broker.dups = 0;
+
+  for (_now = 0; _now < duration_ms; ++ _now) {
+
+    // values published, a saturating producer only fills the free room
+    for (due += produced_per_s / 1000; due >= 1; -- due) {
+      if (produced_per_s >= 1000 && queue.fits(TOPIC, sizeof(payload)) == false)
+        continue;
+
+      uint32_t seq = result.produced ++;
+      memcpy(payload, &seq, sizeof(seq));
+      while (queue.fits(TOPIC, sizeof(payload)) == false) {
+        _dropOldest();
+        ++ result.dropped;
+      }
+      queue.push(TOPIC, payload, sizeof(payload), false, 0);
+    }
+
+    // the link drops, the station notices after a while and reconnects
+    if (link && uniform(_rng) < drops_per_s / 1000) {
+      link = false;
+      down_since = _now;
+      _broker.reset();
+    }
+    if (link == false && noticed && _now - down_since >= detect_ms)
+      noticed = false;
+    if (link == false && noticed == false && _now - down_since >= detect_ms + 1000) {
+      link = noticed = true;
+      _inflight.clear();
+      queue.unsend(true);
+    }
+
+    _broker.run(link);
+    if (link == false)
+      _broker.up.clear();
+
+    if (_now % HANDLE_MS == 0) {
+      uint8_t data[256];
+      while (_transport.available() > 0)
+        _transport.read(data, sizeof(data));
+    }
+
+    if (_now % MQTT_QUEUE_DRAIN_MS == 0 && noticed)
+      _drain(qos, window, next_id);
+  }
+
+  result.delivered = _broker.delivered;
+  result.dups      = _broker.dups;
+  result.rate      = _broker.delivered * 1000.0 / duration_ms;
+  return result;
+}
+
+int main() {
+
+  printf("delivery, 10 msg/s, link drop every ~30 s, noticed after 3 s, 1 h:\n");
+  for (int qos = 0; qos <= 1; ++ qos) {
+    Result_t result = _run(qos, 8, 10, 1.0 / 30, 3000, 3600000);
+    printf("  qos%d: delivered %.2f%% of %lu (dropped by the queue %lu, duplicates %lu)\n", qos, 
+      100.0 * result.delivered / result.produced, result.produced, result.dropped, result.dups);
+  }
+
+  printf("throughput, queue kept full, 40 ms round trip, no drops, 60 s:\n");
+  printf("  qos0:             %.0f msg/s\n", _run(0, 8, 1000, 0, 0, 60000).rate);
+  for (unsigned int window : { 1u, 4u, 8u, 16u })
+    printf("  qos1 window %2u:   %.0f msg/s\n", window, _run(1, window, 1000, 0, 0, 60000).rate);
+  return 0;
+}
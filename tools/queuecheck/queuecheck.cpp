@@ -0,0 +1,485 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+
+/*
+ * Randomized check of the outbound MQTT queue (src/mqtt_queue.cpp) and of
+ * its spool in SPIFFS (src/mqtt_spool.cpp) against plain models, meant to
+ * be built with the address and undefined behaviour sanitizers.
+ *
+ * Queue: rings of random sizes get messages of random topics and lengths,
+ * so records wrap, behind pads with and without a header, retained ones and
+ * with setReplace() all of them replace the queued value of their topic,
+ * and they are sent as by MQTT::drain() (front/pop) or MQTT::drainQoS1()
+ * (unsent/markSent, ack in any order, unsend after a reconnect with or
+ * without the session). After each operation the ring is walked record by
+ * record and the messages handed out are compared with the model.
+ *
+ * Spool: small budgets so the oldest segments get dropped, appends cut part
+ * way as by a reset (the host SPIFFS write budget), restarts with a new
+ * MQTTSpool picking up the segment files, in the middle of a replay too.
+ * Every message comes out in order with its content, the ones missing are
+ * exactly the ones counted as dropped, a restart only replays the messages
+ * of the segment being replayed, and no segment file is left behind.
+ *
+ * Build:
+ *   g++ -O1 -g -fsanitize=address,undefined -I../host -I../../src -I../../include \
+ *     -o queuecheck queuecheck.cpp ../../src/mqtt_queue.cpp ../../src/mqtt_spool.cpp
+ *
+ * Usage:
+ *   ./queuecheck [rounds] [seed]
+ *
+ * Defaults are 200 rounds of each check with seed 1. It prints what was
+ * covered and exits with 1 at the first difference from the model.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <firmware_config.h>
+
+#include "mqtt_queue.h"
+#include "mqtt_spool.h"
+
+static const unsigned int OPERATIONS = 2000; // of each round
+
+static const char * _topics[] = {
+  "t",
+  "miflora_rbs/c4:7c:8d:6a:00:01/moisture",
+  "miflora_rbs/c4:7c:8d:6a:00:02/moisture",
+  "miflora_rbs/c4:7c:8d:6a:00:01/temperature",
+  "miflora_rbs/station/balcony/rssi",
+  "homeassistant/sensor/miflora_c47c8d6a0001_conductivity/config"
+};
+static const unsigned int TOPICS = sizeof(_topics) / sizeof(_topics[0]);
+
+static std::mt19937 _rng;
+
+static unsigned int _random(unsigned int range) {
+  return std::uniform_int_distribution<unsigned int>(0, range - 1)(_rng);
+}
+
+static void _fail(const char * check, unsigned int round, unsigned int operation, const char * what) {
+  printf("FAILED %s, round %u, operation %u: %s\n", check, round, operation, what);
+  exit(1);
+}
+
+/* payload of a message, from its sequence number */
+static void _payload(std::vector<uint8_t> & payload, uint32_t seq, size_t length) {
+  payload.resize(length);
+  for (size_t i = 0; i < length; ++ i)
+    payload[i] = (uint8_t) (seq * 31 + i);
+}
+
+static bool _same(const MQTTQueue::Message_t & message, const std::string & topic, const std::vector<uint8_t> & payload) {
+  return topic == message.topic && message.length == payload.size() && 
+    (payload.empty() || memcmp(message.payload, payload.data(), payload.size()) == 0);
+}
+
+/*
+ * Queue
+ */
+
+/* the queue, with the ring open for walking it */
+class CheckedQueue : public MQTTQueue {
+
+  public:
+    CheckedQueue(uint8_t * buffer, size_t capacity) : MQTTQueue(buffer, capacity) {}
+
+    size_t head() { return _head; }
+    size_t tail() { return _tail; }
+
+    /* walk the ring from the tail, false if a record is not where it should be */
+    bool walk(unsigned int & live) {
+      size_t offset = _tail;
+      size_t walked = 0;
+
+      live = 0;
+      while (walked < _used) {
+        if (_capacity - offset < sizeof(Header_t) || at(offset)->size == 0) {
+          walked += _capacity - offset;
+          offset  = 0;
+          continue;
+        }
+        Header_t * header = at(offset);
+        if (header->size < sizeof(Header_t) || (header->size & 3) != 0 || offset + header->size > _capacity)
+          return false;
+        if ((header->flags & FLAG_PAD) == 0 && 
+            header->size != recordSize(header->topic_len, header->payload_len))
+          return false;
+        if ((header->flags & (FLAG_DEAD | FLAG_PAD)) == 0)
+          ++ live;
+        walked += header->size;
+        offset += header->size;
+        if (offset >= _capacity)
+          offset = 0;
+      }
+      return walked == _used && offset == _head;
+    }
+};
+
+/* a live message of the model */
+typedef struct {
+  uint32_t             seq;
+  std::string          topic;
+  std::vector<uint8_t> payload;
+  bool                 retained;
+  bool                 sent;
+  bool                 dup;
+  uint16_t             packet_id;
+  uint32_t             ref;
+} Entry_t;
+
+typedef struct {
+  unsigned long pushed;
+  unsigned long refused;
+  unsigned long replaced;
+  unsigned long wraps;
+  unsigned long pads;       // with a header
+  unsigned long short_pads; // too small for a header
+  unsigned long sent;
+  unsigned long acked;
+  unsigned long resent;
+} QueueStats_t;
+
+static void _checkQueue(unsigned int round, QueueStats_t & stats) {
+
+  size_t       capacity = 4 * (16 + _random(400));
+  bool         replace  = _random(2) == 1;
+  bool         qos1     = _random(2) == 1;
+  uint8_t *    buffer   = new uint8_t[capacity]; // exact, for the sanitizer to catch overruns
+  CheckedQueue queue(buffer, capacity);
+  uint32_t     seq      = 0;
+  uint16_t     packet_id = 0;
+
+  std::deque<Entry_t>  model;
+  std::vector<uint8_t> payload;
+  queue.setReplace(replace);
+
+  for (unsigned int operation = 0; operation < OPERATIONS; ++ operation) {
+
+    unsigned int choice = _random(100);
+    MQTTQueue::Message_t message;
+
+    if (choice < 55) {
+      // a message of up to half the ring, now and then larger than it
+      Entry_t entry;
+      entry.seq       = ++ seq;
+      entry.topic     = _topics[_random(TOPICS)];
+      entry.retained  = _random(3) == 0;
+      entry.sent      = false;
+      entry.dup       = false;
+      entry.packet_id = 0;
+      _payload(entry.payload, seq, _random(20) == 0 ? _random(capacity + 64) : _random(capacity / 2));
+
+      size_t head = queue.head();
+      size_t tail = queue.tail();
+      size_t used = queue.bytes();
+      size_t size = MQTTQueue::recordSize(entry.topic.size(), entry.payload.size());
+
+      bool fits = queue.fits(entry.topic.c_str(), entry.payload.size());
+      bool done = queue.push(entry.topic.c_str(), entry.payload.data(), entry.payload.size(), entry.retained, seq);
+      if (done != fits)
+        _fail("queue", round, operation, "push() doesn't agree with fits()");
+      if (done == false) {
+        if (used + size <= capacity && used == 0)
+          _fail("queue", round, operation, "an empty queue refused a message that fits");
+        ++ stats.refused;
+        continue;
+      }
+      ++ stats.pushed;
+
+      // the model replaces the queued value of the topic not sent yet
+      if (entry.retained || replace) {
+        for (auto it = model.begin(); it != model.end(); ++ it) {
+          if (it->topic == entry.topic && it->retained == entry.retained && it->sent == false && it->dup == false) {
+            model.erase(it);
+            ++ stats.replaced;
+            break;
+          }
+        }
+      }
+
+      if (used > 0 && head >= tail && capacity - head < size) {
+        if (capacity - head >= sizeof(MQTTQueue::Header_t)) ++ stats.pads;
+        else if (capacity - head > 0) ++ stats.short_pads;
+      }
+      if (queue.head() < head + size)
+        ++ stats.wraps;
+
+      queue.unsent(message);
+      entry.ref = (queue.head() >= size ? queue.head() : capacity) - size;
+      model.push_back(entry);
+    } else
+    if (qos1 == false) {
+      // sent as by drain()
+      bool found = queue.front(message);
+      if (found != (model.empty() == false))
+        _fail("queue", round, operation, "front() doesn't agree with the model");
+      if (found) {
+        const Entry_t & entry = model.front();
+        if (_same(message, entry.topic, entry.payload) == false || message.retained != entry.retained || message.time != entry.seq)
+          _fail("queue", round, operation, "front() returned another message");
+        queue.pop();
+        model.pop_front();
+        ++ stats.sent;
+      }
+    } else
+    if (choice < 85) {
+      // sent as by drainQoS1(), the oldest not sent yet
+      Entry_t * expected = NULL;
+      for (Entry_t & entry : model) {
+        if (entry.sent == false) {
+          expected = &entry;
+          break;
+        }
+      }
+      bool found = queue.unsent(message);
+      if (found != (expected != NULL))
+        _fail("queue", round, operation, "unsent() doesn't agree with the model");
+      if (found) {
+        if (_same(message, expected->topic, expected->payload) == false || message.dup != expected->dup ||
+            message.packet_id != expected->packet_id || message.time != expected->seq)
+          _fail("queue", round, operation, "unsent() returned another message");
+        uint16_t id = message.packet_id != 0 ? message.packet_id : ++ packet_id ? packet_id : ++ packet_id;
+        queue.markSent(message.ref, id);
+        expected->sent      = true;
+        expected->packet_id = id;
+        expected->ref       = message.ref;
+        ++ stats.sent;
+      }
+    } else
+    if (choice < 97) {
+      // a PUBACK, for any message in flight
+      std::vector<size_t> inflight;
+      for (size_t i = 0; i < model.size(); ++ i)
+        if (model[i].sent) inflight.push_back(i);
+      if (inflight.empty() == false) {
+        size_t index = inflight[_random(inflight.size())];
+        queue.ack(model[index].ref);
+        model.erase(model.begin() + index);
+        ++ stats.acked;
+      }
+    } else {
+      // a reconnect, with or without the session
+      bool session = _random(2) == 1;
+      queue.unsend(session);
+      for (Entry_t & entry : model) {
+        if (entry.sent) {
+          entry.sent = false;
+          entry.dup  = true;
+          if (session == false)
+            entry.packet_id = 0;
+          ++ stats.resent;
+        }
+      }
+    }
+
+    unsigned int live;
+    if (queue.walk(live) == false)
+      _fail("queue", round, operation, "the ring doesn't walk from the tail to the head");
+    if (live != model.size() || queue.count() != model.size() || queue.empty() != model.empty())
+      _fail("queue", round, operation, "the count doesn't agree with the model");
+    if (queue.bytes() > capacity)
+      _fail("queue", round, operation, "more bytes used than the ring has");
+  }
+  delete [] buffer;
+}
+
+/*
+ * Spool
+ */
+
+typedef struct {
+  unsigned long appended;
+  unsigned long replayed;
+  unsigned long dropped;
+  unsigned long cut;
+  unsigned long restarts;
+  unsigned long restarts_replaying; // restarts in the middle of a segment's replay
+  unsigned long again;              // messages replayed again after a restart
+} SpoolStats_t;
+
+static const size_t SPOOL_MAX_RECORD = MQTTQueue::recordSize(0, MQTT_QUEUE_MAX_MESSAGE);
+
+/* the message of a sequence number, as spilled from the queue */
+static void _spoolMessage(uint32_t seq, std::vector<uint8_t> & payload, MQTTQueue::Message_t & message) {
+  _payload(payload, seq, seq % 11 == 0 ? 600 + seq % 500 : seq * 37 % 200);
+  message.topic     = _topics[seq % TOPICS];
+  message.payload   = payload.data();
+  message.length    = payload.size();
+  message.retained  = seq % 3 == 0;
+  message.time      = 1000 + seq;
+  message.dup       = false;
+  message.packet_id = seq % 5 == 0 ? (uint16_t) (seq | 1) : 0;
+  message.ref       = 0;
+}
+
+static void _checkSpool(unsigned int round, SpoolStats_t & stats) {
+
+  size_t       budget = 1024 + _random(8192);
+  MQTTSpool *  spool  = new MQTTSpool();
+  uint32_t     next   = 1;   // sequence number of the next message appended
+  uint32_t     oldest = 1;   // of the oldest message in the spool
+  unsigned long dropped = 0; // by this spool, seen so far
+
+  std::vector<uint8_t> payload, expected;
+  MQTTQueue::Message_t message, out;
+
+  hostSPIFFS().init();
+  spool->begin(budget, SPOOL_MAX_RECORD);
+
+  for (unsigned int operation = 0; operation <= OPERATIONS; ++ operation) {
+
+    unsigned int choice = operation == OPERATIONS ? 100 : _random(100);
+    bool appending = false;
+
+    if (choice < 50) {
+      _spoolMessage(next, payload, message);
+      appending = true;
+      if (spool->append(message)) {
+        ++ next;
+        ++ stats.appended;
+      } else
+        _fail("spool", round, operation, "append() failed");
+    } else
+    if (choice < 54) {
+      // a reset cuts the record, the spool is picked up after the restart now and then
+      _spoolMessage(next, payload, message);
+      appending = true;
+      hostSPIFFS().write_budget = _random(sizeof(MQTTQueue::Header_t) + strlen(message.topic) + 1 + message.length);
+      if (spool->append(message))
+        _fail("spool", round, operation, "append() of a cut record succeeded");
+      hostSPIFFS().write_budget = SIZE_MAX;
+      ++ stats.cut;
+      if (_random(2) == 0)
+        choice = 100;
+    } else
+    if (choice < 56) {
+      // larger than a record of the spool
+      std::vector<uint8_t> large(SPOOL_MAX_RECORD);
+      MQTTQueue::Message_t too_large = { "t", large.data(), (unsigned int) large.size(), false, 0, false, 0, 0 };
+      if (spool->append(too_large))
+        _fail("spool", round, operation, "append() took a record larger than the largest");
+    } else
+    if (choice < 97) {
+      bool found = spool->front(out);
+      if (found != (next != oldest))
+        _fail("spool", round, operation, "front() doesn't agree with the model");
+      if (found) {
+        _spoolMessage(oldest, expected, message);
+        if (_same(out, message.topic, expected) == false || out.retained != message.retained || 
+            out.time != message.time || out.packet_id != message.packet_id || out.dup != (message.packet_id != 0))
+          _fail("spool", round, operation, "front() returned another message");
+        spool->pop();
+        ++ oldest;
+        ++ stats.replayed;
+      }
+    } else
+      choice = 100;
+
+    // segments are dropped when appending only, the oldest ones
+    if (spool->dropped() != dropped) {
+      if (appending == false)
+        _fail("spool", round, operation, "messages dropped while replaying, a segment didn't read back");
+      oldest  += spool->dropped() - dropped;
+      stats.dropped += spool->dropped() - dropped;
+      dropped  = spool->dropped();
+    }
+
+    if (choice == 100) {
+      // a restart: the segment being replayed is replayed again from its start
+      unsigned int count = spool->count();
+      delete spool;
+      spool   = new MQTTSpool();
+      dropped = 0;
+      spool->begin(budget, SPOOL_MAX_RECORD);
+      if (spool->count() < count || spool->count() - count > oldest - 1)
+        _fail("spool", round, operation, "the restart picked up other messages");
+      if (spool->count() > count)
+        ++ stats.restarts_replaying;
+      stats.again += spool->count() - count;
+      oldest -= spool->count() - count;
+      ++ stats.restarts;
+    }
+
+    if (spool->count() != next - oldest || spool->empty() != (next == oldest))
+      _fail("spool", round, operation, "the count doesn't agree with the model");
+    if (hostSPIFFS().files.size() > MQTT_SPOOL_SEGMENTS)
+      _fail("spool", round, operation, "more segment files than segments");
+  }
+
+  // replay what is left, no segment is left behind
+  while (spool->front(out)) {
+    spool->pop();
+    ++ oldest;
+  }
+  delete spool;
+  spool = new MQTTSpool();
+  spool->begin(budget, SPOOL_MAX_RECORD);
+  if (oldest != next || spool->empty() == false || hostSPIFFS().files.empty() == false)
+    _fail("spool", round, OPERATIONS, "segments left after replaying everything");
+  delete spool;
+}
+
+int main(int argc, char ** argv) {
+
+  unsigned int rounds = argc > 1 ? atoi(argv[1]) : 200;
+  unsigned int seed   = argc > 2 ? atoi(argv[2]) : 1;
+
+  QueueStats_t queue_stats;
+  SpoolStats_t spool_stats;
+  memset(&queue_stats, 0, sizeof(queue_stats));
+  memset(&spool_stats, 0, sizeof(spool_stats));
+
+  // the spool logs every segment it drops
+  Serial.quiet = true;
+
+  _rng.seed(seed);
+  for (unsigned int round = 0; round < rounds; ++ round)
+    _checkQueue(round, queue_stats);
+
+  printf("queue: %u rounds of %u operations, seed %u\n", rounds, OPERATIONS, seed);
+  printf("  %lu pushed, %lu refused, %lu replaced, %lu wraps (%lu pads, %lu too small for a header)\n",
+    queue_stats.pushed, queue_stats.refused, queue_stats.replaced, queue_stats.wraps, queue_stats.pads, queue_stats.short_pads);
+  printf("  %lu sent, %lu acknowledged, %lu sent again after a reconnect\n",
+    queue_stats.sent, queue_stats.acked, queue_stats.resent);
+
+  for (unsigned int round = 0; round < rounds; ++ round)
+    _checkSpool(round, spool_stats);
+
+  printf("spool: %u rounds of %u operations\n", rounds, OPERATIONS);
+  printf("  %lu appended, %lu replayed, %lu dropped with their segment, %lu records cut\n",
+    spool_stats.appended, spool_stats.replayed, spool_stats.dropped, spool_stats.cut);
+  printf("  %lu restarts, %lu in the middle of a replay, %lu messages replayed again\n",
+    spool_stats.restarts, spool_stats.restarts_replaying, spool_stats.again);
+  return 0;
+}
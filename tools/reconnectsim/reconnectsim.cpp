@@ -0,0 +1,425 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host model of a station reconnecting after an outage, comparing the
+ * single FIFO queue with direct discovery against the classes of messages
+ * sent within the station budget. The real MQTTQueue, MQTTSpool (over the
+ * host SPIFFS) and TokenBucket are driven as MQTT::enqueue(),
+ * MQTT::spillMarked() and MQTT::drain() do, and HomeAssistant's discovery
+ * pass as taskDiscoverCbk() does.
+ *
+ * Build:
+ *   g++ -O2 -I../host -I../../src -I../../include -o reconnectsim reconnectsim.cpp \
+ *     ../../src/mqtt_queue.cpp ../../src/mqtt_spool.cpp ../../src/token_bucket.cpp
+ *
+ * Usage:
+ *   ./reconnectsim [rate_msgs] [rate_bytes]
+ *
+ * For 60 s offline the station queues 100 RSSI updates of 20 plants and 72
+ * readings, it then connects, an alert fires 50 ms later and a discovery
+ * pass of 60 configs (600 B each) starts. Defaults are the MQTT_RATE_MSGS,
+ * MQTT_BURST_MSGS, MQTT_RATE_BYTES and MQTT_BURST_BYTES of default_config.h.
+ *
+ * before   one 8 KB FIFO spilling to the spool when full, discovery sent
+ *          directly with 100 ms delays blocking the loop
+ * classes  the queues of firmware_config.h, alerts first, the spool, then
+ *          state, diagnostics and discovery within the budget
+ * The drain task runs every MQTT_QUEUE_DRAIN_MS with bursts of
+ * MQTT_QUEUE_BURST, sending takes no time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <firmware_config.h>
+#include <default_config.h>
+
+#include "mqtt_queue.h"
+#include "mqtt_spool.h"
+#include "token_bucket.h"
+
+enum Priority { PRIORITY_ALERT, PRIORITY_STATE, PRIORITY_DIAGNOSTIC, PRIORITY_DISCOVERY, PRIORITY_COUNT };
+
+static const unsigned long OFFLINE_MS    = 60000;
+static const unsigned long ALERT_MS      = OFFLINE_MS + 50;
+static const unsigned int  RSSI_UPDATES  = 100;
+static const unsigned int  READINGS      = 72;
+static const unsigned int  DISCOVERY     = 60;
+static const unsigned int  DISCOVERY_LEN = 600;
+static const unsigned long END_MS        = OFFLINE_MS + 120000;
+
+/* what left the station, for the report */
+typedef struct {
+  unsigned long at;
+  char          kind;   // 'a'lert, 's'tate, 'r'ssi, 'd'iscovery
+} Sent_t;
+
+typedef struct {
+  std::vector<Sent_t> sent;
+  unsigned long       alert_ms;
+  unsigned long       spilled;
+  unsigned long       dropped;
+  unsigned long       throttled;
+} Result_t;
+
+static char _config[DISCOVERY_LEN + 1];
+
+static char _kind(const char * topic) {
+  if (strstr(topic, "/alert")) return 'a';
+  if (strstr(topic, "/rssi"))  return 'r';
+  if (strstr(topic, "config")) return 'd';
+  return 's';
+}
+
+/* the station, with either queueing */
+class Station {
+
+  public:
+    Station(bool classes, uint32_t rate_msgs, uint32_t rate_bytes) 
+      : _classes(classes)
+      , _fifo(_fifo_buffer, sizeof(_fifo_buffer))
+      , _alerts(_alerts_buffer, sizeof(_alerts_buffer))
+      , _state(_state_buffer, sizeof(_state_buffer))
+      , _diagnostics(_diagnostics_buffer, sizeof(_diagnostics_buffer))
+      , _discovery(_discovery_buffer, sizeof(_discovery_buffer))
+      , _spill_pending(0)
+      , _discovery_index(0)
+      , _discovery_resume(0)
+      , _discovery_at(OFFLINE_MS)
+      , _discovery_done(false)
+      , _now(0)
+      , _connected(false)
+      , _alert_queued(0) {
+      hostSPIFFS().init();
+      _spool.begin(MQTT_SPOOL_SIZE, MQTTQueue::recordSize(0, MQTT_QUEUE_MAX_MESSAGE));
+      _diagnostics.setReplace(true);
+      _budget_msgs.configure(classes ? rate_msgs : 0, MQTT_BURST_MSGS, 0);
+      _budget_bytes.configure(classes ? rate_bytes : 0, MQTT_BURST_BYTES, 0);
+      _result.alert_ms  = 0;
+      _result.spilled   = 0;
+      _result.dropped   = 0;
+      _result.throttled = 0;
+    }
+
+    Result_t & run();
+
+  protected:
+    bool          _classes;
+    alignas(4) uint8_t _fifo_buffer[8192];
+    alignas(4) uint8_t _alerts_buffer[MQTT_QUEUE_ALERTS];
+    alignas(4) uint8_t _state_buffer[MQTT_QUEUE_STATE];
+    alignas(4) uint8_t _diagnostics_buffer[MQTT_QUEUE_DIAGNOSTICS];
+    alignas(4) uint8_t _discovery_buffer[MQTT_QUEUE_DISCOVERY];
+    MQTTQueue     _fifo;
+    MQTTQueue     _alerts;
+    MQTTQueue     _state;
+    MQTTQueue     _diagnostics;
+    MQTTQueue     _discovery;
+    MQTTSpool     _spool;
+    TokenBucket   _budget_msgs;
+    TokenBucket   _budget_bytes;
+    uint8_t       _spill_pending;
+    unsigned int  _discovery_index;
+    unsigned int  _discovery_resume;
+    unsigned long _discovery_at;
+    bool          _discovery_done;
+    unsigned long _now;
+    bool          _connected;
+    unsigned long _alert_queued;
+    Result_t      _result;
+
+    MQTTQueue &   queue(uint8_t priority);
+    bool          publish(const char * topic, const char * payload, unsigned int len, bool retained, Priority priority);
+    bool          spillOldest(MQTTQueue & queue);
+    void          spillMarked();
+    bool          budget(const MQTTQueue::Message_t & message);
+    void          send(const MQTTQueue::Message_t & message);
+    void          drain();
+    void          discoveryPass();
+};
+
+MQTTQueue & Station::queue(uint8_t priority) {
+  switch (priority) {
+    case PRIORITY_ALERT:      return _alerts;
+    case PRIORITY_STATE:      return _state;
+    case PRIORITY_DIAGNOSTIC: return _diagnostics;
+    default:                  return _discovery;
+  }
+}
+
+/* as MQTT::enqueue(), or as the FIFO did */
+bool Station::publish(const char * topic, const char * payload, unsigned int len, bool retained, Priority priority) {
+
+  if (_classes == false) {
+    while (_fifo.fits(topic, len) == false) {
+      if (spillOldest(_fifo) == false) {
+        MQTTQueue::Message_t message;
+        if (_fifo.front(message) == false)
+          return false;
+        _fifo.pop();
+        _result.dropped ++;
+      }
+    }
+    _fifo.push(topic, (const uint8_t *) payload, len, retained, 0);
+    return true;
+  }
+
+  MQTTQueue & target = queue(priority);
+
+  while (target.fits(topic, len) == false) {
+    if (priority == PRIORITY_DISCOVERY)
+      return false;
+
+    MQTTQueue::Message_t message;
+    if (target.front(message) == false)
+      return false;
+    target.pop();
+    _result.dropped ++;
+  }
+  target.push(topic, (const uint8_t *) payload, len, retained, 0);
+
+  if (priority <= PRIORITY_STATE && target.bytes() > target.capacity() * MQTT_QUEUE_SPILL_PERCENT / 100)
+    _spill_pending |= 1 << priority;
+  return true;
+}
+
+bool Station::spillOldest(MQTTQueue & from) {
+
+  MQTTQueue::Message_t message;
+
+  if (from.front(message) == false || _spool.append(message) == false)
+    return false;
+  from.pop();
+  _result.spilled ++;
+  return true;
+}
+
+/* as MQTT::spillMarked() */
+void Station::spillMarked() {
+
+  for (uint8_t priority = PRIORITY_ALERT; priority <= PRIORITY_STATE; priority ++) {
+    MQTTQueue & from = queue(priority);
+    size_t      mark = from.capacity() * MQTT_QUEUE_SPILL_PERCENT / 100;
+
+    if ((_spill_pending & (1 << priority)) == 0 || from.bytes() <= mark)
+      continue;
+    while (from.bytes() > mark / 2 && spillOldest(from));
+  }
+  _spill_pending = 0;
+}
+
+bool Station::budget(const MQTTQueue::Message_t & message) {
+
+  _budget_msgs.refill(_now);
+  _budget_bytes.refill(_now);
+
+  if (_budget_msgs.has(1) && _budget_bytes.has(strlen(message.topic) + message.length))
+    return true;
+
+  _result.throttled ++;
+  return false;
+}
+
+void Station::send(const MQTTQueue::Message_t & message) {
+
+  _budget_msgs.force(1);
+  _budget_bytes.force(strlen(message.topic) + message.length);
+
+  char kind = _kind(message.topic);
+  if (kind == 'a' && _result.alert_ms == 0)
+    _result.alert_ms = _now - _alert_queued;
+  _result.sent.push_back({ _now, kind });
+}
+
+/* as MQTT::drain(), or as the FIFO did */
+void Station::drain() {
+
+  MQTTQueue::Message_t message;
+
+  for (unsigned int sent = 0; sent < MQTT_QUEUE_BURST; sent ++) {
+
+    if (_classes && _alerts.front(message)) {
+      send(message);
+      _alerts.pop();
+      continue;
+    }
+
+    if (_spool.empty() == false) {
+      if (_spool.front(message) == false || budget(message) == false)
+        return;
+      send(message);
+      _spool.pop();
+      continue;
+    }
+
+    uint8_t priority = PRIORITY_STATE;
+    if (_classes) {
+      while (priority < PRIORITY_COUNT && queue(priority).front(message) == false)
+        priority ++;
+      if (priority == PRIORITY_COUNT || budget(message) == false)
+        return;
+    } else
+    if (_fifo.front(message) == false) {
+      return;
+    }
+
+    send(message);
+    if (_classes) queue(priority).pop(); else _fifo.pop();
+  }
+}
+
+/* as HomeAssistant::taskDiscoverCbk(), a full queue pauses the pass */
+void Station::discoveryPass() {
+
+  char topic[64];
+
+  for (_discovery_index = 0; _discovery_index < DISCOVERY; ) {
+
+    snprintf(topic, sizeof(topic), "homeassistant/sensor/plant_%u/config", _discovery_index);
+
+    if (_classes == false) {
+      // sent directly, the loop is held by the delay after each
+      MQTTQueue::Message_t message = { topic, (const uint8_t *) _config, DISCOVERY_LEN, true, 0, false, 0, 0 };
+      send(message);
+      _discovery_index ++;
+      for (unsigned long until = _now + 100; _now < until; _now ++);
+      continue;
+    }
+
+    if (_discovery_index ++ < _discovery_resume)
+      continue;
+    if (publish(topic, _config, DISCOVERY_LEN, true, PRIORITY_DISCOVERY) == false) {
+      _discovery_resume = _discovery_index - 1;
+      _discovery_at     = _now + HASS_DISCOVERY_RESUME_MS;
+      return;
+    }
+  }
+  _discovery_done = true;
+}
+
+Result_t & Station::run() {
+
+  char topic[64];
+  char value[8];
+  unsigned int rssi = 0;
+  unsigned int reading = 0;
+
+  for (_now = 0; _now < END_MS; _now ++) {
+
+    _connected = _now >= OFFLINE_MS;
+
+    // producers while offline, spread over the outage
+    if (rssi < RSSI_UPDATES && _now == rssi * OFFLINE_MS / RSSI_UPDATES) {
+      snprintf(topic, sizeof(topic), "miflora_rbs/c4:7c:8d:6a:00:%02x/rssi", rssi % 20);
+      snprintf(value, sizeof(value), "-%u", 60 + rssi % 30);
+      publish(topic, value, strlen(value), false, PRIORITY_DIAGNOSTIC);
+      rssi ++;
+    }
+    if (reading < READINGS && _now == reading * OFFLINE_MS / READINGS) {
+      static const char * levels[] = { "moisture", "temp", "conductivity", "light" };
+      snprintf(topic, sizeof(topic), "miflora_rbs/c4:7c:8d:6a:00:%02x/%s", reading / 4, levels[reading % 4]);
+      publish(topic, "21.50", 5, true, PRIORITY_STATE);
+      reading ++;
+    }
+
+    if (_now == ALERT_MS || (_alert_queued == 0 && _now > ALERT_MS)) {
+      _alert_queued = _now;
+      const char * event = "{\"rule\":\"dry\",\"state\":\"on\"}";
+      publish("miflora_rbs/alert/dry", event, strlen(event), false, PRIORITY_ALERT);
+    }
+
+    if (_connected && _discovery_done == false && _now >= _discovery_at)
+      discoveryPass();
+
+    if (_now % MQTT_QUEUE_DRAIN_MS == 0) {
+      if (_connected)
+        drain();
+      if (_spill_pending)
+        spillMarked();
+    }
+
+    if (_discovery_done && _spool.empty() && _alerts.empty() && _state.empty() && 
+        _diagnostics.empty() && _discovery.empty() && _fifo.empty() && _alert_queued)
+      break;
+  }
+  return _result;
+}
+
+static void _report(const char * label, Result_t & result) {
+
+  unsigned int  peak = 0, rssi = 0, state = 0, discovery = 0;
+  unsigned long first_discovery = 0, last_discovery = 0, last = 0;
+
+  for (size_t i = 0, j = 0; i < result.sent.size(); ++ i) {
+    while (result.sent[i].at - result.sent[j].at >= 1000)
+      j ++;
+    if (i - j + 1 > peak)
+      peak = i - j + 1;
+
+    switch (result.sent[i].kind) {
+      case 'r': rssi ++; break;
+      case 's': state ++; break;
+      case 'd':
+        if (discovery ++ == 0) first_discovery = result.sent[i].at;
+        last_discovery = result.sent[i].at;
+        break;
+    }
+    last = result.sent[i].at;
+  }
+
+  printf("  %-8s %3u msg/s peak, alert sent after %4lu ms, %3u RSSI, %2u readings, "
+         "discovery over %5.2f s, all sent %5.2f s after connecting\n",
+    label, peak, result.alert_ms, rssi, state, (last_discovery - first_discovery) / 1000.0, 
+    (last - OFFLINE_MS) / 1000.0);
+  printf("  %-8s %lu spilled, %lu dropped, %lu drain runs held by the budget\n",
+    "", result.spilled, result.dropped, result.throttled);
+}
+
+int main(int argc, char ** argv) {
+
+  uint32_t rate_msgs  = argc > 1 ? atoi(argv[1]) : MQTT_RATE_MSGS;
+  uint32_t rate_bytes = argc > 2 ? atoi(argv[2]) : MQTT_RATE_BYTES;
+
+  memset(_config, 'x', DISCOVERY_LEN);
+
+  printf("%u RSSI updates and %u readings queued over %lu s offline, an alert, %u discovery configs of %u B\n",
+    RSSI_UPDATES, READINGS, OFFLINE_MS / 1000, DISCOVERY, DISCOVERY_LEN);
+
+  Station * before = new Station(false, 0, 0);
+  _report("before", before->run());
+  delete before;
+
+  Station * classes = new Station(true, rate_msgs, rate_bytes);
+  printf("  budget %u msg/s (burst %u), %u B/s (burst %u)\n", 
+    rate_msgs, MQTT_BURST_MSGS, rate_bytes, MQTT_BURST_BYTES);
+  _report("classes", classes->run());
+  delete classes;
+  return 0;
+}
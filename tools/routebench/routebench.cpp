@@ -0,0 +1,143 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host benchmark of the dispatch of received MQTT topics: the previous
+ * list of subscriptions, compared one by one, against the trie of
+ * src/topic_router.cpp, for fleets of growing size. Both are checked to
+ * give the same handler parameter for every topic.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o routebench routebench.cpp ../../src/topic_router.cpp
+ *
+ * Usage:
+ *   ./routebench
+ *
+ * Each fleet has 8 station command topics plus the 4 attribute topics of
+ * each plant. Times are of the host, per received message.
+ */
+
+#include <stdio.h>
+#include <strings.h>
+#include <chrono>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "topic_router.h"
+
+/* the list as MQTT kept it, copied entry by entry while searching */
+typedef struct {
+  std::string            topic;
+  TopicRouter::Handler_t handler;
+  void *                 param;
+} Subscription_t;
+
+static std::list<Subscription_t> _subscriptions;
+
+static TopicRouter::Handler_t _listMatch(const char * topic, void ** param) {
+  for (auto subscription : _subscriptions) {
+    if (strcasecmp(topic, subscription.topic.c_str()) == 0) {
+      *param = subscription.param;
+      return subscription.handler;
+    }
+  }
+  return NULL;
+}
+
+static volatile long _sink;
+
+static void _handler(const char *, uint8_t *, unsigned int, void * param) {
+  _sink += (long) param;
+}
+
+static const char * _attributes[] = { "temp", "conductivity", "light", "moisture" };
+
+int main() {
+
+  int errors = 0;
+
+  for (int plants : { 10, 50, 100, 200, 400 }) {
+
+    TopicRouter router;
+    std::vector<std::string> topics;
+    char topic[96];
+
+    _subscriptions.clear();
+    for (int i = 0; i < 8; ++ i) {
+      snprintf(topic, sizeof(topic), "miflora_rbs/station/station1/command/c%d", i);
+      _subscriptions.push_back({ topic, _handler, NULL });
+      router.add(topic, _handler, NULL);
+    }
+
+    for (int p = 0; p < plants; ++ p) {
+      for (auto attr : _attributes) {
+        snprintf(topic, sizeof(topic), "miflora_rbs/C4:7C:8D:6A:%02X:%02X/%s", p >> 8, p & 0xFF, attr);
+        _subscriptions.push_back({ topic, _handler, (void *) (long) (p + 1) });
+        router.add(topic, _handler, (void *) (long) (p + 1));
+        topics.push_back(topic);
+      }
+    }
+
+    for (auto & t : topics) {
+      void * a = NULL, * b = NULL;
+      _listMatch(t.c_str(), &a);
+      router.match(t.c_str(), &b);
+      if (a != b) {
+        printf("mismatch on %s\n", t.c_str());
+        ++ errors;
+      }
+    }
+
+    int rounds = 200000 / plants;
+    void * param;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++ r) {
+      for (auto & t : topics) {
+        TopicRouter::Handler_t handler = _listMatch(t.c_str(), &param);
+        if (handler) handler(NULL, NULL, 0, param);
+      }
+    }
+    double list_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / (rounds * topics.size());
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++ r) {
+      for (auto & t : topics) {
+        TopicRouter::Handler_t handler = router.match(t.c_str(), &param);
+        if (handler) handler(NULL, NULL, 0, param);
+      }
+    }
+    double trie_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / (rounds * topics.size());
+
+    printf("%3d plants: %4zu subscriptions, list %6.0f ns, trie %4.0f ns, %u nodes\n",
+      plants, _subscriptions.size(), list_ns, trie_ns, router.countNodes());
+  }
+
+  return errors ? 1 : 0;
+}
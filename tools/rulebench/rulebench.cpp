@@ -0,0 +1,144 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host benchmark of the alert rules (src/rule_vm.cpp) at 1000 rules:
+ * bytecode size, cost of evaluating every rule, and cost of an attribute
+ * update when only the rules reading it run, as in AlertRules.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o rulebench rulebench.cpp ../../src/rule_vm.cpp
+ *
+ * Usage:
+ *   ./rulebench [rules]
+ *
+ * Times are of the host, the ratios between them are what carries over.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "rule_vm.h"
+
+/* slots as in AlertRules, one per AttributeID */
+static const RuleSymbol_t _symbols[] = {
+  { "moisture"     , 0 },
+  { "temp"         , 1 },
+  { "conductivity" , 2 },
+  { "light"        , 3 },
+  { "rssi"         , 4 },
+  { "dli"          , 5 },
+  { "vpd"          , 6 },
+};
+static const unsigned int SLOTS = 7;
+
+/* a mix of the rules of data/rules.cfg.sample */
+static const char * _templates[] = {
+  "moisture < %d for 30 min",
+  "temp > max and light > %d000",
+  "conductivity < %d0 or conductivity > max",
+  "vpd > 1.%d and temp > 25",
+  "dli < %d and not (light > 30000)",
+  "moisture < min + %d or moisture > max",
+  "age > %dm",
+};
+
+static double _seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv) {
+
+  unsigned int count = argc > 1 ? atoi(argv[1]) : 1000;
+  size_t templates   = sizeof(_templates) / sizeof(_templates[0]);
+
+  RuleCode code;
+  std::vector<RuleCode::Program_t> programs(count);
+  std::vector<uint16_t> by_slot[SLOTS];
+  const char * error;
+  char expr[96];
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < count; ++ i) {
+    snprintf(expr, sizeof(expr), _templates[i % templates], (int) (i % 50 + 1));
+    if (code.compile(expr, _symbols, SLOTS, programs[i], &error) == false) {
+      fprintf(stderr, "%s: %s\n", expr, error);
+      return 1;
+    }
+    for (unsigned int slot = 0; slot < SLOTS; ++ slot) {
+      if (programs[i].deps & (1u << slot))
+        by_slot[slot].push_back(i);
+    }
+  }
+  double compile_sec = _seconds(start);
+
+  float values[SLOTS] = { 25, 24, 800, 12000, -70, 14, 1.1f };
+  float mins[SLOTS]   = { 20, 10, 350, NAN, NAN, NAN, NAN };
+  float maxs[SLOTS]   = { 60, 32, 2000, 30000, NAN, NAN, NAN };
+  RuleContext_t ctx   = { values, mins, maxs, 600 };
+  volatile unsigned int holds = 0;
+
+  printf("%u rules, %zu bytes of bytecode, compiled in %.1f us\n", count, code.size(), compile_sec * 1e6);
+
+  // every rule on every update
+  unsigned int rounds = 0;
+  start = std::chrono::steady_clock::now();
+  do {
+    values[rounds % 4] += (rounds & 1) ? 0.5f : -0.5f;
+    for (auto & program : programs)
+      holds += code.evaluate(program, ctx, (rounds & 2) ? 2.0f : 0.0f);
+    ++ rounds;
+  } while (_seconds(start) < 0.5);
+  double full_us = _seconds(start) * 1e6 / rounds;
+  printf("  all rules      %8.2f us per update, %6.1f ns per rule\n", full_us, full_us * 1e3 / count);
+
+  // only the rules reading the updated value
+  size_t evaluated = 0;
+  rounds = 0;
+  start = std::chrono::steady_clock::now();
+  do {
+    unsigned int slot = rounds % 4;
+    values[slot] += (rounds & 1) ? 0.5f : -0.5f;
+    for (uint16_t rule : by_slot[slot])
+      holds += code.evaluate(programs[rule], ctx, (rounds & 2) ? 2.0f : 0.0f);
+    evaluated += by_slot[slot].size();
+    ++ rounds;
+  } while (_seconds(start) < 0.5);
+  double incr_us = _seconds(start) * 1e6 / rounds;
+  printf("  reading rules  %8.2f us per update, %6.1f rules per update, %.1fx less than all\n",
+    incr_us, (double) evaluated / rounds, full_us / incr_us);
+
+  // age rules, run every ALERT_AGE_CHECK_SEC for each plant
+  size_t age_rules = 0;
+  for (auto & program : programs)
+    age_rules += program.uses_age;
+  printf("  age rules      %zu, evaluated periodically for each plant\n", age_rules);
+
+  return holds == 0xFFFFFFFF;
+}
@@ -0,0 +1,278 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host simulation of connecting with a fleet of retained values on the
+ * broker, from the SUBACK until the last retained value is applied: the
+ * real TopicRouter and MQTTQueue are driven as MQTT::handleCbk(),
+ * MQTT::acceptRetained() and MQTT::applyCbk() do.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -I../../include -o rxsim rxsim.cpp \
+ *     ../../src/topic_router.cpp ../../src/mqtt_queue.cpp
+ *
+ * Usage:
+ *   ./rxsim [plants] [rtt_ms]
+ *
+ * Each plant has 10 retained topics on the broker, 5 of them routed (the
+ * four values and the state, as collaborating stations do). The broker
+ * sends them as fast as the TCP window of lwIP lets it, the window opening
+ * again half a round trip after the station read the data. Defaults are 200
+ * plants over a 20 ms round trip.
+ *
+ * Modes:
+ *   before   one packet read every 100 ms, applied as it is read
+ *   mqtt 3   up to MQTT_RX_BURST packets read every 100 ms, into the table
+ *   mqtt 5   all the packets waiting read every 100 ms, into the table
+ * The table is applied MQTT_RX_APPLY_BURST values every MQTT_RX_APPLY_MS.
+ * Handlers only count, the time they take on the station is not modeled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <firmware_config.h>
+
+#include "topic_router.h"
+#include "mqtt_queue.h"
+
+static const unsigned long HANDLE_MS = 100;  // MQTT_UPDATE_INTERVAL of mqtt.h
+static const size_t        TCP_WND   = 5744; // CONFIG_TCP_WND_DEFAULT of the ESP32 lwIP
+
+static const char * _levels[] = {
+  "temp", "conductivity", "light", "moisture", "state",          // routed
+  "rssi", "availability", "dli", "vpd", "water_in"               // not routed
+};
+static const unsigned int LEVELS = sizeof(_levels) / sizeof(_levels[0]);
+static const unsigned int ROUTED = 5;
+
+static const char * STATE = "{\"moisture\":41,\"temp\":21.50,\"conductivity\":350,\"light\":1200,"
+  "\"age\":{\"moisture\":12,\"temp\":12,\"conductivity\":12,\"light\":12},\"station\":\"kitchen\"}";
+
+enum Mode { MODE_BEFORE, MODE_MQTT3, MODE_MQTT5 };
+
+typedef struct {
+  std::string topic;
+  std::string payload;
+  size_t      size;    // on the wire
+} Retained_t;
+
+typedef struct {
+  unsigned long at;
+  size_t        index;
+} Arrival_t;
+
+typedef struct {
+  unsigned long at;
+  size_t        bytes;
+} WindowUpdate_t;
+
+static std::vector<Retained_t> _retained;
+static TopicRouter             _router;
+static unsigned long           _applied;
+
+static void _countHandler(const char *, uint8_t *, unsigned int, void *) {
+  ++ _applied;
+}
+
+static void _buildFleet(unsigned int plants) {
+
+  char prefix[64];
+
+  for (unsigned int p = 0; p < plants; ++ p) {
+    snprintf(prefix, sizeof(prefix), "miflora_rbs/c4:7c:8d:6a:%02x:%02x/", p >> 8, p & 0xFF);
+
+    for (unsigned int l = 0; l < LEVELS; ++ l) {
+      Retained_t retained;
+      retained.topic   = std::string(prefix) + _levels[l];
+      retained.payload = l == 4 ? STATE : l == 6 ? "online" : "21.50";
+
+      size_t remaining = 2 + retained.topic.size() + retained.payload.size() + 1;
+      retained.size    = 1 + (remaining < 128 ? 1 : 2) + remaining;
+      _retained.push_back(retained);
+
+      if (l < ROUTED)
+        _router.add(retained.topic.c_str(), _countHandler, NULL);
+    }
+  }
+}
+
+/* the received message, as MQTT::deliver() */
+static void _deliver(const char * topic, const uint8_t * payload, unsigned int len) {
+
+  void * param;
+  TopicRouter::Handler_t handler = _router.match(topic, &param);
+  if (handler)
+    handler(topic, (uint8_t *) payload, len, param);
+}
+
+/* as MQTT::applyRetained() */
+static bool _applyRetained(MQTTQueue & table) {
+
+  MQTTQueue::Message_t message;
+
+  if (table.front(message) == false)
+    return false;
+
+  _deliver(message.topic, message.payload, message.length);
+  table.pop();
+  return true;
+}
+
+/* as MQTT::acceptRetained() */
+static void _acceptRetained(MQTTQueue & table, const Retained_t & retained, bool & apply_enabled) {
+
+  void * param;
+  const uint8_t * payload = (const uint8_t *) retained.payload.c_str();
+
+  if (_router.match(retained.topic.c_str(), &param) == NULL)
+    return;
+
+  while (table.fits(retained.topic.c_str(), retained.payload.size()) == false) {
+    if (table.empty()) {
+      _deliver(retained.topic.c_str(), payload, retained.payload.size());
+      return;
+    }
+    _applyRetained(table);
+  }
+
+  table.push(retained.topic.c_str(), payload, retained.payload.size(), true, 0);
+  apply_enabled = true;
+}
+
+/* ms from the SUBACK to the last retained value applied */
+static unsigned long _settle(Mode mode, unsigned long rtt_ms, unsigned int & peak) {
+
+  static uint8_t buffer[MQTT_RX_TABLE_SIZE];
+  MQTTQueue table(buffer, sizeof(buffer));
+
+  std::deque<Arrival_t>      in_flight;
+  std::deque<size_t>         socket;
+  std::deque<WindowUpdate_t> updates;
+  size_t        next       = 0;
+  size_t        unacked    = 0;  // sent by the broker, not known to be read
+  size_t        read       = 0;
+  bool          apply_enabled = false;
+  unsigned long apply_at   = 0;
+
+  _applied = 0;
+  peak     = 0;
+
+  for (unsigned long now = 0; ; ++ now) {
+
+    // the broker learns of the read data and fills the window again
+    while (updates.empty() == false && updates.front().at <= now) {
+      unacked -= updates.front().bytes;
+      updates.pop_front();
+    }
+    while (next < _retained.size() && unacked + _retained[next].size <= TCP_WND) {
+      unacked += _retained[next].size;
+      in_flight.push_back({ now + rtt_ms / 2, next ++ });
+    }
+    while (in_flight.empty() == false && in_flight.front().at <= now) {
+      socket.push_back(in_flight.front().index);
+      in_flight.pop_front();
+    }
+
+    // handle task
+    if (now % HANDLE_MS == 0) {
+      unsigned int burst = mode == MODE_BEFORE ? 1 : mode == MODE_MQTT3 ? MQTT_RX_BURST : ~0u;
+
+      for (unsigned int n = 0; n < burst && socket.empty() == false; ++ n) {
+        const Retained_t & retained = _retained[socket.front()];
+        socket.pop_front();
+        updates.push_back({ now + rtt_ms / 2, retained.size });
+        ++ read;
+
+        if (mode == MODE_BEFORE) {
+          _deliver(retained.topic.c_str(), (const uint8_t *) retained.payload.c_str(), retained.payload.size());
+        } else {
+          bool was_enabled = apply_enabled;
+          _acceptRetained(table, retained, apply_enabled);
+          if (apply_enabled && was_enabled == false)
+            apply_at = now;
+        }
+      }
+      if (table.count() > peak)
+        peak = table.count();
+    }
+
+    // apply task, runs from when it is enabled
+    if (apply_enabled && now >= apply_at) {
+      for (unsigned int n = 0; n < MQTT_RX_APPLY_BURST && _applyRetained(table); n ++);
+      apply_at = now + MQTT_RX_APPLY_MS;
+      if (table.empty())
+        apply_enabled = false;
+    }
+
+    if (read == _retained.size() && table.empty())
+      return now;
+  }
+}
+
+int main(int argc, char ** argv) {
+
+  unsigned int  plants = argc > 1 ? atoi(argv[1]) : 200;
+  unsigned long rtt_ms = argc > 2 ? atol(argv[2]) : 20;
+  unsigned int  peak;
+
+  _buildFleet(plants);
+
+  printf("%u plants, %zu retained topics, %u routed, %lu ms round trip, %u byte table\n",
+    plants, _retained.size(), _router.countRoutes(), rtt_ms, (unsigned int) MQTT_RX_TABLE_SIZE);
+
+  const char * labels[] = { "before", "mqtt 3", "mqtt 5" };
+  for (int mode = MODE_BEFORE; mode <= MODE_MQTT5; ++ mode) {
+    unsigned long ms = _settle((Mode) mode, rtt_ms, peak);
+    printf("  %-7s settled in %7.2f s, %lu values applied, table peak %u entries\n",
+      labels[mode], ms / 1000.0, _applied, peak);
+  }
+
+  // host cost of accepting and applying, without the handlers' work
+  static uint8_t buffer[MQTT_RX_TABLE_SIZE];
+  MQTTQueue table(buffer, sizeof(buffer));
+  bool   enabled;
+  size_t messages = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  double elapsed;
+  do {
+    for (auto & retained : _retained) {
+      _acceptRetained(table, retained, enabled);
+    }
+    while (_applyRetained(table));
+    messages += _retained.size();
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5);
+
+  printf("  accept and apply %.3f us per received message on the host\n", elapsed * 1e6 / messages);
+  return 0;
+}
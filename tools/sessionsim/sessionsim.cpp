@@ -0,0 +1,192 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host checks of persistent MQTT sessions: the packet ids of QoS 1 messages
+ * resent after a reconnect, the cost of a reconnect with and without the
+ * session, and the connect attempts of a fleet during a broker outage.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -I../../include -o sessionsim sessionsim.cpp \
+ *     ../../src/mqtt_queue.cpp
+ *
+ * Usage:
+ *   ./sessionsim
+ *
+ * Packet ids: the real MQTTQueue holds 12 messages, 8 are sent and 3 of them
+ * acknowledged before the link drops. unsend() must hand the other 5 out
+ * again as duplicates with their ids while the session is kept
+ * (MQTT-4.4.0-1), without them otherwise. Exits with 1 if not.
+ *
+ * Reconnect: 20 plants collaborating on the value topics, 8 retained topics
+ * each, 10 subscriptions, 30 ms round trip. In a new session the broker
+ * sends a SUBACK for each subscription and every retained value again, and
+ * PubSubClient handles one packet per loop() run, every 100 ms. A kept
+ * session only costs the CONNACK.
+ *
+ * Outage: 10 stations, the broker down for 300 s, retrying every second
+ * against the backoff of Network (MQTT_RECONNECT_MIN_MS doubled up to
+ * MQTT_RECONNECT_MAX_MS, picked in the upper half of each step).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+
+#include <firmware_config.h>
+
+#include "mqtt_queue.h"
+
+static const char *       PLANT_TOPIC   = "miflora_rbs/c4:7c:8d:6a:5c:ff/";
+static const char *       VALUES[]      = { "temp", "moisture", "light", "conductivity", "battery", "rssi", "dli", "vpd" };
+static const char *       PAYLOAD       = "21.50";
+
+static const unsigned int MESSAGES      = 12;
+static const unsigned int SENT          = 8;
+static const unsigned int PLANTS        = 20;
+static const unsigned int SUBSCRIPTIONS = 10;
+static const double       RTT_MS        = 30;
+static const double       LOOP_MS       = 100;
+static const unsigned int STATIONS      = 10;
+static const double       OUTAGE_MS     = 300000;
+
+static std::mt19937 _rng(1);
+
+/* the unacknowledged messages go out again as duplicates, with or without their ids */
+static bool _checkResend(bool session) {
+
+  static uint8_t buffer[MQTT_QUEUE_STATE];
+
+  MQTTQueue            queue(buffer, sizeof(buffer));
+  MQTTQueue::Message_t message;
+  uint16_t             sent_with[MESSAGES] = {};
+  uint32_t             refs[MESSAGES] = {};
+  char                 topic[64];
+  unsigned int         resent = 0, right = 0;
+
+  for (unsigned int i = 0; i < MESSAGES; ++ i) {
+    snprintf(topic, sizeof(topic), "%smoisture/%u", PLANT_TOPIC, i);
+    queue.push(topic, (const uint8_t *) PAYLOAD, strlen(PAYLOAD), false, 0);
+  }
+
+  // the first ones sent with ids from 100, some acknowledged out of order
+  for (unsigned int i = 0; i < SENT && queue.unsent(message); ++ i) {
+    unsigned int index = atoi(strrchr(message.topic, '/') + 1);
+    sent_with[index] = 100 + i;
+    refs[index]      = message.ref;
+    queue.markSent(message.ref, sent_with[index]);
+  }
+  for (unsigned int index : { 1u, 4u, 6u }) {
+    queue.ack(refs[index]);
+    sent_with[index] = 0;
+  }
+
+  queue.unsend(session);
+
+  while (queue.unsent(message)) {
+    unsigned int index = atoi(strrchr(message.topic, '/') + 1);
+    queue.markSent(message.ref, 1);
+
+    if (sent_with[index] == 0) {
+      if (message.dup == false && message.packet_id == 0)
+        ++ right;
+      continue;
+    }
+    ++ resent;
+    if (message.dup && message.packet_id == (session ? sent_with[index] : 0))
+      ++ right;
+  }
+
+  printf("  %-13s %u resent, %u of %u messages as expected\n", 
+    session ? "kept:" : "new session:", resent, right, MESSAGES - 3);
+  return resent == SENT - 3 && right == MESSAGES - 3;
+}
+
+static size_t _publishSize(const char * topic, const char * payload) {
+  size_t remaining = 2 + strlen(topic) + strlen(payload);
+  return 1 + (remaining < 128 ? 1 : 2) + remaining;
+}
+
+/* connect attempts of a station during the outage, and when it gets back after it */
+static unsigned int _attempts(bool backoff, double & back_ms) {
+
+  unsigned long step = 0;
+  unsigned int  count = 0;
+  double        now = 0;
+
+  while (now < OUTAGE_MS) {
+    ++ count;
+    if (backoff == false) {
+      now += 1000;
+      continue;
+    }
+    // as Network::nextMQTTRetry()
+    step = step ? step * 2 : MQTT_RECONNECT_MIN_MS;
+    if (step > MQTT_RECONNECT_MAX_MS)
+      step = MQTT_RECONNECT_MAX_MS;
+    now += step / 2 + std::uniform_int_distribution<unsigned long>(0, step / 2)(_rng);
+  }
+  back_ms = now - OUTAGE_MS;
+  return count;
+}
+
+int main() {
+
+  bool success = true;
+
+  printf("QoS 1 packet ids after a reconnect:\n");
+  success &= _checkResend(true);
+  success &= _checkResend(false);
+
+  char   topic[64];
+  size_t retained = 0;
+  for (const char * value : VALUES) {
+    snprintf(topic, sizeof(topic), "%s%s", PLANT_TOPIC, value);
+    retained += _publishSize(topic, PAYLOAD);
+  }
+  size_t packets = SUBSCRIPTIONS + PLANTS * (sizeof(VALUES) / sizeof(VALUES[0]));
+  size_t bytes   = 4 + SUBSCRIPTIONS * 5 + PLANTS * retained;
+
+  printf("reconnect, %u plants, %u subscriptions:\n", PLANTS, SUBSCRIPTIONS);
+  printf("  new session:  %zu B received, steady after %.1f s\n", bytes, (RTT_MS + packets * LOOP_MS) / 1000);
+  printf("  kept session: 4 B received, steady after %.0f ms\n", RTT_MS);
+
+  printf("%u stations, broker down for %.0f s:\n", STATIONS, OUTAGE_MS / 1000);
+  for (bool backoff : { false, true }) {
+    unsigned int total = 0;
+    double       first = OUTAGE_MS, last = 0, back;
+
+    for (unsigned int station = 0; station < STATIONS; ++ station) {
+      total += _attempts(backoff, back);
+      if (back < first) first = back;
+      if (back > last)  last  = back;
+    }
+    printf("  %-10s %4u connect attempts, back %.1f-%.1f s after the broker\n", 
+      backoff ? "backoff:" : "1 s retry:", total, first / 1000, last / 1000);
+  }
+  return success ? 0 : 1;
+}
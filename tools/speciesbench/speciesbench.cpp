@@ -0,0 +1,165 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host benchmark of the boot cost of plant limits for a large fleet: a
+ * devices.cfg giving the 8 limit keys of each plant against one giving a
+ * species= key, resolved in the database built by tools/speciesdb.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o speciesbench speciesbench.cpp ../../src/species_db.cpp
+ *
+ * Usage:
+ *   ./speciesbench species.bin ../../data/species.csv [plants]
+ *
+ * devices.cfg is modelled as ConfigFile keeps it, parallel vectors of keys
+ * and values searched linearly; heap sizes are those of std::string on a
+ * 32 bit target (24 bytes, 15 characters inline). Times are of the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "species_db.h"
+
+/* ConfigFile as loaded from devices.cfg */
+typedef struct {
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+
+  const char * get(const char * key) {
+    for (size_t i = 0; i < keys.size(); ++ i)
+      if (keys[i].compare(key) == 0)
+        return values[i].c_str();
+    return NULL;
+  }
+} DevicesConfig_t;
+
+static const char * _limits[] = {
+  "min_moisture", "max_moisture", "min_temperature", "max_temperature",
+  "min_conductivity", "max_conductivity", "min_illuminance", "max_illuminance" };
+
+/* heap of a std::string on the target, beyond the object itself */
+static size_t _heap32(const std::string & str) {
+  return str.size() > 15 ? ((str.size() + 1 + 3) & ~3) + 8 : 0;
+}
+
+int main(int argc, char ** argv) {
+
+  static uint8_t db[32768];
+  std::vector<std::string> species;
+  char line[512];
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s species.bin species.csv [plants]\n", argv[0]);
+    return 1;
+  }
+  unsigned int plants = argc > 3 ? atoi(argv[3]) : 200;
+
+  FILE * file = fopen(argv[1], "rb");
+  size_t size = file ? fread(db, 1, sizeof(db), file) : 0;
+  if (file) fclose(file);
+  if (speciesValidate(db, size) == false) {
+    fprintf(stderr, "%s is not a valid species database\n", argv[1]);
+    return 1;
+  }
+
+  file = fopen(argv[2], "r");
+  while (file && fgets(line, sizeof(line), file)) {
+    if (line[0] == '#' || strncmp(line, "key,", 4) == 0 || strchr(line, ',') == NULL)
+      continue;
+    species.push_back(std::string(line, strchr(line, ',') - line));
+  }
+  if (file) fclose(file);
+  if (species.empty()) {
+    fprintf(stderr, "no species in %s\n", argv[2]);
+    return 1;
+  }
+
+  for (int mode = 0; mode < 2; ++ mode) {
+
+    DevicesConfig_t cfg;
+    std::vector<std::string> addresses;
+    char address[18];
+
+    for (unsigned int p = 0; p < plants; ++ p) {
+      snprintf(address, sizeof(address), "c4:7c:8d:6a:%02x:%02x", (p >> 8) & 0xFF, p & 0xFF);
+      std::string prefix(address);
+      addresses.push_back(prefix);
+
+      cfg.keys.push_back(prefix + ":id");   cfg.values.push_back(std::to_string(p));
+      cfg.keys.push_back(prefix + ":name"); cfg.values.push_back("plant" + std::to_string(p));
+      if (mode == 0) {
+        for (auto limit : _limits) {
+          cfg.keys.push_back(prefix + ":" + limit);
+          cfg.values.push_back("1234");
+        }
+      } else {
+        cfg.keys.push_back(prefix + ":species");
+        cfg.values.push_back(species[p % species.size()]);
+      }
+    }
+
+    size_t heap = 0;
+    for (size_t i = 0; i < cfg.keys.size(); ++ i)
+      heap += 2 * 24 + _heap32(cfg.keys[i]) + _heap32(cfg.values[i]);
+
+    // the lookups of MiFloraFleet::loadFromConfig, species first then limits
+    volatile long sink = 0;
+    const int rounds = 20;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++ r) {
+      for (auto & prefix : addresses) {
+        const char * key = cfg.get((prefix + ":species").c_str());
+        if (key) {
+          const SpeciesProfile_t * profile = speciesFind(db, key);
+          sink += profile ? profile->min[0] : 0;
+        }
+        for (auto limit : _limits) {
+          const char * value = cfg.get((prefix + ":" + limit).c_str());
+          if (value) sink += atol(value);
+        }
+      }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    printf("%u plants, %-12s %5zu keys, %7zu bytes of heap while loading, %6.2f ms of lookups\n",
+      plants, mode ? "species=" : "limit keys", cfg.keys.size(), heap, ms);
+  }
+
+  volatile uintptr_t sink = 0;
+  const int lookups = 1000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < lookups; ++ i)
+    sink += (uintptr_t) speciesFind(db, species[i % species.size()].c_str());
+  printf("speciesFind %.1f ns per lookup over %zu species\n",
+    std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / lookups, species.size());
+  return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host generator of the species profile database (see src/species_db.h).
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o speciesdb speciesdb.cpp ../../src/species_db.cpp
+ *
+ * Usage:
+ *   ./speciesdb ../../data/species.csv species.bin
+ *   esptool.py write_flash 0x3D8000 species.bin
+ *
+ * CSV columns, empty fields are not set (first line is the header):
+ *   key,
+ *   min_moisture,max_moisture,min_temperature,max_temperature,
+ *   min_conductivity,max_conductivity,min_illuminance,max_illuminance,
+ *   bar_moisture,bar_temperature,bar_conductivity,bar_illuminance
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include <algorithm>
+
+#include "species_db.h"
+
+#define COLUMNS (1 + 3 * SPECIES_VALUES)
+
+/* split a line in place, returns the number of fields */
+static int _splitFields(char * line, char ** fields, int max_fields) {
+  int count = 0;
+
+  line[strcspn(line, "\r\n")] = '\0';
+  while (count < max_fields) {
+    fields[count++] = line;
+    line = strchr(line, ',');
+    if (line == NULL)
+      break;
+    *line++ = '\0';
+  }
+  return count;
+}
+
+int main(int argc, char ** argv) {
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s species.csv species.bin\n", argv[0]);
+    return 1;
+  }
+
+  FILE * in = fopen(argv[1], "r");
+  if (in == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  std::vector<SpeciesProfile_t> profiles;
+  char line[1024];
+  int  line_no = 0;
+  int  errors = 0;
+
+  while (fgets(line, sizeof(line), in)) {
+
+    char * fields[COLUMNS];
+    line_no++;
+
+    // header, comments and empty lines
+    if (line_no == 1 || line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+      continue;
+
+    int count = _splitFields(line, fields, COLUMNS);
+    size_t key_len = strlen(fields[0]);
+
+    if (key_len == 0 || key_len >= SPECIES_KEY_LEN) {
+      fprintf(stderr, "line %d: key must have 1 to %d characters\n", line_no, SPECIES_KEY_LEN - 1);
+      errors++;
+      continue;
+    }
+
+    SpeciesProfile_t profile;
+    memset(&profile, 0, sizeof(profile));
+
+    for (size_t i = 0; i < key_len; i++)
+      profile.key[i] = tolower((unsigned char) fields[0][i]);
+    profile.hash = speciesHash(profile.key);
+
+    for (int value = 0; value < SPECIES_VALUES; value++) {
+      int column = 1 + value * 2;
+
+      if (column < count && fields[column][0]) {
+        profile.min[value]  = atol(fields[column]);
+        profile.has_min    |= 1 << value;
+      }
+      if (column + 1 < count && fields[column + 1][0]) {
+        profile.max[value]  = atol(fields[column + 1]);
+        profile.has_max    |= 1 << value;
+      }
+
+      column = 1 + SPECIES_VALUES * 2 + value;
+      if (column < count && fields[column][0])
+        profile.display_max[value] = strtoul(fields[column], NULL, 10);
+    }
+
+    profiles.push_back(profile);
+  }
+  fclose(in);
+
+  // the firmware does a binary search on the hash
+  std::sort(profiles.begin(), profiles.end(), 
+    [](const SpeciesProfile_t & a, const SpeciesProfile_t & b) {
+      return a.hash != b.hash ? a.hash < b.hash : strcmp(a.key, b.key) < 0;
+    });
+
+  for (size_t i = 1; i < profiles.size(); i++) {
+    if (strcmp(profiles[i - 1].key, profiles[i].key) == 0) {
+      fprintf(stderr, "duplicate key '%s'\n", profiles[i].key);
+      errors++;
+    }
+  }
+
+  if (errors || profiles.size() > 0xFFFF) {
+    fprintf(stderr, "%d errors, nothing written\n", errors);
+    return 1;
+  }
+
+  SpeciesDBHeader_t header;
+  memset(&header, 0, sizeof(header));
+  header.magic   = SPECIES_DB_MAGIC;
+  header.version = SPECIES_DB_VERSION;
+  header.count   = profiles.size();
+  header.crc     = speciesCRC((const uint8_t *) profiles.data(), profiles.size() * sizeof(SpeciesProfile_t));
+
+  FILE * out = fopen(argv[2], "wb");
+  if (out == NULL) {
+    perror(argv[2]);
+    return 1;
+  }
+
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(profiles.data(), sizeof(SpeciesProfile_t), profiles.size(), out);
+  fclose(out);
+
+  printf("%u profiles, %u bytes\n", (unsigned int) profiles.size(),
+    (unsigned int) (sizeof(header) + profiles.size() * sizeof(SpeciesProfile_t)));
+  return 0;
+}
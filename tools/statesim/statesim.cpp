@@ -0,0 +1,139 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host model of the broker load of one plant heard by one station, with a
+ * topic per attribute against the JSON state of flora:publish_state.
+ *
+ * Build:
+ *   g++ -O2 -I../../include -o statesim statesim.cpp
+ *
+ * Usage:
+ *   ./statesim [subscribers]
+ *
+ * The plant advertises every 3 s, each advert carrying one of temperature,
+ * conductivity, light and moisture in turn, with the RSSI of every advert;
+ * light updates the DLI and temperature the VPD. A value topic is published
+ * when its value was not published for FLORA_PUBLISH_MIN_INTERVAL_SEC, the
+ * state at most once per that interval, built as publishState() does.
+ * Bytes are of whole QoS 0 PUBLISH packets; the broker delivers each of
+ * them to every subscriber (other stations and HASS, 3 by default).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <default_config.h>
+
+static const unsigned int ADVERT_SEC = 3;
+static const unsigned int HOUR_SEC   = 3600;
+
+static const char * BASE_TOPIC = "miflora_rbs/c4:7c:8d:6a:5c:ff/";
+
+enum { TEMP, COND, LIGHT, MOIST, RSSI, DLI, VPD, VALUES };
+
+static const struct {
+  const char * topic;       // last level of the value topic
+  const char * state;       // key in the state
+  const char * text;        // value as published
+} _values[VALUES] = {
+  { "temp"        , "temp"        , "21.50" },
+  { "conductivity", "conductivity", "350"   },
+  { "light"       , "light"       , "12000" },
+  { "moisture"    , "moisture"    , "41"    },
+  { "rssi"        , "rssi"        , "-67"   },
+  { "dli"         , "dli"         , "11.20" },
+  { "vpd"         , "vpd"         , "1.05"  },
+};
+
+static size_t _packetSize(size_t topic, size_t payload) {
+  size_t remaining = 2 + topic + payload;
+  return 1 + (remaining < 128 ? 1 : 2) + remaining;
+}
+
+/* the state with every value known, as publishState() formats it */
+static size_t _stateSize() {
+
+  char values[192] = "", ages[192] = "", payload[512];
+  int  values_len = 0, ages_len = 0;
+
+  for (int v = 0; v < VALUES; ++ v) {
+    const char * sep = v ? "," : "";
+    values_len += snprintf(values + values_len, sizeof(values) - values_len, "%s\"%s\":%s", sep, _values[v].state, _values[v].text);
+    ages_len   += snprintf(ages + ages_len, sizeof(ages) - ages_len, "%s\"%s\":%u", sep, _values[v].state, 12);
+  }
+  return snprintf(payload, sizeof(payload), "{%s,\"age\":{%s},\"station\":\"%s\"}", values, ages, "station1");
+}
+
+int main(int argc, char ** argv) {
+
+  unsigned int subscribers = argc > 1 ? atoi(argv[1]) : 3;
+  unsigned int interval    = FLORA_PUBLISH_MIN_INTERVAL_SEC;
+
+  long   last[VALUES];
+  long   last_state = -1000000;
+  size_t value_msgs = 0, value_bytes = 0;
+  size_t state_msgs = 0, state_bytes = 0;
+  size_t state_size = _stateSize();
+  size_t state_topic = strlen(BASE_TOPIC) + strlen("state");
+
+  for (int v = 0; v < VALUES; ++ v)
+    last[v] = -1000000;
+
+  for (unsigned int i = 0; i < HOUR_SEC / ADVERT_SEC; ++ i) {
+
+    long now     = i * ADVERT_SEC;
+    int  reading = i % 4;
+    int  updated[3] = { reading, RSSI, -1 };
+
+    if (reading == LIGHT) updated[2] = DLI;
+    if (reading == TEMP)  updated[2] = VPD;
+
+    for (int v : updated) {
+      if (v < 0 || now - last[v] <= (long) interval)
+        continue;
+      last[v] = now;
+      ++ value_msgs;
+      value_bytes += _packetSize(strlen(BASE_TOPIC) + strlen(_values[v].topic), strlen(_values[v].text));
+    }
+
+    if (now - last_state >= (long) interval) {
+      last_state = now;
+      ++ state_msgs;
+      state_bytes += _packetSize(state_topic, state_size);
+    }
+  }
+
+  printf("one plant, one station, advert every %u s, publish interval %u s, %u subscribers\n",
+    ADVERT_SEC, interval, subscribers);
+  printf("  value topics  %5zu messages/h, %6.1f KB/h in, %5zu deliveries/h\n",
+    value_msgs, value_bytes / 1024.0, value_msgs * subscribers);
+  printf("  JSON state    %5zu messages/h, %6.1f KB/h in, %5zu deliveries/h (%zu byte payload)\n",
+    state_msgs, state_bytes / 1024.0, state_msgs * subscribers, state_size);
+  printf("  %.1fx fewer messages\n", (double) value_msgs / state_msgs);
+  return 0;
+}
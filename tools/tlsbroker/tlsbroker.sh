@@ -0,0 +1,108 @@
+#!/bin/sh
+#
+#   MIT License
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy
+#  of this software and associated documentation files (the "Software"), to deal
+#  in the Software without restriction, including without limitation the rights
+#  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+#  copies of the Software, and to permit persons to whom the Software is
+#  furnished to do so, subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+#  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+#  SOFTWARE.
+#
+#  Copyright (c) 2021 Alex Mircescu
+#
+
+#
+# Local TLS broker for testing mqtt:tls, and check of its session resumption.
+#
+# Usage:
+#   ./tlsbroker.sh setup <dir> <broker host name>
+#       CA and broker certificates, and a mosquitto.conf with a TLS
+#       listener on 8883, in <dir>; start it with mosquitto -c <dir>/mosquitto.conf
+#       and upload <dir>/ca.crt to SPIFFS as the station's mqtt:tls_ca_file
+#
+#   ./tlsbroker.sh check <host> [port] [ca file]
+#       a full handshake then one offering its session, as TLSClient does
+#       on reconnect; prints the time of both and whether the session was
+#       resumed. The station logs the same for its own handshakes.
+#
+
+set -e
+
+setup() {
+  dir="$1"
+  host="$2"
+  mkdir -p "$dir"
+
+  openssl req -x509 -newkey rsa:2048 -nodes -days 3650 -subj "/CN=miflora_rbs test CA" \
+    -keyout "$dir/ca.key" -out "$dir/ca.crt" 2>/dev/null
+  openssl req -newkey rsa:2048 -nodes -subj "/CN=$host" \
+    -keyout "$dir/broker.key" -out "$dir/broker.csr" 2>/dev/null
+  printf "subjectAltName=DNS:%s\n" "$host" > "$dir/broker.ext"
+  openssl x509 -req -in "$dir/broker.csr" -CA "$dir/ca.crt" -CAkey "$dir/ca.key" -CAcreateserial \
+    -days 3650 -extfile "$dir/broker.ext" -out "$dir/broker.crt" 2>/dev/null
+
+  cat > "$dir/mosquitto.conf" <<CONF
+listener 8883
+cafile $dir/ca.crt
+certfile $dir/broker.crt
+keyfile $dir/broker.key
+allow_anonymous true
+CONF
+
+  echo "certificates and mosquitto.conf in $dir"
+  echo "station config: mqtt:host=$host mqtt:port=8883 mqtt:tls=true, $dir/ca.crt as mqtt:tls_ca_file"
+}
+
+# milliseconds since epoch
+now_ms() {
+  python3 -c 'import time; print(int(time.time() * 1000))'
+}
+
+check() {
+  host="$1"
+  port="${2:-8883}"
+  ca="$3"
+  session=$(mktemp)
+  verify=""
+  [ -n "$ca" ] && verify="-CAfile $ca -verify_return_error"
+
+  for run in full resumed; do
+    if [ "$run" = full ]; then
+      args="-sess_out $session"
+    else
+      args="-sess_in $session"
+    fi
+
+    start=$(now_ms)
+    # shellcheck disable=SC2086
+    out=$(echo | openssl s_client -connect "$host:$port" -servername "$host" -tls1_2 $verify $args 2>&1) || {
+      echo "$out" | tail -5
+      rm -f "$session"
+      exit 1
+    }
+    end=$(now_ms)
+
+    reused=$(echo "$out" | grep -E "^(New|Reused)," | head -1 | cut -d, -f1)
+    echo "$run handshake: $((end - start)) ms, $reused"
+  done
+
+  rm -f "$session"
+}
+
+case "$1" in
+  setup) [ $# -eq 3 ] || { echo "usage: $0 setup <dir> <host>"; exit 1; }; setup "$2" "$3" ;;
+  check) [ $# -ge 2 ] || { echo "usage: $0 check <host> [port] [ca]"; exit 1; }; check "$2" "$3" "$4" ;;
+  *)     sed -n '/^# Usage/,/^$/p' "$0"; exit 1 ;;
+esac
@@ -0,0 +1,233 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host benchmark of the export block codec (src/ts_codec.cpp): compression
+ * ratio and encode/decode speed over plant series, checking that every
+ * block decodes back to the samples it was given.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -I../../include -o tsbench tsbench.cpp \
+ *     ../../src/ts_codec.cpp ../../src/history.cpp
+ *
+ * Usage:
+ *   ./tsbench [capacity] < trace.csv
+ *   ./tsbench [capacity] -synthetic [plants] [days]
+ *
+ * A trace is the CSV printed by tools/tsdecode (address, attribute, epoch
+ * time, value), so the series exported by a station can be replayed. The
+ * synthetic series follow MiFlora 5 minute averages: diurnal temperature
+ * and light, moisture drying out between waterings, and missed scans.
+ * The capacity of a block defaults to what an export gets out of the 256
+ * bytes PubSubClient buffer with a 64 characters topic.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ts_codec.h"
+#include "history.h"
+
+typedef struct {
+  std::vector<uint32_t> times;
+  std::vector<uint16_t> values;
+  AttributeID           attr;
+} Series_t;
+
+static const struct {
+  const char * name;
+  AttributeID  id;
+} _attributes[] = {
+  { "moisture"    , ATTR_ID_MOISTURE     },
+  { "temp"        , ATTR_ID_TEMPERATURE  },
+  { "conductivity", ATTR_ID_CONDUCTIVITY },
+  { "light"       , ATTR_ID_ILLUMINANCE  },
+};
+
+/* same quantization as the flash log */
+static uint16_t _quantize(AttributeID attr, float value) {
+  const HistoryRange_t * range = DeviceHistory::rangeOf(attr);
+  if (value <= range->lo) return 0;
+  if (value >= range->hi) return 0xFFFF;
+  return (uint16_t) ((value - range->lo) * 0xFFFF / (range->hi - range->lo) + 0.5f);
+}
+
+static bool _readTrace(std::map<std::string, Series_t> & series) {
+
+  char line[256];
+
+  while (fgets(line, sizeof(line), stdin)) {
+
+    char * address = strtok(line, ",");
+    char * attr    = strtok(NULL, ",");
+    char * time    = strtok(NULL, ",");
+    char * value   = strtok(NULL, ",\n");
+    if (address == NULL || attr == NULL || time == NULL || value == NULL)
+      continue;
+
+    for (size_t i = 0; i < sizeof(_attributes) / sizeof(_attributes[0]); ++ i) {
+      if (strcmp(attr, _attributes[i].name))
+        continue;
+      Series_t & s = series[std::string(address) + "/" + attr];
+      s.attr = _attributes[i].id;
+      s.times.push_back((uint32_t) strtoul(time, NULL, 10));
+      s.values.push_back(_quantize(s.attr, strtof(value, NULL)));
+    }
+  }
+  return series.empty() == false;
+}
+
+static float _noise(float amplitude) {
+  return amplitude * ((float) rand() / RAND_MAX * 2.0f - 1.0f);
+}
+
+static void _synthetic(std::map<std::string, Series_t> & series, unsigned int plants, unsigned int days) {
+
+  const uint32_t start = 1700000000;
+
+  for (unsigned int p = 0; p < plants; ++ p) {
+
+    float moisture = 30.0f + p % 20;
+    char  key[32];
+
+    for (uint32_t t = start; t < start + days * 86400; t += HISTORY_AVG_PERIOD_SEC) {
+
+      // a scan cycle missed now and then, leaving a gap in all the series
+      if (rand() % 100 == 0)
+        continue;
+
+      float hour  = (float) ((t + p * 600) % 86400) / 3600.0f;
+      float sun   = fmaxf(0.0f, sinf((hour - 6.0f) * (float) M_PI / 12.0f));
+      float temp  = 21.0f + 4.0f * sinf((hour - 9.0f) * (float) M_PI / 12.0f) + _noise(0.2f);
+      float light = sun * (5000.0f + 1000.0f * (p % 8)) * (0.7f + _noise(0.3f));
+
+      moisture -= 0.012f + _noise(0.01f);
+      if (moisture < 15.0f) moisture = 45.0f + _noise(5.0f);
+
+      float values[] = { moisture + _noise(0.2f), temp, moisture * 12.0f + _noise(5.0f), light };
+
+      for (size_t i = 0; i < sizeof(_attributes) / sizeof(_attributes[0]); ++ i) {
+        snprintf(key, sizeof(key), "plant%u/%s", p, _attributes[i].name);
+        Series_t & s = series[key];
+        s.attr = _attributes[i].id;
+        s.times.push_back(t);
+        s.values.push_back(_quantize(s.attr, values[i]));
+      }
+    }
+  }
+}
+
+int main(int argc, char ** argv) {
+
+  size_t capacity = argc > 1 ? strtoul(argv[1], NULL, 10) : 256 - 7 - 64;
+  std::map<std::string, Series_t> series;
+
+  srand(1);
+  if (argc > 2 && strcmp(argv[2], "-synthetic") == 0) {
+    _synthetic(series, argc > 3 ? atoi(argv[3]) : 20, argc > 4 ? atoi(argv[4]) : 7);
+  } else if (_readTrace(series) == false) {
+    fprintf(stderr, "no samples read\n");
+    return 1;
+  }
+
+  std::vector<uint8_t> buffer(capacity);
+  std::vector<std::vector<uint8_t> > blocks;
+  size_t samples = 0, bytes = 0, errors = 0;
+  double encode_sec = 0, decode_sec = 0;
+  int    rounds = 0;
+
+  do {
+    blocks.clear();
+    samples = bytes = 0;
+
+    // encode all the series, in blocks of the given capacity
+    auto start = std::chrono::steady_clock::now();
+    for (auto & it : series) {
+
+      const Series_t & s = it.second;
+      const HistoryRange_t * range = DeviceHistory::rangeOf(s.attr);
+      TSBlockEncoder encoder(buffer.data(), capacity);
+
+      encoder.begin(0xC47C8D000000ULL, s.attr, range->lo, range->hi, 0);
+      for (size_t i = 0; i < s.times.size(); ++ i) {
+        if (encoder.add(s.times[i], s.values[i]) == false) {
+          size_t size = encoder.finish(0);
+          blocks.emplace_back(buffer.data(), buffer.data() + size);
+          encoder.begin(0xC47C8D000000ULL, s.attr, range->lo, range->hi, 0);
+          encoder.add(s.times[i], s.values[i]);
+        }
+      }
+      size_t size = encoder.finish(TS_BLOCK_FLAG_LAST);
+      blocks.emplace_back(buffer.data(), buffer.data() + size);
+      samples += s.times.size();
+    }
+    encode_sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // decode them back in the same order, comparing with the series
+    start = std::chrono::steady_clock::now();
+    auto it = series.begin();
+    size_t index = 0;
+    for (auto & block : blocks) {
+
+      TSBlockDecoder decoder(block.data(), block.size());
+      uint32_t time;
+      uint16_t value;
+
+      errors += decoder.isValid() ? 0 : 1;
+      while (decoder.next(time, value)) {
+        if (time != it->second.times[index] || value != it->second.values[index])
+          ++ errors;
+        ++ index;
+      }
+      if (decoder.header().flags & TS_BLOCK_FLAG_LAST) {
+        errors += index != it->second.times.size();
+        ++ it;
+        index = 0;
+      }
+      bytes += block.size();
+    }
+    decode_sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ++ rounds;
+  } while (encode_sec + decode_sec < 1.0);
+
+  printf("%zu series, %zu samples, %zu blocks of up to %zu bytes (%zu header)\n",
+    series.size(), samples, blocks.size(), capacity, sizeof(TSBlockHeader_t));
+  printf("  encoded    %zu bytes, %.2f bytes/sample with headers\n", bytes, (double) bytes / samples);
+  printf("  ratio      %.2f over time+value (6 bytes), %.2f over flash records (12 bytes)\n",
+    samples * 6.0 / bytes, samples * 12.0 / bytes);
+  printf("  encode     %.1f ns/sample, decode %.1f ns/sample (host)\n",
+    encode_sec * 1e9 / rounds / samples, decode_sec * 1e9 / rounds / samples);
+  if (errors) {
+    printf("  ERROR      %zu samples decoded wrong\n", errors);
+  }
+  return errors ? 1 : 0;
+}
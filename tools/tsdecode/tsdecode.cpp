@@ -0,0 +1,101 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+/*
+ * Host decoder for the blocks published in reply to export commands.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o tsdecode tsdecode.cpp ../../src/ts_codec.cpp
+ *
+ * Usage, one hex encoded block per line:
+ *   mosquitto_sub -t 'miflora_rbs/station/station1/export/#' -F %x | ./tsdecode
+ *
+ * Prints CSV lines of: device address, attribute, epoch time, value
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "ts_codec.h"
+
+static const char * _attributes[] = { "moisture", "temp", "conductivity", "light" };
+
+static int _hexDigit(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+int main() {
+
+  std::vector<uint8_t> block;
+  char line[16384];
+  int  errors = 0;
+
+  printf("device,attribute,time,value\n");
+
+  while (fgets(line, sizeof(line), stdin)) {
+
+    // hex to binary
+    block.clear();
+    for (char * ch = line; _hexDigit(ch[0]) >= 0 && _hexDigit(ch[1]) >= 0; ch += 2) {
+      block.push_back((uint8_t) (_hexDigit(ch[0]) << 4 | _hexDigit(ch[1])));
+    }
+
+    TSBlockDecoder decoder(block.data(), block.size());
+    if (decoder.isValid() == false) {
+      fprintf(stderr, "invalid block: %s", line);
+      ++ errors;
+      continue;
+    }
+
+    const TSBlockHeader_t & header = decoder.header();
+    const char * attr = header.attr < 4 ? _attributes[header.attr] : "unknown";
+    uint32_t time;
+    uint16_t value;
+    uint16_t count = 0;
+
+    while (decoder.next(time, value)) {
+      printf("%02x:%02x:%02x:%02x:%02x:%02x,%s,%u,%.2f\n", 
+        header.mac[0], header.mac[1], header.mac[2], header.mac[3], header.mac[4], header.mac[5],
+        attr, time, decoder.toFloat(value));
+      ++ count;
+    }
+
+    if (count != header.count) {
+      fprintf(stderr, "block %u truncated, %u of %u samples\n", header.index, count, header.count);
+      ++ errors;
+    }
+
+    if (header.flags & TS_BLOCK_FLAG_LAST) {
+      fflush(stdout);
+    }
+  }
+
+  return errors ? 1 : 0;
+}
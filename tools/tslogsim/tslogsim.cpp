@@ -0,0 +1,215 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+/*
+ * Host simulator of the flash log (src/tslog.cpp) over a RAM partition with
+ * NOR flash semantics, reporting the write amplification, the erases and
+ * the query throughput for a fleet logging its 5 minute averages.
+ *
+ * As on the station, the average of a slot is appended, stamped with the
+ * slot start, when the plant's first sample of a later slot is received:
+ * plants are heard at their own times, miss scans and go silent for hours,
+ * so the log receives interleaved times, out of order by up to hours.
+ *
+ * Build:
+ *   g++ -O2 -I../host -I../../src -I../../include -o tslogsim tslogsim.cpp \
+ *     ../../src/tslog.cpp ../../src/history.cpp
+ *
+ * Usage:
+ *   ./tslogsim [plants] [days] [flush_sec] [partition_kb]
+ *
+ * Defaults are 20 plants over 30 days, flushed as by TSLOG_FLUSH_SEC, into
+ * the 160 KiB partition of partitions_tslog.csv. Query times are of the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "tslog.h"
+#include "history.h"
+#include "config.h"
+
+/* the logged attributes, those with a history range */
+static const AttributeID _attributes[] = { 
+  ATTR_ID_MOISTURE, ATTR_ID_TEMPERATURE, ATTR_ID_CONDUCTIVITY, ATTR_ID_ILLUMINANCE };
+static const unsigned int ATTRIBUTES = sizeof(_attributes) / sizeof(_attributes[0]);
+
+static const uint32_t START_TIME = 1700000000;
+
+static const unsigned int MISS_PERCENT    = 20;    // scans missing a plant
+static const unsigned int SILENT_PER_MILLE = 1;    // scans starting a silence of a plant
+static const uint32_t     SILENT_MAX_SEC  = 4 * 3600;
+
+/* plant as heard by the station */
+typedef struct {
+  uint32_t next_sample;
+  uint32_t slot;        // start of the slot being averaged, 0 before the first sample
+} Plant_t;
+
+static uint32_t _random_state = 0x12345678;
+
+/* xorshift, deterministic runs */
+static uint32_t _random(uint32_t range) {
+  _random_state ^= _random_state << 13;
+  _random_state ^= _random_state >> 17;
+  _random_state ^= _random_state << 5;
+  return _random_state % range;
+}
+
+/* globals of the firmware the log links against */
+Scheduler  scheduler;
+ConfigMain config;
+
+ConfigFile::ConfigFile(const char *) {
+}
+
+ConfigMain::ConfigMain() {
+  tslog_enabled   = TSLOG_ENABLED;
+  tslog_flush_sec = TSLOG_FLUSH_SEC;
+}
+
+typedef struct {
+  uint64_t device;
+  size_t   count;
+} QueryContext_t;
+
+static bool _countSample(const TSLogSample_t & sample, void * param) {
+  QueryContext_t & ctx = * (QueryContext_t *) param;
+  if (sample.device == ctx.device)
+    ++ ctx.count;
+  return true;
+}
+
+/* query the range for one plant, prints records visited per second */
+static void _timeQuery(const char * label, uint32_t from, uint32_t to) {
+
+  QueryContext_t ctx = { 0xC47C8D000000ULL, 0 };
+  size_t visited = 0;
+  int    rounds  = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  double elapsed;
+  do {
+    ctx.count = 0;
+    visited  += tslog.query(from, to, _countSample, &ctx);
+    ++ rounds;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < 0.5);
+
+  printf("  %-10s %7zu records, %5zu of one plant, %8.1f us/query, %6.1f M records/s\n",
+    label, visited / rounds, ctx.count, elapsed * 1e6 / rounds, visited / elapsed / 1e6);
+}
+
+int main(int argc, char ** argv) {
+
+  unsigned int plants    = argc > 1 ? atoi(argv[1]) : 20;
+  unsigned int days      = argc > 2 ? atoi(argv[2]) : 30;
+  unsigned int flush_sec = argc > 3 ? atoi(argv[3]) : TSLOG_FLUSH_SEC;
+  unsigned int size_kb   = argc > 4 ? atoi(argv[4]) : 160;
+
+  HostPartition & partition = hostPartition();
+  partition.init(TSLOG_PARTITION_LABEL, size_kb * 1024);
+
+  if (tslog.begin() == false)
+    return 1;
+
+  uint32_t end        = START_TIME + days * 86400;
+  uint32_t next_flush = START_TIME + flush_sec;
+
+  Plant_t * fleet = new Plant_t[plants];
+  for (unsigned int p = 0; p < plants; ++ p) {
+    fleet[p].next_sample = START_TIME + _random(HISTORY_SCAN_SEC);
+    fleet[p].slot        = 0;
+  }
+
+  for (uint32_t now = START_TIME; now <= end; ++ now) {
+
+    for (unsigned int p = 0; p < plants; ++ p) {
+
+      Plant_t & plant = fleet[p];
+      if (now != plant.next_sample)
+        continue;
+
+      // the next scan cycle, or a silence of up to hours
+      plant.next_sample = now + HISTORY_SCAN_SEC;
+      if (_random(1000) < SILENT_PER_MILLE)
+        plant.next_sample += _random(SILENT_MAX_SEC);
+      else if (_random(100) < MISS_PERCENT)
+        continue;
+
+      // a sample in a new slot closes the slot averaged so far
+      uint32_t slot = now - now % HISTORY_AVG_PERIOD_SEC;
+      if (plant.slot != 0 && plant.slot != slot) {
+        for (unsigned int a = 0; a < ATTRIBUTES; ++ a) {
+          float value = 10.0f * (a + 1) + (float) ((plant.slot / 60 + p * 7) % 100) / 10.0f;
+          tslog.append(0xC47C8D000000ULL | p, _attributes[a], plant.slot, value);
+        }
+      }
+      plant.slot = slot;
+    }
+
+    if (now == next_flush) {
+      tslog.flush();
+      next_flush += flush_sec;
+    }
+  }
+  tslog.flush();
+
+  uint64_t records = tslog.statRecords();
+  uint64_t payload = records * sizeof(TSLog::Record_t);
+  uint32_t kept    = tslog.recordCount();
+  double   per_day = (double) records / days;
+
+  printf("%u plants, %u days, flush every %u s, %u KiB in %u pages of %u records (%u bytes each)\n",
+    plants, days, flush_sec, size_kb, (unsigned int) tslog.pageCount(), 
+    (unsigned int) TSLog::RECORDS_PER_PAGE, (unsigned int) sizeof(TSLog::Record_t));
+  printf("  appended   %llu records, %llu bytes of records\n", 
+    (unsigned long long) records, (unsigned long long) payload);
+  printf("  programmed %llu bytes in %u writes, amplification %.3f\n",
+    (unsigned long long) partition.bytes_written, partition.writes, (double) partition.bytes_written / payload);
+  printf("  erased     %u sectors, %.2f per sector per day, %.2f bytes erased per record byte\n",
+    partition.erases, (double) partition.erases / tslog.pageCount() / days, (double) partition.bytes_erased / payload);
+  printf("  kept       %u records, %.1f hours of history, %.1f records per page opened\n", 
+    kept, kept * 24.0 / per_day, (double) records / partition.erases);
+  if (partition.bad_writes) {
+    printf("  ERROR      %u bytes programmed over cleared bits\n", partition.bad_writes);
+  }
+
+  // queries of one plant over the last day, and over the whole log
+  _timeQuery("last day", end - 86400, end);
+  _timeQuery("all", 0, end);
+
+  // a reboot must find the same records, the open page included
+  TSLog reboot;
+  reboot.begin();
+  if (reboot.recordCount() != kept) {
+    printf("  ERROR      %u records after reboot, %u expected\n", (unsigned int) reboot.recordCount(), kept);
+    return 1;
+  }
+  delete [] fleet;
+  return partition.bad_writes ? 1 : 0;
+}
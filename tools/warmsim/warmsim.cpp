@@ -0,0 +1,165 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+
+/*
+ * Host model of a station coming back from a restart, measuring the time
+ * from the snapshot restore in setup() until the fleet is populated (every
+ * plant has its four values, what "Fleet populated" logs) and until it is
+ * fresh (all of them read again over BLE, "Fleet fresh"):
+ *
+ *   ble       nothing retained on the broker, values come from the scans
+ *   retained  flora:mqtt_retain, the broker sends the values after connecting
+ *   snapshot  values restored from NVS in setup(), before the network
+ *
+ * BLE: scans of BLE_SCAN_DURATION_SEC every BLE_SCAN_DURATION_SEC +
+ * BLE_SCAN_WAIT_SEC, starting with ble.begin(). A plant advertises one of
+ * its values at a time, in turns, and each advertisement is caught during a
+ * scan with the plant's own probability (its signal, the scan window of
+ * BLE_WINDOW_INTERVAL_MS in BLE_SCAN_INTERVAL_MS).
+ *
+ * Retained: WiFi and MQTT connect, then 10 retained topics per plant (4 of
+ * them values) are read MQTT_RX_BURST per 100 ms and applied
+ * MQTT_RX_APPLY_BURST every MQTT_RX_APPLY_MS, as tools/rxsim does in detail.
+ *
+ * Build:
+ *   g++ -O2 -I../../include -o warmsim warmsim.cpp
+ *
+ * Usage:
+ *   ./warmsim [plants] [connect_ms] [adv_ms]
+ *
+ * Defaults are 20 plants, 4000 ms from setup() to a connected MQTT session
+ * and an advertisement every 3000 ms; 10000 restarts are run. These two are
+ * assumptions, not measured on a station: the times scale with them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <firmware_config.h>
+#include <default_config.h>
+
+static const unsigned int  ATTRIBUTES       = 4;     // moisture, temperature, conductivity, illuminance
+static const unsigned int  RETAINED_TOPICS  = 10;    // of a plant on the broker
+static const unsigned long HANDLE_MS        = 100;   // MQTT_UPDATE_INTERVAL of mqtt.h
+static const unsigned int  RESTARTS         = 10000;
+static const float          CATCH_MIN        = 0.2f;  // probability of catching an advertisement, far plant
+static const float          CATCH_MAX        = 0.6f;  // near plant, bounded by the scan window
+
+static std::mt19937 _rng(42);
+
+static float _uniform(float from, float to) {
+  return std::uniform_real_distribution<float>(from, to)(_rng);
+}
+
+/* ms until the plant's four values were caught over BLE */
+static unsigned long _bleTime(unsigned long adv_ms) {
+
+  const unsigned long cycle_ms = (BLE_SCAN_DURATION_SEC + BLE_SCAN_WAIT_SEC) * 1000UL;
+  const unsigned long scan_ms  = BLE_SCAN_DURATION_SEC * 1000UL;
+
+  float         catch_p = _uniform(CATCH_MIN, CATCH_MAX);
+  unsigned long at      = (unsigned long) _uniform(0, adv_ms);
+  unsigned int  turn    = (unsigned int) _uniform(0, ATTRIBUTES);
+  unsigned int  missing = (1 << ATTRIBUTES) - 1;
+
+  for (; missing != 0; at += adv_ms, turn = (turn + 1) % ATTRIBUTES) {
+    if (at % cycle_ms < scan_ms && _uniform(0, 1) < catch_p)
+      missing &= ~(1 << turn);
+  }
+  return at - adv_ms;
+}
+
+/* ms until the last retained value of the fleet is applied */
+static unsigned long _retainedTime(unsigned int plants, unsigned long connect_ms) {
+
+  unsigned long packets = (unsigned long) plants * RETAINED_TOPICS;
+  unsigned long values  = (unsigned long) plants * ATTRIBUTES;
+  unsigned long read_ms = (packets + MQTT_RX_BURST - 1) / MQTT_RX_BURST * HANDLE_MS;
+
+  // the values are spread over the packets, applied as fast as they are read
+  unsigned long apply_ms = (values + MQTT_RX_APPLY_BURST - 1) / MQTT_RX_APPLY_BURST * MQTT_RX_APPLY_MS;
+  return connect_ms + std::max(read_ms, apply_ms);
+}
+
+typedef struct {
+  const char *               label;
+  std::vector<unsigned long> populated;
+  std::vector<unsigned long> fresh;
+} Result_t;
+
+static unsigned long _percentile(std::vector<unsigned long> & times, unsigned int percent) {
+  std::sort(times.begin(), times.end());
+  return times[(times.size() - 1) * percent / 100];
+}
+
+static void _print(Result_t & result) {
+  printf("  %-9s populated %6.1f s median, %6.1f s p90, %6.1f s max    fresh %6.1f s median, %6.1f s p90\n",
+    result.label,
+    _percentile(result.populated, 50) / 1000.0, _percentile(result.populated, 90) / 1000.0, 
+    _percentile(result.populated, 100) / 1000.0,
+    _percentile(result.fresh, 50) / 1000.0, _percentile(result.fresh, 90) / 1000.0);
+}
+
+int main(int argc, char ** argv) {
+
+  unsigned int  plants     = argc > 1 ? atoi(argv[1]) : 20;
+  unsigned long connect_ms = argc > 2 ? atol(argv[2]) : 4000;
+  unsigned long adv_ms     = argc > 3 ? atol(argv[3]) : 3000;
+
+  Result_t ble      = { "ble", {}, {} };
+  Result_t retained = { "retained", {}, {} };
+  Result_t snapshot = { "snapshot", {}, {} };
+
+  for (unsigned int restart = 0; restart < RESTARTS; ++ restart) {
+
+    unsigned long fresh = 0;
+    for (unsigned int p = 0; p < plants; ++ p)
+      fresh = std::max(fresh, _bleTime(adv_ms));
+
+    unsigned long from_broker = _retainedTime(plants, connect_ms);
+
+    ble.populated.push_back(fresh);
+    retained.populated.push_back(std::min(fresh, from_broker));
+    snapshot.populated.push_back(0);
+
+    ble.fresh.push_back(fresh);
+    retained.fresh.push_back(fresh);
+    snapshot.fresh.push_back(fresh);
+  }
+
+  printf("%u plants, %lu ms to connect, an advertisement every %lu ms, %u restarts\n",
+    plants, connect_ms, adv_ms, RESTARTS);
+  printf("  scans of %u s every %u s, advertisements caught %.0f%% to %.0f%%\n",
+    BLE_SCAN_DURATION_SEC, BLE_SCAN_DURATION_SEC + BLE_SCAN_WAIT_SEC, CATCH_MIN * 100, CATCH_MAX * 100);
+  _print(ble);
+  _print(retained);
+  _print(snapshot);
+  return 0;
+}
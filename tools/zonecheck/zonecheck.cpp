@@ -0,0 +1,195 @@
+/*
+ *   MIT License
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *  Copyright (c) 2021 Alex Mircescu
+ */
+
+
+
+
+/*
+ * Brute-force check of the zone totals (src/zone_totals.cpp): zones of
+ * random sizes get random member updates (moisture values, values reset,
+ * plants going out of limits and unavailable) and after each update the
+ * totals are compared with the ones computed again over all the members.
+ *
+ * Moisture is mostly whole percents, as sent by the plants, with ties for
+ * the minimum, and now and then fractional, as restored or averaged values,
+ * for the running sum to collect rounding errors; the largest error of the
+ * mean is reported.
+ *
+ * Build:
+ *   g++ -O2 -I../../src -o zonecheck zonecheck.cpp ../../src/zone_totals.cpp
+ *
+ * Usage:
+ *   ./zonecheck [updates] [seed]
+ *
+ * Defaults are 200000 updates with seed 1. It exits with 1 at the first
+ * difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "zone_totals.h"
+
+static const unsigned int ZONES       = 8;
+static const unsigned int MAX_MEMBERS = 24;
+static const float        MEAN_ERROR  = 0.001f; // of the running sum, in percent
+
+static std::mt19937 _rng;
+
+static unsigned int _random(unsigned int range) {
+  return std::uniform_int_distribution<unsigned int>(0, range - 1)(_rng);
+}
+
+typedef struct {
+  ZoneTotals                        totals;
+  std::vector<ZoneTotals::Member_t> members;
+} Zone_t;
+
+/* the totals, computed again over all the members */
+typedef struct {
+  unsigned int count;
+  double       mean;
+  float        min;
+  unsigned int out_of_limits;
+  unsigned int stale;
+} Expected_t;
+
+static Expected_t _recompute(const std::vector<ZoneTotals::Member_t> & members) {
+
+  Expected_t expected = { 0, 0, 0, 0, 0 };
+
+  for (auto & member : members) {
+    if (member.has_moisture) {
+      if (expected.count == 0 || member.moisture < expected.min)
+        expected.min = member.moisture;
+      expected.mean += member.moisture;
+      expected.count ++;
+    }
+    expected.out_of_limits += member.out_of_limits;
+    expected.stale         += member.stale;
+  }
+  if (expected.count)
+    expected.mean /= expected.count;
+  return expected;
+}
+
+static bool _same(const ZoneTotals::Member_t & a, const ZoneTotals::Member_t & b) {
+  return a.has_moisture == b.has_moisture && (a.has_moisture == false || a.moisture == b.moisture) &&
+    a.out_of_limits == b.out_of_limits && a.stale == b.stale;
+}
+
+int main(int argc, char ** argv) {
+
+  unsigned long updates = argc > 1 ? atol(argv[1]) : 200000;
+  unsigned int  seed    = argc > 2 ? atoi(argv[2]) : 1;
+
+  Zone_t        zones[ZONES];
+  unsigned long resets = 0, min_rises = 0, unchanged = 0;
+  double        max_error = 0;
+
+  _rng.seed(seed);
+
+  for (unsigned int z = 0; z < ZONES; ++ z) {
+    unsigned int size = 1 + _random(MAX_MEMBERS);
+    for (unsigned int m = 0; m < size; ++ m) {
+      ZoneTotals::Member_t member = { false, 0, false, true };
+      if (zones[z].totals.add() != (int) m) {
+        printf("FAILED: member %u of zone %u got another slot\n", m, z);
+        return 1;
+      }
+      zones[z].members.push_back(member);
+    }
+  }
+
+  for (unsigned long update = 0; update < updates; ++ update) {
+
+    Zone_t &             zone   = zones[_random(ZONES)];
+    int                  slot   = _random(zone.members.size());
+    ZoneTotals::Member_t member = zone.members[slot];
+    unsigned int         choice = _random(100);
+
+    if (choice < 60) {
+      // a reading, the same value now and then
+      member.has_moisture = true;
+      if (_random(5) == 0)
+        member.moisture = _random(10000) / 100.0f;
+      else
+      if (_random(4) != 0)
+        member.moisture = _random(60);
+    } else
+    if (choice < 70) {
+      // the value goes stale and is reset
+      member.has_moisture = false;
+      member.moisture     = 0;
+      ++ resets;
+    } else
+    if (choice < 85) {
+      member.out_of_limits = _random(2) == 1;
+    } else {
+      member.stale = _random(2) == 1;
+    }
+
+    Expected_t before  = _recompute(zone.members);
+    bool       was_min = zone.members[slot].has_moisture && zone.members[slot].moisture == before.min;
+    bool       changed = _same(member, zone.members[slot]) == false;
+
+    if (was_min && (member.has_moisture == false || member.moisture > before.min))
+      ++ min_rises;
+    if (changed == false)
+      ++ unchanged;
+
+    zone.members[slot] = member;
+    if (zone.totals.update(slot, member) != changed) {
+      printf("FAILED: update %lu reported %s\n", update, changed ? "no change" : "a change");
+      return 1;
+    }
+
+    Expected_t expected = _recompute(zone.members);
+    ZoneTotals & totals = zone.totals;
+
+    if (totals.hasMoisture() != (expected.count > 0) ||
+        (expected.count > 0 && totals.moistureMin() != expected.min) ||
+        totals.outOfLimits() != expected.out_of_limits || totals.stale() != expected.stale) {
+      printf("FAILED: update %lu, min %.2f (%.2f), out of limits %u (%u), stale %u (%u)\n", update,
+        totals.moistureMin(), expected.min, totals.outOfLimits(), expected.out_of_limits, totals.stale(), expected.stale);
+      return 1;
+    }
+
+    double error = expected.count > 0 ? fabs(totals.moistureMean() - expected.mean) : 0;
+    if (error > max_error)
+      max_error = error;
+    if (error > MEAN_ERROR) {
+      printf("FAILED: update %lu, mean %.4f (%.4f)\n", update, totals.moistureMean(), expected.mean);
+      return 1;
+    }
+  }
+
+  printf("%lu updates of %u zones, seed %u: totals agree\n", updates, ZONES, seed);
+  printf("  %lu values reset, %lu minimums recomputed, %lu updates changing nothing\n", resets, min_rises, unchanged);
+  printf("  largest error of the mean %.6f%%\n", max_error);
+  return 0;
+}